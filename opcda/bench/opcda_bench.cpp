@@ -0,0 +1,997 @@
+// opcda_bench.cpp
+#define NOMINMAX
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../logger.h"
+#include "../opcda_backend_memory.h"
+#include "../opcda_backend_session.h"
+#include "../opcda_capture.h"
+#include "../opcda_format.h"
+#include "../opcda_metrics.h"
+#include "../opcda_pi_sink.h"
+#include "../opcda_queue.h"
+#include "../opcda_sim_namespace.h"
+#include "../opcda_trace.h"
+#include "../opcda_utf.h"
+#include "opcda_checks.h"
+
+#ifdef _WIN32
+#include <windows.h>
+
+#include "../opcda_backend_com.h"
+#include "../opcda_client.h"
+#include "../opcda_simulator.h"
+#include "../opcda_utils.h"
+#include "../result_formatter.hpp"
+#endif
+
+using namespace std;
+
+/**
+ * End-to-end throughput benchmarks. On Windows the default backend drives the
+ * real OpcDaClient against the in-process simulator, so the numbers cover
+ * marshaling of the OPC structures, registration, browsing and the output
+ * paths, but not DCOM. --backend com|memory runs the same scenarios through
+ * BackendSession instead; memory is the only backend off Windows.
+ *
+ *   opcda-bench [--sim <spec>] [--backend client|com|memory] [--scenarios a,b,..] [--iterations N] [--threads N] [--out file]
+ *   opcda-bench --check [a,b,..]
+ *
+ * One JSON object per scenario is printed (and appended to --out), so runs can
+ * be collected and compared across commits. --check runs the self checks in
+ * opcda_checks.cpp instead and exits non-zero when one fails.
+ */
+
+constexpr int DEFAULT_BENCH_ITERATIONS = 5;
+constexpr int DEFAULT_BENCH_THREADS = 4;
+#ifdef _WIN32
+const char* const DEFAULT_BENCH_BACKEND = "client";
+const char* const DEFAULT_BENCH_SCENARIOS = "browse,resolve,read_1k,read_10k,read_100k,fan_in,yaml,capture,queue,pi,utf,format";
+#else
+const char* const DEFAULT_BENCH_BACKEND = "memory";
+const char* const DEFAULT_BENCH_SCENARIOS = "browse,resolve,read_1k,read_10k,read_100k,fan_in,capture,queue,pi,utf,format";
+#endif
+
+// the sink scenarios write the snapshot in batches of this size, one latency sample per write
+constexpr size_t BENCH_SINK_BATCH = 100;
+
+// fewer latency samples than this make the percentile the maximum, so it is reported as null
+constexpr size_t BENCH_MIN_P99_SAMPLES = 100;
+constexpr size_t BENCH_MIN_P999_SAMPLES = 1000;
+
+struct BENCH_OPTIONS
+{
+  string sim_spec;
+  string backend = DEFAULT_BENCH_BACKEND;
+  set<string> scenarios;
+  int iterations = DEFAULT_BENCH_ITERATIONS;
+  int threads = DEFAULT_BENCH_THREADS;
+  string out;
+  string metrics;
+  string trace;
+  bool check = false;
+  string checks;
+};
+
+struct BENCH_RESULT
+{
+  string scenario;
+  size_t ops = 0;
+  double seconds = 0.0;
+  vector<double> latencies_us;
+};
+
+using clock_type = chrono::steady_clock;
+
+static double elapsed_us( clock_type::time_point start )
+{
+  return chrono::duration<double, micro>( clock_type::now() - start ).count();
+}
+
+static double percentile( const vector<double>& sorted, double p )
+{
+  if ( sorted.empty() )
+  {
+    return 0.0;
+  }
+  size_t index = static_cast<size_t>( p * ( sorted.size() - 1 ) + 0.5 );
+  return sorted[min( index, sorted.size() - 1 )];
+}
+
+static void put_percentile( ostringstream& oss, const char* name, const vector<double>& sorted, double p, size_t min_samples )
+{
+  oss << ",\"" << name << "\":";
+  if ( sorted.size() < min_samples )
+  {
+    oss << "null";
+  }
+  else
+  {
+    oss << percentile( sorted, p );
+  }
+}
+
+static string to_json( const BENCH_RESULT& result, const BENCH_OPTIONS& options )
+{
+  vector<double> sorted = result.latencies_us;
+  sort( sorted.begin(), sorted.end() );
+
+  ostringstream oss;
+  oss << fixed << setprecision( 1 );
+  oss << "{\"scenario\":\"" << result.scenario << "\"";
+  oss << ",\"backend\":\"" << options.backend << "\"";
+  oss << ",\"sim\":\"" << options.sim_spec << "\"";
+  oss << ",\"ops\":" << result.ops;
+  oss << ",\"seconds\":" << setprecision( 4 ) << result.seconds << setprecision( 1 );
+  oss << ",\"ops_per_sec\":" << ( result.seconds > 0.0 ? result.ops / result.seconds : 0.0 );
+  oss << ",\"samples\":" << sorted.size();
+  oss << ",\"p50_us\":" << percentile( sorted, 0.50 );
+  put_percentile( oss, "p99_us", sorted, 0.99, BENCH_MIN_P99_SAMPLES );
+  put_percentile( oss, "p999_us", sorted, 0.999, BENCH_MIN_P999_SAMPLES );
+  oss << "}";
+  return oss.str();
+}
+
+/**
+ * @brief Swallows everything written to it; used to time formatting without console IO.
+ */
+class NullBuffer : public streambuf
+{
+protected:
+  int overflow( int c ) override
+  {
+    return c;
+  }
+  streamsize xsputn( const char*, streamsize count ) override
+  {
+    return count;
+  }
+};
+
+class NullSink : public SampleSink
+{
+public:
+  atomic<size_t> samples{ 0 };
+
+  bool write( const vector<OPCDA_SAMPLE>& batch ) override
+  {
+    samples += batch.size();
+    return true;
+  }
+  bool flush() override
+  {
+    return true;
+  }
+};
+
+/**
+ * @brief PI archive that knows every point and accepts every snapshot.
+ */
+class NullArchive : public PiArchive
+{
+public:
+  int32_t find_point( const string& tag, int32_t& point ) override
+  {
+    point = static_cast<int32_t>( hash<string>()( tag ) & 0x3FFFFFFF ) + 1;
+    return 0;
+  }
+
+  int32_t put_snapshots( const vector<PI_SNAPSHOT>& snapshots, vector<int32_t>& errors ) override
+  {
+    errors.assign( snapshots.size(), 0 );
+    return 0;
+  }
+};
+
+/**
+ * @brief What a scenario drives: the full OpcDaClient over the COM simulator,
+ *        or a BackendSession over the COM or the in-memory backend.
+ */
+class BenchTarget
+{
+public:
+  virtual ~BenchTarget()
+  {
+  }
+
+  virtual bool open( const shared_ptr<const SimNamespace>& space ) = 0;
+  virtual size_t browse() = 0;
+  virtual size_t resolve() = 0;
+  virtual bool read( const vector<wstring>& ids, vector<OPCDA_SAMPLE>& samples ) = 0;
+};
+
+#ifdef _WIN32
+class ClientTarget : public BenchTarget
+{
+public:
+  bool open( const shared_ptr<const SimNamespace>& space ) override
+  {
+    CComPtr<IOPCServer> server;
+    m_client.set_apartment( OPCDA_APARTMENT::MTA );
+    if ( FAILED( create_sim_server( space, &server ) ) )
+    {
+      return false;
+    }
+    return m_client.attach( server ) && m_client.ensure_group();
+  }
+
+  size_t browse() override
+  {
+    vector<wstring> tags;
+    m_client.request_browse_all_tags( tags );
+    return tags.size();
+  }
+
+  size_t resolve() override
+  {
+    m_client.request_readable_tags();
+    return m_client.m_all_tags.size();
+  }
+
+  bool read( const vector<wstring>& ids, vector<OPCDA_SAMPLE>& samples ) override
+  {
+    vector<OPCDA_TAG> tags;
+    vector<HRESULT> errors;
+    HRESULT hr = m_client.read_sync( ids, tags, errors );
+
+    for ( auto& tag : tags )
+    {
+      OPCDA::UTILS::tag_to_samples( tag, samples );
+      VariantClear( &tag.value );
+    }
+    return SUCCEEDED( hr );
+  }
+
+  OpcDaClient& client()
+  {
+    return m_client;
+  }
+
+private:
+  OpcDaClient m_client;
+};
+#endif
+
+class SessionTarget : public BenchTarget
+{
+public:
+  explicit SessionTarget( const string& backend ) : m_kind( backend )
+  {
+  }
+  ~SessionTarget()
+  {
+    // items are removed through the backend, so the session goes first
+    m_session.reset();
+    m_backend.reset();
+  }
+
+  bool open( const shared_ptr<const SimNamespace>& space ) override
+  {
+    if ( m_kind == "memory" )
+    {
+      m_backend = make_unique<MemoryBackend>( space );
+    }
+#ifdef _WIN32
+    else if ( m_kind == "com" )
+    {
+      CComPtr<IOPCServer> server;
+      auto backend = make_unique<ComBackend>();
+
+      if ( FAILED( create_sim_server( space, &server ) ) || FAILED( backend->open( server ) ) )
+      {
+        return false;
+      }
+      m_backend = move( backend );
+    }
+#endif
+    else
+    {
+      return false;
+    }
+
+    m_session = make_unique<BackendSession>( *m_backend );
+    return true;
+  }
+
+  size_t browse() override
+  {
+    vector<wstring> paths;
+    m_session->browse_all( paths );
+    return paths.size();
+  }
+
+  size_t resolve() override
+  {
+    vector<wstring> paths;
+    vector<wstring> ids;
+    m_session->browse_all( paths );
+    m_session->readable_items( paths, ids );
+    return paths.size();
+  }
+
+  bool read( const vector<wstring>& ids, vector<OPCDA_SAMPLE>& samples ) override
+  {
+    vector<BACKEND_VALUE> values;
+    OPCDA_RESULT result = m_session->read( ids, values );
+
+    BackendSession::to_samples( ids, values, samples );
+    return !opcda_failed( result );
+  }
+
+private:
+  string m_kind;
+  unique_ptr<OpcDaBackend> m_backend;
+  unique_ptr<BackendSession> m_session;
+};
+
+class Bench
+{
+public:
+  explicit Bench( const BENCH_OPTIONS& options ) : m_options( options )
+  {
+    string error;
+    if ( !m_base.parse( options.sim_spec, error ) )
+    {
+      throw runtime_error( error );
+    }
+  }
+
+  bool run( const string& scenario, BENCH_RESULT& result )
+  {
+    result.scenario = scenario;
+
+    if ( scenario == "browse" )
+      return browse( result, false );
+    if ( scenario == "resolve" )
+      return browse( result, true );
+    if ( scenario == "read_1k" )
+      return read( result, 1000 );
+    if ( scenario == "read_10k" )
+      return read( result, 10000 );
+    if ( scenario == "read_100k" )
+      return read( result, 100000 );
+    if ( scenario == "fan_in" )
+      return fan_in( result );
+    if ( scenario == "capture" )
+      return capture( result );
+    if ( scenario == "queue" )
+      return queue( result );
+    if ( scenario == "pi" )
+      return pi( result );
+    if ( scenario == "utf" )
+      return utf( result );
+    if ( scenario == "format" )
+      return format( result );
+#ifdef _WIN32
+    if ( scenario == "yaml" )
+      return yaml( result );
+#endif
+
+    cerr << "Unknown scenario: " << scenario << endl;
+    return false;
+  }
+
+private:
+  BENCH_OPTIONS m_options;
+  SIM_CONFIG m_base;
+
+  unique_ptr<BenchTarget> make_target( const shared_ptr<const SimNamespace>& space ) const
+  {
+    unique_ptr<BenchTarget> target;
+
+#ifdef _WIN32
+    if ( m_options.backend == "client" )
+    {
+      target = make_unique<ClientTarget>();
+    }
+#endif
+    if ( !target )
+    {
+      target = make_unique<SessionTarget>( m_options.backend );
+    }
+
+    if ( !target->open( space ) )
+    {
+      cerr << "Backend not available: " << m_options.backend << endl;
+      return nullptr;
+    }
+    return target;
+  }
+
+  /** @brief The configured namespace, widened on the last level until it holds at least count items. */
+  shared_ptr<const SimNamespace> space_for( size_t count ) const
+  {
+    SIM_CONFIG config = m_base;
+    size_t per_leaf_branch = max<size_t>( config.item_count() / max<size_t>( config.leaves, 1 ), 1 );
+
+    if ( config.item_count() < count )
+    {
+      config.leaves = ( count + per_leaf_branch - 1 ) / per_leaf_branch;
+    }
+    return make_shared<const SimNamespace>( config );
+  }
+
+  static vector<wstring> readable_ids( const SimNamespace& space, size_t count )
+  {
+    vector<wstring> ids;
+    ids.reserve( count );
+
+    for ( const auto& item : space.items() )
+    {
+      if ( ids.size() == count )
+      {
+        break;
+      }
+      if ( item.access_rights & OPCDA_ACCESS_READABLE )
+      {
+        ids.push_back( item.item_id );
+      }
+    }
+    return ids;
+  }
+
+  bool browse( BENCH_RESULT& result, bool resolve )
+  {
+    auto space = space_for( 0 );
+    auto start = clock_type::now();
+
+    for ( int i = 0; i < m_options.iterations; ++i )
+    {
+      // a fresh target per iteration, nothing is learned from the previous pass
+      auto target = make_target( space );
+      if ( !target )
+      {
+        return false;
+      }
+
+      auto op = clock_type::now();
+      result.ops += resolve ? target->resolve() : target->browse();
+      result.latencies_us.push_back( elapsed_us( op ) );
+    }
+
+    result.seconds = elapsed_us( start ) / 1e6;
+    return true;
+  }
+
+  bool read( BENCH_RESULT& result, size_t count )
+  {
+    auto space = space_for( count );
+    vector<wstring> ids = readable_ids( *space, count );
+
+    auto target = make_target( space );
+    if ( !target )
+    {
+      return false;
+    }
+
+    // the first read registers the items, it is not part of the steady state
+    vector<OPCDA_SAMPLE> samples;
+    target->read( ids, samples );
+
+    auto start = clock_type::now();
+    for ( int i = 0; i < m_options.iterations; ++i )
+    {
+      samples.clear();
+
+      auto op = clock_type::now();
+      target->read( ids, samples );
+      result.latencies_us.push_back( elapsed_us( op ) );
+      result.ops += samples.size();
+    }
+
+    result.seconds = elapsed_us( start ) / 1e6;
+    return true;
+  }
+
+  bool fan_in( BENCH_RESULT& result )
+  {
+    size_t threads = static_cast<size_t>( max( m_options.threads, 1 ) );
+    auto space = space_for( 0 );
+    vector<wstring> ids = readable_ids( *space, space->items().size() );
+
+    NullSink consumer;
+    mutex consumer_lock;
+    mutex latency_lock;
+    atomic<bool> failed{ false };
+    vector<thread> workers;
+
+    auto start = clock_type::now();
+    for ( size_t t = 0; t < threads; ++t )
+    {
+      workers.emplace_back( [&, t]()
+      {
+#ifdef _WIN32
+        if ( FAILED( CoInitializeEx( NULL, COINIT_MULTITHREADED ) ) )
+        {
+          failed = true;
+          return;
+        }
+#endif
+
+        {
+          vector<wstring> slice;
+          for ( size_t i = t; i < ids.size(); i += threads )
+          {
+            slice.push_back( ids[i] );
+          }
+
+          auto target = make_target( space );
+          if ( !target )
+          {
+            failed = true;
+          }
+          else
+          {
+            vector<OPCDA_SAMPLE> samples;
+            vector<double> latencies;
+
+            for ( int i = 0; i < m_options.iterations; ++i )
+            {
+              auto op = clock_type::now();
+
+              samples.clear();
+              target->read( slice, samples );
+
+              {
+                lock_guard<mutex> lock( consumer_lock );
+                consumer.write( samples );
+              }
+              latencies.push_back( elapsed_us( op ) );
+            }
+
+            lock_guard<mutex> lock( latency_lock );
+            result.latencies_us.insert( result.latencies_us.end(), latencies.begin(), latencies.end() );
+          }
+        }
+
+#ifdef _WIN32
+        CoUninitialize();
+#endif
+      } );
+    }
+
+    for ( auto& worker : workers )
+    {
+      worker.join();
+    }
+
+    result.seconds = elapsed_us( start ) / 1e6;
+    result.ops = consumer.samples;
+    return !failed;
+  }
+
+  /** @brief Reads the whole namespace once; the output scenarios write the same batch every iteration. */
+  bool snapshot( vector<OPCDA_SAMPLE>& samples )
+  {
+    auto space = space_for( 0 );
+    auto target = make_target( space );
+
+    return target && target->read( readable_ids( *space, space->items().size() ), samples );
+  }
+
+  static string temp_path( const string& name )
+  {
+    error_code ignored;
+    filesystem::path dir = filesystem::temp_directory_path( ignored );
+    return ( dir / ( "opcda-bench-" + to_string( chrono::steady_clock::now().time_since_epoch().count() ) + "-" + name ) ).string();
+  }
+
+  /** @brief The snapshot cut into BENCH_SINK_BATCH sized writes, as a poll loop hands them to a sink. */
+  bool snapshot_batches( vector<vector<OPCDA_SAMPLE>>& batches )
+  {
+    vector<OPCDA_SAMPLE> samples;
+    if ( !snapshot( samples ) )
+    {
+      return false;
+    }
+
+    for ( size_t first = 0; first < samples.size(); first += BENCH_SINK_BATCH )
+    {
+      size_t last = min( first + BENCH_SINK_BATCH, samples.size() );
+      batches.emplace_back( make_move_iterator( samples.begin() + first ), make_move_iterator( samples.begin() + last ) );
+    }
+    return !batches.empty();
+  }
+
+  /** @brief One pass of every batch into the sink per iteration; each write is a latency sample. */
+  bool write_batches( SampleSink& sink, vector<vector<OPCDA_SAMPLE>>& batches, BENCH_RESULT& result )
+  {
+    bool ok = true;
+
+    for ( int i = 0; i < m_options.iterations; ++i )
+    {
+      for ( auto& batch : batches )
+      {
+        // move the batch forward in time so every write appends, like a live capture
+        for ( auto& sample : batch )
+        {
+          sample.timestamp += 1000 * FILETIME_TICKS_PER_MS;
+        }
+
+        auto op = clock_type::now();
+        ok = sink.write( batch ) && ok;
+        result.latencies_us.push_back( elapsed_us( op ) );
+        result.ops += batch.size();
+      }
+    }
+
+    return sink.flush() && ok;
+  }
+
+  bool capture( BENCH_RESULT& result )
+  {
+    vector<vector<OPCDA_SAMPLE>> batches;
+    if ( !snapshot_batches( batches ) )
+    {
+      return false;
+    }
+
+    string path = temp_path( "capture.opcc" );
+    CaptureWriter writer;
+    if ( !writer.open( path ) )
+    {
+      return false;
+    }
+
+    auto start = clock_type::now();
+    bool ok = write_batches( writer, batches, result );
+    writer.close();
+    result.seconds = elapsed_us( start ) / 1e6;
+
+    error_code ignored;
+    filesystem::remove( path, ignored );
+    return ok;
+  }
+
+  bool queue( BENCH_RESULT& result )
+  {
+    vector<vector<OPCDA_SAMPLE>> batches;
+    if ( !snapshot_batches( batches ) )
+    {
+      return false;
+    }
+
+    string dir = temp_path( "queue" );
+    NullSink downstream;
+    bool ok = false;
+
+    {
+      QueueSink sink( downstream );
+      if ( !sink.open( dir ) )
+      {
+        return false;
+      }
+
+      auto start = clock_type::now();
+      ok = write_batches( sink, batches, result );
+      result.seconds = elapsed_us( start ) / 1e6;
+      sink.close();
+    }
+
+    error_code ignored;
+    filesystem::remove_all( dir, ignored );
+    return ok;
+  }
+
+  /**
+   * @brief PiSink batching, point lookup and snapshot conversion against an
+   *        archive that accepts everything; flush() waits for the writer thread.
+   */
+  bool pi( BENCH_RESULT& result )
+  {
+    vector<vector<OPCDA_SAMPLE>> batches;
+    if ( !snapshot_batches( batches ) )
+    {
+      return false;
+    }
+
+    NullArchive archive;
+    PiSink sink( archive );
+    if ( !sink.open() )
+    {
+      return false;
+    }
+
+    auto start = clock_type::now();
+    bool ok = write_batches( sink, batches, result );
+    result.seconds = elapsed_us( start ) / 1e6;
+    sink.close();
+
+    return ok && sink.rejected() == 0;
+  }
+
+  /**
+   * @brief UTF-16 to UTF-8 and back over the namespace's item IDs, every tenth
+   *        one carrying Hangul and an emoji; ops counts UTF-16 units converted.
+   */
+  bool utf( BENCH_RESULT& result )
+  {
+    auto space = space_for( 0 );
+    vector<u16string> ids;
+    size_t units = 0;
+
+    for ( const auto& item : space->items() )
+    {
+      u16string id( item.item_id.begin(), item.item_id.end() );
+      if ( ids.size() % 10 == 0 )
+      {
+        id += u"\uC628\uB3C4\U0001F321";
+      }
+      units += id.size();
+      ids.push_back( move( id ) );
+    }
+
+    string narrow;
+    u16string wide;
+
+    auto start = clock_type::now();
+    for ( int i = 0; i < m_options.iterations; ++i )
+    {
+      auto op = clock_type::now();
+      for ( const auto& id : ids )
+      {
+        narrow.clear();
+        OPCDA::UTILS::append_utf8( id.data(), id.size(), narrow );
+        wide.clear();
+        OPCDA::UTILS::append_wide( narrow.data(), narrow.size(), wide );
+      }
+      result.latencies_us.push_back( elapsed_us( op ) );
+      result.ops += units;
+    }
+    result.seconds = elapsed_us( start ) / 1e6;
+    return wide.size() == ids.back().size();
+  }
+
+  /**
+   * @brief The number and timestamp formatters alone, without sinks or streams:
+   *        each sample's value, epoch ms and ISO 8601 time; ops counts fields.
+   */
+  bool format( BENCH_RESULT& result )
+  {
+    vector<OPCDA_SAMPLE> samples;
+    if ( !snapshot( samples ) )
+    {
+      return false;
+    }
+
+    // the simulator's values are mostly integral; every other one gets a fraction
+    for ( size_t i = 0; i < samples.size(); i += 2 )
+    {
+      samples[i].value += 1.0 / 3.0;
+    }
+
+    char buffer[OPCDA::UTILS::FORMAT_TIME_CHARS];
+    char* last = buffer + sizeof( buffer );
+    size_t chars = 0;
+
+    auto start = clock_type::now();
+    for ( int i = 0; i < m_options.iterations; ++i )
+    {
+      auto op = clock_type::now();
+      for ( const auto& sample : samples )
+      {
+        chars += OPCDA::UTILS::format_double( buffer, last, sample.value ) - buffer;
+        chars += OPCDA::UTILS::format_epoch_ms( buffer, last, sample.timestamp ) - buffer;
+        chars += OPCDA::UTILS::format_iso8601( buffer, last, sample.timestamp ) - buffer;
+      }
+      result.latencies_us.push_back( elapsed_us( op ) );
+      result.ops += samples.size() * 3;
+    }
+    result.seconds = elapsed_us( start ) / 1e6;
+
+    // keeps the loop from being optimized away
+    return chars > 0;
+  }
+
+#ifdef _WIN32
+  bool yaml( BENCH_RESULT& result )
+  {
+    // printTagValues takes the client's OPCDA_TAG, so this one always reads through OpcDaClient
+    auto space = space_for( 0 );
+    ClientTarget target;
+    if ( !target.open( space ) )
+    {
+      return false;
+    }
+
+    vector<OPCDA_TAG> tags;
+    vector<HRESULT> errors;
+    target.client().read_sync( readable_ids( *space, space->items().size() ), tags, errors );
+
+    map<string, OPCDA_TAG> values;
+    map<string, vector<OPCDA_SAMPLE>> by_tag;
+    size_t sample_count = 0;
+
+    for ( auto& tag : tags )
+    {
+      vector<OPCDA_SAMPLE> samples;
+      OPCDA::UTILS::tag_to_samples( tag, samples );
+      for ( auto& sample : samples )
+      {
+        by_tag[sample.id].push_back( move( sample ) );
+        ++sample_count;
+      }
+      values.emplace( OPCDA::UTILS::wstr_to_str( tag.id ), tag );
+    }
+
+    NullBuffer null_buffer;
+    streambuf* console = cout.rdbuf( &null_buffer );
+
+    auto start = clock_type::now();
+    for ( int i = 0; i < m_options.iterations; ++i )
+    {
+      auto op = clock_type::now();
+      ResultFormatter::getInstance().printTagValues( values );
+      ResultFormatter::getInstance().printCaptureSamples( by_tag );
+      result.latencies_us.push_back( elapsed_us( op ) );
+      result.ops += values.size() + sample_count;
+    }
+    result.seconds = elapsed_us( start ) / 1e6;
+
+    cout.rdbuf( console );
+    for ( auto& value : values )
+    {
+      VariantClear( &value.second.value );
+    }
+    return true;
+  }
+#endif
+};
+
+static bool parse_bench_arguments( int argc, char* argv[], BENCH_OPTIONS& options )
+{
+  string scenarios = DEFAULT_BENCH_SCENARIOS;
+
+  for ( int i = 1; i < argc; ++i )
+  {
+    string arg = argv[i];
+    bool has_value = i + 1 < argc;
+
+    if ( arg == "--sim" && has_value )
+      options.sim_spec = argv[++i];
+    else if ( arg == "--backend" && has_value )
+      options.backend = argv[++i];
+    else if ( arg == "--scenarios" && has_value )
+      scenarios = argv[++i];
+    else if ( arg == "--iterations" && has_value )
+      options.iterations = max( atoi( argv[++i] ), 1 );
+    else if ( arg == "--threads" && has_value )
+      options.threads = max( atoi( argv[++i] ), 1 );
+    else if ( arg == "--out" && has_value )
+      options.out = argv[++i];
+    else if ( arg == "--metrics" && has_value )
+      options.metrics = argv[++i];
+    else if ( arg == "--trace" && has_value )
+      options.trace = argv[++i];
+    else if ( arg == "--check" )
+    {
+      options.check = true;
+      if ( has_value && string( argv[i + 1] ).rfind( "--", 0 ) != 0 )
+        options.checks = argv[++i];
+    }
+    else
+      return false;
+  }
+
+  istringstream names( scenarios );
+  string name;
+  while ( getline( names, name, ',' ) )
+  {
+    if ( !name.empty() )
+    {
+      options.scenarios.insert( name );
+    }
+  }
+  return !options.scenarios.empty();
+}
+
+int main( int argc, char* argv[] )
+{
+  BENCH_OPTIONS options;
+  if ( !parse_bench_arguments( argc, argv, options ) )
+  {
+    cerr << "Usage: opcda-bench [--sim <key=value,...>] [--backend <client|com|memory>]" << endl;
+    cerr << "                   [--scenarios " << DEFAULT_BENCH_SCENARIOS << "]" << endl;
+    cerr << "                   [--iterations N] [--threads N] [--out <file>] [--metrics <file|->]" << endl;
+    cerr << "                   [--trace <file>]" << endl;
+    cerr << "       opcda-bench --check [" << DEFAULT_CHECKS << "]" << endl;
+    return 1;
+  }
+
+  Logger::instance().set_mode( LogMode::NONE );
+
+  if ( options.check )
+  {
+    return run_checks( options.checks ) == 0 ? 0 : 1;
+  }
+
+#ifdef _WIN32
+  if ( FAILED( CoInitializeEx( NULL, COINIT_MULTITHREADED ) ) )
+  {
+    cerr << "CoInitializeEx failed" << endl;
+    return 1;
+  }
+#endif
+
+  if ( !options.trace.empty() )
+  {
+    Tracer::instance().start();
+  }
+
+  int exit_code = 0;
+  try
+  {
+    Bench bench( options );
+    ofstream out;
+    if ( !options.out.empty() )
+    {
+      out.open( options.out, ios::app );
+    }
+
+    // keep the documented order rather than the set's alphabetical one
+    istringstream order( DEFAULT_BENCH_SCENARIOS );
+    vector<string> scenarios;
+    string name;
+    while ( getline( order, name, ',' ) )
+    {
+      if ( options.scenarios.erase( name ) )
+      {
+        scenarios.push_back( name );
+      }
+    }
+    scenarios.insert( scenarios.end(), options.scenarios.begin(), options.scenarios.end() );
+
+    for ( const auto& scenario : scenarios )
+    {
+      BENCH_RESULT result;
+      if ( !bench.run( scenario, result ) )
+      {
+        cerr << "Scenario failed: " << scenario << endl;
+        exit_code = 1;
+        continue;
+      }
+
+      string line = to_json( result, options );
+      cout << line << endl;
+      if ( out.is_open() )
+      {
+        out << line << endl;
+      }
+    }
+  }
+  catch ( const exception& e )
+  {
+    cerr << e.what() << endl;
+    exit_code = 1;
+  }
+
+  if ( !options.trace.empty() && !Tracer::instance().write( options.trace ) )
+  {
+    exit_code = 1;
+  }
+
+  // per COM call latency of the client backend, to compare with the scenario totals
+  if ( !options.metrics.empty() && !MetricsRegistry::instance().write( options.metrics ) )
+  {
+    exit_code = 1;
+  }
+
+#ifdef _WIN32
+  CoUninitialize();
+#endif
+  return exit_code;
+}
@@ -0,0 +1,1198 @@
+// opcda_checks.cpp
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <climits>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "../opcda_backend_memory.h"
+#include "../opcda_backend_session.h"
+#include "../opcda_capture.h"
+#include "../opcda_device_queue.h"
+#include "../opcda_error_stats.h"
+#include "../opcda_format.h"
+#include "../opcda_pi_sink.h"
+#include "../opcda_queue.h"
+#include "../opcda_utf.h"
+#include "../opcda_value_cache.h"
+#include "opcda_checks.h"
+
+using namespace std;
+
+/**
+ * Self checks of the portable modules, run with opcda-bench --check [names]
+ * (./make.sh check on Linux). Each check builds its own fixtures and reports
+ * every failed expectation, not only the first one.
+ */
+
+const char* const DEFAULT_CHECKS = "pi,array,capture,queue,device,cache,errors,utf,format,session";
+
+constexpr int PI_NETWORK_ERROR = -10731;
+constexpr int PI_POINT_NOT_FOUND = -5;
+constexpr int PI_SNAPSHOT_REFUSED = -11049;
+
+class CheckContext
+{
+public:
+  vector<string> failures;
+
+  void expect( bool condition, const string& what )
+  {
+    if ( !condition )
+    {
+      failures.push_back( what );
+    }
+  }
+
+  template <typename T>
+  void expect_equal( const T& actual, const T& expected, const string& what )
+  {
+    if ( !( actual == expected ) )
+    {
+      ostringstream oss;
+      oss << what << ": expected " << expected << ", got " << actual;
+      failures.push_back( oss.str() );
+    }
+  }
+};
+
+/**
+ * @brief In-memory PI archive: known points, lookups that fail once with a
+ *        network error, put calls that fail during an outage and points whose
+ *        snapshots are refused one by one.
+ */
+class FakeArchive : public PiArchive
+{
+public:
+  map<string, int32_t> points;
+  set<string> flaky;
+  set<int32_t> refused;
+  int outage_calls = 0;
+
+  int32_t find_point( const string& tag, int32_t& point ) override
+  {
+    lock_guard<mutex> lock( m_lock );
+    ++m_lookups[tag];
+
+    if ( flaky.erase( tag ) )
+    {
+      return PI_NETWORK_ERROR;
+    }
+
+    auto it = points.find( tag );
+    if ( it == points.end() )
+    {
+      return PI_POINT_NOT_FOUND;
+    }
+
+    point = it->second;
+    return 0;
+  }
+
+  int32_t put_snapshots( const vector<PI_SNAPSHOT>& snapshots, vector<int32_t>& errors ) override
+  {
+    lock_guard<mutex> lock( m_lock );
+    ++m_puts;
+
+    if ( outage_calls > 0 )
+    {
+      --outage_calls;
+      return PI_NETWORK_ERROR;
+    }
+
+    errors.assign( snapshots.size(), 0 );
+
+    for ( size_t i = 0; i < snapshots.size(); ++i )
+    {
+      if ( refused.count( snapshots[i].point ) )
+      {
+        errors[i] = PI_SNAPSHOT_REFUSED;
+        continue;
+      }
+      m_received.push_back( snapshots[i] );
+    }
+    return 0;
+  }
+
+  int lookups( const string& tag )
+  {
+    lock_guard<mutex> lock( m_lock );
+    return m_lookups[tag];
+  }
+
+  int puts()
+  {
+    lock_guard<mutex> lock( m_lock );
+    return m_puts;
+  }
+
+  vector<PI_SNAPSHOT> received()
+  {
+    lock_guard<mutex> lock( m_lock );
+    return m_received;
+  }
+
+private:
+  mutex m_lock;
+  map<string, int> m_lookups;
+  int m_puts = 0;
+  vector<PI_SNAPSHOT> m_received;
+};
+
+static vector<OPCDA_SAMPLE> pi_samples( const vector<string>& ids )
+{
+  vector<OPCDA_SAMPLE> samples;
+  int64_t timestamp = epoch_ms_to_ticks( 1700000000000LL );
+
+  for ( const auto& id : ids )
+  {
+    OPCDA_SAMPLE s;
+    s.id = id;
+    s.timestamp = timestamp;
+    s.value = static_cast<double>( samples.size() + 1 );
+    s.quality = 0xC0;
+    samples.push_back( s );
+  }
+  return samples;
+}
+
+static bool flush_within( PiSink& sink, chrono::milliseconds timeout )
+{
+  auto deadline = chrono::steady_clock::now() + timeout;
+
+  while ( chrono::steady_clock::now() < deadline )
+  {
+    if ( sink.flush() )
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void check_pi_partial_errors( CheckContext& check )
+{
+  FakeArchive archive;
+  archive.points = { { "A", 1 }, { "B", 2 }, { "C", 3 } };
+  archive.refused = { 2 };
+
+  PiSink sink( archive );
+  sink.set_batch( 100, 10 );
+  sink.open();
+
+  check.expect( sink.write( pi_samples( { "A", "B", "C" } ) ), "write accepted" );
+  check.expect( sink.flush(), "flush succeeds when the archive answered every sample" );
+  check.expect_equal<uint64_t>( sink.written(), 2, "written" );
+  check.expect_equal<uint64_t>( sink.rejected(), 1, "rejected" );
+
+  vector<PI_SNAPSHOT> received = archive.received();
+  check.expect( received.size() == 2 && received[0].point == 1 && received[1].point == 3, "refused point 2 is the only one missing" );
+  sink.close();
+}
+
+static void check_pi_outage( CheckContext& check )
+{
+  FakeArchive archive;
+  archive.points = { { "A", 1 }, { "B", 2 } };
+  // two failed cycles of two attempts each, then the archive is back
+  archive.outage_calls = 4;
+
+  PiSink sink( archive );
+  sink.set_batch( 100, 10 );
+  sink.set_retry( 1, 20 );
+  sink.open();
+
+  check.expect( sink.write( pi_samples( { "A", "B" } ) ), "write accepted" );
+  check.expect( !sink.flush(), "flush fails while the retries are exhausted" );
+  check.expect_equal<uint64_t>( sink.rejected(), 0, "nothing rejected during the outage" );
+
+  check.expect( flush_within( sink, chrono::seconds( 10 ) ), "flush succeeds once the archive is back" );
+  check.expect_equal<uint64_t>( sink.written(), 2, "written after the outage" );
+  check.expect_equal<uint64_t>( sink.rejected(), 0, "rejected after the outage" );
+  check.expect_equal<size_t>( archive.received().size(), 2, "each sample arrives exactly once" );
+  check.expect_equal( archive.puts(), 5, "put calls" );
+  sink.close();
+}
+
+static void check_pi_resolve_cache( CheckContext& check )
+{
+  FakeArchive archive;
+  archive.points = { { "A", 1 }, { "FLAKY", 2 } };
+  archive.flaky = { "FLAKY" };
+
+  PiSink sink( archive );
+  sink.set_batch( 100, 10 );
+  sink.set_retry( 0, 20 );
+  sink.open();
+
+  sink.write( pi_samples( { "A", "MISSING", "FLAKY" } ) );
+  check.expect( flush_within( sink, chrono::seconds( 10 ) ), "flush succeeds after the failed lookup is retried" );
+
+  sink.write( pi_samples( { "A", "MISSING", "FLAKY" } ) );
+  check.expect( sink.flush(), "second flush" );
+
+  check.expect_equal( archive.lookups( "A" ), 1, "found point looked up once" );
+  check.expect_equal( archive.lookups( "MISSING" ), 1, "missing point looked up once" );
+  check.expect_equal( archive.lookups( "FLAKY" ), 2, "point behind a network error looked up again" );
+  check.expect_equal<uint64_t>( sink.written(), 4, "written" );
+  check.expect_equal<uint64_t>( sink.rejected(), 2, "missing point rejected in both batches" );
+  sink.close();
+}
+
+static void check_pi( CheckContext& check )
+{
+  check_pi_partial_errors( check );
+  check_pi_outage( check );
+  check_pi_resolve_cache( check );
+}
+
+static vector<OPCDA_SAMPLE> array_samples()
+{
+  vector<OPCDA_SAMPLE> samples = pi_samples( { "S", "ARR" } );
+  samples[1].elements = { 1.5, -2.0, 1e300 };
+  samples[1].value = samples[1].elements.front();
+  return samples;
+}
+
+static bool same_samples( const vector<OPCDA_SAMPLE>& a, const vector<OPCDA_SAMPLE>& b )
+{
+  if ( a.size() != b.size() )
+  {
+    return false;
+  }
+
+  for ( size_t i = 0; i < a.size(); ++i )
+  {
+    if ( a[i].id != b[i].id || a[i].timestamp != b[i].timestamp || a[i].value != b[i].value || a[i].quality != b[i].quality || a[i].elements != b[i].elements )
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void check_array_queue( CheckContext& check )
+{
+  vector<OPCDA_SAMPLE> samples = array_samples();
+  vector<OPCDA_SAMPLE> decoded;
+  vector<uint8_t> record;
+
+  QueueSink::encode( samples, record );
+  check.expect( QueueSink::decode( record, decoded ) && same_samples( decoded, samples ), "queue record with an array round trips" );
+
+  record.pop_back();
+  check.expect( !QueueSink::decode( record, decoded ), "truncated array record is rejected" );
+
+  // scalar-only records keep the original layout: u32 count, then 20 bytes plus the id per sample
+  samples.pop_back();
+  QueueSink::encode( samples, record );
+  check.expect_equal<size_t>( record.size(), 4 + 20 + samples[0].id.size(), "scalar record size" );
+  check.expect( QueueSink::decode( record, decoded ) && same_samples( decoded, samples ), "scalar record round trips" );
+}
+
+static void check_array_capture( CheckContext& check )
+{
+  string path = ( filesystem::temp_directory_path() / "opcda_check_array.cap" ).string();
+  error_code ec;
+  filesystem::remove( path, ec );
+
+  vector<OPCDA_SAMPLE> samples = array_samples();
+  {
+    CaptureWriter writer;
+    check.expect( writer.open( path ), "capture opened" );
+    check.expect( writer.write( samples ), "capture written" );
+  }
+
+  CaptureReader reader;
+  vector<OPCDA_SAMPLE> scalar;
+  vector<OPCDA_SAMPLE> array;
+
+  check.expect( reader.open( path ), "capture reopened" );
+  check.expect_equal<size_t>( reader.tags().size(), 2, "one capture tag per sample id" );
+  check.expect( reader.read_range( "S", LLONG_MIN, LLONG_MAX, scalar ) && same_samples( scalar, { samples[0] } ), "scalar read back" );
+  check.expect( reader.read_range( "ARR", LLONG_MIN, LLONG_MAX, array ) && same_samples( array, { samples[1] } ), "array read back as one sample" );
+
+  filesystem::remove( path, ec );
+}
+
+static void check_array_pi( CheckContext& check )
+{
+  FakeArchive archive;
+  archive.points = { { "S", 1 }, { "ARR[0]", 10 }, { "ARR[1]", 11 }, { "ARR[2]", 12 } };
+
+  PiSink sink( archive );
+  sink.set_batch( 100, 10 );
+  sink.open();
+
+  check.expect( sink.write( array_samples() ), "write accepted" );
+  check.expect( sink.flush(), "flush" );
+  check.expect_equal<uint64_t>( sink.written(), 4, "scalar plus one point per element" );
+
+  vector<PI_SNAPSHOT> received = archive.received();
+  check.expect( received.size() == 4 && received[2].point == 11 && received[2].value == -2.0, "element 1 written to ARR[1]" );
+  sink.close();
+}
+
+static void check_array( CheckContext& check )
+{
+  check_array_queue( check );
+  check_array_capture( check );
+  check_array_pi( check );
+}
+
+static vector<OPCDA_SAMPLE> series( const string& id, size_t count, int64_t first_ms )
+{
+  vector<OPCDA_SAMPLE> samples;
+
+  for ( size_t i = 0; i < count; ++i )
+  {
+    OPCDA_SAMPLE s;
+    s.id = id;
+    s.timestamp = epoch_ms_to_ticks( first_ms + static_cast<int64_t>( i ) * 1000 );
+    s.value = static_cast<double>( i ) * 0.5;
+    s.quality = 0xC0;
+    samples.push_back( s );
+  }
+  return samples;
+}
+
+static bool read_back( const string& path, const string& tag, const vector<OPCDA_SAMPLE>& expected )
+{
+  CaptureReader reader;
+  vector<OPCDA_SAMPLE> samples;
+  return reader.open( path ) && reader.read_range( tag, LLONG_MIN, LLONG_MAX, samples ) && same_samples( samples, expected );
+}
+
+static void check_capture( CheckContext& check )
+{
+  string path = ( filesystem::temp_directory_path() / "opcda_check_capture.cap" ).string();
+  error_code ec;
+  filesystem::remove( path, ec );
+
+  vector<OPCDA_SAMPLE> a = series( "A", 4, 1700000000000LL );
+  vector<OPCDA_SAMPLE> b = series( "B", 4, 1700000100000LL );
+  vector<OPCDA_SAMPLE> c = series( "C", 4, 1700000200000LL );
+
+  // one block per write and a footer after every block
+  {
+    CaptureWriter writer;
+    writer.set_block_samples( 4 );
+    writer.set_footer_blocks( 1 );
+    check.expect( writer.open( path ), "capture opened" );
+    check.expect( writer.write( a ) && writer.write( b ), "capture written" );
+  }
+
+  CaptureReader reader;
+  check.expect( reader.open( path ), "capture reopened" );
+  uint64_t size = filesystem::file_size( path, ec );
+  check.expect_equal<uint64_t>( reader.valid_end(), size, "closed file is intact to the end" );
+
+  // a crash in the middle of the last footer: B's block is complete but no footer covers it
+  filesystem::resize_file( path, reader.last_footer() + 5, ec );
+  {
+    CaptureReader torn;
+    check.expect( torn.open( path ), "torn capture opens" );
+    check.expect_equal<uint64_t>( torn.valid_end(), reader.last_footer(), "valid end stops before the torn footer" );
+    check.expect_equal<size_t>( torn.unindexed_blocks().size(), 1, "block after the last footer found by scan" );
+  }
+  check.expect( read_back( path, "A", a ), "indexed block read from the torn file" );
+  check.expect( read_back( path, "B", b ), "unindexed block read from the torn file" );
+
+  // reopening truncates the torn tail and the next footer covers the scanned block
+  {
+    CaptureWriter writer;
+    writer.set_block_samples( 4 );
+    writer.set_footer_blocks( 1 );
+    check.expect( writer.open( path ), "torn capture reopened for writing" );
+    check.expect( writer.write( c ), "capture appended" );
+  }
+
+  CaptureReader recovered;
+  check.expect( recovered.open( path ), "recovered capture opens" );
+  check.expect_equal<uint64_t>( recovered.valid_end(), filesystem::file_size( path, ec ), "recovered file is intact to the end" );
+  check.expect( recovered.unindexed_blocks().empty(), "every block indexed after recovery" );
+  check.expect_equal<size_t>( recovered.tags().size(), 3, "tags of both sessions" );
+  check.expect( read_back( path, "A", a ) && read_back( path, "B", b ) && read_back( path, "C", c ), "all samples read back after recovery" );
+
+  // garbage appended after the END record is cut off on the next open
+  {
+    ofstream tail( path, ios::binary | ios::app );
+    tail << "BLK1 torn";
+  }
+  {
+    CaptureWriter writer;
+    check.expect( writer.open( path ), "capture with a garbage tail reopened" );
+  }
+  check.expect( read_back( path, "C", c ), "samples kept after cutting a garbage tail" );
+  check.expect( recovered.open( path ) && recovered.valid_end() == filesystem::file_size( path, ec ), "garbage tail truncated" );
+
+  filesystem::remove( path, ec );
+}
+
+static size_t segment_files( const filesystem::path& dir )
+{
+  error_code ec;
+  size_t count = 0;
+  for ( const auto& entry : filesystem::directory_iterator( dir, ec ) )
+  {
+    count += entry.path().extension() == ".seg" ? 1 : 0;
+  }
+  return count;
+}
+
+// 1000 byte records filled with their sequence number, four to a 4096 byte segment
+static vector<uint8_t> queue_record( size_t sequence )
+{
+  return vector<uint8_t>( 1000, static_cast<uint8_t>( sequence ) );
+}
+
+static void open_queue( DiskQueue& queue, const filesystem::path& dir )
+{
+  queue.set_segment_bytes( 4096 );
+  queue.set_max_segments( 3 );
+  queue.open( dir.string() );
+}
+
+static void check_queue_replay( CheckContext& check, const filesystem::path& dir )
+{
+  uint64_t offset = 0;
+  uint64_t next_offset = 0;
+  vector<uint8_t> record;
+
+  {
+    DiskQueue queue;
+    open_queue( queue, dir );
+
+    for ( size_t i = 0; i < 6; ++i )
+    {
+      check.expect( queue.append( queue_record( i ) ), "append " + to_string( i ) );
+    }
+
+    for ( size_t i = 0; i < 3; ++i )
+    {
+      check.expect( queue.read( offset, record, next_offset, chrono::milliseconds( 100 ) ) && record == queue_record( i ), "read " + to_string( i ) );
+    }
+    check.expect( queue.commit( next_offset ), "commit after three records" );
+
+    // read but not committed: replayed after the restart
+    check.expect( queue.read( offset, record, next_offset, chrono::milliseconds( 100 ) ), "read past the commit" );
+  }
+
+  DiskQueue queue;
+  open_queue( queue, dir );
+  // record 3 ends the first segment, 4 and 5 start the second
+  check.expect_equal<uint64_t>( queue.pending_bytes(), 4096 + 2 * 1008 - 3 * 1008, "three records pending after the restart" );
+
+  for ( size_t i = 3; i < 6; ++i )
+  {
+    check.expect( queue.read( offset, record, next_offset, chrono::milliseconds( 100 ) ) && record == queue_record( i ), "replayed " + to_string( i ) );
+  }
+  check.expect( !queue.read( offset, record, next_offset, chrono::milliseconds( 10 ) ), "nothing past the last record" );
+}
+
+static void check_queue_recycling( CheckContext& check, const filesystem::path& dir )
+{
+  DiskQueue queue;
+  open_queue( queue, dir );
+
+  uint64_t offset = 0;
+  uint64_t next_offset = 0;
+  vector<uint8_t> record;
+  bool in_order = true;
+  size_t most_files = 0;
+
+  // consumed segments are renamed into new ones; stale records in them must not validate
+  for ( size_t i = 0; i < 40; ++i )
+  {
+    queue.append( queue_record( i ) );
+    in_order = queue.read( offset, record, next_offset, chrono::milliseconds( 100 ) ) && record == queue_record( i ) && in_order;
+    queue.commit( next_offset );
+    most_files = max( most_files, segment_files( dir ) );
+  }
+
+  check.expect( in_order, "every record read once, in order, through recycled segments" );
+  check.expect( most_files <= 3, "live and recycled segments within the budget, saw " + to_string( most_files ) );
+  check.expect_equal<uint64_t>( queue.dropped_bytes(), 0, "nothing dropped while consuming" );
+}
+
+static void check_queue_full( CheckContext& check, const filesystem::path& dir )
+{
+  DiskQueue queue;
+  open_queue( queue, dir );
+
+  size_t most_files = 0;
+  for ( size_t i = 0; i < 40; ++i )
+  {
+    check.expect( queue.append( queue_record( i ) ), "append to a full queue " + to_string( i ) );
+    most_files = max( most_files, segment_files( dir ) );
+  }
+
+  check.expect( most_files <= 3, "full queue within the budget, saw " + to_string( most_files ) );
+  check.expect( queue.dropped_bytes() > 0, "oldest records dropped" );
+
+  // the survivors are the newest records, in order
+  uint64_t offset = 0;
+  uint64_t next_offset = 0;
+  vector<uint8_t> record;
+  size_t last = 0;
+  size_t count = 0;
+  bool ascending = true;
+
+  while ( queue.read( offset, record, next_offset, chrono::milliseconds( 10 ) ) )
+  {
+    ascending = ( count == 0 || record[0] > last ) && ascending;
+    last = record[0];
+    ++count;
+  }
+
+  check.expect( ascending && last == 39, "newest records kept in order" );
+  check.expect( count > 0 && count <= 12, "at most three segments of records kept, got " + to_string( count ) );
+}
+
+static void check_queue( CheckContext& check )
+{
+  filesystem::path dir = filesystem::temp_directory_path() / "opcda_check_queue";
+  error_code ec;
+
+  for ( auto run : { check_queue_replay, check_queue_recycling, check_queue_full } )
+  {
+    filesystem::remove_all( dir, ec );
+    run( check, dir );
+  }
+  filesystem::remove_all( dir, ec );
+}
+
+static void check_device_bucket( CheckContext& check )
+{
+  TokenBucket bucket( 10, 5 );
+  TokenBucket::clock::time_point start = TokenBucket::clock::now();
+
+  for ( int i = 0; i < 5; ++i )
+  {
+    check.expect( bucket.take( 1, start ), "burst token " + to_string( i ) );
+  }
+  check.expect( !bucket.take( 1, start ), "no token past the burst" );
+
+  auto wait_ms = chrono::duration_cast<chrono::milliseconds>( bucket.wait_time( 1, start ) ).count();
+  check.expect( wait_ms >= 99 && wait_ms <= 100, "one token refills in 100 ms, got " + to_string( wait_ms ) );
+
+  check.expect( bucket.take( 1, start + chrono::milliseconds( 100 ) ), "token refilled after 100 ms" );
+  check.expect( !bucket.take( 1, start + chrono::milliseconds( 100 ) ), "only one token refilled" );
+
+  // refills stop at the burst however long the bucket idles
+  check.expect( bucket.full( start + chrono::seconds( 10 ) ), "full after idling" );
+  check.expect( bucket.take( 5, start + chrono::seconds( 10 ) ), "burst available after idling" );
+  check.expect( !bucket.take( 1, start + chrono::seconds( 10 ) ), "no more than the burst after idling" );
+}
+
+static shared_ptr<DEVICE_TAG> device_tag()
+{
+  return make_shared<DEVICE_TAG>();
+}
+
+static void check_device_coalescing( CheckContext& check )
+{
+  DeviceReadQueue queue;
+  queue.set_max_batch( 1 );
+
+  DeviceReadQueue::TAGS first;
+  DeviceReadQueue::TAGS second;
+  check.expect_equal<size_t>( queue.submit( { L"Ch.Dev.A", L"Ch.Dev.B" }, OPCDA_READ_PRIORITY::BULK, device_tag, first ), 0, "new tags" );
+  check.expect_equal<size_t>( queue.submit( { L"Ch.Dev.B" }, OPCDA_READ_PRIORITY::INTERACTIVE, device_tag, second ), 1, "duplicate tag coalesced" );
+  check.expect( second.size() == 1 && second[0] == first[1], "duplicate shares the pending tag" );
+  check.expect_equal<size_t>( queue.pending(), 2, "one pending tag per item" );
+  check.expect_equal<size_t>( queue.requested(), 3, "requested tags" );
+  check.expect( first[1]->priority == OPCDA_READ_PRIORITY::INTERACTIVE, "interactive request lifts the bulk tag" );
+
+  // B was queued after A, but the lift puts it first
+  DeviceReadQueue::TAGS batch;
+  queue.admit( DeviceReadQueue::clock::now(), batch );
+  check.expect( batch.size() == 1 && batch[0]->item_id == L"Ch.Dev.B", "lifted tag admitted first" );
+  check.expect( batch.size() == 1 && !batch[0]->queued, "admitted tag leaves the queue" );
+
+  DeviceReadQueue::TAGS again;
+  queue.submit( { L"Ch.Dev.B" }, OPCDA_READ_PRIORITY::BULK, device_tag, again );
+  check.expect_equal<size_t>( queue.coalesced(), 2, "tag being read is still shared" );
+
+  queue.finish( first[1] );
+  check.expect( first[1]->done, "finished tag done" );
+
+  DeviceReadQueue::TAGS after;
+  queue.submit( { L"Ch.Dev.B" }, OPCDA_READ_PRIORITY::BULK, device_tag, after );
+  check.expect( after.size() == 1 && after[0] != first[1], "finished tag read again for the next request" );
+
+  // A goes next; the stale bulk entry of B is skipped later
+  batch.clear();
+  queue.admit( DeviceReadQueue::clock::now(), batch );
+  check.expect( batch.size() == 1 && batch[0] == first[0], "bulk tag admitted after the lifted one" );
+}
+
+static void check_device_branches( CheckContext& check )
+{
+  DeviceReadQueue queue;
+  queue.set_branch_rate( 1, 1 );
+
+  DeviceReadQueue::TAGS request;
+  queue.submit( { L"X.a", L"X.b", L"Y.a" }, OPCDA_READ_PRIORITY::BULK, device_tag, request );
+
+  DeviceReadQueue::clock::time_point start = DeviceReadQueue::clock::now();
+  DeviceReadQueue::TAGS batch;
+  DeviceReadQueue::clock::duration next = queue.admit( start, batch );
+
+  check.expect( batch.size() == 2 && batch[0]->item_id == L"X.a" && batch[1]->item_id == L"Y.a", "throttled branch does not hold back the other one" );
+  check.expect( next > DeviceReadQueue::clock::duration::zero() && next <= chrono::seconds( 1 ), "next admission within a branch refill" );
+  check.expect_equal<size_t>( queue.branches(), 2, "one bucket per branch" );
+
+  batch.clear();
+  queue.admit( start + chrono::seconds( 2 ), batch );
+  check.expect( batch.size() == 1 && batch[0]->item_id == L"X.b", "held tag admitted after the refill" );
+
+  // both buckets refill completely and are dropped on the next prune
+  batch.clear();
+  queue.admit( start + chrono::milliseconds( DEVICE_BRANCH_PRUNE_MS ) + chrono::seconds( 5 ), batch );
+  check.expect_equal<size_t>( queue.branches(), 0, "idle full buckets pruned" );
+
+  DeviceReadQueue slow;
+  slow.set_branch_rate( 0.01, 1 );
+  slow.submit( { L"Z.a" }, OPCDA_READ_PRIORITY::BULK, device_tag, request );
+  batch.clear();
+  slow.admit( start, batch );
+  slow.admit( start + chrono::milliseconds( DEVICE_BRANCH_PRUNE_MS ) + chrono::seconds( 1 ), batch );
+  check.expect_equal<size_t>( slow.branches(), 1, "bucket still refilling kept" );
+}
+
+static void check_device( CheckContext& check )
+{
+  check_device_bucket( check );
+  check_device_coalescing( check );
+  check_device_branches( check );
+}
+
+static void check_cache_slots( CheckContext& check )
+{
+  ValueCache cache;
+  CACHED_VALUE value;
+
+  check.expect( !cache.get( 1, INT64_MAX, value ), "empty slot misses" );
+  check.expect( !cache.get( 5000, INT64_MAX, value ), "unallocated chunk misses" );
+  check.expect( !cache.put( static_cast<uint32_t>( VALUE_CACHE_CHUNK_SLOTS * VALUE_CACHE_MAX_CHUNKS ), 3, 1, 192, 1 ), "handle out of range refused" );
+
+  check.expect( cache.put( 1, 5, 0x4045000000000000ULL, 192, 1234 ), "put" );
+  check.expect( cache.get( 1, INT64_MAX, value ), "stored value found" );
+  check.expect_equal<uint16_t>( value.type, 5, "type" );
+  check.expect_equal<uint64_t>( value.bits, 0x4045000000000000ULL, "bits" );
+  check.expect_equal<uint16_t>( value.quality, 192, "quality" );
+  check.expect_equal<int64_t>( value.timestamp, 1234, "timestamp" );
+  check.expect( !cache.get( 2, INT64_MAX, value ), "neighbour slot still empty" );
+
+  this_thread::sleep_for( chrono::milliseconds( 20 ) );
+  check.expect( !cache.get( 1, 5000, value ), "value older than max age is stale" );
+  check.expect( cache.get( 1, 60000000, value ), "value within max age" );
+
+  cache.invalidate( 1 );
+  check.expect( !cache.get( 1, INT64_MAX, value ), "invalidated slot misses" );
+  cache.invalidate( 3000 );
+
+  cache.put( 1, 3, 7, 192, 1 );
+  cache.put( 2048, 3, 8, 192, 1 );
+  cache.clear();
+  check.expect( !cache.get( 1, INT64_MAX, value ) && !cache.get( 2048, INT64_MAX, value ), "clear drops every value" );
+
+  cache.put( 1, 3, 9, 192, 1 );
+  check.expect( cache.get( 1, INT64_MAX, value ) && value.bits == 9, "slot reused after clear" );
+}
+
+static void check_cache_torn_reads( CheckContext& check )
+{
+  ValueCache cache;
+  atomic<bool> stop { false };
+  atomic<size_t> torn { 0 };
+  atomic<size_t> hits { 0 };
+
+  // every field is derived from one counter, so a mix of two writes shows up
+  auto writer = [&]( uint64_t first ) {
+    for ( uint64_t i = first; i < first + 200000; ++i )
+    {
+      cache.put( 1, 3, i, static_cast<uint16_t>( i & 0xFFFF ), static_cast<int64_t>( i ) );
+    }
+  };
+
+  vector<thread> readers;
+  for ( int r = 0; r < 2; ++r )
+  {
+    readers.emplace_back( [&]() {
+      CACHED_VALUE value;
+      while ( !stop.load() )
+      {
+        if ( cache.get( 1, INT64_MAX, value ) )
+        {
+          ++hits;
+          if ( value.type != 3 || value.quality != ( value.bits & 0xFFFF ) || value.timestamp != static_cast<int64_t>( value.bits ) )
+          {
+            ++torn;
+          }
+        }
+      }
+    } );
+  }
+
+  thread first( writer, 1 );
+  thread second( writer, 1000000 );
+  first.join();
+  second.join();
+  stop = true;
+  for ( auto& reader : readers )
+  {
+    reader.join();
+  }
+
+  check.expect_equal<size_t>( torn.load(), 0, "torn reads" );
+  check.expect( hits.load() > 0, "readers saw values" );
+}
+
+static void check_cache( CheckContext& check )
+{
+  check_cache_slots( check );
+  check_cache_torn_reads( check );
+}
+
+static void check_errors( CheckContext& check )
+{
+  constexpr int32_t BAD_TYPE = static_cast<int32_t>( 0xC0040004 );
+  constexpr int32_t UNKNOWN_ITEM = static_cast<int32_t>( 0xC0040007 );
+  constexpr int THREADS = 8;
+  constexpr int POLLS = 200;
+
+  ItemErrorStats& stats = ItemErrorStats::instance();
+  stats.reset();
+  stats.set_max_tags( DEFAULT_ERROR_STATS_MAX_TAGS );
+
+  // every thread polls the same 50 bad tags, so the entries are shared across threads
+  vector<thread> pollers;
+  for ( int t = 0; t < THREADS; ++t )
+  {
+    pollers.emplace_back(
+      [&]()
+      {
+        for ( int poll = 0; poll < POLLS; ++poll )
+        {
+          for ( int tag = 0; tag < 50; ++tag )
+          {
+            stats.record( "Read", L"Bad." + to_wstring( tag ), static_cast<uint32_t>( tag + 1 ), tag < 40 ? BAD_TYPE : UNKNOWN_ITEM );
+          }
+        }
+      } );
+  }
+  for ( auto& poller : pollers )
+  {
+    poller.join();
+  }
+
+  uint64_t per_tag = static_cast<uint64_t>( THREADS ) * POLLS;
+  check.expect_equal<uint64_t>( stats.total(), per_tag * 50, "total" );
+  check.expect_equal<size_t>( stats.snapshot().size(), 50, "one entry per tag and code" );
+  check.expect_equal<uint64_t>( stats.failures( L"Bad.7" ), per_tag, "failures of one tag" );
+
+  vector<ERROR_CODE_STAT> codes = stats.by_code();
+  check.expect( codes.size() == 2 && codes[0].code == BAD_TYPE && codes[0].count == per_tag * 40 && codes[0].tags == 40, "bad type merged over shards" );
+  check.expect( codes.size() == 2 && codes[1].code == UNKNOWN_ITEM && codes[1].count == per_tag * 10 && codes[1].tags == 10, "unknown item merged over shards" );
+
+  string summary = stats.summary();
+  check.expect( summary.find( "Read: " + to_string( per_tag * 50 ) + " failures" ) != string::npos, "summary counts every failure" );
+  check.expect( stats.summary().empty(), "nothing new since the last summary" );
+
+  // past the limit new tags are only counted per code
+  stats.reset();
+  stats.set_max_tags( 3 );
+  for ( int tag = 0; tag < 10; ++tag )
+  {
+    stats.record( "Read", L"Over." + to_wstring( tag ), 0, BAD_TYPE );
+  }
+  check.expect_equal<size_t>( stats.snapshot().size(), 3, "entries capped at max_tags" );
+  check.expect_equal<uint64_t>( stats.by_code().front().count, 10, "capped failures still counted" );
+
+  stats.reset();
+  stats.set_max_tags( DEFAULT_ERROR_STATS_MAX_TAGS );
+}
+
+/** @brief Straightforward UTF-8 encoder the transcoder is compared against. */
+static string reference_utf8( const vector<uint32_t>& code_points )
+{
+  string out;
+
+  for ( uint32_t c : code_points )
+  {
+    if ( c < 0x80 )
+    {
+      out += static_cast<char>( c );
+    }
+    else if ( c < 0x800 )
+    {
+      out += static_cast<char>( 0xC0 | ( c >> 6 ) );
+      out += static_cast<char>( 0x80 | ( c & 0x3F ) );
+    }
+    else if ( c < 0x10000 )
+    {
+      out += static_cast<char>( 0xE0 | ( c >> 12 ) );
+      out += static_cast<char>( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+      out += static_cast<char>( 0x80 | ( c & 0x3F ) );
+    }
+    else
+    {
+      out += static_cast<char>( 0xF0 | ( c >> 18 ) );
+      out += static_cast<char>( 0x80 | ( ( c >> 12 ) & 0x3F ) );
+      out += static_cast<char>( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+      out += static_cast<char>( 0x80 | ( c & 0x3F ) );
+    }
+  }
+  return out;
+}
+
+static u16string to_utf16( const vector<uint32_t>& code_points )
+{
+  u16string out;
+
+  for ( uint32_t c : code_points )
+  {
+    if ( c < 0x10000 )
+    {
+      out += static_cast<char16_t>( c );
+    }
+    else
+    {
+      out += static_cast<char16_t>( 0xD800 + ( ( c - 0x10000 ) >> 10 ) );
+      out += static_cast<char16_t>( 0xDC00 + ( ( c - 0x10000 ) & 0x3FF ) );
+    }
+  }
+  return out;
+}
+
+static wstring to_wide( const vector<uint32_t>& code_points )
+{
+  if ( sizeof( wchar_t ) == 2 )
+  {
+    u16string utf16 = to_utf16( code_points );
+    return wstring( utf16.begin(), utf16.end() );
+  }
+  return wstring( code_points.begin(), code_points.end() );
+}
+
+static string hex( const string& bytes )
+{
+  static const char digits[] = "0123456789ABCDEF";
+  string out;
+
+  for ( unsigned char b : bytes )
+  {
+    out += digits[b >> 4];
+    out += digits[b & 0x0F];
+    out += ' ';
+  }
+  return out;
+}
+
+static void check_utf_round_trip( CheckContext& check )
+{
+  // one code point of every encoded length, placed at every offset around the 16 unit SIMD blocks
+  const vector<uint32_t> samples = { 0x41, 0xE9, 0x7FF, 0x800, 0xD55C, 0xFFFD, 0xFFFF, 0x10000, 0x1F600, 0x10FFFF };
+
+  for ( uint32_t sample : samples )
+  {
+    for ( size_t offset = 0; offset < 40; ++offset )
+    {
+      vector<uint32_t> code_points( offset, 'a' );
+      code_points.push_back( sample );
+      code_points.insert( code_points.end(), 20, 'z' );
+
+      string expected = reference_utf8( code_points );
+      u16string utf16 = to_utf16( code_points );
+      wstring wide = to_wide( code_points );
+
+      string narrow;
+      OPCDA::UTILS::append_utf8( utf16.data(), utf16.size(), narrow );
+      string narrow_wide;
+      OPCDA::UTILS::append_utf8( wide.data(), wide.size(), narrow_wide );
+
+      u16string back;
+      OPCDA::UTILS::append_wide( narrow.data(), narrow.size(), back );
+      wstring back_wide;
+      OPCDA::UTILS::append_wide( narrow.data(), narrow.size(), back_wide );
+
+      string where = "U+" + hex( reference_utf8( { sample } ) ) + "at " + to_string( offset );
+      check.expect( narrow == expected, "UTF-16 to UTF-8 of " + where );
+      check.expect( narrow_wide == expected, "wchar_t to UTF-8 of " + where );
+      check.expect( back == utf16, "UTF-8 to UTF-16 of " + where );
+      check.expect( back_wide == wide, "UTF-8 to wchar_t of " + where );
+    }
+  }
+
+  // output is appended, not assigned
+  string prefixed = "id=";
+  u16string tag = u"Tag\u00E9";
+  OPCDA::UTILS::append_utf8( tag.data(), tag.size(), prefixed );
+  check.expect_equal<string>( prefixed, "id=Tag\xC3\xA9", "append to an existing buffer" );
+}
+
+static void check_utf_invalid( CheckContext& check )
+{
+  const string fffd = "\xEF\xBF\xBD";
+
+  struct SURROGATE_CASE
+  {
+    const char* name;
+    u16string input;
+    string expected;
+  };
+
+  const vector<SURROGATE_CASE> surrogates = {
+    { "lone high surrogate", u16string( { 0xD800, u'a' } ), fffd + "a" },
+    { "lone low surrogate", u16string( { u'a', 0xDC00 } ), "a" + fffd },
+    { "high surrogate at the end", u16string( { u'a', 0xDBFF } ), "a" + fffd },
+    { "reversed pair", u16string( { 0xDC00, 0xD800 } ), fffd + fffd },
+    { "two high surrogates", u16string( { 0xD800, 0xD800, 0xDC00 } ), fffd + "\xF0\x90\x80\x80" },
+  };
+
+  for ( const auto& c : surrogates )
+  {
+    string out;
+    OPCDA::UTILS::append_utf8( c.input.data(), c.input.size(), out );
+    check.expect( out == c.expected, string( c.name ) + ": got " + hex( out ) );
+  }
+
+  struct UTF8_CASE
+  {
+    const char* name;
+    string input;
+    size_t replacements;
+  };
+
+  // one U+FFFD per maximal invalid subpart, like MultiByteToWideChar and the WHATWG decoder
+  const vector<UTF8_CASE> malformed = {
+    { "overlong slash", "\xC0\xAF", 2 },
+    { "encoded surrogate", "\xED\xA0\x80", 3 },
+    { "truncated sequence", "\xE2\x82", 1 },
+    { "stray continuation", "\x80", 1 },
+    { "above U+10FFFF", "\xF4\x90\x80\x80", 4 },
+    { "invalid lead byte", "\xFF", 1 },
+  };
+
+  for ( const auto& c : malformed )
+  {
+    u16string out;
+    OPCDA::UTILS::append_wide( c.input.data(), c.input.size(), out );
+    check.expect( out == u16string( c.replacements, 0xFFFD ), string( c.name ) + ": got " + to_string( out.size() ) + " units" );
+  }
+}
+
+static void check_utf( CheckContext& check )
+{
+  check_utf_round_trip( check );
+  check_utf_invalid( check );
+}
+
+static void check_format( CheckContext& check )
+{
+  using namespace OPCDA::UTILS;
+
+  char buffer[FORMAT_TIME_CHARS];
+  char* end = buffer + sizeof( buffer );
+  int64_t ticks = epoch_ms_to_ticks( 1700000000123LL );
+
+  check.expect_equal( string( buffer, format_double( buffer, end, 1.5 ) ), string( "1.5" ), "fractional double" );
+  check.expect_equal( string( buffer, format_double( buffer, end, 3.0 ) ), string( "3" ), "integral double" );
+  check.expect_equal( string( buffer, format_double( buffer, end, -0.0 ) ), string( "-0" ), "negative zero" );
+  check.expect_equal( string( buffer, format_int( buffer, end, INT64_MIN ) ), string( "-9223372036854775808" ), "INT64_MIN" );
+  check.expect_equal( string( buffer, format_uint( buffer, end, UINT64_MAX ) ), string( "18446744073709551615" ), "UINT64_MAX" );
+  check.expect_equal( string( buffer, format_float( buffer, end, 0.1f ) ), string( "0.1" ), "float" );
+  check.expect_equal( string( buffer, format_iso8601( buffer, end, ticks ) ), string( "2023-11-14T22:13:20.123Z" ), "ISO 8601" );
+  check.expect_equal( string( buffer, format_epoch_ms( buffer, end, ticks ) ), string( "1700000000123" ), "epoch ms" );
+  check.expect_equal( string( buffer, format_date_time( buffer, end, 12345, 1, 2, 3, 4, 5, ' ' ) ), string( "12345-01-02 03:04:05" ), "five digit year" );
+
+  // a buffer one character short yields an empty range, never nullptr
+  char small[24];
+  char* small_end = small + sizeof( small ) - 1;
+  check.expect( format_iso8601( small, small_end, ticks ) == small, "ISO 8601 into a short buffer" );
+  check.expect( format_date_time( small, small + 18, 2023, 11, 14, 22, 13, 20, ' ' ) == small, "date time into a short buffer" );
+  check.expect( format_int( small, small + 3, 12345 ) == small, "int into a short buffer" );
+  check.expect( format_uint( small, small + 3, 12345 ) == small, "uint into a short buffer" );
+  check.expect( format_double( small, small + 3, 1.0 / 3.0 ) == small, "double into a short buffer" );
+  check.expect( format_double( small, small + 3, 12345.0 ) == small, "integral double into a short buffer" );
+  check.expect( format_float( small, small + 3, 1.0f / 3.0f ) == small, "float into a short buffer" );
+  check.expect( format_epoch_ms( small, small + 3, ticks ) == small, "epoch ms into a short buffer" );
+}
+
+static shared_ptr<const SimNamespace> session_space( bool item_io )
+{
+  SIM_CONFIG config;
+  config.depth = 1;
+  config.branches = 2;
+  config.leaves = 5;
+  config.browse_da3 = true;
+  config.item_io = item_io;
+  config.id_prefix = L"ns=";
+  return make_shared<const SimNamespace>( config );
+}
+
+static void check_session_browse( CheckContext& check )
+{
+  MemoryBackend backend( session_space( false ) );
+  BackendSession session( backend );
+
+  // three elements a page, so every branch takes several continuation points
+  BACKEND_BROWSE_QUERY filter;
+  filter.page_size = 3;
+  session.set_browse_filter( filter );
+
+  vector<wstring> ids;
+  check.expect( session.browse_all( ids ) == OPCDA_OK, "browse_all" );
+  check.expect_equal<size_t>( ids.size(), 10, "items over all pages" );
+  check.expect( all_of( ids.begin(), ids.end(), []( const wstring& id ) { return id.compare( 0, 3, L"ns=" ) == 0; } ), "DA 3.0 browse returns item IDs" );
+  check.expect_equal<size_t>( set<wstring>( ids.begin(), ids.end() ).size(), ids.size(), "no element listed twice" );
+
+  session.browse_all( ids );
+  check.expect_equal<size_t>( ids.size(), 10, "a second browse adds nothing" );
+
+  vector<wstring> branches;
+  vector<wstring> leaves;
+  check.expect( session.browse( L"", branches, leaves ) == OPCDA_OK, "browse root" );
+  check.expect_equal<size_t>( branches.size(), 2, "branches below the root" );
+
+  BackendSession fresh( backend );
+  wstring item_id;
+  check.expect( fresh.resolve( L"Branch001.Item00002", item_id ) == OPCDA_OK, "browse path resolves" );
+  check.expect( item_id == L"ns=Branch001.Item00002", "resolved to the prefixed item ID" );
+  check.expect( fresh.resolve( L"Branch001.Missing", item_id ) == OPCDA_FALSE && item_id == L"Branch001.Missing", "unknown path stays as it is" );
+
+  vector<wstring> readable;
+  check.expect( fresh.readable_items( { L"Branch000.Item00000", L"Branch000.Item00001" }, readable ) == OPCDA_OK, "readable_items" );
+  check.expect_equal<size_t>( readable.size(), 2, "readable items" );
+}
+
+static void check_session_group( CheckContext& check )
+{
+  MemoryBackend backend( session_space( false ) );
+  BackendSession session( backend );
+
+  vector<wstring> ids = { L"Branch000.Item00000", L"ns=Branch000.Item00001", L"ns=Missing" };
+  vector<BACKEND_VALUE> values;
+
+  check.expect( session.read( ids, values ) == OPCDA_FALSE, "read with one unknown item" );
+  check.expect( !opcda_failed( values[0].error ) && !opcda_failed( values[1].error ), "known items read" );
+  check.expect( opcda_failed( values[2].error ), "unknown item fails" );
+  check.expect_equal<size_t>( session.registered(), 3, "failed registrations are kept" );
+
+  session.read( ids, values, BACKEND_SOURCE::DEVICE );
+  check.expect_equal<size_t>( session.registered(), 3, "items are added once" );
+
+  BACKEND_VALUE written;
+  written.value = 42.0;
+  written.type = OPCDA_TYPE_R8;
+  vector<OPCDA_RESULT> errors;
+  check.expect( session.write( { ids[1] }, { written }, errors ) == OPCDA_OK, "write" );
+  // the second simulated item is an I4
+  session.read( { ids[1] }, values );
+  check.expect( holds_alternative<int64_t>( values[0].value ) && get<int64_t>( values[0].value ) == 42, "written value reads back as the item type" );
+
+  vector<wstring> completed;
+  session.set_write_complete( [&]( uint32_t, const vector<wstring>& item_ids, const vector<OPCDA_RESULT>& results ) {
+    completed = item_ids;
+    check.expect( results.size() == 1 && !opcda_failed( results[0] ), "async write succeeded" );
+  } );
+
+  uint32_t transaction = 0;
+  check.expect( session.write_async( { ids[0] }, { written }, transaction, errors ) == OPCDA_OK, "write_async" );
+  check.expect( transaction != 0, "transaction ID" );
+  check.expect( completed.size() == 1 && completed[0] == ids[0], "completion names the item" );
+
+  check.expect( session.unregister( { ids[0], ids[2] } ) == OPCDA_OK, "unregister" );
+  check.expect_equal<size_t>( session.registered(), 1, "items left after unregister" );
+  check.expect( session.restore() == OPCDA_OK, "restore" );
+  check.expect_equal<size_t>( session.registered(), 1, "items left after restore" );
+
+  session.read( { ids[1] }, values );
+  check.expect( !opcda_failed( values[0].error ), "restored item reads" );
+}
+
+static void check_session_item_io( CheckContext& check )
+{
+  MemoryBackend backend( session_space( true ) );
+  BackendSession session( backend );
+
+  vector<wstring> ids = { L"ns=Branch001.Item00003", L"Branch001.Item00004" };
+  vector<BACKEND_VALUE> values;
+
+  check.expect( session.read( ids, values ) == OPCDA_OK, "item IO read, one ID resolved on the way" );
+  check.expect_equal<size_t>( session.registered(), 0, "item IO registers nothing" );
+
+  BACKEND_VALUE written;
+  written.value = wstring( L"7.5" );
+  written.type = OPCDA_TYPE_BSTR;
+  vector<OPCDA_RESULT> errors;
+  check.expect( session.write( { ids[0] }, { written }, errors ) == OPCDA_OK, "item IO write" );
+  session.read( { ids[0] }, values, BACKEND_SOURCE::DEVICE );
+  check.expect( holds_alternative<double>( values[0].value ) && get<double>( values[0].value ) == 7.5, "string converted to the item type" );
+}
+
+static void check_session( CheckContext& check )
+{
+  check_session_browse( check );
+  check_session_group( check );
+  check_session_item_io( check );
+}
+
+int run_checks( const string& names )
+{
+  static const map<string, function<void( CheckContext& )>> checks = {
+    { "pi", check_pi },
+    { "array", check_array },
+    { "capture", check_capture },
+    { "queue", check_queue },
+    { "device", check_device },
+    { "cache", check_cache },
+    { "errors", check_errors },
+    { "utf", check_utf },
+    { "format", check_format },
+    { "session", check_session },
+  };
+
+  istringstream list( names.empty() ? DEFAULT_CHECKS : names );
+  string name;
+  int failed = 0;
+
+  while ( getline( list, name, ',' ) )
+  {
+    if ( name.empty() )
+    {
+      continue;
+    }
+
+    auto it = checks.find( name );
+    if ( it == checks.end() )
+    {
+      cerr << "Unknown check: " << name << endl;
+      ++failed;
+      continue;
+    }
+
+    CheckContext context;
+    it->second( context );
+
+    cout << ( context.failures.empty() ? "PASS " : "FAIL " ) << name << endl;
+    for ( const auto& failure : context.failures )
+    {
+      cout << "  " << failure << endl;
+    }
+    failed += context.failures.empty() ? 0 : 1;
+  }
+
+  return failed;
+}
@@ -0,0 +1,17 @@
+// opcda_checks.h
+#ifndef OPCDA_CHECKS_H
+#define OPCDA_CHECKS_H
+
+#include <string>
+
+using namespace std;
+
+extern const char* const DEFAULT_CHECKS;
+
+/**
+ * @brief Runs the named self checks (comma separated, DEFAULT_CHECKS when empty)
+ *        and prints one PASS/FAIL line per check; returns the number that failed.
+ */
+int run_checks( const string& names );
+
+#endif
@@ -486,6 +486,154 @@ public:
     OriginalError originalError( quality, subStatus, "OPC Quality Error", subStatusMessage, limitMessage );
     return UnifiedError( U_ProtocolType::OPCDA, severity, category, unifiedCode, errorMessage, detailMessage, originalError, source );
   }
+  UnifiedError fromPiError( int32_t code, const string& message = "", const string& source = "" )
+  {
+    U_ErrorSeverity severity = U_ErrorSeverity::ERROR;
+    U_ErrorCategory category = U_ErrorCategory::EXTERNAL;
+    string errorMessage;
+    if ( code == 0 )
+    {
+      return UnifiedError( U_ProtocolType::PISDK, U_ErrorSeverity::GOOD, U_ErrorCategory::NONE, 0, "", "", OriginalError(), source );
+    }
+    else if ( code > 0 )
+    {
+      severity = U_ErrorSeverity::WARNING;
+      errorMessage = "PI Warning";
+    }
+    else if ( code == -1 || code == -5 )
+    {
+      category = U_ErrorCategory::TAG;
+      errorMessage = "PI Point Not Found";
+    }
+    else if ( code <= -10400 && code > -10500 )
+    {
+      category = U_ErrorCategory::PERMISSION;
+      errorMessage = "PI Access Denied";
+    }
+    else if ( code == -10722 )
+    {
+      category = U_ErrorCategory::TIMEOUT;
+      errorMessage = "PI Request Timeout";
+    }
+    else if ( code <= -10700 && code > -10800 )
+    {
+      severity = U_ErrorSeverity::CRITICAL_ERROR;
+      category = U_ErrorCategory::CONNECTION;
+      errorMessage = "PI Network Error";
+    }
+    else if ( code <= -11000 && code > -12000 )
+    {
+      category = U_ErrorCategory::DEVICE;
+      errorMessage = "PI Snapshot/Archive Error";
+    }
+    else
+    {
+      errorMessage = "PI API Error";
+    }
+    uint32_t unifiedCode = static_cast<uint32_t>( code < 0 ? -static_cast<int64_t>( code ) : code );
+    OriginalError originalError( static_cast<uint32_t>( code ), 0, "PI API Error", message, "" );
+    return UnifiedError( U_ProtocolType::PISDK, severity, category, unifiedCode, errorMessage, message, originalError, source );
+  }
+  UnifiedError fromOpcDaResult( int32_t code, const string& message = "", const string& source = "" )
+  {
+    U_ErrorSeverity severity = U_ErrorSeverity::ERROR;
+    U_ErrorCategory category = U_ErrorCategory::UNKNOWN;
+    string errorMessage;
+    uint32_t hr = static_cast<uint32_t>( code );
+    if ( hr == 0 )
+    {
+      return UnifiedError( U_ProtocolType::OPCDA, U_ErrorSeverity::GOOD, U_ErrorCategory::NONE, 0, "", "", OriginalError(), source );
+    }
+    switch ( hr )
+    {
+      case 0x00000001: // S_FALSE
+        severity = U_ErrorSeverity::WARNING;
+        category = U_ErrorCategory::NONE;
+        errorMessage = "Partial Success";
+        break;
+      case 0x0004000D: // OPC_S_UNSUPPORTEDRATE
+      case 0x0004000E: // OPC_S_CLAMP
+      case 0x0004000F: // OPC_S_INUSE
+        severity = U_ErrorSeverity::WARNING;
+        category = U_ErrorCategory::VALIDATION;
+        errorMessage = "OPC Value Adjusted";
+        break;
+      case 0xC0040001: // OPC_E_INVALIDHANDLE
+        category = U_ErrorCategory::TAG;
+        errorMessage = "Invalid Item Handle";
+        break;
+      case 0xC0040004: // OPC_E_BADTYPE
+        category = U_ErrorCategory::VALIDATION;
+        errorMessage = "Bad Data Type";
+        break;
+      case 0xC0040006: // OPC_E_BADRIGHTS
+        category = U_ErrorCategory::PERMISSION;
+        errorMessage = "Item Access Rights Violated";
+        break;
+      case 0xC0040007: // OPC_E_UNKNOWNITEMID
+      case 0xC0040011: // OPC_E_NOTFOUND
+        category = U_ErrorCategory::TAG;
+        errorMessage = "Unknown Item ID";
+        break;
+      case 0xC0040008: // OPC_E_INVALIDITEMID
+      case 0xC004000A: // OPC_E_UNKNOWNPATH
+        category = U_ErrorCategory::CONFIGURATION;
+        errorMessage = "Invalid Item ID";
+        break;
+      case 0xC0040009: // OPC_E_INVALIDFILTER
+      case 0xC004000B: // OPC_E_RANGE
+      case 0xC0040203: // OPC_E_INVALID_PID
+      case 0x80020005: // DISP_E_TYPEMISMATCH
+      case 0x8002000A: // DISP_E_OVERFLOW
+      case 0x80070057: // E_INVALIDARG
+        category = U_ErrorCategory::VALIDATION;
+        errorMessage = "Invalid Argument or Value";
+        break;
+      case 0x80070005: // E_ACCESSDENIED
+        category = U_ErrorCategory::SECURITY;
+        errorMessage = "Access Denied";
+        break;
+      case 0x8007000E: // E_OUTOFMEMORY
+        category = U_ErrorCategory::RESOURCE;
+        errorMessage = "Out of Memory";
+        break;
+      case 0x80010002: // RPC_E_CALL_CANCELED
+      case 0x8001011F: // RPC_E_TIMEOUT
+        category = U_ErrorCategory::TIMEOUT;
+        errorMessage = "Call Timed Out";
+        break;
+      case 0x80010108: // RPC_E_DISCONNECTED
+      case 0x80010105: // RPC_E_SERVERFAULT
+      case 0x800706BA: // RPC_S_SERVER_UNAVAILABLE
+      case 0x800706BE: // RPC_S_CALL_FAILED
+      case 0x800706BF: // RPC_S_CALL_FAILED_DNE
+        severity = U_ErrorSeverity::CRITICAL_ERROR;
+        category = U_ErrorCategory::CONNECTION;
+        errorMessage = "Server Connection Lost";
+        break;
+      case 0x80004001: // E_NOTIMPL
+      case 0x80004002: // E_NOINTERFACE
+      case 0xC0040406: // OPC_E_NOTSUPPORTED
+        category = U_ErrorCategory::CONFIGURATION;
+        errorMessage = "Not Supported by Server";
+        break;
+      default:
+        if ( !( hr & 0x80000000u ) )
+        {
+          severity = U_ErrorSeverity::INFO;
+          category = U_ErrorCategory::NONE;
+          errorMessage = "OPC Success Code";
+        }
+        else
+        {
+          category = ( hr & 0xFFFF0000u ) == 0xC0040000u ? U_ErrorCategory::DEVICE : U_ErrorCategory::UNKNOWN;
+          errorMessage = "OPC Error";
+        }
+        break;
+    }
+    OriginalError originalError( hr, 0, "OPC HRESULT", message, "" );
+    return UnifiedError( U_ProtocolType::OPCDA, severity, category, hr & 0xFFFFu, errorMessage, message, originalError, source );
+  }
   UnifiedError createSystemError( U_ErrorSeverity severity, U_ErrorCategory category, const string& errorMessage, const string& detailMessage = "", const string& source = "" )
   {
     uint32_t unifiedCode = ( static_cast<uint32_t>( severity ) * 1000 ) + ( static_cast<uint32_t>( category ) * 100 );
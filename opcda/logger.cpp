@@ -5,7 +5,10 @@
 #include <sstream>
 
 #include "logger.h"
+
+#ifdef _WIN32
 #include "result_formatter.hpp"
+#endif
 
 using namespace std;
 
@@ -69,7 +72,8 @@ string Logger::getCurrentTimeString()
   localtime_s( &timeinfo, &time );
   ss << put_time( &timeinfo, "%Y-%m-%d %H:%M:%S" );
 #else
-  ss << put_time( localtime( &time ), "%Y-%m-%d %H:%M:%S" );
+  localtime_r( &time, &timeinfo );
+  ss << put_time( &timeinfo, "%Y-%m-%d %H:%M:%S" );
 #endif
 
   ss << '.' << setfill( '0' ) << setw( 3 ) << ms.count();
@@ -126,7 +130,16 @@ void Logger::flush()
   {
     vector<string> logs = m_logBuffer;
     m_logBuffer.clear();
+#ifdef _WIN32
     ResultFormatter::getInstance().printLogs( logs );
+#else
+    // the formatter needs the COM headers; the portable core prints the same block itself
+    cout << "logs:" << endl;
+    for ( const auto& log : logs )
+    {
+      cout << "  - " << log << endl;
+    }
+#endif
   }
 
   if ( m_mode == LogMode::FILE && m_logFile.is_open() )
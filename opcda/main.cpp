@@ -2,11 +2,11 @@
 
 int main( int argc, char* argv[] )
 {
-  CLIOptions opts;
-  if ( !parseArguments( argc, argv, opts ) )
+  OPCDA::CLI::OptionParams opts;
+  if ( !OPCDA::CLI::parse_arguments( argc, argv, opts ) )
   {
-    printHelp();
+    OPCDA::CLI::help();
     return 1;
   }
-  return runCLI( opts );
+  return OPCDA::CLI::commander( opts );
 }
@@ -20,6 +20,7 @@ IF NOT EXIST %TIMESTAMP_DIR% MKDIR %TIMESTAMP_DIR%
 REM Process command line arguments
 SET DLL_ONLY=0
 SET REG_ONLY=0
+SET BENCH_ONLY=0
 
 FOR %%A IN (%*) DO (
     IF "%%A"=="-64" SET IS_X64=1
@@ -27,6 +28,7 @@ FOR %%A IN (%*) DO (
     IF "%%A"=="rebuild" GOTO :CLEAN
     IF "%%A"=="dll" SET DLL_ONLY=1
     IF "%%A"=="reg" SET REG_ONLY=1
+    IF "%%A"=="bench" SET BENCH_ONLY=1
 )
 
 REM Set up compilation environment
@@ -34,11 +36,13 @@ IF "%IS_X64%"=="1" (
     CALL "%BUILD_TOOL_DIR%\vcvars64.bat" > nul 2>&1
     SET OUTPUT_NAME="%BUILD_DIR%\%EXEC%.exe"
     SET OPC_LIB="libs\x64\opccomn_x64.lib" "libs\x64\opcda_x64.lib" "libs\x64\shlwapi_x64.lib"
+    SET PI_DEFINE=
     SET SRC_DLL_PATH="C:\Program Files\Common Files\OPC Foundation\Binary"
 ) ELSE (
     CALL "%BUILD_TOOL_DIR%\vcvars32.bat" > nul 2>&1
     SET OUTPUT_NAME="%BUILD_DIR%\%EXEC%-x86.exe"
-    SET OPC_LIB="libs\x86\opccomn_x86.lib" "libs\x86\opcda_x86.lib" "libs\x86\shlwapi_x86.lib"
+    SET OPC_LIB="libs\x86\opccomn_x86.lib" "libs\x86\opcda_x86.lib" "libs\x86\shlwapi_x86.lib" "libs\x86\osi-pi\piapi32.lib"
+    SET PI_DEFINE=/D "OPCDA_WITH_PIAPI"
     SET SRC_DLL_PATH="C:\Program Files (x86)\Common Files\OPC Foundation\Binary"
 )
 
@@ -53,6 +57,11 @@ IF "%REG_ONLY%"=="1" (
     GOTO :END
 )
 
+IF "%BENCH_ONLY%"=="1" (
+    CALL :BUILD_BENCH
+    GOTO :END
+)
+
 ECHO Build started at %TIME% > %LOG_FILE%
 
 REM Compile all cpp files with incremental checking
@@ -101,7 +110,7 @@ FOR %%F IN (*.cpp) DO (
     
     IF "!NEED_COMPILE!"=="1" (
         ECHO Compiling !SRC_FILE!
-        cl /c /EHsc /MD /std:c++17 /W4 /D "_WINDOWS" /D "_CONSOLE" /D "_UNICODE" /D "UNICODE" ^
+        cl /c /EHsc /MD /std:c++17 /W4 /D "_WINDOWS" /D "_CONSOLE" /D "_UNICODE" /D "UNICODE" %PI_DEFINE% ^
             /Zc:wchar_t /I"C:\Program Files (x86)\Common Files\OPC Foundation\Include" ^
             /I"C:\Program Files (x86)\Common Files\OPC Foundation\Include\opcda" /Fo"!OBJ_FILE!" ^
             !SRC_FILE! >> %LOG_FILE% 2>&1
@@ -199,6 +208,43 @@ IF "%1"=="rebuild" (
     GOTO :END
 )
 
+:BUILD_BENCH
+REM Benchmark binary: every source except main.cpp plus bench\*.cpp, always rebuilt
+ECHO Building benchmark...
+SET BENCH_OBJ_DIR=%OBJ_DIR%\bench
+IF NOT EXIST %BENCH_OBJ_DIR% MKDIR %BENCH_OBJ_DIR%
+ECHO Benchmark build started at %TIME% > %LOG_FILE%
+
+SET BENCH_OBJ_FILES=
+FOR %%F IN (*.cpp bench\*.cpp) DO (
+    IF /I NOT "%%~nxF"=="main.cpp" (
+        ECHO Compiling %%F
+        cl /c /EHsc /MD /O2 /std:c++17 /W4 /D "_WINDOWS" /D "_CONSOLE" /D "_UNICODE" /D "UNICODE" %PI_DEFINE% ^
+            /Zc:wchar_t /I"C:\Program Files (x86)\Common Files\OPC Foundation\Include" ^
+            /I"C:\Program Files (x86)\Common Files\OPC Foundation\Include\opcda" /Fo"%BENCH_OBJ_DIR%\%%~nF.obj" ^
+            %%F >> %LOG_FILE% 2>&1
+
+        IF !ERRORLEVEL! NEQ 0 (
+            ECHO Error compiling %%F - see %LOG_FILE% for details
+            TYPE %LOG_FILE%
+            EXIT /B 1
+        )
+        SET BENCH_OBJ_FILES=!BENCH_OBJ_FILES! "%BENCH_OBJ_DIR%\%%~nF.obj"
+    )
+)
+
+link /OUT:"%BUILD_DIR%\opcda-bench.exe" !BENCH_OBJ_FILES! %OPC_LIB% ole32.lib oleaut32.lib uuid.lib /NODEFAULTLIB:LIBCMT >> %LOG_FILE% 2>&1
+
+IF !ERRORLEVEL! NEQ 0 (
+    ECHO Error linking benchmark - see %LOG_FILE% for details
+    TYPE %LOG_FILE%
+    EXIT /B 1
+)
+
+CALL :PROCESS_DLLS
+ECHO Benchmark built: %BUILD_DIR%\opcda-bench.exe
+EXIT /B 0
+
 :PROCESS_DLLS
 ECHO Processing DLL dependencies...
 
@@ -0,0 +1,57 @@
+#!/bin/sh
+# Builds the portable core (backend session, in-memory backend, simulator
+# namespace, capture and formatting) and opcda-bench with GCC or Clang.
+# The COM client and the CLI stay Windows-only, see make.bat.
+#
+#   ./make.sh [clean] [release|debug] [asan|tsan] [check]
+#   CXX=clang++ ./make.sh asan
+
+set -e
+cd "$(dirname "$0")"
+
+CXX=${CXX:-g++}
+BUILD_DIR=build/linux
+MODE=release
+SANITIZE=
+CHECK=0
+
+for ARG in "$@"; do
+    case "$ARG" in
+        clean) rm -rf "$BUILD_DIR"; echo "Clean completed."; exit 0 ;;
+        release|debug) MODE=$ARG ;;
+        asan) SANITIZE="-fsanitize=address,undefined -fno-omit-frame-pointer" ;;
+        tsan) SANITIZE="-fsanitize=thread" ;;
+        check) CHECK=1 ;;
+        *) echo "Unknown argument: $ARG"; exit 1 ;;
+    esac
+done
+
+SOURCES="logger.cpp opcda_backend_memory.cpp opcda_backend_session.cpp opcda_capture.cpp opcda_device_queue.cpp opcda_error_stats.cpp opcda_format.cpp opcda_metrics.cpp opcda_pi_sink.cpp opcda_queue.cpp opcda_sim_namespace.cpp opcda_trace.cpp opcda_utf.cpp opcda_value_cache.cpp"
+
+if [ "$MODE" = "release" ]; then
+    OPT="-O2 -g"
+else
+    OPT="-O0 -g"
+fi
+
+# perf needs frame pointers to walk the stacks of -O2 code
+CXXFLAGS="-std=c++17 -Wall -Wextra -fno-omit-frame-pointer $OPT $SANITIZE $CXXFLAGS"
+
+mkdir -p "$BUILD_DIR/obj"
+
+OBJ_FILES=
+for SRC in $SOURCES bench/opcda_bench.cpp bench/opcda_checks.cpp; do
+    OBJ="$BUILD_DIR/obj/$(basename "${SRC%.cpp}").o"
+    echo "Compiling $SRC"
+    $CXX $CXXFLAGS -c "$SRC" -o "$OBJ"
+    OBJ_FILES="$OBJ_FILES $OBJ"
+done
+
+echo "Linking..."
+$CXX $CXXFLAGS -o "$BUILD_DIR/opcda-bench" $OBJ_FILES -lpthread
+
+echo "Build completed: $BUILD_DIR/opcda-bench"
+
+if [ "$CHECK" = "1" ]; then
+    "$BUILD_DIR/opcda-bench" --check
+fi
@@ -0,0 +1,207 @@
+// opcda_backend.h
+#ifndef OPCDA_BACKEND_H
+#define OPCDA_BACKEND_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <variant>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Result codes keep the HRESULT bit layout and the OPC error values, so the
+ * COM backend hands server errors through unchanged and the rest of the tool
+ * can print them with the usual error helpers.
+ */
+using OPCDA_RESULT = int32_t;
+
+constexpr OPCDA_RESULT OPCDA_OK = 0;
+constexpr OPCDA_RESULT OPCDA_FALSE = 1;
+constexpr OPCDA_RESULT OPCDA_E_NOTIMPL = static_cast<OPCDA_RESULT>( 0x80004001 );
+constexpr OPCDA_RESULT OPCDA_E_NOINTERFACE = static_cast<OPCDA_RESULT>( 0x80004002 );
+constexpr OPCDA_RESULT OPCDA_E_FAIL = static_cast<OPCDA_RESULT>( 0x80004005 );
+constexpr OPCDA_RESULT OPCDA_E_WRONG_THREAD = static_cast<OPCDA_RESULT>( 0x8001010E );
+constexpr OPCDA_RESULT OPCDA_E_INVALIDARG = static_cast<OPCDA_RESULT>( 0x80070057 );
+constexpr OPCDA_RESULT OPCDA_E_INVALIDHANDLE = static_cast<OPCDA_RESULT>( 0xC0040001 );
+constexpr OPCDA_RESULT OPCDA_E_BADTYPE = static_cast<OPCDA_RESULT>( 0xC0040004 );
+constexpr OPCDA_RESULT OPCDA_E_BADRIGHTS = static_cast<OPCDA_RESULT>( 0xC0040006 );
+constexpr OPCDA_RESULT OPCDA_E_UNKNOWNITEMID = static_cast<OPCDA_RESULT>( 0xC0040007 );
+constexpr OPCDA_RESULT OPCDA_E_INVALIDITEMID = static_cast<OPCDA_RESULT>( 0xC0040008 );
+constexpr OPCDA_RESULT OPCDA_E_INVALID_PID = static_cast<OPCDA_RESULT>( 0xC0040203 );
+
+inline bool opcda_failed( OPCDA_RESULT result )
+{
+  return result < 0;
+}
+
+// VARTYPE, OPC access right and quality values, usable without the Windows headers
+constexpr uint16_t OPCDA_TYPE_EMPTY = 0;
+constexpr uint16_t OPCDA_TYPE_I4 = 3;
+constexpr uint16_t OPCDA_TYPE_R4 = 4;
+constexpr uint16_t OPCDA_TYPE_R8 = 5;
+constexpr uint16_t OPCDA_TYPE_BSTR = 8;
+constexpr uint16_t OPCDA_TYPE_BOOL = 11;
+constexpr uint16_t OPCDA_TYPE_ARRAY = 0x2000;
+
+constexpr uint32_t OPCDA_ACCESS_READABLE = 1;
+constexpr uint32_t OPCDA_ACCESS_WRITEABLE = 2;
+
+constexpr uint16_t OPCDA_QUALITY_GOOD = 0xC0;
+
+constexpr uint32_t OPCDA_PROPERTY_DATATYPE = 1;
+constexpr uint32_t OPCDA_PROPERTY_ACCESS_RIGHTS = 5;
+constexpr uint32_t OPCDA_PROPERTY_DESCRIPTION = 101;
+
+constexpr uint32_t DEFAULT_BACKEND_BROWSE_PAGE = 1000;
+
+using OPCDA_VALUE = variant<monostate, bool, int64_t, double, wstring, vector<double>, vector<wstring>>;
+
+enum class BACKEND_SOURCE
+{
+  CACHE,
+  DEVICE
+};
+
+// same values as OPCBROWSEFILTER
+enum class BACKEND_BROWSE_FILTER
+{
+  ALL = 1,
+  BRANCHES = 2,
+  ITEMS = 3
+};
+
+struct BACKEND_BROWSE_QUERY
+{
+  wstring name;  // wildcard; filters every element of browse_elements(), but only the leaves of browse()
+  wstring vendor;
+  uint16_t data_type = OPCDA_TYPE_EMPTY;  // browse() only, IOPCBrowse has no type filter
+  uint32_t page_size = DEFAULT_BACKEND_BROWSE_PAGE;
+  BACKEND_BROWSE_FILTER filter = BACKEND_BROWSE_FILTER::ALL;
+  bool with_properties = false;  // data type and access rights of each item
+};
+
+struct BACKEND_BROWSE_ELEMENT
+{
+  wstring name;
+  wstring item_id;
+  bool is_item = false;
+  bool has_children = false;
+  bool has_properties = false;
+  uint16_t data_type = OPCDA_TYPE_EMPTY;
+  uint32_t access_rights = 0;
+};
+
+/** @brief What a backend can do beyond the group operations every backend has. */
+struct BACKEND_FEATURES
+{
+  bool browse_elements = false;  // DA 3.0 paged browse
+  bool address_space = false;    // browse() lists branches and leaves
+  bool flat = false;             // ... and the space has no branches
+  bool properties = false;
+  bool item_io = false;          // read and write by item ID, without a group
+  bool async_write = false;
+};
+
+struct BACKEND_ITEM
+{
+  wstring item_id;
+  uint32_t handle = 0;
+  uint16_t canonical_type = OPCDA_TYPE_EMPTY;
+  uint32_t access_rights = 0;
+  OPCDA_RESULT error = OPCDA_OK;
+};
+
+struct BACKEND_VALUE
+{
+  uint32_t handle = 0;
+  OPCDA_VALUE value;
+  uint16_t type = OPCDA_TYPE_EMPTY;  // VARTYPE the server delivered, or the one to write as
+  uint16_t quality = 0;
+  int64_t timestamp = 0;  // FILETIME ticks
+  OPCDA_RESULT error = OPCDA_OK;
+};
+
+struct BACKEND_STATUS
+{
+  uint32_t state = 0;
+  uint32_t group_count = 0;
+  int64_t start_time = 0;
+  int64_t current_time = 0;
+  int64_t last_update_time = 0;
+  uint16_t major_version = 0;
+  uint16_t minor_version = 0;
+  uint16_t build_number = 0;
+  wstring vendor;
+};
+
+struct BACKEND_PROPERTY
+{
+  uint32_t id = 0;
+  OPCDA_VALUE value;
+  OPCDA_RESULT error = OPCDA_OK;
+};
+
+struct BACKEND_PROPERTIES
+{
+  wstring item_id;
+  vector<BACKEND_PROPERTY> properties;  // one per requested ID, in request order
+  OPCDA_RESULT error = OPCDA_OK;
+};
+
+/** @brief Outcome of write_async, by the client handles the items were added with. */
+using BACKEND_WRITE_COMPLETE = function<void( uint32_t transaction, OPCDA_RESULT master_error, const vector<uint32_t>& client_handles, const vector<OPCDA_RESULT>& errors )>;
+
+/**
+ * @brief The server operations the client core needs, without COM types.
+ *
+ * One backend is one server connection with one group. Handles are the
+ * backend's own and only valid for it; client handles are the caller's and
+ * come back with async write completions. Per-item results follow the input
+ * order and always have the input's size when the call itself succeeds.
+ * Operations features() does not list fail with OPCDA_E_NOINTERFACE.
+ *
+ * BackendSession is the only caller, for OpcDaClient over ComBackend as well
+ * as for the bench and the checks over MemoryBackend.
+ */
+class OpcDaBackend
+{
+public:
+  virtual ~OpcDaBackend()
+  {
+  }
+
+  virtual BACKEND_FEATURES features() const = 0;
+  virtual OPCDA_RESULT status( BACKEND_STATUS& status ) = 0;
+
+  /**
+   * @brief Children of a branch; path is the dotted browse path, empty for the root.
+   *        A flat space lists every item ID under the root; query filters the leaves.
+   */
+  virtual OPCDA_RESULT browse( const wstring& path, const BACKEND_BROWSE_QUERY& query, vector<wstring>& branches, vector<wstring>& leaves ) = 0;
+  /**
+   * @brief Appends one page of the elements below item_id, the root when empty.
+   *        continuation is empty on the first call and again after the last page.
+   */
+  virtual OPCDA_RESULT browse_elements( const wstring& item_id, const BACKEND_BROWSE_QUERY& query, wstring& continuation, vector<BACKEND_BROWSE_ELEMENT>& elements ) = 0;
+  virtual OPCDA_RESULT item_id( const wstring& browse_path, wstring& item_id ) = 0;
+  virtual OPCDA_RESULT properties( const vector<wstring>& item_ids, const vector<uint32_t>& property_ids, vector<BACKEND_PROPERTIES>& properties ) = 0;
+
+  virtual OPCDA_RESULT validate( const vector<wstring>& item_ids, vector<BACKEND_ITEM>& items ) = 0;
+  virtual OPCDA_RESULT add( const vector<wstring>& item_ids, const vector<uint32_t>& client_handles, vector<BACKEND_ITEM>& items ) = 0;
+  virtual OPCDA_RESULT remove( const vector<uint32_t>& handles, vector<OPCDA_RESULT>& errors ) = 0;
+
+  virtual OPCDA_RESULT read( const vector<uint32_t>& handles, BACKEND_SOURCE source, vector<BACKEND_VALUE>& values ) = 0;
+  /** @brief Writes each value to its handle, converted to its type first unless that is OPCDA_TYPE_EMPTY. */
+  virtual OPCDA_RESULT write( const vector<BACKEND_VALUE>& values, vector<OPCDA_RESULT>& errors ) = 0;
+  /** @brief write() that returns once the server queued it; the outcome goes to the write-complete callback. */
+  virtual OPCDA_RESULT write_async( const vector<BACKEND_VALUE>& values, uint32_t transaction, vector<OPCDA_RESULT>& errors ) = 0;
+  virtual void set_write_complete( const BACKEND_WRITE_COMPLETE& on_complete ) = 0;
+
+  /** @brief Item IO: max_age_ms 0 reads the device, 0xFFFFFFFF any cached value. */
+  virtual OPCDA_RESULT read_ids( const vector<wstring>& item_ids, uint32_t max_age_ms, vector<BACKEND_VALUE>& values ) = 0;
+  virtual OPCDA_RESULT write_ids( const vector<wstring>& item_ids, const vector<BACKEND_VALUE>& values, vector<OPCDA_RESULT>& errors ) = 0;
+};
+
+#endif
@@ -0,0 +1,1558 @@
+// opcda_backend_com.cpp
+#define NOMINMAX
+#include <algorithm>
+#include <functional>
+#include <opcerror.h>
+#include <windows.h>
+
+#include "logger.h"
+#include "opcda_backend_com.h"
+#include "opcda_client.h"
+#include "opcda_metrics.h"
+#include "opcda_utils.h"
+
+using namespace std;
+
+namespace OPCDA::UTILS
+{
+  int64_t filetime_to_ticks( const FILETIME& ft )
+  {
+    ULARGE_INTEGER uli;
+    uli.LowPart = ft.dwLowDateTime;
+    uli.HighPart = ft.dwHighDateTime;
+    return static_cast<int64_t>( uli.QuadPart );
+  }
+
+  FILETIME ticks_to_filetime( int64_t ticks )
+  {
+    ULARGE_INTEGER uli;
+    uli.QuadPart = static_cast<ULONGLONG>( ticks );
+
+    FILETIME ft;
+    ft.dwLowDateTime = uli.LowPart;
+    ft.dwHighDateTime = uli.HighPart;
+    return ft;
+  }
+
+  static HRESULT string_to_variant( const wstring& text, VARIANT& variant )
+  {
+    V_VT( &variant ) = VT_BSTR;
+    V_BSTR( &variant ) = SysAllocStringLen( text.data(), static_cast<UINT>( text.size() ) );
+    if ( !V_BSTR( &variant ) )
+    {
+      V_VT( &variant ) = VT_EMPTY;
+      return E_OUTOFMEMORY;
+    }
+    return S_OK;
+  }
+
+  // element by element through VariantChangeTypeEx, so any element type the server declares works
+  static HRESULT elements_to_variant( size_t count, VARTYPE element_type, const function<HRESULT( size_t, VARIANT& )>& element, VARIANT& variant )
+  {
+    SAFEARRAY* array = SafeArrayCreateVector( element_type, 0, static_cast<ULONG>( count ) );
+    if ( !array )
+    {
+      return E_OUTOFMEMORY;
+    }
+
+    HRESULT hr = S_OK;
+
+    for ( LONG i = 0; i < static_cast<LONG>( count ) && SUCCEEDED( hr ); ++i )
+    {
+      VARIANT source;
+      VARIANT converted;
+      VariantInit( &source );
+      VariantInit( &converted );
+
+      hr = element( static_cast<size_t>( i ), source );
+      if ( SUCCEEDED( hr ) )
+      {
+        hr = element_type == VT_VARIANT ? VariantCopy( &converted, &source ) : VariantChangeTypeEx( &converted, &source, LOCALE_INVARIANT, 0, element_type );
+      }
+
+      if ( SUCCEEDED( hr ) )
+      {
+        // SafeArrayPutElement takes the VARIANT itself, a BSTR, or a pointer to the scalar
+        void* data = element_type == VT_VARIANT   ? static_cast<void*>( &converted )
+                     : element_type == VT_BSTR    ? static_cast<void*>( V_BSTR( &converted ) )
+                     : element_type == VT_DECIMAL ? static_cast<void*>( &V_DECIMAL( &converted ) )
+                                                  : static_cast<void*>( &V_UI1( &converted ) );
+        hr = SafeArrayPutElement( array, &i, data );
+      }
+
+      VariantClear( &source );
+      VariantClear( &converted );
+    }
+
+    if ( FAILED( hr ) )
+    {
+      SafeArrayDestroy( array );
+      return hr;
+    }
+
+    V_VT( &variant ) = VT_ARRAY | element_type;
+    V_ARRAY( &variant ) = array;
+    return S_OK;
+  }
+
+  HRESULT value_to_variant( const OPCDA_VALUE& value, VARTYPE type, VARIANT& variant )
+  {
+    VariantInit( &variant );
+    VARTYPE element_type = ( type & VT_ARRAY ) ? static_cast<VARTYPE>( type & VT_TYPEMASK ) : VT_EMPTY;
+
+    if ( holds_alternative<bool>( value ) )
+    {
+      V_VT( &variant ) = VT_BOOL;
+      V_BOOL( &variant ) = get<bool>( value ) ? VARIANT_TRUE : VARIANT_FALSE;
+    }
+    else if ( holds_alternative<int64_t>( value ) )
+    {
+      V_VT( &variant ) = VT_I8;
+      V_I8( &variant ) = get<int64_t>( value );
+    }
+    else if ( holds_alternative<double>( value ) )
+    {
+      V_VT( &variant ) = VT_R8;
+      V_R8( &variant ) = get<double>( value );
+    }
+    else if ( holds_alternative<wstring>( value ) )
+    {
+      HRESULT hr = string_to_variant( get<wstring>( value ), variant );
+      if ( FAILED( hr ) )
+      {
+        return hr;
+      }
+    }
+    else if ( holds_alternative<vector<double>>( value ) )
+    {
+      const vector<double>& data = get<vector<double>>( value );
+
+      if ( element_type != VT_EMPTY && element_type != VT_R8 )
+      {
+        return elements_to_variant(
+          data.size(), element_type,
+          [&]( size_t i, VARIANT& source )
+          {
+            V_VT( &source ) = VT_R8;
+            V_R8( &source ) = data[i];
+            return S_OK;
+          },
+          variant );
+      }
+
+      SAFEARRAY* array = SafeArrayCreateVector( VT_R8, 0, static_cast<ULONG>( data.size() ) );
+      double* target = nullptr;
+
+      if ( !array || FAILED( SafeArrayAccessData( array, reinterpret_cast<void**>( &target ) ) ) )
+      {
+        if ( array )
+        {
+          SafeArrayDestroy( array );
+        }
+        return E_OUTOFMEMORY;
+      }
+
+      copy( data.begin(), data.end(), target );
+      SafeArrayUnaccessData( array );
+
+      V_VT( &variant ) = VT_ARRAY | VT_R8;
+      V_ARRAY( &variant ) = array;
+    }
+    else if ( holds_alternative<vector<wstring>>( value ) )
+    {
+      const vector<wstring>& data = get<vector<wstring>>( value );
+      return elements_to_variant( data.size(), element_type != VT_EMPTY ? element_type : static_cast<VARTYPE>( VT_BSTR ), [&]( size_t i, VARIANT& source ) { return string_to_variant( data[i], source ); }, variant );
+    }
+
+    // arrays already have their element type; a scalar goes to the requested type
+    if ( type == VT_EMPTY || type == V_VT( &variant ) || ( type & VT_ARRAY ) || ( V_VT( &variant ) & VT_ARRAY ) || V_VT( &variant ) == VT_EMPTY )
+    {
+      return S_OK;
+    }
+
+    HRESULT hr = VariantChangeTypeEx( &variant, &variant, LOCALE_INVARIANT, 0, type );
+    if ( FAILED( hr ) )
+    {
+      VariantClear( &variant );
+    }
+    return hr;
+  }
+
+  static bool array_to_strings( const VARIANT& variant, vector<wstring>& data )
+  {
+    SAFEARRAY* array = V_ARRAY( &variant );
+    if ( !array )
+    {
+      return false;
+    }
+
+    // every dimension flattened in memory order
+    size_t count = 1;
+    for ( UINT dim = 1; dim <= SafeArrayGetDim( array ); ++dim )
+    {
+      LONG lower = 0;
+      LONG upper = -1;
+      SafeArrayGetLBound( array, dim, &lower );
+      SafeArrayGetUBound( array, dim, &upper );
+      count *= static_cast<size_t>( max<LONG>( upper - lower + 1, 0 ) );
+    }
+
+    BSTR* strings = nullptr;
+    if ( FAILED( SafeArrayAccessData( array, reinterpret_cast<void**>( &strings ) ) ) )
+    {
+      return false;
+    }
+
+    data.clear();
+    data.reserve( count );
+    for ( size_t i = 0; i < count; ++i )
+    {
+      data.emplace_back( strings[i] ? strings[i] : L"", strings[i] ? SysStringLen( strings[i] ) : 0 );
+    }
+
+    SafeArrayUnaccessData( array );
+    return true;
+  }
+
+  HRESULT variant_to_value( const VARIANT& variant, OPCDA_VALUE& value )
+  {
+    VARTYPE type = V_VT( &variant );
+
+    if ( type == ( VT_ARRAY | VT_BSTR ) )
+    {
+      vector<wstring> data;
+      if ( !array_to_strings( variant, data ) )
+      {
+        return DISP_E_TYPEMISMATCH;
+      }
+      value = move( data );
+      return S_OK;
+    }
+
+    if ( type & VT_ARRAY )
+    {
+      vector<double> data;
+      if ( !array_to_doubles( variant, data ) )
+      {
+        return DISP_E_TYPEMISMATCH;
+      }
+      value = move( data );
+      return S_OK;
+    }
+
+    switch ( type )
+    {
+      case VT_EMPTY:
+      case VT_NULL:
+        value = monostate();
+        return S_OK;
+
+      case VT_BOOL:
+        value = V_BOOL( &variant ) != VARIANT_FALSE;
+        return S_OK;
+
+      case VT_BSTR:
+        value = wstring( V_BSTR( &variant ) ? V_BSTR( &variant ) : L"", V_BSTR( &variant ) ? SysStringLen( V_BSTR( &variant ) ) : 0 );
+        return S_OK;
+
+      case VT_R4:
+        value = static_cast<double>( V_R4( &variant ) );
+        return S_OK;
+
+      case VT_R8:
+      case VT_DATE:
+        value = V_R8( &variant );
+        return S_OK;
+
+      default:
+        break;
+    }
+
+    VARIANT converted;
+    VariantInit( &converted );
+
+    // currency and decimal keep their fraction as a double
+    HRESULT hr = type == VT_CY || type == VT_DECIMAL ? DISP_E_TYPEMISMATCH : VariantChangeType( &converted, const_cast<VARIANT*>( &variant ), 0, VT_I8 );
+    if ( SUCCEEDED( hr ) )
+    {
+      value = static_cast<int64_t>( V_I8( &converted ) );
+    }
+    else if ( SUCCEEDED( hr = VariantChangeType( &converted, const_cast<VARIANT*>( &variant ), 0, VT_R8 ) ) )
+    {
+      value = V_R8( &converted );
+    }
+
+    VariantClear( &converted );
+    return hr;
+  }
+
+} // namespace OPCDA::UTILS
+
+/**
+ * @brief IOPCDataCallback sink for the group; only write completions are used.
+ *
+ * The server may still hold a reference after the backend is gone, so the
+ * backend detaches itself before it releases the sink.
+ */
+class WriteCompleteSink : public IOPCDataCallback
+{
+public:
+  using Handler = function<void( DWORD, HRESULT, DWORD, const OPCHANDLE*, const HRESULT* )>;
+
+  explicit WriteCompleteSink( const Handler& handler ) : m_handler( handler )
+  {
+  }
+
+  void detach()
+  {
+    lock_guard<mutex> lock( m_lock );
+    m_handler = nullptr;
+  }
+
+  STDMETHODIMP QueryInterface( REFIID riid, void** ppv ) override
+  {
+    if ( !ppv )
+    {
+      return E_POINTER;
+    }
+
+    if ( riid == IID_IUnknown || riid == IID_IOPCDataCallback )
+    {
+      *ppv = static_cast<IOPCDataCallback*>( this );
+      AddRef();
+      return S_OK;
+    }
+
+    *ppv = nullptr;
+    return E_NOINTERFACE;
+  }
+
+  STDMETHODIMP_( ULONG ) AddRef() override
+  {
+    return InterlockedIncrement( &m_refs );
+  }
+
+  STDMETHODIMP_( ULONG ) Release() override
+  {
+    ULONG refs = InterlockedDecrement( &m_refs );
+    if ( refs == 0 )
+    {
+      delete this;
+    }
+    return refs;
+  }
+
+  STDMETHODIMP OnDataChange( DWORD, OPCHANDLE, HRESULT, HRESULT, DWORD, OPCHANDLE*, VARIANT*, WORD*, FILETIME*, HRESULT* ) override
+  {
+    return S_OK;
+  }
+
+  STDMETHODIMP OnReadComplete( DWORD, OPCHANDLE, HRESULT, HRESULT, DWORD, OPCHANDLE*, VARIANT*, WORD*, FILETIME*, HRESULT* ) override
+  {
+    return S_OK;
+  }
+
+  STDMETHODIMP OnWriteComplete( DWORD transaction, OPCHANDLE, HRESULT master_error, DWORD count, OPCHANDLE* client_handles, HRESULT* errors ) override
+  {
+    lock_guard<mutex> lock( m_lock );
+    if ( m_handler )
+    {
+      m_handler( transaction, master_error, count, client_handles, errors );
+    }
+    return S_OK;
+  }
+
+  STDMETHODIMP OnCancelComplete( DWORD, OPCHANDLE ) override
+  {
+    return S_OK;
+  }
+
+private:
+  virtual ~WriteCompleteSink()
+  {
+  }
+
+  volatile LONG m_refs = 0;
+  mutex m_lock;
+  Handler m_handler;
+};
+
+static CallMetrics s_add_group_call( "AddGroup" );
+static CallMetrics s_remove_group_call( "RemoveGroup" );
+static CallMetrics s_get_status_call( "GetStatus" );
+static CallMetrics s_add_items_call( "AddItems" );
+static CallMetrics s_remove_items_call( "RemoveItems" );
+static CallMetrics s_validate_items_call( "ValidateItems" );
+static CallMetrics s_change_browse_position_call( "ChangeBrowsePosition" );
+static CallMetrics s_browse_item_ids_call( "BrowseOPCItemIDs" );
+static CallMetrics s_get_item_id_call( "GetItemID" );
+static CallMetrics s_browse_call( "Browse" );
+static CallMetrics s_query_properties_call( "QueryAvailableProperties" );
+static CallMetrics s_lookup_item_ids_call( "LookupItemIDs" );
+static CallMetrics s_get_properties_call( "GetProperties" );
+static CallMetrics s_get_item_properties_call( "GetItemProperties" );
+static CallMetrics s_sync_read_call( "Read" );
+static CallMetrics s_device_read_call( "Read.Device" );
+static CallMetrics s_item_io_read_call( "ItemIO.Read" );
+static CallMetrics s_sync_write_call( "Write" );
+static CallMetrics s_async_write_call( "AsyncWrite" );
+static CallMetrics s_write_vqt_call( "WriteVQT" );
+
+// interfaces of the opening apartment, or a GIT proxy for callers outside it
+template <typename T>
+static HRESULT apartment_interface( bool home, const CComPtr<T>& direct, const CComGITPtr<T>& global, CComPtr<T>& local )
+{
+  if ( home )
+  {
+    local = direct;
+    return local ? S_OK : E_POINTER;
+  }
+
+  return global.CopyTo( &local );
+}
+
+// the server allocates every string and array it returns
+static void free_item_properties( OPCITEMPROPERTIES& props )
+{
+  for ( DWORD i = 0; i < props.dwNumProperties && props.pItemProperties; ++i )
+  {
+    OPCITEMPROPERTY& prop = props.pItemProperties[i];
+    CoTaskMemFree( prop.szItemID );
+    CoTaskMemFree( prop.szDescription );
+    VariantClear( &prop.vValue );
+  }
+
+  CoTaskMemFree( props.pItemProperties );
+  props.pItemProperties = nullptr;
+  props.dwNumProperties = 0;
+}
+
+static void take_browse_element( OPCBROWSEELEMENT& src, BACKEND_BROWSE_ELEMENT& dst )
+{
+  dst.name = src.szName ? src.szName : L"";
+  dst.item_id = src.szItemID ? src.szItemID : L"";
+  dst.is_item = ( src.dwFlagValue & OPC_BROWSE_ISITEM ) != 0;
+  dst.has_children = ( src.dwFlagValue & OPC_BROWSE_HASCHILDREN ) != 0;
+
+  CoTaskMemFree( src.szName );
+  CoTaskMemFree( src.szItemID );
+
+  OPCITEMPROPERTIES& props = src.ItemProperties;
+  dst.has_properties = SUCCEEDED( props.hrErrorID ) && props.dwNumProperties > 0;
+
+  for ( DWORD i = 0; i < props.dwNumProperties && props.pItemProperties; ++i )
+  {
+    OPCITEMPROPERTY& prop = props.pItemProperties[i];
+
+    if ( FAILED( prop.hrErrorID ) )
+    {
+      dst.has_properties = false;
+      continue;
+    }
+
+    VARIANT converted;
+    VariantInit( &converted );
+
+    if ( SUCCEEDED( VariantChangeType( &converted, &prop.vValue, 0, VT_I4 ) ) )
+    {
+      if ( prop.dwPropertyID == OPC_PROPERTY_DATATYPE )
+      {
+        dst.data_type = static_cast<uint16_t>( V_I4( &converted ) );
+      }
+      else if ( prop.dwPropertyID == OPC_PROPERTY_ACCESS_RIGHTS )
+      {
+        dst.access_rights = static_cast<uint32_t>( V_I4( &converted ) );
+      }
+    }
+
+    VariantClear( &converted );
+  }
+
+  free_item_properties( props );
+}
+
+ComBackend::ComBackend()
+{
+}
+
+ComBackend::~ComBackend()
+{
+  close();
+}
+
+HRESULT ComBackend::open( IOPCServer* server, OPCDA_APARTMENT apartment, const wstring& group_name )
+{
+  close();
+
+  if ( !server )
+  {
+    return E_POINTER;
+  }
+
+  m_apartment = apartment;
+  m_owner_thread = GetCurrentThreadId();
+  m_group_name = group_name;
+  m_server = server;
+
+  HRESULT hr = m_git_server.Attach( m_server );
+  if ( FAILED( hr ) )
+  {
+    Logger::instance().logWarning( "[backend] GIT IOPCServer: " + OPCDA::UTILS::to_str( hr ) );
+  }
+
+  // every interface but IOPCServer is optional, features() reports which ones the server has
+  if ( SUCCEEDED( hr = m_server->QueryInterface( IID_IOPCBrowse, reinterpret_cast<void**>( &m_browse ) ) ) )
+  {
+    m_git_browse.Attach( m_browse );
+  }
+  else
+  {
+    Logger::instance().logDebug( "[backend] IOPCBrowse not available: " + OPCDA::UTILS::to_str( hr ) );
+  }
+
+  if ( SUCCEEDED( hr = m_server->QueryInterface( IID_IOPCBrowseServerAddressSpace, reinterpret_cast<void**>( &m_browser ) ) ) )
+  {
+    if ( FAILED( m_browser->QueryOrganization( &m_organization ) ) )
+    {
+      m_organization = OPC_NS_HIERARCHIAL;
+    }
+  }
+  else
+  {
+    Logger::instance().logDebug( "[backend] IOPCBrowseServerAddressSpace not available: " + OPCDA::UTILS::to_str( hr ) );
+  }
+
+  if ( SUCCEEDED( hr = m_server->QueryInterface( IID_IOPCItemProperties, reinterpret_cast<void**>( &m_item_properties ) ) ) )
+  {
+    m_git_item_properties.Attach( m_item_properties );
+  }
+  else
+  {
+    Logger::instance().logDebug( "[backend] IOPCItemProperties not available: " + OPCDA::UTILS::to_str( hr ) );
+  }
+
+  if ( SUCCEEDED( hr = m_server->QueryInterface( IID_IOPCItemIO, reinterpret_cast<void**>( &m_item_io ) ) ) )
+  {
+    m_git_item_io.Attach( m_item_io );
+  }
+  else
+  {
+    Logger::instance().logDebug( "[backend] IOPCItemIO not available: " + OPCDA::UTILS::to_str( hr ) );
+  }
+
+  return S_OK;
+}
+
+void ComBackend::close( bool remove_group )
+{
+  release_group( remove_group );
+
+  lock_guard<mutex> lock( m_browse_lock );
+
+  m_git_item_io.Revoke();
+  m_git_item_properties.Revoke();
+  m_git_browse.Revoke();
+  m_git_server.Revoke();
+
+  m_item_io.Release();
+  m_item_properties.Release();
+  m_browser.Release();
+  m_browse.Release();
+  m_server.Release();
+
+  m_organization = OPC_NS_HIERARCHIAL;
+  m_at_root = true;
+}
+
+bool ComBackend::is_open() const
+{
+  return m_server.p != nullptr;
+}
+
+bool ComBackend::is_home_thread() const
+{
+  if ( m_apartment == OPCDA_APARTMENT::STA )
+  {
+    return GetCurrentThreadId() == m_owner_thread;
+  }
+
+  APTTYPE type;
+  APTTYPEQUALIFIER qualifier;
+  return SUCCEEDED( CoGetApartmentType( &type, &qualifier ) ) && type == APTTYPE_MTA;
+}
+
+HRESULT ComBackend::ensure_group()
+{
+  lock_guard<mutex> lock( m_group_lock );
+
+  if ( m_item_mgt && m_sync_io )
+  {
+    return S_OK;
+  }
+
+  if ( !m_server )
+  {
+    return E_POINTER;
+  }
+
+  if ( !is_home_thread() )
+  {
+    Logger::instance().logDebug( "[backend] The group can only be created from the opening apartment" );
+    return OPCDA_E_WRONG_THREAD;
+  }
+
+  DWORD revised_rate = 0;
+  OPCHANDLE handle = 0;
+  CComPtr<IUnknown> group;
+
+  // active, so cache reads see the server's current values
+  HRESULT hr = s_add_group_call.measure( [&]() { return m_server->AddGroup( m_group_name.c_str(), TRUE, 1000, 1, nullptr, nullptr, LOCALE_SYSTEM_DEFAULT, &handle, &revised_rate, IID_IUnknown, &group ); } );
+
+  if ( FAILED( hr ) || !group )
+  {
+    Logger::instance().logError( "[backend] AddGroup failed: " + OPCDA::UTILS::to_str( hr ) );
+    return FAILED( hr ) ? hr : E_POINTER;
+  }
+
+  m_group = group;
+  m_group_handle = handle;
+
+  if ( FAILED( hr = m_group->QueryInterface( IID_IOPCItemMgt, reinterpret_cast<void**>( &m_item_mgt ) ) ) || FAILED( hr = m_group->QueryInterface( IID_IOPCSyncIO, reinterpret_cast<void**>( &m_sync_io ) ) ) )
+  {
+    Logger::instance().logError( "[backend] Group interfaces not available: " + OPCDA::UTILS::to_str( hr ) );
+
+    m_sync_io.Release();
+    m_item_mgt.Release();
+    m_group.Release();
+    s_remove_group_call.measure( [&]() { return m_server->RemoveGroup( m_group_handle, FALSE ); } );
+    m_group_handle = 0;
+    return hr;
+  }
+
+  if ( FAILED( hr = m_git_item_mgt.Attach( m_item_mgt ) ) || FAILED( hr = m_git_sync_io.Attach( m_sync_io ) ) )
+  {
+    Logger::instance().logWarning( "[backend] GIT group interfaces: " + OPCDA::UTILS::to_str( hr ) );
+  }
+
+  return S_OK;
+}
+
+HRESULT ComBackend::group_interfaces( CComPtr<IOPCItemMgt>& item_mgt, CComPtr<IOPCSyncIO>& sync_io, bool create )
+{
+  if ( create )
+  {
+    HRESULT hr = ensure_group();
+    if ( FAILED( hr ) )
+    {
+      return hr;
+    }
+  }
+
+  bool home = is_home_thread();
+  lock_guard<mutex> lock( m_group_lock );
+
+  if ( !m_item_mgt )
+  {
+    return E_POINTER;
+  }
+
+  HRESULT hr = apartment_interface( home, m_item_mgt, m_git_item_mgt, item_mgt );
+  return SUCCEEDED( hr ) ? apartment_interface( home, m_sync_io, m_git_sync_io, sync_io ) : hr;
+}
+
+HRESULT ComBackend::async_interface( CComPtr<IOPCAsyncIO2>& async_io )
+{
+  // completions come back through a sink advised in the opening apartment
+  if ( !is_home_thread() )
+  {
+    return OPCDA_E_WRONG_THREAD;
+  }
+
+  HRESULT hr = ensure_group();
+  if ( FAILED( hr ) )
+  {
+    return hr;
+  }
+
+  lock_guard<mutex> lock( m_group_lock );
+
+  if ( m_async_io )
+  {
+    async_io = m_async_io;
+    return S_OK;
+  }
+
+  if ( !m_group )
+  {
+    return E_POINTER;
+  }
+
+  if ( FAILED( hr = m_group->QueryInterface( IID_IOPCAsyncIO2, reinterpret_cast<void**>( &m_async_io ) ) ) )
+  {
+    Logger::instance().logWarning( "[backend] IOPCAsyncIO2 not available: " + OPCDA::UTILS::to_str( hr ) );
+    return hr;
+  }
+
+  CComPtr<IConnectionPointContainer> container;
+  CComPtr<IConnectionPoint> point;
+
+  if ( FAILED( hr = m_group->QueryInterface( IID_IConnectionPointContainer, reinterpret_cast<void**>( &container ) ) ) || FAILED( hr = container->FindConnectionPoint( IID_IOPCDataCallback, &point ) ) )
+  {
+    Logger::instance().logWarning( "[backend] IOPCDataCallback connection point: " + OPCDA::UTILS::to_str( hr ) );
+    m_async_io.Release();
+    return hr;
+  }
+
+  m_write_sink = new WriteCompleteSink( [this]( DWORD transaction, HRESULT master_error, DWORD count, const OPCHANDLE* handles, const HRESULT* errors ) { on_write_complete( transaction, master_error, count, handles, errors ); } );
+
+  if ( FAILED( hr = point->Advise( m_write_sink, &m_write_sink_cookie ) ) )
+  {
+    Logger::instance().logWarning( "[backend] IConnectionPoint::Advise: " + OPCDA::UTILS::to_str( hr ) );
+    m_write_sink->detach();
+    m_write_sink.Release();
+    m_async_io.Release();
+    m_write_sink_cookie = 0;
+    return hr;
+  }
+
+  async_io = m_async_io;
+  return S_OK;
+}
+
+void ComBackend::release_group( bool remove )
+{
+  lock_guard<mutex> lock( m_group_lock );
+
+  m_git_sync_io.Revoke();
+  m_git_item_mgt.Revoke();
+
+  if ( m_write_sink )
+  {
+    // a dead server cannot be asked to unadvise, its proxy is dropped below
+    CComPtr<IConnectionPointContainer> container;
+    CComPtr<IConnectionPoint> point;
+
+    if ( remove && m_write_sink_cookie != 0 && m_group && SUCCEEDED( m_group->QueryInterface( IID_IConnectionPointContainer, reinterpret_cast<void**>( &container ) ) ) && SUCCEEDED( container->FindConnectionPoint( IID_IOPCDataCallback, &point ) ) )
+    {
+      point->Unadvise( m_write_sink_cookie );
+    }
+
+    m_write_sink->detach();
+    m_write_sink.Release();
+    m_write_sink_cookie = 0;
+  }
+
+  m_async_io.Release();
+  m_sync_io.Release();
+  m_item_mgt.Release();
+  m_group.Release();
+
+  if ( remove && m_server && m_group_handle != 0 )
+  {
+    HRESULT hr = s_remove_group_call.measure( [&]() { return m_server->RemoveGroup( m_group_handle, FALSE ); } );
+    if ( FAILED( hr ) )
+    {
+      Logger::instance().logWarning( "[backend] RemoveGroup failed: " + OPCDA::UTILS::to_str( hr ) );
+    }
+  }
+
+  m_group_handle = 0;
+}
+
+BACKEND_FEATURES ComBackend::features() const
+{
+  BACKEND_FEATURES features;
+  features.browse_elements = m_browse.p != nullptr;
+  features.address_space = m_browser.p != nullptr;
+  features.flat = m_browser.p != nullptr && m_organization == OPC_NS_FLAT;
+  features.properties = m_browse.p != nullptr || m_item_properties.p != nullptr;
+  features.item_io = m_item_io.p != nullptr;
+  features.async_write = m_server.p != nullptr;
+  return features;
+}
+
+OPCDA_RESULT ComBackend::status( BACKEND_STATUS& status )
+{
+  CComPtr<IOPCServer> server;
+  HRESULT hr = apartment_interface( is_home_thread(), m_server, m_git_server, server );
+  if ( FAILED( hr ) )
+  {
+    return hr;
+  }
+
+  OPCSERVERSTATUS* server_status = nullptr;
+  hr = s_get_status_call.measure( [&]() { return server->GetStatus( &server_status ); } );
+
+  if ( FAILED( hr ) || !server_status )
+  {
+    return FAILED( hr ) ? hr : OPCDA_E_FAIL;
+  }
+
+  status.state = server_status->dwServerState;
+  status.group_count = server_status->dwGroupCount;
+  status.start_time = OPCDA::UTILS::filetime_to_ticks( server_status->ftStartTime );
+  status.current_time = OPCDA::UTILS::filetime_to_ticks( server_status->ftCurrentTime );
+  status.last_update_time = OPCDA::UTILS::filetime_to_ticks( server_status->ftLastUpdateTime );
+  status.major_version = server_status->wMajorVersion;
+  status.minor_version = server_status->wMinorVersion;
+  status.build_number = server_status->wBuildNumber;
+  status.vendor = server_status->szVendorInfo ? server_status->szVendorInfo : L"";
+
+  CoTaskMemFree( server_status->szVendorInfo );
+  CoTaskMemFree( server_status );
+  return OPCDA_OK;
+}
+
+OPCDA_RESULT ComBackend::browse_names( OPCBROWSETYPE type, const wstring& name, VARTYPE data_type, vector<wstring>& names )
+{
+  CComPtr<IEnumString> enumerator;
+  HRESULT hr = s_browse_item_ids_call.measure( [&]() { return m_browser->BrowseOPCItemIDs( type, name.c_str(), data_type, 0, &enumerator ); } );
+
+  // S_FALSE without an enumerator is an empty level
+  if ( FAILED( hr ) || !enumerator )
+  {
+    return FAILED( hr ) ? hr : OPCDA_OK;
+  }
+
+  // fetch in blocks so a large level costs a few calls, not one per name
+  LPOLESTR batch[256];
+  ULONG fetched = 0;
+
+  do
+  {
+    fetched = 0;
+    hr = enumerator->Next( static_cast<ULONG>( size( batch ) ), batch, &fetched );
+
+    for ( ULONG i = 0; i < fetched; ++i )
+    {
+      if ( batch[i] && *batch[i] )
+      {
+        names.emplace_back( batch[i] );
+      }
+      CoTaskMemFree( batch[i] );
+    }
+  } while ( hr == S_OK && fetched > 0 );
+
+  return FAILED( hr ) ? hr : OPCDA_OK;
+}
+
+OPCDA_RESULT ComBackend::browse_properties( const wstring& item_id, vector<wstring>& leaves )
+{
+  CComPtr<IOPCItemProperties> item_properties;
+  HRESULT hr = apartment_interface( is_home_thread(), m_item_properties, m_git_item_properties, item_properties );
+  if ( FAILED( hr ) )
+  {
+    return hr;
+  }
+
+  DWORD count = 0;
+  DWORD* property_ids = nullptr;
+  LPWSTR* descriptions = nullptr;
+  VARTYPE* data_types = nullptr;
+
+  hr = s_query_properties_call.measure( [&]() { return item_properties->QueryAvailableProperties( const_cast<LPWSTR>( item_id.c_str() ), &count, &property_ids, &descriptions, &data_types ); } );
+
+  if ( FAILED( hr ) )
+  {
+    return hr;
+  }
+
+  // properties that are items of their own (limits, engineering units, ...) are the browsable children
+  LPWSTR* property_items = nullptr;
+  HRESULT* errors = nullptr;
+
+  if ( count > 0 )
+  {
+    hr = s_lookup_item_ids_call.measure( [&]() { return item_properties->LookupItemIDs( const_cast<LPWSTR>( item_id.c_str() ), count, property_ids, &property_items, &errors ); } );
+
+    if ( SUCCEEDED( hr ) && property_items && errors )
+    {
+      for ( DWORD i = 0; i < count; ++i )
+      {
+        if ( SUCCEEDED( errors[i] ) && property_items[i] && *property_items[i] )
+        {
+          leaves.push_back( property_items[i] );
+        }
+        CoTaskMemFree( property_items[i] );
+      }
+    }
+  }
+
+  for ( DWORD i = 0; i < count && descriptions; ++i )
+  {
+    CoTaskMemFree( descriptions[i] );
+  }
+
+  CoTaskMemFree( property_items );
+  CoTaskMemFree( errors );
+  CoTaskMemFree( property_ids );
+  CoTaskMemFree( descriptions );
+  CoTaskMemFree( data_types );
+  return FAILED( hr ) ? hr : OPCDA_OK;
+}
+
+OPCDA_RESULT ComBackend::browse( const wstring& path, const BACKEND_BROWSE_QUERY& query, vector<wstring>& branches, vector<wstring>& leaves )
+{
+  branches.clear();
+  leaves.clear();
+
+  if ( !m_browser )
+  {
+    if ( !m_item_properties )
+    {
+      return OPCDA_E_NOINTERFACE;
+    }
+
+    // without an address space only the property items below a known item ID can be listed
+    return path.empty() ? OPCDA_E_NOTIMPL : browse_properties( path, leaves );
+  }
+
+  if ( !is_home_thread() )
+  {
+    return OPCDA_E_WRONG_THREAD;
+  }
+
+  lock_guard<mutex> lock( m_browse_lock );
+
+  // a flat space is one OPC_FLAT enumeration, it has no positions to move to
+  if ( m_organization == OPC_NS_FLAT )
+  {
+    return path.empty() ? browse_names( OPC_FLAT, query.name, query.data_type, leaves ) : OPCDA_E_INVALIDARG;
+  }
+
+  HRESULT hr = s_change_browse_position_call.measure( [&]() { return m_browser->ChangeBrowsePosition( OPC_BROWSE_TO, path.c_str() ); } );
+  m_at_root = SUCCEEDED( hr ) && path.empty();
+  if ( FAILED( hr ) )
+  {
+    return hr;
+  }
+
+  // branch names are never filtered, otherwise the tree below them would be cut off
+  if ( opcda_failed( hr = browse_names( OPC_BRANCH, L"", VT_EMPTY, branches ) ) )
+  {
+    return hr;
+  }
+  return browse_names( OPC_LEAF, query.name, query.data_type, leaves );
+}
+
+OPCDA_RESULT ComBackend::browse_elements( const wstring& item_id, const BACKEND_BROWSE_QUERY& query, wstring& continuation, vector<BACKEND_BROWSE_ELEMENT>& elements )
+{
+  if ( !m_browse )
+  {
+    return OPCDA_E_NOINTERFACE;
+  }
+
+  CComPtr<IOPCBrowse> browse;
+  HRESULT hr = apartment_interface( is_home_thread(), m_browse, m_git_browse, browse );
+  if ( FAILED( hr ) )
+  {
+    return hr;
+  }
+
+  DWORD property_ids[] = { OPC_PROPERTY_DATATYPE, OPC_PROPERTY_ACCESS_RIGHTS };
+  DWORD property_count = query.with_properties ? static_cast<DWORD>( size( property_ids ) ) : 0;
+
+  // the continuation point is [in, out]: the server frees the one it gets and allocates the next
+  LPWSTR point = nullptr;
+  if ( !continuation.empty() )
+  {
+    size_t bytes = ( continuation.size() + 1 ) * sizeof( wchar_t );
+    if ( !( point = static_cast<LPWSTR>( CoTaskMemAlloc( bytes ) ) ) )
+    {
+      return E_OUTOFMEMORY;
+    }
+    memcpy( point, continuation.c_str(), bytes );
+  }
+
+  BOOL more = FALSE;
+  DWORD count = 0;
+  OPCBROWSEELEMENT* found = nullptr;
+
+  hr = s_browse_call.measure( [&]() { return browse->Browse( const_cast<LPWSTR>( item_id.c_str() ), &point, query.page_size, static_cast<OPCBROWSEFILTER>( query.filter ), const_cast<LPWSTR>( query.name.c_str() ), const_cast<LPWSTR>( query.vendor.c_str() ), FALSE, query.with_properties ? TRUE : FALSE, property_count, property_count ? property_ids : nullptr, &more, &count, &found ); } );
+
+  continuation = SUCCEEDED( hr ) && point ? point : L"";
+  CoTaskMemFree( point );
+
+  if ( FAILED( hr ) )
+  {
+    return hr;
+  }
+
+  elements.reserve( elements.size() + count );
+
+  for ( DWORD i = 0; i < count && found; ++i )
+  {
+    BACKEND_BROWSE_ELEMENT element;
+    take_browse_element( found[i], element );
+    elements.push_back( move( element ) );
+  }
+
+  CoTaskMemFree( found );
+
+  if ( more && continuation.empty() )
+  {
+    Logger::instance().logWarning( "[backend] Server truncated the browse of '" + OPCDA::UTILS::wstr_to_str( item_id ) + "' without a continuation point" );
+  }
+
+  return OPCDA_OK;
+}
+
+OPCDA_RESULT ComBackend::item_id( const wstring& browse_path, wstring& item_id )
+{
+  if ( !m_browser )
+  {
+    return OPCDA_E_NOINTERFACE;
+  }
+
+  if ( !is_home_thread() )
+  {
+    return OPCDA_E_WRONG_THREAD;
+  }
+
+  lock_guard<mutex> lock( m_browse_lock );
+
+  // GetItemID names are relative to the browse position, a browse may have moved it
+  if ( !m_at_root )
+  {
+    HRESULT hr = s_change_browse_position_call.measure( [&]() { return m_browser->ChangeBrowsePosition( OPC_BROWSE_TO, L"" ); } );
+    if ( FAILED( hr ) )
+    {
+      return hr;
+    }
+    m_at_root = true;
+  }
+
+  LPWSTR resolved = nullptr;
+  HRESULT hr = s_get_item_id_call.measure( [&]() { return m_browser->GetItemID( const_cast<LPWSTR>( browse_path.c_str() ), &resolved ); } );
+
+  if ( SUCCEEDED( hr ) && resolved )
+  {
+    item_id = resolved;
+  }
+  CoTaskMemFree( resolved );
+  return FAILED( hr ) ? hr : OPCDA_OK;
+}
+
+OPCDA_RESULT ComBackend::properties( const vector<wstring>& item_ids, const vector<uint32_t>& property_ids, vector<BACKEND_PROPERTIES>& properties )
+{
+  properties.assign( item_ids.size(), BACKEND_PROPERTIES() );
+
+  for ( size_t i = 0; i < item_ids.size(); ++i )
+  {
+    properties[i].item_id = item_ids[i];
+    properties[i].properties.resize( property_ids.size() );
+
+    for ( size_t p = 0; p < property_ids.size(); ++p )
+    {
+      properties[i].properties[p].id = property_ids[p];
+    }
+  }
+
+  if ( item_ids.empty() )
+  {
+    return OPCDA_OK;
+  }
+
+  vector<DWORD> ids( property_ids.begin(), property_ids.end() );
+  DWORD property_count = static_cast<DWORD>( ids.size() );
+  bool home = is_home_thread();
+
+  if ( m_browse )
+  {
+    CComPtr<IOPCBrowse> browse;
+    HRESULT hr = apartment_interface( home, m_browse, m_git_browse, browse );
+    if ( FAILED( hr ) )
+    {
+      return hr;
+    }
+
+    vector<LPWSTR> names;
+    for ( const auto& id : item_ids )
+    {
+      names.push_back( const_cast<LPWSTR>( id.c_str() ) );
+    }
+
+    OPCITEMPROPERTIES* found = nullptr;
+    hr = s_get_properties_call.measure( [&]() { return browse->GetProperties( static_cast<DWORD>( names.size() ), names.data(), TRUE, property_count, ids.data(), &found ); } );
+
+    if ( FAILED( hr ) || !found )
+    {
+      CoTaskMemFree( found );
+      return FAILED( hr ) ? hr : OPCDA_E_FAIL;
+    }
+
+    for ( size_t i = 0; i < properties.size(); ++i )
+    {
+      OPCITEMPROPERTIES& props = found[i];
+      properties[i].error = props.hrErrorID;
+
+      // returned in the order they were asked for
+      for ( DWORD p = 0; p < props.dwNumProperties && p < property_count && props.pItemProperties; ++p )
+      {
+        OPCITEMPROPERTY& prop = props.pItemProperties[p];
+        BACKEND_PROPERTY& property = properties[i].properties[p];
+        property.error = prop.hrErrorID;
+
+        if ( SUCCEEDED( prop.hrErrorID ) )
+        {
+          property.error = OPCDA::UTILS::variant_to_value( prop.vValue, property.value );
+        }
+      }
+
+      free_item_properties( props );
+    }
+
+    CoTaskMemFree( found );
+    return OPCDA_OK;
+  }
+
+  if ( !m_item_properties )
+  {
+    return OPCDA_E_NOINTERFACE;
+  }
+
+  CComPtr<IOPCItemProperties> item_properties;
+  HRESULT hr = apartment_interface( home, m_item_properties, m_git_item_properties, item_properties );
+  if ( FAILED( hr ) )
+  {
+    return hr;
+  }
+
+  // DA 2.0 has no bulk query, one call per item
+  for ( BACKEND_PROPERTIES& item : properties )
+  {
+    VARIANT* values = nullptr;
+    HRESULT* errors = nullptr;
+
+    item.error = s_get_item_properties_call.measure( [&]() { return item_properties->GetItemProperties( const_cast<LPWSTR>( item.item_id.c_str() ), property_count, ids.data(), &values, &errors ); } );
+
+    if ( SUCCEEDED( item.error ) && values && errors )
+    {
+      for ( DWORD p = 0; p < property_count; ++p )
+      {
+        BACKEND_PROPERTY& property = item.properties[p];
+        property.error = SUCCEEDED( errors[p] ) ? OPCDA::UTILS::variant_to_value( values[p], property.value ) : errors[p];
+        VariantClear( &values[p] );
+      }
+    }
+
+    CoTaskMemFree( values );
+    CoTaskMemFree( errors );
+  }
+
+  return OPCDA_OK;
+}
+
+OPCDA_RESULT ComBackend::item_results( const vector<wstring>& item_ids, const vector<uint32_t>* client_handles, vector<BACKEND_ITEM>& items )
+{
+  items.assign( item_ids.size(), BACKEND_ITEM() );
+
+  if ( item_ids.empty() )
+  {
+    return OPCDA_OK;
+  }
+
+  if ( client_handles && client_handles->size() != item_ids.size() )
+  {
+    return OPCDA_E_INVALIDARG;
+  }
+
+  CComPtr<IOPCItemMgt> item_mgt;
+  CComPtr<IOPCSyncIO> sync_io;
+  HRESULT hr = group_interfaces( item_mgt, sync_io );
+  if ( FAILED( hr ) )
+  {
+    return hr;
+  }
+
+  vector<OPCITEMDEF> defs( item_ids.size() );
+  for ( size_t i = 0; i < item_ids.size(); ++i )
+  {
+    defs[i].szAccessPath = const_cast<LPWSTR>( L"" );
+    defs[i].szItemID = const_cast<LPWSTR>( item_ids[i].c_str() );
+    defs[i].bActive = TRUE;
+    defs[i].hClient = client_handles ? ( *client_handles )[i] : 0;
+    defs[i].vtRequestedDataType = VT_EMPTY;
+  }
+
+  OPCITEMRESULT* results = nullptr;
+  HRESULT* errors = nullptr;
+  DWORD count = static_cast<DWORD>( defs.size() );
+
+  hr = client_handles ? s_add_items_call.measure( [&]() { return item_mgt->AddItems( count, defs.data(), &results, &errors ); } )
+                      : s_validate_items_call.measure( [&]() { return item_mgt->ValidateItems( count, defs.data(), FALSE, &results, &errors ); } );
+
+  if ( FAILED( hr ) || !results || !errors )
+  {
+    CoTaskMemFree( results );
+    CoTaskMemFree( errors );
+    return FAILED( hr ) ? hr : OPCDA_E_FAIL;
+  }
+
+  for ( size_t i = 0; i < items.size(); ++i )
+  {
+    BACKEND_ITEM& item = items[i];
+    item.item_id = item_ids[i];
+    item.error = errors[i];
+
+    if ( SUCCEEDED( errors[i] ) )
+    {
+      item.handle = results[i].hServer;
+      item.canonical_type = results[i].vtCanonicalDataType;
+      item.access_rights = results[i].dwAccessRights;
+    }
+    CoTaskMemFree( results[i].pBlob );
+  }
+
+  CoTaskMemFree( results );
+  CoTaskMemFree( errors );
+  return hr;
+}
+
+OPCDA_RESULT ComBackend::validate( const vector<wstring>& item_ids, vector<BACKEND_ITEM>& items )
+{
+  return item_results( item_ids, nullptr, items );
+}
+
+OPCDA_RESULT ComBackend::add( const vector<wstring>& item_ids, const vector<uint32_t>& client_handles, vector<BACKEND_ITEM>& items )
+{
+  return item_results( item_ids, &client_handles, items );
+}
+
+OPCDA_RESULT ComBackend::remove( const vector<uint32_t>& handles, vector<OPCDA_RESULT>& errors )
+{
+  errors.assign( handles.size(), OPCDA_OK );
+
+  if ( handles.empty() )
+  {
+    return OPCDA_OK;
+  }
+
+  // without a group there is nothing to remove, and no reason to create one
+  CComPtr<IOPCItemMgt> item_mgt;
+  CComPtr<IOPCSyncIO> sync_io;
+  if ( FAILED( group_interfaces( item_mgt, sync_io, false ) ) )
+  {
+    errors.assign( handles.size(), OPCDA_E_INVALIDHANDLE );
+    return OPCDA_FALSE;
+  }
+
+  vector<OPCHANDLE> server_handles( handles.begin(), handles.end() );
+  HRESULT* remove_errors = nullptr;
+
+  HRESULT hr = s_remove_items_call.measure( [&]() { return item_mgt->RemoveItems( static_cast<DWORD>( server_handles.size() ), server_handles.data(), &remove_errors ); } );
+
+  if ( remove_errors )
+  {
+    copy( remove_errors, remove_errors + handles.size(), errors.begin() );
+    CoTaskMemFree( remove_errors );
+  }
+  else if ( FAILED( hr ) )
+  {
+    errors.assign( handles.size(), hr );
+  }
+  return hr;
+}
+
+OPCDA_RESULT ComBackend::read( const vector<uint32_t>& handles, BACKEND_SOURCE source, vector<BACKEND_VALUE>& values )
+{
+  values.assign( handles.size(), BACKEND_VALUE() );
+
+  if ( handles.empty() )
+  {
+    return OPCDA_OK;
+  }
+
+  CComPtr<IOPCItemMgt> item_mgt;
+  CComPtr<IOPCSyncIO> sync_io;
+  HRESULT hr = group_interfaces( item_mgt, sync_io );
+  if ( FAILED( hr ) )
+  {
+    return hr;
+  }
+
+  vector<OPCHANDLE> server_handles( handles.begin(), handles.end() );
+  DWORD count = static_cast<DWORD>( server_handles.size() );
+  OPCITEMSTATE* states = nullptr;
+  HRESULT* errors = nullptr;
+
+  hr = source == BACKEND_SOURCE::DEVICE ? s_device_read_call.measure( [&]() { return sync_io->Read( OPC_DS_DEVICE, count, server_handles.data(), &states, &errors ); } )
+                                        : s_sync_read_call.measure( [&]() { return sync_io->Read( OPC_DS_CACHE, count, server_handles.data(), &states, &errors ); } );
+
+  if ( FAILED( hr ) || !states || !errors )
+  {
+    CoTaskMemFree( states );
+    CoTaskMemFree( errors );
+    return FAILED( hr ) ? hr : OPCDA_E_FAIL;
+  }
+
+  for ( size_t i = 0; i < values.size(); ++i )
+  {
+    BACKEND_VALUE& value = values[i];
+    value.handle = handles[i];
+    value.error = errors[i];
+
+    if ( SUCCEEDED( errors[i] ) )
+    {
+      value.quality = states[i].wQuality;
+      value.timestamp = OPCDA::UTILS::filetime_to_ticks( states[i].ftTimeStamp );
+      value.type = V_VT( &states[i].vDataValue );
+
+      HRESULT converted = OPCDA::UTILS::variant_to_value( states[i].vDataValue, value.value );
+      if ( FAILED( converted ) )
+      {
+        value.error = converted;
+      }
+    }
+    VariantClear( &states[i].vDataValue );
+  }
+
+  CoTaskMemFree( states );
+  CoTaskMemFree( errors );
+  return hr;
+}
+
+OPCDA_RESULT ComBackend::write_group( const vector<BACKEND_VALUE>& values, vector<OPCDA_RESULT>& errors, const uint32_t* transaction )
+{
+  errors.assign( values.size(), OPCDA_OK );
+
+  if ( values.empty() )
+  {
+    return OPCDA_OK;
+  }
+
+  CComPtr<IOPCItemMgt> item_mgt;
+  CComPtr<IOPCSyncIO> sync_io;
+  CComPtr<IOPCAsyncIO2> async_io;
+
+  HRESULT hr = transaction ? async_interface( async_io ) : group_interfaces( item_mgt, sync_io );
+  if ( FAILED( hr ) )
+  {
+    return hr;
+  }
+
+  // value.type is the canonical type the caller registered the item with
+  vector<OPCHANDLE> handles;
+  vector<VARIANT> variants;
+  vector<size_t> original_indices;
+
+  for ( size_t i = 0; i < values.size(); ++i )
+  {
+    VARIANT variant;
+    errors[i] = OPCDA::UTILS::value_to_variant( values[i].value, values[i].type, variant );
+
+    if ( SUCCEEDED( errors[i] ) )
+    {
+      handles.push_back( values[i].handle );
+      variants.push_back( variant );
+      original_indices.push_back( i );
+    }
+  }
+
+  if ( handles.empty() )
+  {
+    return OPCDA_FALSE;
+  }
+
+  DWORD count = static_cast<DWORD>( handles.size() );
+  DWORD cancel_id = 0;
+  HRESULT* write_errors = nullptr;
+
+  hr = transaction ? s_async_write_call.measure( [&]() { return async_io->Write( count, handles.data(), variants.data(), *transaction, &cancel_id, &write_errors ); } )
+                   : s_sync_write_call.measure( [&]() { return sync_io->Write( count, handles.data(), variants.data(), &write_errors ); } );
+
+  for ( auto& variant : variants )
+  {
+    VariantClear( &variant );
+  }
+
+  for ( size_t i = 0; i < original_indices.size(); ++i )
+  {
+    errors[original_indices[i]] = ( SUCCEEDED( hr ) && write_errors ) ? write_errors[i] : hr;
+  }
+
+  CoTaskMemFree( write_errors );
+
+  if ( FAILED( hr ) )
+  {
+    return hr;
+  }
+  return any_of( errors.begin(), errors.end(), []( OPCDA_RESULT e ) { return opcda_failed( e ); } ) ? OPCDA_FALSE : OPCDA_OK;
+}
+
+OPCDA_RESULT ComBackend::write( const vector<BACKEND_VALUE>& values, vector<OPCDA_RESULT>& errors )
+{
+  return write_group( values, errors, nullptr );
+}
+
+OPCDA_RESULT ComBackend::write_async( const vector<BACKEND_VALUE>& values, uint32_t transaction, vector<OPCDA_RESULT>& errors )
+{
+  return write_group( values, errors, &transaction );
+}
+
+void ComBackend::set_write_complete( const BACKEND_WRITE_COMPLETE& on_complete )
+{
+  lock_guard<mutex> lock( m_callback_lock );
+  m_write_complete = on_complete;
+}
+
+void ComBackend::on_write_complete( DWORD transaction, HRESULT master_error, DWORD count, const OPCHANDLE* client_handles, const HRESULT* errors )
+{
+  vector<uint32_t> handles;
+  vector<OPCDA_RESULT> results;
+
+  for ( DWORD i = 0; i < count && client_handles; ++i )
+  {
+    handles.push_back( client_handles[i] );
+    results.push_back( errors ? errors[i] : master_error );
+  }
+
+  // held during the call, so set_write_complete( nullptr ) waits for a completion in flight
+  lock_guard<mutex> lock( m_callback_lock );
+  if ( m_write_complete )
+  {
+    m_write_complete( transaction, master_error, handles, results );
+  }
+}
+
+OPCDA_RESULT ComBackend::read_ids( const vector<wstring>& item_ids, uint32_t max_age_ms, vector<BACKEND_VALUE>& values )
+{
+  values.assign( item_ids.size(), BACKEND_VALUE() );
+
+  if ( !m_item_io )
+  {
+    return OPCDA_E_NOINTERFACE;
+  }
+  if ( item_ids.empty() )
+  {
+    return OPCDA_OK;
+  }
+
+  CComPtr<IOPCItemIO> item_io;
+  HRESULT hr = apartment_interface( is_home_thread(), m_item_io, m_git_item_io, item_io );
+  if ( FAILED( hr ) )
+  {
+    return hr;
+  }
+
+  DWORD count = static_cast<DWORD>( item_ids.size() );
+  vector<LPCWSTR> ids;
+  vector<DWORD> max_ages( count, max_age_ms );
+
+  for ( const auto& id : item_ids )
+  {
+    ids.push_back( id.c_str() );
+  }
+
+  VARIANT* variants = nullptr;
+  WORD* qualities = nullptr;
+  FILETIME* timestamps = nullptr;
+  HRESULT* errors = nullptr;
+
+  hr = s_item_io_read_call.measure( [&]() { return item_io->Read( count, ids.data(), max_ages.data(), &variants, &qualities, &timestamps, &errors ); } );
+
+  if ( FAILED( hr ) || !variants || !qualities || !timestamps || !errors )
+  {
+    hr = FAILED( hr ) ? hr : OPCDA_E_FAIL;
+  }
+  else
+  {
+    for ( DWORD i = 0; i < count; ++i )
+    {
+      BACKEND_VALUE& value = values[i];
+      value.error = errors[i];
+
+      if ( SUCCEEDED( errors[i] ) )
+      {
+        value.quality = qualities[i];
+        value.timestamp = OPCDA::UTILS::filetime_to_ticks( timestamps[i] );
+        value.type = V_VT( &variants[i] );
+
+        HRESULT converted = OPCDA::UTILS::variant_to_value( variants[i], value.value );
+        if ( FAILED( converted ) )
+        {
+          value.error = converted;
+        }
+      }
+      VariantClear( &variants[i] );
+    }
+  }
+
+  CoTaskMemFree( variants );
+  CoTaskMemFree( qualities );
+  CoTaskMemFree( timestamps );
+  CoTaskMemFree( errors );
+  return hr;
+}
+
+OPCDA_RESULT ComBackend::write_ids( const vector<wstring>& item_ids, const vector<BACKEND_VALUE>& values, vector<OPCDA_RESULT>& errors )
+{
+  errors.assign( item_ids.size(), OPCDA_OK );
+
+  if ( !m_item_io )
+  {
+    return OPCDA_E_NOINTERFACE;
+  }
+  if ( item_ids.size() != values.size() )
+  {
+    return OPCDA_E_INVALIDARG;
+  }
+  if ( item_ids.empty() )
+  {
+    return OPCDA_OK;
+  }
+
+  CComPtr<IOPCItemIO> item_io;
+  HRESULT hr = apartment_interface( is_home_thread(), m_item_io, m_git_item_io, item_io );
+  if ( FAILED( hr ) )
+  {
+    return hr;
+  }
+
+  vector<LPCWSTR> ids;
+  vector<OPCITEMVQT> vqts;
+  vector<size_t> original_indices;
+
+  for ( size_t i = 0; i < item_ids.size(); ++i )
+  {
+    // value only, the server keeps its own quality and timestamp
+    OPCITEMVQT vqt;
+    ZeroMemory( &vqt, sizeof( OPCITEMVQT ) );
+
+    errors[i] = OPCDA::UTILS::value_to_variant( values[i].value, values[i].type, vqt.vDataValue );
+    if ( SUCCEEDED( errors[i] ) )
+    {
+      ids.push_back( item_ids[i].c_str() );
+      vqts.push_back( vqt );
+      original_indices.push_back( i );
+    }
+  }
+
+  if ( vqts.empty() )
+  {
+    return OPCDA_FALSE;
+  }
+
+  DWORD count = static_cast<DWORD>( vqts.size() );
+  HRESULT* write_errors = nullptr;
+
+  hr = s_write_vqt_call.measure( [&]() { return item_io->WriteVQT( count, ids.data(), vqts.data(), &write_errors ); } );
+
+  for ( auto& vqt : vqts )
+  {
+    VariantClear( &vqt.vDataValue );
+  }
+
+  for ( size_t i = 0; i < original_indices.size(); ++i )
+  {
+    errors[original_indices[i]] = ( SUCCEEDED( hr ) && write_errors ) ? write_errors[i] : hr;
+  }
+
+  CoTaskMemFree( write_errors );
+
+  if ( FAILED( hr ) )
+  {
+    return hr;
+  }
+  return any_of( errors.begin(), errors.end(), []( OPCDA_RESULT e ) { return opcda_failed( e ); } ) ? OPCDA_FALSE : OPCDA_OK;
+}
@@ -0,0 +1,133 @@
+// opcda_backend_com.h
+#ifndef OPCDA_BACKEND_COM_H
+#define OPCDA_BACKEND_COM_H
+
+#include <atlbase.h>
+#include <mutex>
+#include <opcda.h>
+#include <string>
+#include <vector>
+
+#include "opcda_backend.h"
+
+using namespace std;
+
+constexpr const wchar_t* DEFAULT_BACKEND_GROUP_NAME = L"opcda-backend";
+
+enum class OPCDA_APARTMENT
+{
+  STA,
+  MTA
+};
+
+class WriteCompleteSink;
+
+/**
+ * @brief OpcDaBackend over the custom interfaces of one DA 2.0 or 3.0 server.
+ *
+ * Browses through IOPCBrowse when the server has it and through
+ * IOPCBrowseServerAddressSpace or IOPCItemProperties otherwise. Reads and
+ * writes go through IOPCItemIO when available, the rest through a private
+ * group that is created on first use. The server pointer may come from
+ * CoCreateInstanceEx, an OpcDaClient connection or the in-process simulator.
+ *
+ * Threads outside the opening apartment reach the IO, group, IOPCBrowse and
+ * property interfaces through the Global Interface Table. Address space
+ * browsing, item ID resolution, group creation and async writes stay on the
+ * opening apartment; elsewhere they fail with OPCDA_E_WRONG_THREAD.
+ */
+class ComBackend : public OpcDaBackend
+{
+public:
+  ComBackend();
+  ~ComBackend();
+
+  HRESULT open( IOPCServer* server, OPCDA_APARTMENT apartment = OPCDA_APARTMENT::STA, const wstring& group_name = DEFAULT_BACKEND_GROUP_NAME );
+  /** @brief remove_group false after the server went away, so nothing waits on it. */
+  void close( bool remove_group = true );
+  bool is_open() const;
+  /** @brief Creates the group; only from the opening apartment. */
+  HRESULT ensure_group();
+  bool is_home_thread() const;
+
+  BACKEND_FEATURES features() const override;
+  OPCDA_RESULT status( BACKEND_STATUS& status ) override;
+
+  OPCDA_RESULT browse( const wstring& path, const BACKEND_BROWSE_QUERY& query, vector<wstring>& branches, vector<wstring>& leaves ) override;
+  OPCDA_RESULT browse_elements( const wstring& item_id, const BACKEND_BROWSE_QUERY& query, wstring& continuation, vector<BACKEND_BROWSE_ELEMENT>& elements ) override;
+  OPCDA_RESULT item_id( const wstring& browse_path, wstring& item_id ) override;
+  OPCDA_RESULT properties( const vector<wstring>& item_ids, const vector<uint32_t>& property_ids, vector<BACKEND_PROPERTIES>& properties ) override;
+
+  OPCDA_RESULT validate( const vector<wstring>& item_ids, vector<BACKEND_ITEM>& items ) override;
+  OPCDA_RESULT add( const vector<wstring>& item_ids, const vector<uint32_t>& client_handles, vector<BACKEND_ITEM>& items ) override;
+  OPCDA_RESULT remove( const vector<uint32_t>& handles, vector<OPCDA_RESULT>& errors ) override;
+
+  OPCDA_RESULT read( const vector<uint32_t>& handles, BACKEND_SOURCE source, vector<BACKEND_VALUE>& values ) override;
+  OPCDA_RESULT write( const vector<BACKEND_VALUE>& values, vector<OPCDA_RESULT>& errors ) override;
+  OPCDA_RESULT write_async( const vector<BACKEND_VALUE>& values, uint32_t transaction, vector<OPCDA_RESULT>& errors ) override;
+  void set_write_complete( const BACKEND_WRITE_COMPLETE& on_complete ) override;
+
+  OPCDA_RESULT read_ids( const vector<wstring>& item_ids, uint32_t max_age_ms, vector<BACKEND_VALUE>& values ) override;
+  OPCDA_RESULT write_ids( const vector<wstring>& item_ids, const vector<BACKEND_VALUE>& values, vector<OPCDA_RESULT>& errors ) override;
+
+private:
+  OPCDA_APARTMENT m_apartment = OPCDA_APARTMENT::STA;
+  DWORD m_owner_thread = 0;
+  wstring m_group_name;
+
+  CComPtr<IOPCServer> m_server;
+  CComPtr<IOPCBrowse> m_browse;
+  CComPtr<IOPCBrowseServerAddressSpace> m_browser;
+  CComPtr<IOPCItemProperties> m_item_properties;
+  CComPtr<IOPCItemIO> m_item_io;
+  OPCNAMESPACETYPE m_organization = OPC_NS_HIERARCHIAL;
+
+  CComGITPtr<IOPCServer> m_git_server;
+  CComGITPtr<IOPCBrowse> m_git_browse;
+  CComGITPtr<IOPCItemProperties> m_git_item_properties;
+  CComGITPtr<IOPCItemIO> m_git_item_io;
+
+  // the browse position of IOPCBrowseServerAddressSpace is shared by every caller
+  mutex m_browse_lock;
+  bool m_at_root = true;
+
+  mutex m_group_lock;
+  CComPtr<IUnknown> m_group;
+  OPCHANDLE m_group_handle = 0;
+  CComPtr<IOPCItemMgt> m_item_mgt;
+  CComPtr<IOPCSyncIO> m_sync_io;
+  CComGITPtr<IOPCItemMgt> m_git_item_mgt;
+  CComGITPtr<IOPCSyncIO> m_git_sync_io;
+  CComPtr<IOPCAsyncIO2> m_async_io;
+  CComPtr<WriteCompleteSink> m_write_sink;
+  DWORD m_write_sink_cookie = 0;
+
+  mutex m_callback_lock;
+  BACKEND_WRITE_COMPLETE m_write_complete;
+
+  HRESULT group_interfaces( CComPtr<IOPCItemMgt>& item_mgt, CComPtr<IOPCSyncIO>& sync_io, bool create = true );
+  HRESULT async_interface( CComPtr<IOPCAsyncIO2>& async_io );
+  void release_group( bool remove );
+  OPCDA_RESULT browse_names( OPCBROWSETYPE type, const wstring& name, VARTYPE data_type, vector<wstring>& names );
+  OPCDA_RESULT browse_properties( const wstring& item_id, vector<wstring>& leaves );
+  OPCDA_RESULT item_results( const vector<wstring>& item_ids, const vector<uint32_t>* client_handles, vector<BACKEND_ITEM>& items );
+  OPCDA_RESULT write_group( const vector<BACKEND_VALUE>& values, vector<OPCDA_RESULT>& errors, const uint32_t* transaction );
+  void on_write_complete( DWORD transaction, HRESULT master_error, DWORD count, const OPCHANDLE* client_handles, const HRESULT* errors );
+};
+
+namespace OPCDA::UTILS
+{
+  int64_t filetime_to_ticks( const FILETIME& ft );
+  FILETIME ticks_to_filetime( int64_t ticks );
+
+  /**
+   * @brief Backend value to VARIANT, converted to type unless it is VT_EMPTY.
+   *        Arrays become a SAFEARRAY of type's element type, VT_R8 or VT_BSTR without one.
+   */
+  HRESULT value_to_variant( const OPCDA_VALUE& value, VARTYPE type, VARIANT& variant );
+  /** @brief VARIANT to backend value; string arrays stay strings, other arrays become doubles. */
+  HRESULT variant_to_value( const VARIANT& variant, OPCDA_VALUE& value );
+
+} // namespace OPCDA::UTILS
+
+#endif
@@ -0,0 +1,625 @@
+// opcda_backend_memory.cpp
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cwchar>
+
+#include "opcda_backend_memory.h"
+#include "opcda_sample.h"
+
+using namespace std;
+
+constexpr uint32_t MEMORY_BACKEND_RUNNING = 1;
+
+static int64_t now_ticks()
+{
+  return epoch_ms_to_ticks( chrono::duration_cast<chrono::milliseconds>( chrono::system_clock::now().time_since_epoch() ).count() );
+}
+
+// '*' and '?' of the OPC name filter syntax, which is all the simulator's names need
+static bool name_matches( const wchar_t* name, const wchar_t* filter )
+{
+  if ( *filter == L'\0' )
+  {
+    return *name == L'\0';
+  }
+
+  if ( *filter == L'*' )
+  {
+    return name_matches( name, filter + 1 ) || ( *name != L'\0' && name_matches( name + 1, filter ) );
+  }
+
+  return *name != L'\0' && ( *filter == L'?' || *filter == *name ) && name_matches( name + 1, filter + 1 );
+}
+
+static bool name_matches( const wstring& name, const wstring& filter )
+{
+  return filter.empty() || name_matches( name.c_str(), filter.c_str() );
+}
+
+static bool as_number( const OPCDA_VALUE& value, double& number )
+{
+  if ( holds_alternative<double>( value ) )
+    number = get<double>( value );
+  else if ( holds_alternative<int64_t>( value ) )
+    number = static_cast<double>( get<int64_t>( value ) );
+  else if ( holds_alternative<bool>( value ) )
+    number = get<bool>( value ) ? 1.0 : 0.0;
+  else if ( holds_alternative<wstring>( value ) )
+  {
+    const wstring& text = get<wstring>( value );
+    wchar_t* end = nullptr;
+    number = wcstod( text.c_str(), &end );
+    return !text.empty() && end == text.c_str() + text.size();
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+// what the server's conversion to the canonical type would store
+static OPCDA_RESULT coerce_value( const OPCDA_VALUE& value, uint16_t type, OPCDA_VALUE& coerced )
+{
+  double number = 0;
+
+  switch ( type )
+  {
+    case OPCDA_TYPE_R8:
+    case OPCDA_TYPE_R4:
+      if ( !as_number( value, number ) )
+      {
+        return OPCDA_E_BADTYPE;
+      }
+      coerced = type == OPCDA_TYPE_R4 ? static_cast<double>( static_cast<float>( number ) ) : number;
+      return OPCDA_OK;
+
+    case OPCDA_TYPE_I4:
+      if ( !as_number( value, number ) || fabs( number ) > 2147483647.0 )
+      {
+        return OPCDA_E_BADTYPE;
+      }
+      coerced = static_cast<int64_t>( llround( number ) );
+      return OPCDA_OK;
+
+    case OPCDA_TYPE_BOOL:
+      if ( !as_number( value, number ) )
+      {
+        return OPCDA_E_BADTYPE;
+      }
+      coerced = number != 0;
+      return OPCDA_OK;
+
+    case OPCDA_TYPE_BSTR:
+      if ( holds_alternative<wstring>( value ) )
+        coerced = value;
+      else if ( holds_alternative<bool>( value ) )
+        coerced = wstring( get<bool>( value ) ? L"True" : L"False" );
+      else if ( holds_alternative<int64_t>( value ) )
+        coerced = to_wstring( get<int64_t>( value ) );
+      else if ( holds_alternative<double>( value ) )
+        coerced = to_wstring( get<double>( value ) );
+      else
+        return OPCDA_E_BADTYPE;
+      return OPCDA_OK;
+
+    case OPCDA_TYPE_ARRAY | OPCDA_TYPE_R8:
+      if ( !holds_alternative<vector<double>>( value ) )
+      {
+        return OPCDA_E_BADTYPE;
+      }
+      coerced = value;
+      return OPCDA_OK;
+
+    default:
+      return OPCDA_E_BADTYPE;
+  }
+}
+
+MemoryBackend::MemoryBackend( const shared_ptr<const SimNamespace>& space ) : m_space( space ), m_start_time( now_ticks() )
+{
+}
+
+BACKEND_FEATURES MemoryBackend::features() const
+{
+  const SIM_CONFIG& config = m_space->config();
+
+  BACKEND_FEATURES features;
+  features.browse_elements = config.browse_da3;
+  features.address_space = true;
+  features.flat = config.flat;
+  features.properties = true;
+  features.item_io = config.item_io;
+  features.async_write = true;
+  return features;
+}
+
+OPCDA_RESULT MemoryBackend::status( BACKEND_STATUS& status )
+{
+  m_space->simulate_latency();
+
+  status.state = MEMORY_BACKEND_RUNNING;
+  status.group_count = 1;
+  status.start_time = m_start_time;
+  status.current_time = now_ticks();
+  status.last_update_time = status.current_time;
+  status.major_version = m_space->config().browse_da3 || m_space->config().item_io ? 3 : 2;
+  status.vendor = L"opcda-cli memory backend";
+  return OPCDA_OK;
+}
+
+OPCDA_RESULT MemoryBackend::browse( const wstring& path, const BACKEND_BROWSE_QUERY& query, vector<wstring>& branches, vector<wstring>& leaves )
+{
+  m_space->simulate_latency();
+  branches.clear();
+  leaves.clear();
+
+  auto wanted = [&]( const SIM_ITEM& item, const wstring& name ) { return name_matches( name, query.name ) && ( query.data_type == OPCDA_TYPE_EMPTY || query.data_type == item.type ); };
+
+  // a flat space lists every item ID under the root, like OPC_FLAT
+  if ( m_space->config().flat )
+  {
+    if ( !path.empty() )
+    {
+      return OPCDA_E_INVALIDARG;
+    }
+
+    leaves.reserve( m_space->items().size() );
+    for ( const auto& item : m_space->items() )
+    {
+      if ( wanted( item, item.item_id ) )
+      {
+        leaves.push_back( item.item_id );
+      }
+    }
+    return OPCDA_OK;
+  }
+
+  const SIM_BRANCH* branch = m_space->branch( path );
+  if ( !branch )
+  {
+    return OPCDA_E_INVALIDARG;
+  }
+
+  branches = branch->branch_names;
+  leaves.reserve( branch->leaf_names.size() );
+
+  for ( const auto& leaf : branch->leaf_names )
+  {
+    long index = m_space->find_browse_path( path.empty() ? leaf : path + L"." + leaf );
+    if ( index >= 0 && wanted( m_space->items()[index], leaf ) )
+    {
+      leaves.push_back( leaf );
+    }
+  }
+  return OPCDA_OK;
+}
+
+OPCDA_RESULT MemoryBackend::browse_elements( const wstring& item_id, const BACKEND_BROWSE_QUERY& query, wstring& continuation, vector<BACKEND_BROWSE_ELEMENT>& elements )
+{
+  if ( !m_space->config().browse_da3 )
+  {
+    return OPCDA_E_NOINTERFACE;
+  }
+
+  m_space->simulate_latency();
+
+  const SIM_CONFIG& config = m_space->config();
+  const wstring& prefix = config.id_prefix;
+
+  // branch item IDs carry the prefix like item IDs do, the root is the empty ID
+  wstring path = item_id;
+  if ( !prefix.empty() && path.compare( 0, prefix.size(), prefix ) == 0 )
+  {
+    path.erase( 0, prefix.size() );
+  }
+
+  const SIM_BRANCH* branch = config.flat ? ( item_id.empty() ? m_space->branch( L"" ) : nullptr ) : m_space->branch( path );
+  if ( !branch )
+  {
+    return m_space->find_item( item_id ) >= 0 ? OPCDA_OK : OPCDA_E_UNKNOWNITEMID;
+  }
+
+  vector<BACKEND_BROWSE_ELEMENT> found;
+  bool branches = !config.flat && query.filter != BACKEND_BROWSE_FILTER::ITEMS;
+  bool items = query.filter != BACKEND_BROWSE_FILTER::BRANCHES;
+
+  for ( size_t b = 0; branches && b < branch->branch_names.size(); ++b )
+  {
+    const wstring& name = branch->branch_names[b];
+    if ( !name_matches( name, query.name ) )
+    {
+      continue;
+    }
+
+    wstring child_path = path.empty() ? name : path + L"." + name;
+    const SIM_BRANCH* child = m_space->branch( child_path );
+
+    BACKEND_BROWSE_ELEMENT element;
+    element.name = name;
+    element.item_id = prefix + child_path;
+    element.has_children = child && ( !child->branch_names.empty() || !child->leaf_names.empty() );
+    found.push_back( move( element ) );
+  }
+
+  auto add_item = [&]( const SIM_ITEM& item, const wstring& name )
+  {
+    if ( !name_matches( name, query.name ) )
+    {
+      return;
+    }
+
+    BACKEND_BROWSE_ELEMENT element;
+    element.name = name;
+    element.item_id = item.item_id;
+    element.is_item = true;
+
+    if ( query.with_properties )
+    {
+      element.has_properties = true;
+      element.data_type = item.type;
+      element.access_rights = item.access_rights;
+    }
+    found.push_back( move( element ) );
+  };
+
+  if ( items && config.flat )
+  {
+    for ( const auto& item : m_space->items() )
+    {
+      add_item( item, item.item_id );
+    }
+  }
+  else if ( items )
+  {
+    for ( const auto& leaf : branch->leaf_names )
+    {
+      long index = m_space->find_browse_path( path.empty() ? leaf : path + L"." + leaf );
+      if ( index >= 0 )
+      {
+        add_item( m_space->items()[index], leaf );
+      }
+    }
+  }
+
+  // the continuation point is the offset of the next page
+  size_t first = continuation.empty() ? 0 : static_cast<size_t>( wcstoull( continuation.c_str(), nullptr, 10 ) );
+  if ( first > found.size() )
+  {
+    return OPCDA_E_INVALIDARG;
+  }
+
+  size_t last = query.page_size ? min( found.size(), first + query.page_size ) : found.size();
+  elements.reserve( elements.size() + ( last - first ) );
+
+  for ( size_t i = first; i < last; ++i )
+  {
+    elements.push_back( move( found[i] ) );
+  }
+
+  continuation = last < found.size() ? to_wstring( last ) : wstring();
+  return OPCDA_OK;
+}
+
+OPCDA_RESULT MemoryBackend::item_id( const wstring& browse_path, wstring& item_id )
+{
+  m_space->simulate_latency();
+
+  long index = m_space->find_browse_path( browse_path );
+  if ( index < 0 && m_space->config().flat )
+  {
+    index = m_space->find_item( browse_path );
+  }
+
+  if ( index >= 0 )
+  {
+    item_id = m_space->items()[index].item_id;
+    return OPCDA_OK;
+  }
+
+  if ( m_space->branch( browse_path ) )
+  {
+    item_id = m_space->config().id_prefix + browse_path;
+    return OPCDA_OK;
+  }
+  return OPCDA_E_UNKNOWNITEMID;
+}
+
+OPCDA_RESULT MemoryBackend::properties( const vector<wstring>& item_ids, const vector<uint32_t>& property_ids, vector<BACKEND_PROPERTIES>& properties )
+{
+  m_space->simulate_latency();
+  properties.assign( item_ids.size(), BACKEND_PROPERTIES() );
+
+  OPCDA_RESULT result = OPCDA_OK;
+
+  for ( size_t i = 0; i < item_ids.size(); ++i )
+  {
+    BACKEND_PROPERTIES& item = properties[i];
+    item.item_id = item_ids[i];
+
+    long index = m_space->find_item( item_ids[i] );
+    if ( index < 0 )
+    {
+      item.error = OPCDA_E_UNKNOWNITEMID;
+      result = OPCDA_FALSE;
+      continue;
+    }
+
+    const SIM_ITEM& sim = m_space->items()[index];
+    item.properties.resize( property_ids.size() );
+
+    for ( size_t p = 0; p < property_ids.size(); ++p )
+    {
+      BACKEND_PROPERTY& property = item.properties[p];
+      property.id = property_ids[p];
+
+      switch ( property.id )
+      {
+        case OPCDA_PROPERTY_DATATYPE:
+          property.value = static_cast<int64_t>( sim.type );
+          break;
+
+        case OPCDA_PROPERTY_ACCESS_RIGHTS:
+          property.value = static_cast<int64_t>( sim.access_rights );
+          break;
+
+        case OPCDA_PROPERTY_DESCRIPTION:
+          property.value = sim.browse_path;
+          break;
+
+        default:
+          property.error = OPCDA_E_INVALID_PID;
+          break;
+      }
+    }
+  }
+  return result;
+}
+
+OPCDA_RESULT MemoryBackend::item_results( const vector<wstring>& item_ids, const vector<uint32_t>* client_handles, vector<BACKEND_ITEM>& items )
+{
+  m_space->simulate_latency();
+  items.assign( item_ids.size(), BACKEND_ITEM() );
+
+  if ( client_handles && client_handles->size() != item_ids.size() )
+  {
+    return OPCDA_E_INVALIDARG;
+  }
+
+  lock_guard<mutex> lock( m_lock );
+  OPCDA_RESULT result = OPCDA_OK;
+
+  for ( size_t i = 0; i < item_ids.size(); ++i )
+  {
+    BACKEND_ITEM& item = items[i];
+    item.item_id = item_ids[i];
+
+    long index = m_space->find_item( item_ids[i] );
+    if ( index < 0 )
+    {
+      item.error = OPCDA_E_UNKNOWNITEMID;
+      result = OPCDA_FALSE;
+      continue;
+    }
+
+    item.canonical_type = m_space->items()[index].type;
+    item.access_rights = m_space->items()[index].access_rights;
+
+    if ( client_handles )
+    {
+      item.handle = m_next_handle++;
+      m_handles[item.handle] = { static_cast<size_t>( index ), ( *client_handles )[i] };
+    }
+  }
+  return result;
+}
+
+OPCDA_RESULT MemoryBackend::validate( const vector<wstring>& item_ids, vector<BACKEND_ITEM>& items )
+{
+  return item_results( item_ids, nullptr, items );
+}
+
+OPCDA_RESULT MemoryBackend::add( const vector<wstring>& item_ids, const vector<uint32_t>& client_handles, vector<BACKEND_ITEM>& items )
+{
+  return item_results( item_ids, &client_handles, items );
+}
+
+OPCDA_RESULT MemoryBackend::remove( const vector<uint32_t>& handles, vector<OPCDA_RESULT>& errors )
+{
+  m_space->simulate_latency();
+  errors.assign( handles.size(), OPCDA_OK );
+
+  lock_guard<mutex> lock( m_lock );
+  OPCDA_RESULT result = OPCDA_OK;
+
+  for ( size_t i = 0; i < handles.size(); ++i )
+  {
+    if ( !m_handles.erase( handles[i] ) )
+    {
+      errors[i] = OPCDA_E_INVALIDHANDLE;
+      result = OPCDA_FALSE;
+    }
+  }
+  return result;
+}
+
+OPCDA_RESULT MemoryBackend::read_value( size_t index, BACKEND_VALUE& value ) const
+{
+  const SIM_ITEM& item = m_space->items()[index];
+
+  if ( !( item.access_rights & OPCDA_ACCESS_READABLE ) )
+  {
+    return OPCDA_E_BADRIGHTS;
+  }
+
+  value.quality = OPCDA_QUALITY_GOOD;
+  value.type = item.type;
+  m_space->value( index, value.value, value.timestamp );
+
+  auto written = m_written.find( index );
+  if ( written != m_written.end() )
+  {
+    value.value = written->second;
+  }
+  return OPCDA_OK;
+}
+
+OPCDA_RESULT MemoryBackend::read( const vector<uint32_t>& handles, BACKEND_SOURCE, vector<BACKEND_VALUE>& values )
+{
+  m_space->simulate_latency();
+  values.assign( handles.size(), BACKEND_VALUE() );
+
+  lock_guard<mutex> lock( m_lock );
+  OPCDA_RESULT result = OPCDA_OK;
+
+  for ( size_t i = 0; i < handles.size(); ++i )
+  {
+    BACKEND_VALUE& value = values[i];
+    value.handle = handles[i];
+
+    auto it = m_handles.find( handles[i] );
+    value.error = it == m_handles.end() ? OPCDA_E_INVALIDHANDLE : read_value( it->second.index, value );
+
+    if ( opcda_failed( value.error ) )
+    {
+      result = OPCDA_FALSE;
+    }
+  }
+  return result;
+}
+
+OPCDA_RESULT MemoryBackend::write_value( size_t index, const OPCDA_VALUE& value )
+{
+  const SIM_ITEM& item = m_space->items()[index];
+
+  if ( !( item.access_rights & OPCDA_ACCESS_WRITEABLE ) )
+  {
+    return OPCDA_E_BADRIGHTS;
+  }
+
+  OPCDA_VALUE coerced;
+  OPCDA_RESULT result = coerce_value( value, item.type, coerced );
+  if ( !opcda_failed( result ) )
+  {
+    m_written[index] = move( coerced );
+  }
+  return result;
+}
+
+OPCDA_RESULT MemoryBackend::write_handles( const vector<BACKEND_VALUE>& values, vector<OPCDA_RESULT>& errors, vector<uint32_t>* client_handles )
+{
+  m_space->simulate_latency();
+  errors.assign( values.size(), OPCDA_OK );
+
+  lock_guard<mutex> lock( m_lock );
+  OPCDA_RESULT result = OPCDA_OK;
+
+  for ( size_t i = 0; i < values.size(); ++i )
+  {
+    auto it = m_handles.find( values[i].handle );
+    errors[i] = it == m_handles.end() ? OPCDA_E_INVALIDHANDLE : write_value( it->second.index, values[i].value );
+
+    if ( opcda_failed( errors[i] ) )
+    {
+      result = OPCDA_FALSE;
+    }
+    else if ( client_handles )
+    {
+      client_handles->push_back( it->second.client_handle );
+    }
+  }
+  return result;
+}
+
+OPCDA_RESULT MemoryBackend::write( const vector<BACKEND_VALUE>& values, vector<OPCDA_RESULT>& errors )
+{
+  return write_handles( values, errors, nullptr );
+}
+
+OPCDA_RESULT MemoryBackend::write_async( const vector<BACKEND_VALUE>& values, uint32_t transaction, vector<OPCDA_RESULT>& errors )
+{
+  vector<uint32_t> client_handles;
+  OPCDA_RESULT result = write_handles( values, errors, &client_handles );
+
+  // like a server, only the items the call accepted complete
+  if ( client_handles.empty() )
+  {
+    return result;
+  }
+
+  BACKEND_WRITE_COMPLETE on_complete;
+  {
+    lock_guard<mutex> lock( m_callback_lock );
+    on_complete = m_write_complete;
+  }
+
+  if ( on_complete )
+  {
+    on_complete( transaction, OPCDA_OK, client_handles, vector<OPCDA_RESULT>( client_handles.size(), OPCDA_OK ) );
+  }
+  return result;
+}
+
+void MemoryBackend::set_write_complete( const BACKEND_WRITE_COMPLETE& on_complete )
+{
+  lock_guard<mutex> lock( m_callback_lock );
+  m_write_complete = on_complete;
+}
+
+OPCDA_RESULT MemoryBackend::read_ids( const vector<wstring>& item_ids, uint32_t, vector<BACKEND_VALUE>& values )
+{
+  if ( !m_space->config().item_io )
+  {
+    return OPCDA_E_NOINTERFACE;
+  }
+
+  m_space->simulate_latency();
+  values.assign( item_ids.size(), BACKEND_VALUE() );
+
+  lock_guard<mutex> lock( m_lock );
+  OPCDA_RESULT result = OPCDA_OK;
+
+  for ( size_t i = 0; i < item_ids.size(); ++i )
+  {
+    long index = m_space->find_item( item_ids[i] );
+    values[i].error = index < 0 ? OPCDA_E_UNKNOWNITEMID : read_value( static_cast<size_t>( index ), values[i] );
+
+    if ( opcda_failed( values[i].error ) )
+    {
+      result = OPCDA_FALSE;
+    }
+  }
+  return result;
+}
+
+OPCDA_RESULT MemoryBackend::write_ids( const vector<wstring>& item_ids, const vector<BACKEND_VALUE>& values, vector<OPCDA_RESULT>& errors )
+{
+  if ( !m_space->config().item_io )
+  {
+    return OPCDA_E_NOINTERFACE;
+  }
+
+  m_space->simulate_latency();
+  errors.assign( item_ids.size(), OPCDA_OK );
+
+  if ( item_ids.size() != values.size() )
+  {
+    return OPCDA_E_INVALIDARG;
+  }
+
+  lock_guard<mutex> lock( m_lock );
+  OPCDA_RESULT result = OPCDA_OK;
+
+  for ( size_t i = 0; i < item_ids.size(); ++i )
+  {
+    long index = m_space->find_item( item_ids[i] );
+    errors[i] = index < 0 ? OPCDA_E_UNKNOWNITEMID : write_value( static_cast<size_t>( index ), values[i].value );
+
+    if ( opcda_failed( errors[i] ) )
+    {
+      result = OPCDA_FALSE;
+    }
+  }
+  return result;
+}
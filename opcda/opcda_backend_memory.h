@@ -0,0 +1,75 @@
+// opcda_backend_memory.h
+#ifndef OPCDA_BACKEND_MEMORY_H
+#define OPCDA_BACKEND_MEMORY_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "opcda_backend.h"
+#include "opcda_sim_namespace.h"
+
+using namespace std;
+
+/**
+ * @brief OpcDaBackend served from a SimNamespace, without COM or a server.
+ *
+ * Answers like the COM simulator, including its configured latency, so the
+ * browse, resolve and read logic can be run, profiled and sanitized on any
+ * platform. Written values are kept, converted to the item's type, and read
+ * back instead of the generated ones, which makes write paths checkable too.
+ * DA 3.0 paged browsing is only offered with browse_da3 in the SIM_CONFIG and
+ * item IO only with item_io; async writes complete before write_async returns.
+ * Thread-safe.
+ */
+class MemoryBackend : public OpcDaBackend
+{
+public:
+  explicit MemoryBackend( const shared_ptr<const SimNamespace>& space );
+
+  BACKEND_FEATURES features() const override;
+  OPCDA_RESULT status( BACKEND_STATUS& status ) override;
+
+  OPCDA_RESULT browse( const wstring& path, const BACKEND_BROWSE_QUERY& query, vector<wstring>& branches, vector<wstring>& leaves ) override;
+  OPCDA_RESULT browse_elements( const wstring& item_id, const BACKEND_BROWSE_QUERY& query, wstring& continuation, vector<BACKEND_BROWSE_ELEMENT>& elements ) override;
+  OPCDA_RESULT item_id( const wstring& browse_path, wstring& item_id ) override;
+  OPCDA_RESULT properties( const vector<wstring>& item_ids, const vector<uint32_t>& property_ids, vector<BACKEND_PROPERTIES>& properties ) override;
+
+  OPCDA_RESULT validate( const vector<wstring>& item_ids, vector<BACKEND_ITEM>& items ) override;
+  OPCDA_RESULT add( const vector<wstring>& item_ids, const vector<uint32_t>& client_handles, vector<BACKEND_ITEM>& items ) override;
+  OPCDA_RESULT remove( const vector<uint32_t>& handles, vector<OPCDA_RESULT>& errors ) override;
+
+  OPCDA_RESULT read( const vector<uint32_t>& handles, BACKEND_SOURCE source, vector<BACKEND_VALUE>& values ) override;
+  OPCDA_RESULT write( const vector<BACKEND_VALUE>& values, vector<OPCDA_RESULT>& errors ) override;
+  OPCDA_RESULT write_async( const vector<BACKEND_VALUE>& values, uint32_t transaction, vector<OPCDA_RESULT>& errors ) override;
+  void set_write_complete( const BACKEND_WRITE_COMPLETE& on_complete ) override;
+
+  OPCDA_RESULT read_ids( const vector<wstring>& item_ids, uint32_t max_age_ms, vector<BACKEND_VALUE>& values ) override;
+  OPCDA_RESULT write_ids( const vector<wstring>& item_ids, const vector<BACKEND_VALUE>& values, vector<OPCDA_RESULT>& errors ) override;
+
+private:
+  struct MEMORY_ITEM
+  {
+    size_t index = 0;
+    uint32_t client_handle = 0;
+  };
+
+  shared_ptr<const SimNamespace> m_space;
+  int64_t m_start_time;
+
+  mutable mutex m_lock;
+  unordered_map<uint32_t, MEMORY_ITEM> m_handles;
+  unordered_map<size_t, OPCDA_VALUE> m_written;
+  uint32_t m_next_handle = 1;
+
+  mutex m_callback_lock;
+  BACKEND_WRITE_COMPLETE m_write_complete;
+
+  OPCDA_RESULT item_results( const vector<wstring>& item_ids, const vector<uint32_t>* client_handles, vector<BACKEND_ITEM>& items );
+  OPCDA_RESULT read_value( size_t index, BACKEND_VALUE& value ) const;
+  OPCDA_RESULT write_value( size_t index, const OPCDA_VALUE& value );
+  OPCDA_RESULT write_handles( const vector<BACKEND_VALUE>& values, vector<OPCDA_RESULT>& errors, vector<uint32_t>* client_handles );
+};
+
+#endif
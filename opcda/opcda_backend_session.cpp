@@ -0,0 +1,1285 @@
+// opcda_backend_session.cpp
+#include <algorithm>
+#include <cwchar>
+#include <set>
+
+#include "logger.h"
+#include "opcda_backend_session.h"
+#include "opcda_error_stats.h"
+#include "opcda_metrics.h"
+#include "opcda_trace.h"
+#include "opcda_utf.h"
+
+using namespace std;
+
+static MetricGauge& s_async_writes_pending = MetricsRegistry::instance().gauge( "opcda_async_writes_pending", "", "Async write transactions awaiting OnWriteComplete" );
+
+static string narrow( const wstring& text )
+{
+  string utf8;
+  OPCDA::UTILS::append_utf8( text.data(), text.size(), utf8 );
+  return utf8;
+}
+
+static bool any_failed( const vector<OPCDA_RESULT>& errors )
+{
+  return any_of( errors.begin(), errors.end(), []( OPCDA_RESULT e ) { return opcda_failed( e ); } );
+}
+
+static bool any_failed( const vector<BACKEND_VALUE>& values )
+{
+  return any_of( values.begin(), values.end(), []( const BACKEND_VALUE& v ) { return opcda_failed( v.error ); } );
+}
+
+BackendSession::BackendSession( OpcDaBackend& backend ) : m_backend( backend )
+{
+  m_backend.set_write_complete( [this]( uint32_t transaction, OPCDA_RESULT master_error, const vector<uint32_t>& client_handles, const vector<OPCDA_RESULT>& errors ) { on_write_complete( transaction, master_error, client_handles, errors ); } );
+}
+
+BackendSession::~BackendSession()
+{
+  m_backend.set_write_complete( nullptr );
+  release();
+  drop_pending_writes();
+}
+
+void BackendSession::set_max_browse_depth( int depth )
+{
+  m_max_browse_depth = max( depth, 1 );
+}
+
+void BackendSession::set_read_batch( size_t items )
+{
+  m_read_batch = max<size_t>( items, 1 );
+}
+
+void BackendSession::set_max_age( uint32_t max_age_ms )
+{
+  m_max_age = max_age_ms;
+}
+
+void BackendSession::set_browse_filter( const BACKEND_BROWSE_QUERY& filter )
+{
+  lock_guard<mutex> lock( m_filter_lock );
+  m_filter = filter;
+}
+
+BACKEND_BROWSE_QUERY BackendSession::browse_filter() const
+{
+  lock_guard<mutex> lock( m_filter_lock );
+  return m_filter;
+}
+
+OPCDA_RESULT BackendSession::browse( const wstring& path, vector<wstring>& branches, vector<wstring>& leaves )
+{
+  TraceSpan span( "browse_tags" );
+  branches.clear();
+  leaves.clear();
+
+  if ( !m_backend.features().browse_elements )
+  {
+    return m_backend.browse( path, browse_filter(), branches, leaves );
+  }
+
+  vector<BACKEND_BROWSE_ELEMENT> elements;
+  OPCDA_RESULT result = browse_elements( path, BACKEND_BROWSE_FILTER::ALL, false, elements );
+
+  for ( const auto& element : elements )
+  {
+    if ( element.has_children )
+    {
+      branches.push_back( element.name );
+    }
+
+    if ( element.is_item )
+    {
+      leaves.push_back( element.name );
+    }
+  }
+  return result;
+}
+
+OPCDA_RESULT BackendSession::browse_elements( const wstring& item_id, BACKEND_BROWSE_FILTER filter, bool with_properties, vector<BACKEND_BROWSE_ELEMENT>& elements )
+{
+  TraceSpan span( "browse_elements" );
+
+  BACKEND_BROWSE_QUERY query = browse_filter();
+  query.filter = filter;
+  query.with_properties = with_properties;
+
+  // branch names are never filtered, otherwise the tree below them would be cut off
+  if ( filter == BACKEND_BROWSE_FILTER::BRANCHES )
+  {
+    query.name.clear();
+  }
+
+  wstring continuation;
+  size_t before = elements.size();
+
+  do
+  {
+    OPCDA_RESULT result = m_backend.browse_elements( item_id, query, continuation, elements );
+    if ( opcda_failed( result ) )
+    {
+      Logger::instance().logWarning( "[backend] Browsing " + narrow( item_id ) + " failed: " + to_string( result ) );
+      return result;
+    }
+  } while ( !continuation.empty() );
+
+  span.set_items( static_cast<int64_t>( elements.size() - before ) );
+  return OPCDA_OK;
+}
+
+OPCDA_RESULT BackendSession::browse_all( vector<wstring>& browse_paths, const wstring& path, const function<void( const BACKEND_BROWSE_ELEMENT& )>& on_item )
+{
+  TraceSpan span( "browse_all" );
+  size_t before = browse_paths.size();
+
+  BACKEND_FEATURES features = m_backend.features();
+  OPCDA_RESULT result;
+
+  if ( features.browse_elements )
+  {
+    result = browse_elements_all( path, browse_paths, on_item );
+  }
+  else
+  {
+    // a flat space has no branches, its root lists every item
+    result = browse_address_space( features.flat ? L"" : path, browse_paths );
+  }
+
+  span.set_items( static_cast<int64_t>( browse_paths.size() - before ) );
+  return result;
+}
+
+OPCDA_RESULT BackendSession::browse_elements_all( const wstring& root, vector<wstring>& browse_paths, const function<void( const BACKEND_BROWSE_ELEMENT& )>& on_item )
+{
+  struct BROWSE_NODE
+  {
+    wstring item_id;
+    int depth;
+  };
+
+  vector<BROWSE_NODE> nodes;
+  nodes.push_back( { root, 0 } );
+
+  set<wstring> processed;
+  set<wstring> known( browse_paths.begin(), browse_paths.end() );
+  BACKEND_BROWSE_QUERY filter = browse_filter();
+  bool split = !filter.name.empty();
+  OPCDA_RESULT result = OPCDA_OK;
+
+  while ( !nodes.empty() )
+  {
+    BROWSE_NODE current = nodes.back();
+    nodes.pop_back();
+
+    if ( !processed.insert( current.item_id ).second )
+    {
+      continue;
+    }
+
+    if ( current.depth > m_max_browse_depth )
+    {
+      Logger::instance().logWarning( "[backend] Browse depth limit " + to_string( m_max_browse_depth ) + " reached at " + narrow( current.item_id ) );
+      result = OPCDA_FALSE;
+      continue;
+    }
+
+    // with a name filter, branches and items need separate calls so that filtering never prunes branches
+    vector<BACKEND_BROWSE_ELEMENT> elements;
+    OPCDA_RESULT browsed = browse_elements( current.item_id, split ? BACKEND_BROWSE_FILTER::ITEMS : BACKEND_BROWSE_FILTER::ALL, true, elements );
+
+    if ( !opcda_failed( browsed ) && split )
+    {
+      browsed = browse_elements( current.item_id, BACKEND_BROWSE_FILTER::BRANCHES, false, elements );
+    }
+
+    if ( opcda_failed( browsed ) )
+    {
+      // one unreadable branch does not end the walk
+      result = current.depth == 0 ? browsed : OPCDA_FALSE;
+      continue;
+    }
+
+    for ( const auto& element : elements )
+    {
+      if ( element.has_children )
+      {
+        nodes.push_back( { element.item_id, current.depth + 1 } );
+      }
+
+      // IOPCBrowse has no data type filter, apply it to the returned properties
+      if ( filter.data_type != OPCDA_TYPE_EMPTY && element.has_properties && element.data_type != filter.data_type )
+      {
+        continue;
+      }
+
+      if ( element.is_item && !element.item_id.empty() && known.insert( element.item_id ).second )
+      {
+        browse_paths.push_back( element.item_id );
+        store_mapping( element.item_id, element.item_id );
+
+        if ( on_item )
+        {
+          on_item( element );
+        }
+      }
+    }
+  }
+  return result;
+}
+
+OPCDA_RESULT BackendSession::browse_address_space( const wstring& root, vector<wstring>& browse_paths )
+{
+  struct BROWSE_PATH
+  {
+    wstring path;
+    int depth;
+  };
+
+  vector<BROWSE_PATH> paths;
+  paths.push_back( { root, 0 } );
+
+  set<wstring> processed;
+  set<wstring> known( browse_paths.begin(), browse_paths.end() );
+  BACKEND_BROWSE_QUERY filter = browse_filter();
+  OPCDA_RESULT result = OPCDA_OK;
+
+  vector<wstring> branches;
+  vector<wstring> leaves;
+
+  while ( !paths.empty() )
+  {
+    BROWSE_PATH current = paths.back();
+    paths.pop_back();
+
+    if ( !processed.insert( current.path ).second )
+    {
+      continue;
+    }
+
+    if ( current.depth > m_max_browse_depth )
+    {
+      Logger::instance().logWarning( "[backend] Browse depth limit " + to_string( m_max_browse_depth ) + " reached at " + narrow( current.path ) );
+      result = OPCDA_FALSE;
+      continue;
+    }
+
+    OPCDA_RESULT browsed = m_backend.browse( current.path, filter, branches, leaves );
+    if ( opcda_failed( browsed ) )
+    {
+      // one unreadable branch does not end the walk
+      result = current.depth == 0 ? browsed : OPCDA_FALSE;
+      continue;
+    }
+
+    for ( const auto& leaf : leaves )
+    {
+      wstring browse_path = current.path.empty() ? leaf : current.path + L"." + leaf;
+      if ( known.insert( browse_path ).second )
+      {
+        browse_paths.push_back( move( browse_path ) );
+      }
+    }
+
+    for ( const auto& branch : branches )
+    {
+      paths.push_back( { current.path.empty() ? branch : current.path + L"." + branch, current.depth + 1 } );
+    }
+  }
+  return result;
+}
+
+bool BackendSession::find_mapping( const wstring& browse_path, wstring& item_id ) const
+{
+  shared_lock<shared_mutex> lock( m_mapping_lock );
+
+  auto it = m_id_mapping.find( browse_path );
+  if ( it == m_id_mapping.end() )
+  {
+    return false;
+  }
+
+  item_id = it->second;
+  return true;
+}
+
+void BackendSession::store_mapping( const wstring& browse_path, const wstring& item_id )
+{
+  unique_lock<shared_mutex> lock( m_mapping_lock );
+  m_id_mapping[browse_path] = item_id;
+}
+
+wstring BackendSession::mapped_id( const wstring& browse_path ) const
+{
+  wstring item_id;
+  return find_mapping( browse_path, item_id ) ? item_id : browse_path;
+}
+
+bool BackendSession::is_valid( const wstring& item_id )
+{
+  vector<BACKEND_ITEM> items;
+  OPCDA_RESULT result = m_backend.validate( vector<wstring>{ item_id }, items );
+  return !opcda_failed( result ) && items.size() == 1 && !opcda_failed( items[0].error );
+}
+
+OPCDA_RESULT BackendSession::resolve( const wstring& browse_path, wstring& item_id )
+{
+  TraceSpan span( "resolve_item_id" );
+
+  if ( find_mapping( browse_path, item_id ) )
+  {
+    return OPCDA_OK;
+  }
+
+  wstring candidate;
+  OPCDA_RESULT result = m_backend.item_id( browse_path, candidate );
+
+  // resolution stays on the connecting apartment, other threads use the path as it is
+  if ( result == OPCDA_E_WRONG_THREAD )
+  {
+    item_id = browse_path;
+    return OPCDA_FALSE;
+  }
+
+  if ( !opcda_failed( result ) && !candidate.empty() && is_valid( candidate ) )
+  {
+    item_id = candidate;
+    store_mapping( browse_path, item_id );
+    return OPCDA_OK;
+  }
+
+  vector<pair<wstring, wstring>> patterns;
+  {
+    shared_lock<shared_mutex> lock( m_mapping_lock );
+    patterns = m_id_patterns;
+  }
+
+  for ( const auto& pattern : patterns )
+  {
+    if ( browse_path.compare( 0, pattern.first.size(), pattern.first ) == 0 )
+    {
+      wstring transformed = pattern.second + browse_path.substr( pattern.first.size() );
+
+      if ( is_valid( transformed ) )
+      {
+        item_id = transformed;
+        store_mapping( browse_path, item_id );
+        return OPCDA_OK;
+      }
+    }
+  }
+
+  vector<wstring> candidates;
+  item_id_candidates( browse_path, candidates );
+
+  for ( const auto& id : candidates )
+  {
+    if ( is_valid( id ) )
+    {
+      item_id = id;
+      store_mapping( browse_path, item_id );
+      learn_pattern( browse_path, id );
+      return OPCDA_OK;
+    }
+  }
+
+  item_id = browse_path;
+  return OPCDA_FALSE;
+}
+
+void BackendSession::item_id_candidates( const wstring& browse_path, vector<wstring>& candidates ) const
+{
+  vector<wstring> components;
+  size_t start = 0;
+  size_t end = 0;
+
+  while ( ( end = browse_path.find( L'.', start ) ) != wstring::npos )
+  {
+    components.push_back( browse_path.substr( start, end - start ) );
+    start = end + 1;
+  }
+  components.push_back( browse_path.substr( start ) );
+
+  // the whole path, then every suffix of its components down to the last one
+  candidates.push_back( browse_path );
+
+  for ( size_t i = 1; i < components.size(); ++i )
+  {
+    wstring suffix;
+    for ( size_t j = i; j < components.size(); ++j )
+    {
+      if ( j > i )
+      {
+        suffix += L".";
+      }
+      suffix += components[j];
+    }
+
+    if ( !suffix.empty() && find( candidates.begin(), candidates.end(), suffix ) == candidates.end() )
+    {
+      candidates.push_back( suffix );
+    }
+  }
+}
+
+void BackendSession::learn_pattern( const wstring& browse_path, const wstring& item_id )
+{
+  size_t first_dot = browse_path.find( L'.' );
+
+  if ( first_dot == wstring::npos || ( browse_path.substr( first_dot ) != item_id && browse_path.substr( first_dot + 1 ) != item_id ) )
+  {
+    return;
+  }
+
+  // the server drops the first component: later paths under it skip the candidates
+  wstring prefix = browse_path.substr( 0, first_dot + 1 );
+  unique_lock<shared_mutex> lock( m_mapping_lock );
+
+  if ( none_of( m_id_patterns.begin(), m_id_patterns.end(), [&]( const pair<wstring, wstring>& pattern ) { return pattern.first == prefix; } ) )
+  {
+    Logger::instance().logDebug( "[backend] Found item ID pattern: '" + narrow( prefix ) + "' -> ''" );
+    m_id_patterns.push_back( make_pair( prefix, wstring() ) );
+  }
+}
+
+OPCDA_RESULT BackendSession::readable_items( const vector<wstring>& browse_paths, vector<wstring>& item_ids )
+{
+  TraceSpan span( "resolve_readable", static_cast<int64_t>( browse_paths.size() ) );
+  item_ids.clear();
+
+  vector<wstring> resolved;
+  resolved.reserve( browse_paths.size() );
+
+  for ( const auto& browse_path : browse_paths )
+  {
+    wstring item_id;
+    if ( !find_mapping( browse_path, item_id ) && opcda_failed( m_backend.item_id( browse_path, item_id ) ) )
+    {
+      item_id = browse_path;
+    }
+    resolved.push_back( move( item_id ) );
+  }
+
+  vector<BACKEND_ITEM> items;
+  OPCDA_RESULT result = m_backend.validate( resolved, items );
+  if ( opcda_failed( result ) )
+  {
+    return result;
+  }
+
+  // what the server's own resolution got wrong goes through the patterns and candidates, then one more validate
+  vector<wstring> retry_ids;
+  vector<size_t> retry_at;
+
+  for ( size_t i = 0; i < items.size(); ++i )
+  {
+    wstring item_id;
+    if ( opcda_failed( items[i].error ) && resolve( browse_paths[i], item_id ) == OPCDA_OK && item_id != resolved[i] )
+    {
+      retry_ids.push_back( item_id );
+      retry_at.push_back( i );
+    }
+  }
+
+  if ( !retry_ids.empty() )
+  {
+    vector<BACKEND_ITEM> retried;
+    if ( !opcda_failed( m_backend.validate( retry_ids, retried ) ) )
+    {
+      for ( size_t k = 0; k < retry_at.size(); ++k )
+      {
+        items[retry_at[k]] = move( retried[k] );
+      }
+    }
+  }
+
+  for ( size_t i = 0; i < items.size(); ++i )
+  {
+    if ( opcda_failed( items[i].error ) )
+    {
+      continue;
+    }
+
+    store_mapping( browse_paths[i], items[i].item_id );
+
+    if ( items[i].access_rights & OPCDA_ACCESS_READABLE )
+    {
+      item_ids.push_back( items[i].item_id );
+    }
+  }
+  return item_ids.size() == browse_paths.size() ? OPCDA_OK : OPCDA_FALSE;
+}
+
+uint32_t BackendSession::client_handle( const wstring& item_id )
+{
+  auto it = m_handles.find( item_id );
+  if ( it != m_handles.end() )
+  {
+    return it->second;
+  }
+
+  uint32_t handle = m_next_handle++;
+  m_handles[item_id] = handle;
+  return handle;
+}
+
+void BackendSession::client_handles( const vector<wstring>& item_ids, vector<uint32_t>& handles )
+{
+  lock_guard<mutex> lock( m_lock );
+  handles.resize( item_ids.size() );
+
+  for ( size_t i = 0; i < item_ids.size(); ++i )
+  {
+    handles[i] = client_handle( item_ids[i] );
+  }
+}
+
+void BackendSession::find_client_handles( const vector<wstring>& item_ids, vector<uint32_t>& handles ) const
+{
+  lock_guard<mutex> lock( m_lock );
+  handles.assign( item_ids.size(), 0 );
+
+  for ( size_t i = 0; i < item_ids.size(); ++i )
+  {
+    auto it = m_handles.find( item_ids[i] );
+    if ( it != m_handles.end() )
+    {
+      handles[i] = it->second;
+    }
+  }
+}
+
+void BackendSession::registrations( const vector<wstring>& item_ids, vector<BACKEND_ITEM>& items ) const
+{
+  lock_guard<mutex> lock( m_lock );
+  items.assign( item_ids.size(), BACKEND_ITEM() );
+
+  for ( size_t i = 0; i < item_ids.size(); ++i )
+  {
+    auto it = m_items.find( item_ids[i] );
+    if ( it != m_items.end() )
+    {
+      items[i] = it->second;
+    }
+  }
+}
+
+OPCDA_RESULT BackendSession::add_items( const vector<wstring>& keys, const vector<wstring>& item_ids, vector<BACKEND_ITEM>& items )
+{
+  vector<uint32_t> handles;
+  client_handles( keys, handles );
+
+  OPCDA_RESULT result = m_backend.add( item_ids, handles, items );
+  if ( opcda_failed( result ) )
+  {
+    Logger::instance().logError( "[backend] Adding " + to_string( item_ids.size() ) + " items failed: " + to_string( result ) );
+  }
+  return result;
+}
+
+OPCDA_RESULT BackendSession::register_items( const vector<wstring>& item_ids, vector<BACKEND_ITEM>& items )
+{
+  TraceSpan span( "register_items", static_cast<int64_t>( item_ids.size() ) );
+  items.assign( item_ids.size(), BACKEND_ITEM() );
+
+  auto find_missing = [&]( vector<wstring>& missing )
+  {
+    lock_guard<mutex> lock( m_lock );
+    set<wstring> listed;
+
+    for ( const auto& id : item_ids )
+    {
+      if ( !m_items.count( id ) && listed.insert( id ).second )
+      {
+        missing.push_back( id );
+      }
+    }
+  };
+
+  vector<wstring> missing;
+  find_missing( missing );
+
+  if ( !missing.empty() )
+  {
+    // one registration at a time, so no item is added twice; reads of registered items do not wait
+    lock_guard<mutex> registering( m_register_lock );
+
+    missing.clear();
+    find_missing( missing );
+
+    if ( !missing.empty() )
+    {
+      vector<wstring> ids;
+      ids.reserve( missing.size() );
+      for ( const auto& key : missing )
+      {
+        ids.push_back( mapped_id( key ) );
+      }
+
+      vector<BACKEND_ITEM> added;
+      OPCDA_RESULT result = add_items( missing, ids, added );
+
+      if ( opcda_failed( result ) )
+      {
+        for ( auto& item : items )
+        {
+          item.error = result;
+        }
+        return result;
+      }
+
+      // IDs the server rejects may be browse paths; resolve those and add them once more
+      vector<wstring> retry_keys;
+      vector<wstring> retry_ids;
+      vector<size_t> retry_at;
+
+      for ( size_t k = 0; k < missing.size(); ++k )
+      {
+        wstring item_id;
+        if ( opcda_failed( added[k].error ) && resolve( missing[k], item_id ) == OPCDA_OK && item_id != ids[k] )
+        {
+          retry_keys.push_back( missing[k] );
+          retry_ids.push_back( item_id );
+          retry_at.push_back( k );
+        }
+      }
+
+      vector<BACKEND_ITEM> retried;
+      if ( !retry_ids.empty() && !opcda_failed( add_items( retry_keys, retry_ids, retried ) ) )
+      {
+        for ( size_t j = 0; j < retry_at.size(); ++j )
+        {
+          added[retry_at[j]] = move( retried[j] );
+        }
+      }
+
+      lock_guard<mutex> lock( m_lock );
+      for ( size_t k = 0; k < missing.size(); ++k )
+      {
+        m_items[missing[k]] = move( added[k] );
+      }
+    }
+  }
+
+  lock_guard<mutex> lock( m_lock );
+  for ( size_t i = 0; i < item_ids.size(); ++i )
+  {
+    auto it = m_items.find( item_ids[i] );
+    if ( it != m_items.end() )
+    {
+      items[i] = it->second;
+    }
+    else
+    {
+      // unregistered by another thread in the meantime
+      items[i].item_id = item_ids[i];
+      items[i].error = OPCDA_E_INVALIDHANDLE;
+    }
+  }
+  return OPCDA_OK;
+}
+
+OPCDA_RESULT BackendSession::read( const vector<wstring>& item_ids, vector<BACKEND_VALUE>& values, BACKEND_SOURCE source )
+{
+  if ( item_ids.empty() )
+  {
+    values.clear();
+    return OPCDA_OK;
+  }
+
+  // item IO needs no group: nothing to register, and the source is a max age
+  if ( m_backend.features().item_io )
+  {
+    return read_ids( item_ids, source == BACKEND_SOURCE::DEVICE ? BACKEND_MAX_AGE_DEVICE : m_max_age.load(), values );
+  }
+
+  return read_group( item_ids, source, values );
+}
+
+OPCDA_RESULT BackendSession::read_group( const vector<wstring>& item_ids, BACKEND_SOURCE source, vector<BACKEND_VALUE>& values )
+{
+  TraceSpan span( "read", static_cast<int64_t>( item_ids.size() ) );
+  values.assign( item_ids.size(), BACKEND_VALUE() );
+
+  // items stay registered once added, so repeated reads skip the add entirely
+  vector<BACKEND_ITEM> items;
+  OPCDA_RESULT result = register_items( item_ids, items );
+  if ( opcda_failed( result ) )
+  {
+    for ( auto& value : values )
+    {
+      value.error = result;
+    }
+    return result;
+  }
+
+  vector<uint32_t> handles;
+  vector<size_t> positions;
+  handles.reserve( item_ids.size() );
+  positions.reserve( item_ids.size() );
+
+  for ( size_t i = 0; i < items.size(); ++i )
+  {
+    if ( opcda_failed( items[i].error ) )
+    {
+      // counted, not printed: a console line per bad tag and poll outweighs the read itself
+      values[i].error = items[i].error;
+      ItemErrorStats::instance().record( "Read", item_ids[i], 0, items[i].error );
+      result = OPCDA_FALSE;
+      continue;
+    }
+    handles.push_back( items[i].handle );
+    positions.push_back( i );
+  }
+
+  vector<uint32_t> batch;
+  vector<BACKEND_VALUE> batch_values;
+
+  for ( size_t first = 0; first < handles.size(); first += m_read_batch )
+  {
+    size_t last = min( first + m_read_batch, handles.size() );
+    batch.assign( handles.begin() + first, handles.begin() + last );
+
+    OPCDA_RESULT batch_result;
+    {
+      TraceSpan batch_span( "read_batch", static_cast<int64_t>( batch.size() ) );
+      batch_result = m_backend.read( batch, source, batch_values );
+    }
+
+    if ( opcda_failed( batch_result ) )
+    {
+      // this batch and the ones after it were never read
+      for ( size_t k = first; k < handles.size(); ++k )
+      {
+        values[positions[k]].handle = handles[k];
+        values[positions[k]].error = batch_result;
+      }
+      return batch_result;
+    }
+
+    for ( size_t k = 0; k < batch.size(); ++k )
+    {
+      BACKEND_VALUE& value = values[positions[first + k]];
+      value = move( batch_values[k] );
+
+      if ( opcda_failed( value.error ) )
+      {
+        ItemErrorStats::instance().record( "Read", item_ids[positions[first + k]], batch[k], value.error );
+        result = OPCDA_FALSE;
+      }
+    }
+  }
+  return result;
+}
+
+OPCDA_RESULT BackendSession::read_id_batches( const vector<wstring>& item_ids, const vector<size_t>& targets, uint32_t max_age_ms, vector<BACKEND_VALUE>& values )
+{
+  vector<wstring> batch;
+  vector<BACKEND_VALUE> batch_values;
+
+  for ( size_t first = 0; first < item_ids.size(); first += m_read_batch )
+  {
+    size_t last = min( first + m_read_batch, item_ids.size() );
+    batch.assign( item_ids.begin() + first, item_ids.begin() + last );
+
+    OPCDA_RESULT result = m_backend.read_ids( batch, max_age_ms, batch_values );
+
+    if ( opcda_failed( result ) )
+    {
+      for ( size_t k = first; k < item_ids.size(); ++k )
+      {
+        values[targets[k]].error = result;
+      }
+      return result;
+    }
+
+    for ( size_t k = 0; k < batch.size(); ++k )
+    {
+      values[targets[first + k]] = move( batch_values[k] );
+    }
+  }
+  return OPCDA_OK;
+}
+
+OPCDA_RESULT BackendSession::read_ids( const vector<wstring>& item_ids, uint32_t max_age_ms, vector<BACKEND_VALUE>& values )
+{
+  TraceSpan span( "read_item_io", static_cast<int64_t>( item_ids.size() ) );
+  values.assign( item_ids.size(), BACKEND_VALUE() );
+
+  vector<wstring> resolved;
+  vector<size_t> targets;
+  resolved.reserve( item_ids.size() );
+  targets.reserve( item_ids.size() );
+
+  for ( size_t i = 0; i < item_ids.size(); ++i )
+  {
+    resolved.push_back( mapped_id( item_ids[i] ) );
+    targets.push_back( i );
+  }
+
+  OPCDA_RESULT result = read_id_batches( resolved, targets, max_age_ms, values );
+  if ( opcda_failed( result ) )
+  {
+    return result;
+  }
+
+  // browse paths that are not item IDs go through the usual resolution, then one more read
+  vector<wstring> retry_ids;
+  vector<size_t> retry_targets;
+
+  for ( size_t i = 0; i < item_ids.size(); ++i )
+  {
+    wstring item_id;
+    if ( ( values[i].error == OPCDA_E_UNKNOWNITEMID || values[i].error == OPCDA_E_INVALIDITEMID ) && resolve( item_ids[i], item_id ) == OPCDA_OK && item_id != resolved[i] )
+    {
+      retry_ids.push_back( item_id );
+      retry_targets.push_back( i );
+    }
+  }
+
+  if ( !retry_ids.empty() && opcda_failed( result = read_id_batches( retry_ids, retry_targets, max_age_ms, values ) ) )
+  {
+    Logger::instance().logWarning( "[backend] Item IO read with resolved item IDs failed: " + to_string( result ) );
+  }
+
+  for ( size_t i = 0; i < item_ids.size(); ++i )
+  {
+    if ( opcda_failed( values[i].error ) )
+    {
+      ItemErrorStats::instance().record( "ItemIO.Read", item_ids[i], 0, values[i].error );
+    }
+  }
+  return any_failed( values ) ? OPCDA_FALSE : OPCDA_OK;
+}
+
+OPCDA_RESULT BackendSession::write( const vector<wstring>& item_ids, const vector<BACKEND_VALUE>& values, vector<OPCDA_RESULT>& errors )
+{
+  TraceSpan span( "write_sync", static_cast<int64_t>( item_ids.size() ) );
+  errors.assign( item_ids.size(), OPCDA_OK );
+
+  if ( item_ids.size() != values.size() )
+  {
+    return OPCDA_E_INVALIDARG;
+  }
+
+  if ( item_ids.empty() )
+  {
+    return OPCDA_OK;
+  }
+
+  if ( m_backend.features().item_io )
+  {
+    // only items a group read has registered have a known canonical type here
+    vector<BACKEND_ITEM> items;
+    registrations( item_ids, items );
+
+    vector<wstring> ids;
+    vector<BACKEND_VALUE> typed( values );
+    ids.reserve( item_ids.size() );
+
+    for ( size_t i = 0; i < item_ids.size(); ++i )
+    {
+      ids.push_back( mapped_id( item_ids[i] ) );
+      if ( items[i].handle && items[i].canonical_type != OPCDA_TYPE_EMPTY )
+      {
+        typed[i].type = items[i].canonical_type;
+      }
+    }
+
+    OPCDA_RESULT result = m_backend.write_ids( ids, typed, errors );
+    if ( opcda_failed( result ) )
+    {
+      errors.assign( item_ids.size(), result );
+      return result;
+    }
+    return any_failed( errors ) ? OPCDA_FALSE : OPCDA_OK;
+  }
+
+  TraceSpan group_span( "write_group", static_cast<int64_t>( item_ids.size() ) );
+
+  vector<BACKEND_ITEM> items;
+  OPCDA_RESULT result = register_items( item_ids, items );
+  if ( opcda_failed( result ) )
+  {
+    errors.assign( item_ids.size(), result );
+    return result;
+  }
+
+  vector<BACKEND_VALUE> accepted;
+  vector<size_t> positions;
+
+  for ( size_t i = 0; i < items.size(); ++i )
+  {
+    if ( opcda_failed( items[i].error ) )
+    {
+      errors[i] = items[i].error;
+      continue;
+    }
+
+    BACKEND_VALUE value;
+    value.handle = items[i].handle;
+    value.value = values[i].value;
+    value.type = items[i].canonical_type != OPCDA_TYPE_EMPTY ? items[i].canonical_type : values[i].type;
+    accepted.push_back( move( value ) );
+    positions.push_back( i );
+  }
+
+  if ( accepted.empty() )
+  {
+    return OPCDA_FALSE;
+  }
+
+  vector<OPCDA_RESULT> write_errors;
+  OPCDA_RESULT write_result = m_backend.write( accepted, write_errors );
+
+  for ( size_t k = 0; k < positions.size(); ++k )
+  {
+    errors[positions[k]] = opcda_failed( write_result ) ? write_result : write_errors[k];
+  }
+
+  if ( opcda_failed( write_result ) )
+  {
+    return write_result;
+  }
+  return any_failed( errors ) ? OPCDA_FALSE : OPCDA_OK;
+}
+
+OPCDA_RESULT BackendSession::write_async( const vector<wstring>& item_ids, const vector<BACKEND_VALUE>& values, uint32_t& transaction, vector<OPCDA_RESULT>& errors )
+{
+  TraceSpan span( "write_async", static_cast<int64_t>( item_ids.size() ) );
+  transaction = 0;
+  errors.assign( item_ids.size(), OPCDA_OK );
+
+  if ( item_ids.size() != values.size() )
+  {
+    return OPCDA_E_INVALIDARG;
+  }
+
+  if ( item_ids.empty() )
+  {
+    return OPCDA_OK;
+  }
+
+  if ( !m_backend.features().async_write )
+  {
+    return OPCDA_E_NOINTERFACE;
+  }
+
+  vector<BACKEND_ITEM> items;
+  OPCDA_RESULT result = register_items( item_ids, items );
+  if ( opcda_failed( result ) )
+  {
+    errors.assign( item_ids.size(), result );
+    return result;
+  }
+
+  vector<uint32_t> handles;
+  find_client_handles( item_ids, handles );
+
+  vector<BACKEND_VALUE> accepted;
+  vector<size_t> positions;
+  map<uint32_t, wstring> pending;
+
+  for ( size_t i = 0; i < items.size(); ++i )
+  {
+    if ( opcda_failed( items[i].error ) )
+    {
+      errors[i] = items[i].error;
+      continue;
+    }
+
+    BACKEND_VALUE value;
+    value.handle = items[i].handle;
+    value.value = values[i].value;
+    value.type = items[i].canonical_type != OPCDA_TYPE_EMPTY ? items[i].canonical_type : values[i].type;
+    accepted.push_back( move( value ) );
+    positions.push_back( i );
+    pending[handles[i]] = item_ids[i];
+  }
+
+  if ( accepted.empty() )
+  {
+    return OPCDA_FALSE;
+  }
+
+  // registered before the call, the completion can arrive while the write is still pumping
+  {
+    lock_guard<mutex> async( m_async_lock );
+    transaction = ++m_next_transaction;
+    m_pending_writes[transaction] = move( pending );
+    s_async_writes_pending.set( static_cast<int64_t>( m_pending_writes.size() ) );
+  }
+
+  vector<OPCDA_RESULT> write_errors;
+  OPCDA_RESULT write_result = m_backend.write_async( accepted, transaction, write_errors );
+
+  for ( size_t k = 0; k < positions.size(); ++k )
+  {
+    errors[positions[k]] = opcda_failed( write_result ) ? write_result : write_errors[k];
+  }
+
+  // no completion comes for a transaction the server queued nothing of
+  if ( opcda_failed( write_result ) || all_of( write_errors.begin(), write_errors.end(), []( OPCDA_RESULT e ) { return opcda_failed( e ); } ) )
+  {
+    lock_guard<mutex> async( m_async_lock );
+    m_pending_writes.erase( transaction );
+    s_async_writes_pending.set( static_cast<int64_t>( m_pending_writes.size() ) );
+  }
+
+  if ( opcda_failed( write_result ) )
+  {
+    return write_result;
+  }
+  return any_failed( errors ) ? OPCDA_FALSE : OPCDA_OK;
+}
+
+void BackendSession::set_write_complete( const SESSION_WRITE_COMPLETE& on_complete )
+{
+  lock_guard<mutex> async( m_async_lock );
+  m_write_complete = on_complete;
+}
+
+void BackendSession::on_write_complete( uint32_t transaction, OPCDA_RESULT master_error, const vector<uint32_t>& client_handles, const vector<OPCDA_RESULT>& errors )
+{
+  SESSION_WRITE_COMPLETE on_complete;
+  vector<wstring> ids;
+  vector<OPCDA_RESULT> results;
+
+  {
+    lock_guard<mutex> async( m_async_lock );
+
+    auto it = m_pending_writes.find( transaction );
+    if ( it == m_pending_writes.end() )
+    {
+      return;
+    }
+
+    for ( size_t i = 0; i < client_handles.size(); ++i )
+    {
+      auto item = it->second.find( client_handles[i] );
+      if ( item != it->second.end() )
+      {
+        ids.push_back( item->second );
+        results.push_back( i < errors.size() ? errors[i] : master_error );
+      }
+    }
+
+    m_pending_writes.erase( it );
+    s_async_writes_pending.set( static_cast<int64_t>( m_pending_writes.size() ) );
+    on_complete = m_write_complete;
+  }
+
+  if ( on_complete )
+  {
+    on_complete( transaction, ids, results );
+  }
+}
+
+void BackendSession::drop_pending_writes()
+{
+  // completions for these can no longer arrive
+  lock_guard<mutex> async( m_async_lock );
+  m_pending_writes.clear();
+  s_async_writes_pending.set( 0 );
+}
+
+OPCDA_RESULT BackendSession::unregister( const vector<wstring>& item_ids )
+{
+  TraceSpan span( "unregister_items", static_cast<int64_t>( item_ids.size() ) );
+
+  lock_guard<mutex> registering( m_register_lock );
+  vector<uint32_t> handles;
+  {
+    lock_guard<mutex> lock( m_lock );
+
+    for ( const auto& item_id : item_ids )
+    {
+      auto item = m_items.find( item_id );
+      if ( item != m_items.end() )
+      {
+        if ( !opcda_failed( item->second.error ) )
+        {
+          handles.push_back( item->second.handle );
+        }
+        m_items.erase( item );
+      }
+
+      // client handles are not reused, so a read still in flight only fills an orphaned slot
+      m_handles.erase( item_id );
+    }
+  }
+
+  if ( handles.empty() )
+  {
+    return OPCDA_OK;
+  }
+
+  // the registration is gone either way: a failed removal must not be restored on reconnect
+  vector<OPCDA_RESULT> errors;
+  OPCDA_RESULT result = m_backend.remove( handles, errors );
+  if ( opcda_failed( result ) )
+  {
+    Logger::instance().logWarning( "[backend] Removing " + to_string( handles.size() ) + " items failed: " + to_string( result ) );
+  }
+  return result;
+}
+
+OPCDA_RESULT BackendSession::restore()
+{
+  TraceSpan span( "restore_items" );
+  drop_pending_writes();
+
+  lock_guard<mutex> registering( m_register_lock );
+  vector<wstring> keys;
+  vector<wstring> ids;
+  vector<uint32_t> handles;
+  {
+    lock_guard<mutex> lock( m_lock );
+
+    // items that failed before are tried again on their next read
+    for ( auto it = m_items.begin(); it != m_items.end(); )
+    {
+      if ( opcda_failed( it->second.error ) )
+      {
+        it = m_items.erase( it );
+        continue;
+      }
+
+      keys.push_back( it->first );
+      ids.push_back( it->second.item_id );
+      handles.push_back( client_handle( it->first ) );
+      ++it;
+    }
+  }
+
+  if ( keys.empty() )
+  {
+    return OPCDA_OK;
+  }
+
+  // item IDs were resolved before the outage, one add brings them all back
+  vector<BACKEND_ITEM> added;
+  OPCDA_RESULT result = m_backend.add( ids, handles, added );
+  if ( opcda_failed( result ) )
+  {
+    Logger::instance().logError( "[backend] Restoring " + to_string( keys.size() ) + " items failed: " + to_string( result ) );
+    return result;
+  }
+
+  size_t restored = 0;
+  {
+    lock_guard<mutex> lock( m_lock );
+
+    for ( size_t k = 0; k < keys.size(); ++k )
+    {
+      if ( opcda_failed( added[k].error ) )
+      {
+        m_items.erase( keys[k] );
+        continue;
+      }
+
+      m_items[keys[k]] = move( added[k] );
+      ++restored;
+    }
+  }
+
+  Logger::instance().logInfo( "[backend] Restored " + to_string( restored ) + " of " + to_string( keys.size() ) + " items" );
+  return OPCDA_OK;
+}
+
+void BackendSession::release()
+{
+  lock_guard<mutex> registering( m_register_lock );
+  vector<uint32_t> handles;
+  {
+    lock_guard<mutex> lock( m_lock );
+
+    for ( const auto& item : m_items )
+    {
+      if ( !opcda_failed( item.second.error ) )
+      {
+        handles.push_back( item.second.handle );
+      }
+    }
+    m_items.clear();
+  }
+
+  if ( !handles.empty() )
+  {
+    vector<OPCDA_RESULT> errors;
+    m_backend.remove( handles, errors );
+  }
+}
+
+void BackendSession::clear()
+{
+  {
+    lock_guard<mutex> registering( m_register_lock );
+    lock_guard<mutex> lock( m_lock );
+    m_items.clear();
+    m_handles.clear();
+  }
+  {
+    unique_lock<shared_mutex> lock( m_mapping_lock );
+    m_id_mapping.clear();
+    m_id_patterns.clear();
+  }
+  drop_pending_writes();
+}
+
+size_t BackendSession::registered() const
+{
+  lock_guard<mutex> lock( m_lock );
+  return m_items.size();
+}
+
+void BackendSession::to_samples( const vector<wstring>& item_ids, const vector<BACKEND_VALUE>& values, vector<OPCDA_SAMPLE>& samples )
+{
+  samples.reserve( samples.size() + values.size() );
+
+  for ( size_t i = 0; i < values.size() && i < item_ids.size(); ++i )
+  {
+    const BACKEND_VALUE& value = values[i];
+    if ( opcda_failed( value.error ) )
+    {
+      continue;
+    }
+
+    OPCDA_SAMPLE sample;
+    OPCDA::UTILS::append_utf8( item_ids[i].data(), item_ids[i].size(), sample.id );
+    sample.timestamp = value.timestamp;
+    sample.quality = value.quality;
+
+    if ( holds_alternative<vector<double>>( value.value ) )
+    {
+      // the whole array stays one sample with one contiguous payload
+      sample.elements = get<vector<double>>( value.value );
+      sample.value = sample.elements.empty() ? 0.0 : sample.elements.front();
+    }
+    else if ( holds_alternative<double>( value.value ) )
+      sample.value = get<double>( value.value );
+    else if ( holds_alternative<int64_t>( value.value ) )
+      sample.value = static_cast<double>( get<int64_t>( value.value ) );
+    else if ( holds_alternative<bool>( value.value ) )
+      sample.value = get<bool>( value.value ) ? 1.0 : 0.0;
+    else if ( holds_alternative<wstring>( value.value ) )
+    {
+      // like VariantChangeType, only strings that are a number in full convert
+      const wstring& text = get<wstring>( value.value );
+      wchar_t* end = nullptr;
+      sample.value = wcstod( text.c_str(), &end );
+      if ( text.empty() || end != text.c_str() + text.size() )
+      {
+        continue;
+      }
+    }
+    else
+    {
+      continue;
+    }
+
+    samples.push_back( move( sample ) );
+  }
+}
@@ -0,0 +1,157 @@
+// opcda_backend_session.h
+#ifndef OPCDA_BACKEND_SESSION_H
+#define OPCDA_BACKEND_SESSION_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "opcda_backend.h"
+#include "opcda_sample.h"
+
+using namespace std;
+
+constexpr int DEFAULT_BACKEND_BROWSE_DEPTH = 32;
+constexpr size_t DEFAULT_BACKEND_READ_BATCH = 5000;
+constexpr uint32_t BACKEND_MAX_AGE_CACHE = 0xFFFFFFFF;
+constexpr uint32_t BACKEND_MAX_AGE_DEVICE = 0;
+
+/** @brief Outcome of BackendSession::write_async, by item ID; items the server never reported are left out. */
+using SESSION_WRITE_COMPLETE = function<void( uint32_t transaction, const vector<wstring>& item_ids, const vector<OPCDA_RESULT>& errors )>;
+
+/**
+ * @brief Browse, ID resolution, registration and IO on top of any OpcDaBackend.
+ *
+ * The client core: OpcDaClient runs it over ComBackend, the bench and the
+ * checks over MemoryBackend, so every platform exercises the same code.
+ *
+ * Browsing uses DA 3.0 paged browsing when the backend has it and the
+ * address space otherwise. Browse paths resolve to item IDs through the
+ * mapping browsing left behind, the backend's own resolution, learned prefix
+ * patterns and finally a list of candidates, each validated.
+ *
+ * Items are registered once, on first use and in one add call, then read by
+ * handle in batches of at most read_batch items; backends with item IO read
+ * and write by ID instead and never register. Failed registrations are
+ * remembered too, so an unknown ID costs one round trip, not one per read,
+ * until unregister() or restore() forgets it. Every item ID keeps one client
+ * handle for the whole session, also when it is only read through item IO.
+ * Thread-safe; reads and writes run without a session lock held.
+ */
+class BackendSession
+{
+public:
+  explicit BackendSession( OpcDaBackend& backend );
+  ~BackendSession();
+
+  void set_max_browse_depth( int depth );
+  void set_read_batch( size_t items );
+  /** @brief Max age of item IO reads from the cache; BACKEND_MAX_AGE_CACHE takes any cached value. */
+  void set_max_age( uint32_t max_age_ms );
+  /** @brief Name, vendor and data type filters and the page size of every browse. */
+  void set_browse_filter( const BACKEND_BROWSE_QUERY& filter );
+
+  /** @brief Names of the branches and leaves directly below path. */
+  OPCDA_RESULT browse( const wstring& path, vector<wstring>& branches, vector<wstring>& leaves );
+  /**
+   * @brief Appends every leaf below path that is not listed yet: item IDs from a DA 3.0
+   *        or a flat browse, dotted browse paths from a hierarchical one. on_item sees
+   *        each new DA 3.0 element, with its data type and access rights when it has them.
+   */
+  OPCDA_RESULT browse_all( vector<wstring>& browse_paths, const wstring& path = L"", const function<void( const BACKEND_BROWSE_ELEMENT& )>& on_item = nullptr );
+  /** @brief Every page of the elements below item_id. */
+  OPCDA_RESULT browse_elements( const wstring& item_id, BACKEND_BROWSE_FILTER filter, bool with_properties, vector<BACKEND_BROWSE_ELEMENT>& elements );
+
+  /** @brief OPCDA_FALSE with item_id = browse_path when nothing validated. */
+  OPCDA_RESULT resolve( const wstring& browse_path, wstring& item_id );
+  /** @brief The item ID a browse path was resolved to, the path itself before that. */
+  wstring mapped_id( const wstring& browse_path ) const;
+  /** @brief Resolves browse paths to item IDs and keeps the readable ones, validated in one call. */
+  OPCDA_RESULT readable_items( const vector<wstring>& browse_paths, vector<wstring>& item_ids );
+
+  /** @brief Reads through item IO when the backend has it, from the group otherwise. */
+  OPCDA_RESULT read( const vector<wstring>& item_ids, vector<BACKEND_VALUE>& values, BACKEND_SOURCE source = BACKEND_SOURCE::CACHE );
+  /** @brief Item IO read in batches; IDs the server does not know are resolved and read once more. */
+  OPCDA_RESULT read_ids( const vector<wstring>& item_ids, uint32_t max_age_ms, vector<BACKEND_VALUE>& values );
+  /**
+   * @brief Writes each value as the canonical type of its item; value.type is only
+   *        used for items whose canonical type is not known yet.
+   */
+  OPCDA_RESULT write( const vector<wstring>& item_ids, const vector<BACKEND_VALUE>& values, vector<OPCDA_RESULT>& errors );
+  /** @brief write() through the group's async interface; the outcome goes to the write-complete callback. */
+  OPCDA_RESULT write_async( const vector<wstring>& item_ids, const vector<BACKEND_VALUE>& values, uint32_t& transaction, vector<OPCDA_RESULT>& errors );
+  void set_write_complete( const SESSION_WRITE_COMPLETE& on_complete );
+
+  /** @brief Registrations of item_ids; an unregistered ID gets an empty entry with handle 0. */
+  void registrations( const vector<wstring>& item_ids, vector<BACKEND_ITEM>& items ) const;
+  /** @brief Client handles of item_ids, handing out new ones for IDs that have none. */
+  void client_handles( const vector<wstring>& item_ids, vector<uint32_t>& handles );
+  /** @brief client_handles() without handing any out: 0 for IDs never used. */
+  void find_client_handles( const vector<wstring>& item_ids, vector<uint32_t>& handles ) const;
+
+  /** @brief Removes items from the backend and forgets their registration and client handle. */
+  OPCDA_RESULT unregister( const vector<wstring>& item_ids );
+  /** @brief Adds every registered item again in one call, after the backend reconnected. */
+  OPCDA_RESULT restore();
+  /** @brief Removes every registered item from the backend. */
+  void release();
+  /** @brief Forgets registrations, handles, mappings and pending writes without calling the backend. */
+  void clear();
+  size_t registered() const;
+
+  /** @brief Numeric values as samples; an array stays one sample with its elements in OPCDA_SAMPLE::elements. */
+  static void to_samples( const vector<wstring>& item_ids, const vector<BACKEND_VALUE>& values, vector<OPCDA_SAMPLE>& samples );
+
+private:
+  OpcDaBackend& m_backend;
+  int m_max_browse_depth = DEFAULT_BACKEND_BROWSE_DEPTH;
+  size_t m_read_batch = DEFAULT_BACKEND_READ_BATCH;
+  atomic<uint32_t> m_max_age{ BACKEND_MAX_AGE_CACHE };
+
+  mutable mutex m_filter_lock;
+  BACKEND_BROWSE_QUERY m_filter;
+
+  // lock order: register, items; mapping and async are never held with another
+  mutex m_register_lock;
+  mutable mutex m_lock;
+  unordered_map<wstring, BACKEND_ITEM> m_items;
+  unordered_map<wstring, uint32_t> m_handles;
+  uint32_t m_next_handle = 1;
+
+  mutable shared_mutex m_mapping_lock;
+  unordered_map<wstring, wstring> m_id_mapping;
+  vector<pair<wstring, wstring>> m_id_patterns;
+
+  // async writes in flight: transaction -> client handle -> item
+  mutex m_async_lock;
+  uint32_t m_next_transaction = 0;
+  map<uint32_t, map<uint32_t, wstring>> m_pending_writes;
+  SESSION_WRITE_COMPLETE m_write_complete;
+
+  BACKEND_BROWSE_QUERY browse_filter() const;
+  OPCDA_RESULT browse_elements_all( const wstring& root, vector<wstring>& browse_paths, const function<void( const BACKEND_BROWSE_ELEMENT& )>& on_item );
+  OPCDA_RESULT browse_address_space( const wstring& root, vector<wstring>& browse_paths );
+
+  bool find_mapping( const wstring& browse_path, wstring& item_id ) const;
+  void store_mapping( const wstring& browse_path, const wstring& item_id );
+  bool is_valid( const wstring& item_id );
+  void item_id_candidates( const wstring& browse_path, vector<wstring>& candidates ) const;
+  void learn_pattern( const wstring& browse_path, const wstring& item_id );
+
+  uint32_t client_handle( const wstring& item_id );
+  OPCDA_RESULT register_items( const vector<wstring>& item_ids, vector<BACKEND_ITEM>& items );
+  OPCDA_RESULT add_items( const vector<wstring>& keys, const vector<wstring>& item_ids, vector<BACKEND_ITEM>& items );
+  OPCDA_RESULT read_group( const vector<wstring>& item_ids, BACKEND_SOURCE source, vector<BACKEND_VALUE>& values );
+  OPCDA_RESULT read_id_batches( const vector<wstring>& item_ids, const vector<size_t>& targets, uint32_t max_age_ms, vector<BACKEND_VALUE>& values );
+  void on_write_complete( uint32_t transaction, OPCDA_RESULT master_error, const vector<uint32_t>& client_handles, const vector<OPCDA_RESULT>& errors );
+  void drop_pending_writes();
+};
+
+#endif
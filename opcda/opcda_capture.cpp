@@ -0,0 +1,1167 @@
+// opcda_capture.cpp
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <set>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "logger.h"
+#include "opcda_capture.h"
+#include "opcda_crc32.h"
+
+using namespace std;
+
+static const char CAPTURE_MAGIC[8] = { 'O', 'P', 'C', 'D', 'A', 'C', 'A', 'P' };
+static const uint64_t CAPTURE_HEADER_SIZE = 16;
+static const uint64_t CAPTURE_RECORD_HEADER_SIZE = 12;
+static const uint64_t CAPTURE_TRAILER_SIZE = CAPTURE_RECORD_HEADER_SIZE + 8;
+static const uint32_t CAPTURE_MAX_RECORD = 64u * 1024u * 1024u;
+
+static const uint32_t RECORD_TAG = 0x31474154;    // "TAG1"
+static const uint32_t RECORD_BLOCK = 0x314B4C42;  // "BLK1"
+static const uint32_t RECORD_ARRAY = 0x31525241;  // "ARR1"
+static const uint32_t RECORD_FOOTER = 0x31525446; // "FTR1"
+static const uint32_t RECORD_END = 0x31444E45;    // "END1"
+
+// ofstream::flush only reaches the OS cache; this pushes the file on to the disk
+static bool sync_file( const string& path )
+{
+#ifdef _WIN32
+  HANDLE f = CreateFileA( path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+  if ( f == INVALID_HANDLE_VALUE )
+  {
+    return false;
+  }
+
+  bool ok = FlushFileBuffers( f ) != FALSE;
+  CloseHandle( f );
+  return ok;
+#else
+  int fd = ::open( path.c_str(), O_WRONLY );
+  if ( fd < 0 )
+  {
+    return false;
+  }
+
+  bool ok = fsync( fd ) == 0;
+  ::close( fd );
+  return ok;
+#endif
+}
+
+static void put_u32( vector<uint8_t>& out, uint32_t v )
+{
+  for ( int i = 0; i < 4; ++i )
+  {
+    out.push_back( static_cast<uint8_t>( v >> ( i * 8 ) ) );
+  }
+}
+
+static void put_u64( vector<uint8_t>& out, uint64_t v )
+{
+  for ( int i = 0; i < 8; ++i )
+  {
+    out.push_back( static_cast<uint8_t>( v >> ( i * 8 ) ) );
+  }
+}
+
+static void put_varint( vector<uint8_t>& out, uint64_t v )
+{
+  while ( v >= 0x80 )
+  {
+    out.push_back( static_cast<uint8_t>( v | 0x80 ) );
+    v >>= 7;
+  }
+  out.push_back( static_cast<uint8_t>( v ) );
+}
+
+struct ByteCursor
+{
+  const uint8_t* data;
+  size_t size;
+  size_t pos = 0;
+  bool failed = false;
+
+  ByteCursor( const uint8_t* d, size_t s ) : data( d ), size( s )
+  {
+  }
+
+  uint64_t fixed( int bytes )
+  {
+    if ( pos + bytes > size )
+    {
+      failed = true;
+      return 0;
+    }
+
+    uint64_t v = 0;
+    for ( int i = 0; i < bytes; ++i )
+    {
+      v |= static_cast<uint64_t>( data[pos + i] ) << ( i * 8 );
+    }
+    pos += bytes;
+    return v;
+  }
+
+  uint64_t varint()
+  {
+    uint64_t v = 0;
+    for ( int shift = 0; shift < 64; shift += 7 )
+    {
+      if ( pos >= size )
+      {
+        failed = true;
+        return 0;
+      }
+
+      uint8_t b = data[pos++];
+      v |= static_cast<uint64_t>( b & 0x7F ) << shift;
+
+      if ( !( b & 0x80 ) )
+      {
+        return v;
+      }
+    }
+    failed = true;
+    return 0;
+  }
+
+  string text( size_t len )
+  {
+    if ( pos + len > size )
+    {
+      failed = true;
+      return string();
+    }
+
+    string s( reinterpret_cast<const char*>( data + pos ), len );
+    pos += len;
+    return s;
+  }
+};
+
+class BitWriter
+{
+public:
+  vector<uint8_t>& out;
+  int free_bits = 0;
+
+  explicit BitWriter( vector<uint8_t>& o ) : out( o )
+  {
+  }
+
+  void write( uint64_t value, int bits )
+  {
+    while ( bits > 0 )
+    {
+      if ( free_bits == 0 )
+      {
+        out.push_back( 0 );
+        free_bits = 8;
+      }
+
+      int take = min( bits, free_bits );
+      uint8_t chunk = static_cast<uint8_t>( ( value >> ( bits - take ) ) & ( ( 1u << take ) - 1 ) );
+      out.back() |= static_cast<uint8_t>( chunk << ( free_bits - take ) );
+      free_bits -= take;
+      bits -= take;
+    }
+  }
+};
+
+class BitReader
+{
+public:
+  const uint8_t* data;
+  size_t size;
+  size_t bit = 0;
+  bool failed = false;
+
+  BitReader( const uint8_t* d, size_t s ) : data( d ), size( s )
+  {
+  }
+
+  uint64_t read( int bits )
+  {
+    uint64_t v = 0;
+    while ( bits > 0 )
+    {
+      if ( ( bit >> 3 ) >= size )
+      {
+        failed = true;
+        return 0;
+      }
+
+      int avail = 8 - static_cast<int>( bit & 7 );
+      int take = min( bits, avail );
+      uint8_t b = data[bit >> 3];
+      uint64_t chunk = ( b >> ( avail - take ) ) & ( ( 1u << take ) - 1 );
+      v = ( v << take ) | chunk;
+      bit += take;
+      bits -= take;
+    }
+    return v;
+  }
+};
+
+static int leading_zeros( uint64_t x )
+{
+  int n = 0;
+  if ( !( x & 0xFFFFFFFF00000000ULL ) )
+  {
+    n += 32;
+    x <<= 32;
+  }
+  if ( !( x & 0xFFFF000000000000ULL ) )
+  {
+    n += 16;
+    x <<= 16;
+  }
+  if ( !( x & 0xFF00000000000000ULL ) )
+  {
+    n += 8;
+    x <<= 8;
+  }
+  if ( !( x & 0xF000000000000000ULL ) )
+  {
+    n += 4;
+    x <<= 4;
+  }
+  if ( !( x & 0xC000000000000000ULL ) )
+  {
+    n += 2;
+    x <<= 2;
+  }
+  if ( !( x & 0x8000000000000000ULL ) )
+  {
+    n += 1;
+  }
+  return n;
+}
+
+static int trailing_zeros( uint64_t x )
+{
+  int n = 0;
+  while ( !( x & 1 ) )
+  {
+    x >>= 1;
+    ++n;
+  }
+  return n;
+}
+
+static uint64_t double_bits( double v )
+{
+  uint64_t bits;
+  memcpy( &bits, &v, sizeof( bits ) );
+  return bits;
+}
+
+static double bits_double( uint64_t bits )
+{
+  double v;
+  memcpy( &v, &bits, sizeof( v ) );
+  return v;
+}
+
+/* Delta-of-delta buckets, zigzag encoded: '0' | '10'+7 | '110'+12 | '1110'+20 | '11110'+32 | '11111'+64
+ */
+static void encode_timestamps( BitWriter& bw, const vector<int64_t>& ts )
+{
+  int64_t prev_delta = 0;
+
+  for ( size_t i = 1; i < ts.size(); ++i )
+  {
+    int64_t delta = ts[i] - ts[i - 1];
+    int64_t dod = delta - prev_delta;
+    prev_delta = delta;
+
+    uint64_t zz = ( static_cast<uint64_t>( dod ) << 1 ) ^ static_cast<uint64_t>( dod >> 63 );
+
+    if ( zz == 0 )
+    {
+      bw.write( 0, 1 );
+    }
+    else if ( zz < ( 1ULL << 7 ) )
+    {
+      bw.write( 0x2, 2 );
+      bw.write( zz, 7 );
+    }
+    else if ( zz < ( 1ULL << 12 ) )
+    {
+      bw.write( 0x6, 3 );
+      bw.write( zz, 12 );
+    }
+    else if ( zz < ( 1ULL << 20 ) )
+    {
+      bw.write( 0xE, 4 );
+      bw.write( zz, 20 );
+    }
+    else if ( zz < ( 1ULL << 32 ) )
+    {
+      bw.write( 0x1E, 5 );
+      bw.write( zz, 32 );
+    }
+    else
+    {
+      bw.write( 0x1F, 5 );
+      bw.write( zz, 64 );
+    }
+  }
+}
+
+static bool decode_timestamps( BitReader& br, int64_t first, size_t count, vector<int64_t>& ts )
+{
+  ts.resize( count );
+  if ( count == 0 )
+  {
+    return true;
+  }
+
+  ts[0] = first;
+  int64_t prev_delta = 0;
+
+  for ( size_t i = 1; i < count; ++i )
+  {
+    int prefix = 0;
+    while ( prefix < 5 && br.read( 1 ) == 1 )
+    {
+      ++prefix;
+    }
+
+    static const int widths[6] = { 0, 7, 12, 20, 32, 64 };
+    uint64_t zz = prefix == 0 ? 0 : br.read( widths[prefix] );
+    int64_t dod = static_cast<int64_t>( zz >> 1 ) ^ -static_cast<int64_t>( zz & 1 );
+
+    prev_delta += dod;
+    ts[i] = ts[i - 1] + prev_delta;
+  }
+
+  return !br.failed;
+}
+
+/* Gorilla XOR: '0' same value | '10' + bits inside previous window | '11' + 5 bit lead + 6 bit length + bits
+ */
+static void encode_values( BitWriter& bw, const vector<double>& values )
+{
+  if ( values.empty() )
+  {
+    return;
+  }
+
+  uint64_t prev = double_bits( values[0] );
+  bw.write( prev, 64 );
+
+  int prev_lead = -1;
+  int prev_trail = 0;
+
+  for ( size_t i = 1; i < values.size(); ++i )
+  {
+    uint64_t cur = double_bits( values[i] );
+    uint64_t x = cur ^ prev;
+    prev = cur;
+
+    if ( x == 0 )
+    {
+      bw.write( 0, 1 );
+      continue;
+    }
+
+    int lead = min( leading_zeros( x ), 31 );
+    int trail = trailing_zeros( x );
+
+    if ( prev_lead >= 0 && lead >= prev_lead && trail >= prev_trail )
+    {
+      bw.write( 0x2, 2 );
+      bw.write( x >> prev_trail, 64 - prev_lead - prev_trail );
+    }
+    else
+    {
+      int meaningful = 64 - lead - trail;
+      bw.write( 0x3, 2 );
+      bw.write( lead, 5 );
+      bw.write( meaningful - 1, 6 );
+      bw.write( x >> trail, meaningful );
+      prev_lead = lead;
+      prev_trail = trail;
+    }
+  }
+}
+
+static bool decode_values( BitReader& br, size_t count, vector<double>& values )
+{
+  values.resize( count );
+  if ( count == 0 )
+  {
+    return true;
+  }
+
+  uint64_t prev = br.read( 64 );
+  values[0] = bits_double( prev );
+
+  int prev_lead = -1;
+  int prev_trail = 0;
+
+  for ( size_t i = 1; i < count && !br.failed; ++i )
+  {
+    if ( br.read( 1 ) == 0 )
+    {
+      values[i] = bits_double( prev );
+      continue;
+    }
+
+    uint64_t x;
+    if ( br.read( 1 ) == 0 )
+    {
+      if ( prev_lead < 0 )
+      {
+        return false;
+      }
+      x = br.read( 64 - prev_lead - prev_trail ) << prev_trail;
+    }
+    else
+    {
+      int lead = static_cast<int>( br.read( 5 ) );
+      int meaningful = static_cast<int>( br.read( 6 ) ) + 1;
+      int trail = 64 - lead - meaningful;
+      if ( trail < 0 )
+      {
+        return false;
+      }
+      x = br.read( meaningful ) << trail;
+      prev_lead = lead;
+      prev_trail = trail;
+    }
+
+    prev ^= x;
+    values[i] = bits_double( prev );
+  }
+
+  return !br.failed;
+}
+
+static bool decode_block( const vector<uint8_t>& payload, uint32_t& tag_id, vector<int64_t>& ts, vector<double>& values, vector<uint16_t>& qualities )
+{
+  ByteCursor c( payload.data(), payload.size() );
+  tag_id = static_cast<uint32_t>( c.fixed( 4 ) );
+  size_t count = static_cast<size_t>( c.fixed( 4 ) );
+  int64_t first = static_cast<int64_t>( c.fixed( 8 ) );
+  c.fixed( 8 );
+  size_t quality_len = static_cast<size_t>( c.fixed( 4 ) );
+
+  if ( c.failed || c.pos + quality_len > payload.size() || count > payload.size() * 8 + 1 )
+  {
+    return false;
+  }
+
+  ByteCursor q( payload.data() + c.pos, quality_len );
+  qualities.clear();
+  qualities.reserve( count );
+  while ( q.pos < q.size && !q.failed )
+  {
+    uint16_t quality = static_cast<uint16_t>( q.varint() );
+    uint64_t run = q.varint();
+    if ( q.failed || qualities.size() + run > count )
+    {
+      return false;
+    }
+    qualities.insert( qualities.end(), static_cast<size_t>( run ), quality );
+  }
+
+  if ( qualities.size() != count )
+  {
+    return false;
+  }
+
+  size_t bits_offset = c.pos + quality_len;
+  BitReader br( payload.data() + bits_offset, payload.size() - bits_offset );
+
+  return decode_timestamps( br, first, count, ts ) && decode_values( br, count, values );
+}
+
+static bool decode_array( const vector<uint8_t>& payload, uint32_t& tag_id, OPCDA_SAMPLE& sample )
+{
+  ByteCursor c( payload.data(), payload.size() );
+  tag_id = static_cast<uint32_t>( c.fixed( 4 ) );
+  sample.timestamp = static_cast<int64_t>( c.fixed( 8 ) );
+  sample.quality = static_cast<uint16_t>( c.fixed( 4 ) );
+  size_t count = static_cast<size_t>( c.fixed( 4 ) );
+
+  if ( c.failed || payload.size() - c.pos != count * 8 )
+  {
+    return false;
+  }
+
+  sample.elements.resize( count );
+  for ( size_t i = 0; i < count; ++i )
+  {
+    sample.elements[i] = bits_double( c.fixed( 8 ) );
+  }
+  sample.value = count > 0 ? sample.elements.front() : 0.0;
+
+  return !c.failed;
+}
+
+CaptureWriter::CaptureWriter() : m_last_flush( chrono::steady_clock::now() )
+{
+}
+
+CaptureWriter::~CaptureWriter()
+{
+  close();
+}
+
+void CaptureWriter::set_block_samples( size_t samples )
+{
+  if ( samples > 0 )
+  {
+    m_block_samples = samples;
+  }
+}
+
+void CaptureWriter::set_footer_blocks( size_t blocks )
+{
+  if ( blocks > 0 )
+  {
+    m_footer_blocks = blocks;
+  }
+}
+
+void CaptureWriter::set_flush_interval( int interval_ms )
+{
+  if ( interval_ms > 0 )
+  {
+    m_flush_interval = chrono::milliseconds( interval_ms );
+  }
+}
+
+bool CaptureWriter::open( const string& path )
+{
+  close();
+
+  m_tag_ids.clear();
+  m_columns.clear();
+  m_pending_tags.clear();
+  m_pending_index.clear();
+  m_last_footer = UINT64_MAX;
+  m_offset = 0;
+  m_path = path;
+
+  error_code ec;
+  uint64_t size = filesystem::exists( path, ec ) ? filesystem::file_size( path, ec ) : 0;
+
+  if ( size > 0 )
+  {
+    CaptureReader reader;
+    if ( !reader.open( path ) )
+    {
+      Logger::instance().logError( "[capture] Not a capture file: " + path );
+      return false;
+    }
+
+    for ( const auto& tag : reader.tag_names() )
+    {
+      m_tag_ids[tag.second] = tag.first;
+    }
+
+    m_pending_tags = reader.unindexed_tags();
+    m_pending_index = reader.unindexed_blocks();
+    m_last_footer = reader.last_footer();
+    m_offset = reader.valid_end();
+
+    if ( m_offset < size )
+    {
+      Logger::instance().logWarning( "[capture] Truncating torn tail of " + path + " at offset " + to_string( m_offset ) );
+      filesystem::resize_file( path, m_offset, ec );
+      if ( ec )
+      {
+        Logger::instance().logError( "[capture] Failed to truncate " + path + ": " + ec.message() );
+        return false;
+      }
+    }
+  }
+
+  m_file.open( path, ios::binary | ios::app );
+  if ( !m_file )
+  {
+    Logger::instance().logError( "[capture] Failed to open " + path );
+    return false;
+  }
+
+  if ( m_offset == 0 )
+  {
+    vector<uint8_t> header( CAPTURE_MAGIC, CAPTURE_MAGIC + sizeof( CAPTURE_MAGIC ) );
+    put_u32( header, CAPTURE_VERSION );
+    put_u32( header, 0 );
+    m_file.write( reinterpret_cast<const char*>( header.data() ), header.size() );
+    m_offset = header.size();
+  }
+
+  m_last_flush = chrono::steady_clock::now();
+  return static_cast<bool>( m_file );
+}
+
+void CaptureWriter::close()
+{
+  if ( m_file.is_open() )
+  {
+    flush();
+    m_file.close();
+  }
+}
+
+bool CaptureWriter::tag_id( const string& name, uint32_t& id )
+{
+  auto it = m_tag_ids.find( name );
+  if ( it != m_tag_ids.end() )
+  {
+    id = it->second;
+    return true;
+  }
+
+  id = static_cast<uint32_t>( m_tag_ids.size() );
+
+  vector<uint8_t> payload;
+  put_u32( payload, id );
+  payload.insert( payload.end(), name.begin(), name.end() );
+
+  // an id whose TAG1 record is not in the file would name nothing on reopen
+  if ( !write_record( RECORD_TAG, payload ) )
+  {
+    return false;
+  }
+
+  m_tag_ids[name] = id;
+  m_pending_tags.push_back( { id, name } );
+  return true;
+}
+
+bool CaptureWriter::write( const vector<OPCDA_SAMPLE>& samples )
+{
+  if ( !m_file.is_open() )
+  {
+    return false;
+  }
+
+  bool ok = true;
+
+  for ( const auto& s : samples )
+  {
+    uint32_t id = 0;
+    if ( !tag_id( s.id, id ) )
+    {
+      ok = false;
+      continue;
+    }
+
+    if ( !s.elements.empty() )
+    {
+      ok = write_array( id, s ) && ok;
+      continue;
+    }
+
+    Column& column = m_columns[id];
+
+    column.timestamps.push_back( s.timestamp );
+    column.values.push_back( s.value );
+    column.qualities.push_back( s.quality );
+
+    if ( column.timestamps.size() >= m_block_samples )
+    {
+      ok = write_block( id, column ) && ok;
+    }
+  }
+
+  if ( chrono::steady_clock::now() - m_last_flush >= m_flush_interval )
+  {
+    flush();
+  }
+
+  return ok && static_cast<bool>( m_file );
+}
+
+bool CaptureWriter::flush()
+{
+  if ( !m_file.is_open() )
+  {
+    return false;
+  }
+
+  for ( auto& column : m_columns )
+  {
+    if ( !column.second.timestamps.empty() )
+    {
+      write_block( column.first, column.second );
+    }
+  }
+
+  if ( !m_pending_index.empty() || !m_pending_tags.empty() )
+  {
+    write_footer();
+  }
+
+  m_file.flush();
+  m_last_flush = chrono::steady_clock::now();
+  return static_cast<bool>( m_file );
+}
+
+bool CaptureWriter::write_block( uint32_t id, Column& column )
+{
+  size_t count = column.timestamps.size();
+  auto range = minmax_element( column.timestamps.begin(), column.timestamps.end() );
+
+  vector<uint8_t> quality_runs;
+  for ( size_t i = 0; i < count; )
+  {
+    size_t j = i;
+    while ( j < count && column.qualities[j] == column.qualities[i] )
+    {
+      ++j;
+    }
+    put_varint( quality_runs, column.qualities[i] );
+    put_varint( quality_runs, j - i );
+    i = j;
+  }
+
+  vector<uint8_t> payload;
+  payload.reserve( 28 + quality_runs.size() + count * 4 );
+  put_u32( payload, id );
+  put_u32( payload, static_cast<uint32_t>( count ) );
+  put_u64( payload, static_cast<uint64_t>( column.timestamps.front() ) );
+  put_u64( payload, static_cast<uint64_t>( *range.second ) );
+  put_u32( payload, static_cast<uint32_t>( quality_runs.size() ) );
+  payload.insert( payload.end(), quality_runs.begin(), quality_runs.end() );
+
+  BitWriter bw( payload );
+  encode_timestamps( bw, column.timestamps );
+  encode_values( bw, column.values );
+
+  CAPTURE_BLOCK_INDEX entry;
+  entry.tag_id = id;
+  entry.count = static_cast<uint32_t>( count );
+  entry.t_min = *range.first;
+  entry.t_max = *range.second;
+  entry.offset = m_offset;
+
+  column.timestamps.clear();
+  column.values.clear();
+  column.qualities.clear();
+
+  if ( !write_record( RECORD_BLOCK, payload ) )
+  {
+    return false;
+  }
+
+  return add_index( entry );
+}
+
+bool CaptureWriter::write_array( uint32_t id, const OPCDA_SAMPLE& sample )
+{
+  vector<uint8_t> payload;
+  payload.reserve( 20 + sample.elements.size() * 8 );
+  put_u32( payload, id );
+  put_u64( payload, static_cast<uint64_t>( sample.timestamp ) );
+  put_u32( payload, sample.quality );
+  put_u32( payload, static_cast<uint32_t>( sample.elements.size() ) );
+  for ( double element : sample.elements )
+  {
+    put_u64( payload, double_bits( element ) );
+  }
+
+  CAPTURE_BLOCK_INDEX entry;
+  entry.tag_id = id;
+  entry.count = 1;
+  entry.t_min = sample.timestamp;
+  entry.t_max = sample.timestamp;
+  entry.offset = m_offset;
+
+  if ( !write_record( RECORD_ARRAY, payload ) )
+  {
+    return false;
+  }
+
+  return add_index( entry );
+}
+
+bool CaptureWriter::add_index( const CAPTURE_BLOCK_INDEX& entry )
+{
+  m_pending_index.push_back( entry );
+
+  if ( m_pending_index.size() >= m_footer_blocks )
+  {
+    return write_footer();
+  }
+
+  return true;
+}
+
+bool CaptureWriter::write_footer()
+{
+  vector<uint8_t> payload;
+  put_u64( payload, m_last_footer );
+
+  put_u32( payload, static_cast<uint32_t>( m_pending_tags.size() ) );
+  for ( const auto& tag : m_pending_tags )
+  {
+    put_u32( payload, tag.first );
+    put_u32( payload, static_cast<uint32_t>( tag.second.size() ) );
+    payload.insert( payload.end(), tag.second.begin(), tag.second.end() );
+  }
+
+  put_u32( payload, static_cast<uint32_t>( m_pending_index.size() ) );
+  for ( const auto& e : m_pending_index )
+  {
+    put_u32( payload, e.tag_id );
+    put_u32( payload, e.count );
+    put_u64( payload, static_cast<uint64_t>( e.t_min ) );
+    put_u64( payload, static_cast<uint64_t>( e.t_max ) );
+    put_u64( payload, e.offset );
+  }
+
+  uint64_t footer_offset = m_offset;
+  if ( !write_record( RECORD_FOOTER, payload ) )
+  {
+    return false;
+  }
+
+  vector<uint8_t> trailer;
+  put_u64( trailer, footer_offset );
+  if ( !write_record( RECORD_END, trailer ) )
+  {
+    return false;
+  }
+
+  m_last_footer = footer_offset;
+  m_pending_tags.clear();
+  m_pending_index.clear();
+
+  // a footer is the point a reopen recovers to, so it has to survive power loss, not just a crash
+  m_file.flush();
+  if ( !m_file || !sync_file( m_path ) )
+  {
+    Logger::instance().logError( "[capture] Failed to sync " + m_path + " at offset " + to_string( m_offset ) );
+    return false;
+  }
+  return true;
+}
+
+bool CaptureWriter::write_record( uint32_t type, const vector<uint8_t>& payload )
+{
+  vector<uint8_t> header;
+  put_u32( header, type );
+  put_u32( header, static_cast<uint32_t>( payload.size() ) );
+  put_u32( header, crc32( payload.data(), payload.size() ) );
+
+  m_file.write( reinterpret_cast<const char*>( header.data() ), header.size() );
+  m_file.write( reinterpret_cast<const char*>( payload.data() ), payload.size() );
+
+  if ( !m_file )
+  {
+    Logger::instance().logError( "[capture] Write failed at offset " + to_string( m_offset ) );
+    return false;
+  }
+
+  m_offset += header.size() + payload.size();
+  return true;
+}
+
+bool CaptureReader::open( const string& path )
+{
+  m_tag_names.clear();
+  m_index.clear();
+  m_unindexed_blocks.clear();
+  m_unindexed_tags.clear();
+  m_last_footer = UINT64_MAX;
+  m_valid_end = 0;
+
+  if ( m_file.is_open() )
+  {
+    m_file.close();
+  }
+
+  m_file.open( path, ios::binary );
+  if ( !m_file )
+  {
+    return false;
+  }
+
+  m_file.seekg( 0, ios::end );
+  uint64_t size = static_cast<uint64_t>( m_file.tellg() );
+
+  char header[CAPTURE_HEADER_SIZE];
+  m_file.seekg( 0 );
+  if ( size < CAPTURE_HEADER_SIZE || !m_file.read( header, CAPTURE_HEADER_SIZE ) || memcmp( header, CAPTURE_MAGIC, sizeof( CAPTURE_MAGIC ) ) != 0 )
+  {
+    return false;
+  }
+
+  if ( !load_from_footers( size ) )
+  {
+    m_tag_names.clear();
+    m_index.clear();
+    m_last_footer = UINT64_MAX;
+    load_by_scan( size );
+  }
+
+  sort( m_index.begin(), m_index.end(), []( const CAPTURE_BLOCK_INDEX& a, const CAPTURE_BLOCK_INDEX& b ) { return a.offset < b.offset; } );
+  return true;
+}
+
+bool CaptureReader::read_record( uint64_t offset, uint64_t file_size, uint32_t& type, vector<uint8_t>& payload )
+{
+  if ( offset + CAPTURE_RECORD_HEADER_SIZE > file_size )
+  {
+    return false;
+  }
+
+  uint8_t header[CAPTURE_RECORD_HEADER_SIZE];
+  m_file.clear();
+  m_file.seekg( static_cast<streamoff>( offset ) );
+  if ( !m_file.read( reinterpret_cast<char*>( header ), CAPTURE_RECORD_HEADER_SIZE ) )
+  {
+    return false;
+  }
+
+  ByteCursor c( header, sizeof( header ) );
+  type = static_cast<uint32_t>( c.fixed( 4 ) );
+  uint32_t len = static_cast<uint32_t>( c.fixed( 4 ) );
+  uint32_t crc = static_cast<uint32_t>( c.fixed( 4 ) );
+
+  if ( len > CAPTURE_MAX_RECORD || offset + CAPTURE_RECORD_HEADER_SIZE + len > file_size )
+  {
+    return false;
+  }
+
+  payload.resize( len );
+  if ( len > 0 && !m_file.read( reinterpret_cast<char*>( payload.data() ), len ) )
+  {
+    return false;
+  }
+
+  return crc32( payload.data(), payload.size() ) == crc;
+}
+
+bool CaptureReader::load_from_footers( uint64_t file_size )
+{
+  if ( file_size < CAPTURE_HEADER_SIZE + CAPTURE_TRAILER_SIZE )
+  {
+    return false;
+  }
+
+  uint32_t type = 0;
+  vector<uint8_t> payload;
+  if ( !read_record( file_size - CAPTURE_TRAILER_SIZE, file_size, type, payload ) || type != RECORD_END || payload.size() != 8 )
+  {
+    return false;
+  }
+
+  uint64_t footer = ByteCursor( payload.data(), payload.size() ).fixed( 8 );
+  m_last_footer = footer;
+
+  set<uint64_t> visited;
+  while ( footer != UINT64_MAX )
+  {
+    if ( footer < CAPTURE_HEADER_SIZE || !visited.insert( footer ).second )
+    {
+      return false;
+    }
+
+    if ( !read_record( footer, file_size, type, payload ) || type != RECORD_FOOTER )
+    {
+      return false;
+    }
+
+    ByteCursor c( payload.data(), payload.size() );
+    uint64_t prev = c.fixed( 8 );
+
+    uint32_t tag_count = static_cast<uint32_t>( c.fixed( 4 ) );
+    for ( uint32_t i = 0; i < tag_count && !c.failed; ++i )
+    {
+      uint32_t id = static_cast<uint32_t>( c.fixed( 4 ) );
+      uint32_t len = static_cast<uint32_t>( c.fixed( 4 ) );
+      m_tag_names[id] = c.text( len );
+    }
+
+    uint32_t entry_count = static_cast<uint32_t>( c.fixed( 4 ) );
+    for ( uint32_t i = 0; i < entry_count && !c.failed; ++i )
+    {
+      CAPTURE_BLOCK_INDEX e;
+      e.tag_id = static_cast<uint32_t>( c.fixed( 4 ) );
+      e.count = static_cast<uint32_t>( c.fixed( 4 ) );
+      e.t_min = static_cast<int64_t>( c.fixed( 8 ) );
+      e.t_max = static_cast<int64_t>( c.fixed( 8 ) );
+      e.offset = c.fixed( 8 );
+      m_index.push_back( e );
+    }
+
+    if ( c.failed )
+    {
+      return false;
+    }
+
+    footer = prev;
+  }
+
+  m_valid_end = file_size;
+  return true;
+}
+
+bool CaptureReader::load_by_scan( uint64_t file_size )
+{
+  uint64_t offset = CAPTURE_HEADER_SIZE;
+  uint32_t type = 0;
+  vector<uint8_t> payload;
+
+  while ( read_record( offset, file_size, type, payload ) )
+  {
+    ByteCursor c( payload.data(), payload.size() );
+
+    if ( type == RECORD_TAG )
+    {
+      uint32_t id = static_cast<uint32_t>( c.fixed( 4 ) );
+      string name = c.text( payload.size() - c.pos );
+      m_tag_names[id] = name;
+      m_unindexed_tags.push_back( { id, name } );
+    }
+    else if ( type == RECORD_BLOCK )
+    {
+      CAPTURE_BLOCK_INDEX e;
+      e.tag_id = static_cast<uint32_t>( c.fixed( 4 ) );
+      e.count = static_cast<uint32_t>( c.fixed( 4 ) );
+      c.fixed( 8 );
+      e.t_max = static_cast<int64_t>( c.fixed( 8 ) );
+      e.offset = offset;
+
+      // the header stores the first timestamp; the exact minimum needs a decode
+      uint32_t id;
+      vector<int64_t> ts;
+      vector<double> values;
+      vector<uint16_t> qualities;
+      if ( !decode_block( payload, id, ts, values, qualities ) )
+      {
+        break;
+      }
+      e.t_min = ts.empty() ? 0 : *min_element( ts.begin(), ts.end() );
+
+      m_index.push_back( e );
+      m_unindexed_blocks.push_back( e );
+    }
+    else if ( type == RECORD_ARRAY )
+    {
+      CAPTURE_BLOCK_INDEX e;
+      OPCDA_SAMPLE sample;
+      if ( !decode_array( payload, e.tag_id, sample ) )
+      {
+        break;
+      }
+      e.count = 1;
+      e.t_min = sample.timestamp;
+      e.t_max = sample.timestamp;
+      e.offset = offset;
+
+      m_index.push_back( e );
+      m_unindexed_blocks.push_back( e );
+    }
+    else if ( type == RECORD_FOOTER )
+    {
+      m_last_footer = offset;
+      m_unindexed_blocks.clear();
+      m_unindexed_tags.clear();
+    }
+
+    offset += CAPTURE_RECORD_HEADER_SIZE + payload.size();
+  }
+
+  m_valid_end = offset;
+  return true;
+}
+
+vector<string> CaptureReader::tags() const
+{
+  vector<string> names;
+  for ( const auto& tag : m_tag_names )
+  {
+    names.push_back( tag.second );
+  }
+  return names;
+}
+
+bool CaptureReader::read_range( const string& tag, int64_t from, int64_t to, vector<OPCDA_SAMPLE>& samples )
+{
+  uint32_t tag_id = UINT32_MAX;
+  for ( const auto& t : m_tag_names )
+  {
+    if ( t.second == tag )
+    {
+      tag_id = t.first;
+      break;
+    }
+  }
+
+  if ( tag_id == UINT32_MAX )
+  {
+    return false;
+  }
+
+  uint64_t file_size = m_valid_end;
+  size_t first_sample = samples.size();
+
+  vector<uint8_t> payload;
+  vector<int64_t> ts;
+  vector<double> values;
+  vector<uint16_t> qualities;
+
+  for ( const auto& e : m_index )
+  {
+    if ( e.tag_id != tag_id || e.t_max < from || e.t_min > to )
+    {
+      continue;
+    }
+
+    uint32_t type = 0;
+    uint32_t id = 0;
+    if ( read_record( e.offset, file_size, type, payload ) && type == RECORD_ARRAY )
+    {
+      OPCDA_SAMPLE s;
+      if ( !decode_array( payload, id, s ) )
+      {
+        Logger::instance().logWarning( "[capture] Skipping unreadable array at offset " + to_string( e.offset ) );
+      }
+      else if ( s.timestamp >= from && s.timestamp <= to )
+      {
+        s.id = tag;
+        samples.push_back( move( s ) );
+      }
+      continue;
+    }
+
+    if ( type != RECORD_BLOCK || !decode_block( payload, id, ts, values, qualities ) )
+    {
+      Logger::instance().logWarning( "[capture] Skipping unreadable block at offset " + to_string( e.offset ) );
+      continue;
+    }
+
+    for ( size_t i = 0; i < ts.size(); ++i )
+    {
+      if ( ts[i] >= from && ts[i] <= to )
+      {
+        OPCDA_SAMPLE s;
+        s.id = tag;
+        s.timestamp = ts[i];
+        s.value = values[i];
+        s.quality = qualities[i];
+        samples.push_back( s );
+      }
+    }
+  }
+
+  stable_sort( samples.begin() + first_sample, samples.end(), []( const OPCDA_SAMPLE& a, const OPCDA_SAMPLE& b ) { return a.timestamp < b.timestamp; } );
+  return true;
+}
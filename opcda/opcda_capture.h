@@ -0,0 +1,146 @@
+// opcda_capture.h
+#ifndef OPCDA_CAPTURE_H
+#define OPCDA_CAPTURE_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "opcda_sample.h"
+
+using namespace std;
+
+/*
+ * Capture file layout (little endian, append-only)
+ *
+ *   header   : "OPCDACAP" u32 version u32 reserved
+ *   record   : u32 type, u32 payload_len, u32 crc32(payload), payload
+ *
+ *   TAG1     : u32 tag_id, utf-8 name
+ *   BLK1     : u32 tag_id, u32 count, i64 t_first, i64 t_max, u32 quality_len, quality runs, bitstream
+ *              bitstream = delta-of-delta timestamps followed by XOR compressed values
+ *   ARR1     : u32 tag_id, i64 timestamp, u32 quality, u32 count, f64 elements[count]
+ *              one array sample, indexed like a block holding a single sample (version 2)
+ *   FTR1     : u64 prev_footer, u32 tag_count, tags { u32 id, u32 len, name }, u32 entry_count, entries
+ *   END1     : u64 footer_offset (always the last record of a cleanly flushed file)
+ *
+ * A footer indexes every block and tag written since the previous footer. Readers follow the chain
+ * from the trailing END1 record; when the tail is torn (crash) they fall back to a CRC checked scan.
+ */
+
+constexpr uint32_t CAPTURE_VERSION = 2;
+constexpr size_t DEFAULT_CAPTURE_BLOCK_SAMPLES = 1024;
+constexpr size_t DEFAULT_CAPTURE_FOOTER_BLOCKS = 64;
+constexpr int DEFAULT_CAPTURE_FLUSH_INTERVAL_MS = 10000;
+
+struct CAPTURE_BLOCK_INDEX
+{
+  uint32_t tag_id = 0;
+  uint32_t count = 0;
+  int64_t t_min = 0;
+  int64_t t_max = 0;
+  uint64_t offset = 0;
+};
+
+class CaptureWriter : public SampleSink
+{
+public:
+  CaptureWriter();
+  ~CaptureWriter();
+
+  bool open( const string& path );
+  void close();
+  bool is_open() const
+  {
+    return m_file.is_open();
+  }
+
+  void set_block_samples( size_t samples );
+  void set_footer_blocks( size_t blocks );
+  void set_flush_interval( int interval_ms );
+
+  bool write( const vector<OPCDA_SAMPLE>& samples ) override;
+  bool flush() override;
+
+private:
+  struct Column
+  {
+    vector<int64_t> timestamps;
+    vector<double> values;
+    vector<uint16_t> qualities;
+  };
+
+  ofstream m_file;
+  string m_path;
+  uint64_t m_offset = 0;
+  uint64_t m_last_footer = UINT64_MAX;
+
+  size_t m_block_samples = DEFAULT_CAPTURE_BLOCK_SAMPLES;
+  size_t m_footer_blocks = DEFAULT_CAPTURE_FOOTER_BLOCKS;
+  chrono::milliseconds m_flush_interval{ DEFAULT_CAPTURE_FLUSH_INTERVAL_MS };
+  chrono::steady_clock::time_point m_last_flush;
+
+  unordered_map<string, uint32_t> m_tag_ids;
+  map<uint32_t, Column> m_columns;
+  vector<pair<uint32_t, string>> m_pending_tags;
+  vector<CAPTURE_BLOCK_INDEX> m_pending_index;
+
+  bool tag_id( const string& name, uint32_t& id );
+  bool write_block( uint32_t id, Column& column );
+  bool write_array( uint32_t id, const OPCDA_SAMPLE& sample );
+  bool add_index( const CAPTURE_BLOCK_INDEX& entry );
+  bool write_footer();
+  bool write_record( uint32_t type, const vector<uint8_t>& payload );
+};
+
+class CaptureReader
+{
+public:
+  bool open( const string& path );
+
+  vector<string> tags() const;
+  bool read_range( const string& tag, int64_t from, int64_t to, vector<OPCDA_SAMPLE>& samples );
+
+  /** @brief Offset just past the last intact record; writers truncate torn tails to it. */
+  uint64_t valid_end() const
+  {
+    return m_valid_end;
+  }
+  uint64_t last_footer() const
+  {
+    return m_last_footer;
+  }
+  const map<uint32_t, string>& tag_names() const
+  {
+    return m_tag_names;
+  }
+
+  /** @brief Blocks and tags found after the last footer of a torn file; the next footer must cover them. */
+  const vector<CAPTURE_BLOCK_INDEX>& unindexed_blocks() const
+  {
+    return m_unindexed_blocks;
+  }
+  const vector<pair<uint32_t, string>>& unindexed_tags() const
+  {
+    return m_unindexed_tags;
+  }
+
+private:
+  ifstream m_file;
+  uint64_t m_valid_end = 0;
+  uint64_t m_last_footer = UINT64_MAX;
+  map<uint32_t, string> m_tag_names;
+  vector<CAPTURE_BLOCK_INDEX> m_index;
+  vector<CAPTURE_BLOCK_INDEX> m_unindexed_blocks;
+  vector<pair<uint32_t, string>> m_unindexed_tags;
+
+  bool load_from_footers( uint64_t file_size );
+  bool load_by_scan( uint64_t file_size );
+  bool read_record( uint64_t offset, uint64_t file_size, uint32_t& type, vector<uint8_t>& payload );
+};
+
+#endif
@@ -1,22 +1,85 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <csignal>
 #include <iostream>
+#include <iterator>
 #include <map>
+#include <memory>
 #include <set>
 #include <sstream>
 #include <thread>
 
 #include "opcda_cli.h"
 #include "crash_handler.h"
+#include "opcda_capture.h"
+#include "opcda_connection_manager.h"
+#include "opcda_device_read.h"
+#include "opcda_discovery.h"
+#include "opcda_discovery_cache.h"
+#include "opcda_error_stats.h"
+#include "opcda_health.h"
+#include "opcda_metrics.h"
+#include "opcda_pi_sink.h"
+#include "opcda_queue.h"
+#include "opcda_serve.h"
+#include "opcda_trace.h"
 #include "opcda_utils.h"
+#include "opcda_write_batch.h"
 #include "result_formatter.hpp"
 
 using namespace std;
 
 namespace OPCDA::CLI
 {
-  static int discovery( const string& host = "localhost" )
+  static atomic<bool> g_stop_requested( false );
+
+  static void request_stop( int )
+  {
+    g_stop_requested = true;
+  }
+
+  class FormatterSink : public SampleSink
+  {
+  public:
+    bool write( const vector<OPCDA_SAMPLE>& samples ) override
+    {
+      map<string, vector<OPCDA_SAMPLE>> result;
+
+      for ( const auto& s : samples )
+      {
+        result[s.id].push_back( s );
+      }
+
+      ResultFormatter::getInstance().printCaptureSamples( result );
+      return static_cast<bool>( cout );
+    }
+
+    bool flush() override
+    {
+      cout.flush();
+      return static_cast<bool>( cout );
+    }
+  };
+
+  static bool connect_server( OpcDaClient& client, const ConnectionParams& conn )
+  {
+    if ( !conn.clsid.empty() )
+    {
+      CLSID clsid;
+      if ( SUCCEEDED( CLSIDFromString( OPCDA::UTILS::str_to_wstr( conn.clsid ).c_str(), &clsid ) ) )
+      {
+        return client.connect_clsid( conn.host, clsid );
+      }
+    }
+
+    return client.connect_progid( conn.host, conn.progid );
+  }
+
+  static int discovery( DiscoveryCache* cache, const string& host, bool refresh, OPCDA_APARTMENT apartment )
   {
-    auto servers = OpcDaClient::discovery( host );
+    auto servers = cache ? cache->discover( host, refresh ) : OpcDaClient::discovery( host, apartment );
 
     map<string, map<string, string>> server_map;
 
@@ -39,7 +102,41 @@ namespace OPCDA::CLI
     return 0;
   }
 
-  static int browse_tags( OpcDaClient& client, bool with_status = false, bool only_readable = false )
+  static int sweep_discovery( DiscoveryCache* cache, const vector<string>& specs, const string& hosts_file, int workers, int timeout_ms )
+  {
+    vector<string> hosts;
+    string error;
+
+    if ( !DiscoverySweep::expand_hosts( specs, hosts_file, hosts, error ) )
+    {
+      ResultFormatter::getInstance().printError( 1, error );
+      return 1;
+    }
+
+    if ( hosts.empty() )
+    {
+      ResultFormatter::getInstance().printError( 1, "No hosts to discover" );
+      return 1;
+    }
+
+    DiscoverySweep sweep;
+    sweep.set_workers( workers > 0 ? static_cast<size_t>( workers ) : 1 );
+    sweep.set_timeout( timeout_ms );
+
+    ResultFormatter::getInstance().printDiscoveryHeader();
+    sweep.run( hosts,
+               [cache]( const DISCOVERY_RESULT& result )
+               {
+                 if ( cache && result.status == DISCOVERY_STATUS::OK )
+                 {
+                   cache->put_host( result.host, result.servers );
+                 }
+                 ResultFormatter::getInstance().printDiscoveryHost( result );
+               } );
+    return 0;
+  }
+
+  static int browse_tags( OpcDaClient& client, bool with_status = false, bool only_readable = false, bool with_properties = false )
   {
     if ( with_status )
     {
@@ -51,6 +148,7 @@ namespace OPCDA::CLI
     if ( only_readable )
     {
       client.request_readable_tags( L"" );
+      tags = client.m_available_tags;
     }
     else
     {
@@ -62,6 +160,14 @@ namespace OPCDA::CLI
       return 1;
     }
 
+    if ( with_properties )
+    {
+      vector<OPCDA_ITEM_PROPERTIES> properties;
+      client.get_item_properties( tags, PROPERTY_ALL, properties );
+      ResultFormatter::getInstance().printTagProperties( properties );
+      return 0;
+    }
+
     vector<string> tagList;
     for ( const auto& t : tags )
     {
@@ -72,7 +178,65 @@ namespace OPCDA::CLI
     return 0;
   }
 
-  static int read_tag_values( OpcDaClient& client, const vector<wstring>& tags, const vector<wstring>& columns, bool showStatus )
+  /**
+   * @brief Splits one read across threads sharing the connection (MTA clients only).
+   */
+  static HRESULT read_tags( OpcDaClient& client, const vector<wstring>& tags, int threads, vector<OPCDA_TAG>& results, vector<HRESULT>& errors )
+  {
+    size_t parts = min( static_cast<size_t>( max( 1, threads ) ), tags.size() );
+
+    if ( parts <= 1 || client.apartment() != OPCDA_APARTMENT::MTA )
+    {
+      return client.read_sync( tags, results, errors );
+    }
+
+    size_t chunk = ( tags.size() + parts - 1 ) / parts;
+    vector<vector<OPCDA_TAG>> part_results( parts );
+    vector<vector<HRESULT>> part_errors( parts );
+    vector<HRESULT> part_hr( parts, S_OK );
+    vector<thread> readers;
+
+    for ( size_t p = 0; p < parts; ++p )
+    {
+      readers.emplace_back(
+        [&, p]()
+        {
+          HRESULT init = CoInitializeEx( NULL, COINIT_MULTITHREADED );
+          vector<wstring> part( tags.begin() + min( p * chunk, tags.size() ), tags.begin() + min( ( p + 1 ) * chunk, tags.size() ) );
+
+          part_hr[p] = client.read_sync( part, part_results[p], part_errors[p] );
+
+          if ( SUCCEEDED( init ) )
+          {
+            CoUninitialize();
+          }
+        } );
+    }
+
+    for ( auto& reader : readers )
+    {
+      reader.join();
+    }
+
+    HRESULT hr = S_OK;
+    results.clear();
+    errors.clear();
+
+    for ( size_t p = 0; p < parts; ++p )
+    {
+      move( part_results[p].begin(), part_results[p].end(), back_inserter( results ) );
+      errors.insert( errors.end(), part_errors[p].begin(), part_errors[p].end() );
+
+      if ( FAILED( part_hr[p] ) || ( part_hr[p] == S_FALSE && hr == S_OK ) )
+      {
+        hr = part_hr[p];
+      }
+    }
+
+    return hr;
+  }
+
+  static int read_tag_values( OpcDaClient& client, const vector<wstring>& tags, const vector<wstring>& columns, bool showStatus, bool with_properties, int read_threads, DeviceReadScheduler* device )
   {
     if ( tags.empty() )
     {
@@ -81,8 +245,9 @@ namespace OPCDA::CLI
 
     vector<OPCDA_TAG> results;
     vector<HRESULT> errors;
+    HRESULT hr = device ? device->read( tags, OPCDA_READ_PRIORITY::INTERACTIVE, results, errors ) : read_tags( client, tags, read_threads, results, errors );
 
-    if ( FAILED( client.read_sync( tags, results, errors ) ) )
+    if ( FAILED( hr ) && hr != RPC_E_TIMEOUT )
     {
       return 1;
     }
@@ -94,12 +259,449 @@ namespace OPCDA::CLI
       result[OPCDA::UTILS::wstr_to_str( tag.id )] = tag;
     }
 
+    if ( with_properties )
+    {
+      vector<OPCDA_ITEM_PROPERTIES> properties;
+      map<string, OPCDA_ITEM_PROPERTIES> by_tag;
+
+      client.get_item_properties( tags, PROPERTY_ALL, properties );
+
+      for ( const auto& item : properties )
+      {
+        by_tag[OPCDA::UTILS::wstr_to_str( item.item_id )] = item;
+      }
+
+      ResultFormatter::getInstance().printTagValues( result, &by_tag );
+      return 0;
+    }
+
     ResultFormatter::getInstance().printTagValues( result );
     return 0;
   }
 
-  static int subscribe_on_change( OpcDaClient& client, const vector<wstring>& excludes, const vector<wstring>& columns, int intervalMs, bool showStatus )
+  static bool parse_write( const string& pair, wstring& id, CComVariant& value )
+  {
+    size_t eq = pair.find( '=' );
+    if ( eq == string::npos || eq == 0 )
+    {
+      return false;
+    }
+
+    // sent as text, the client converts it once to the item's canonical type
+    id = OPCDA::UTILS::str_to_wstr( pair.substr( 0, eq ) );
+    value = OPCDA::UTILS::str_to_wstr( pair.substr( eq + 1 ) ).c_str();
+    return true;
+  }
+
+  /**
+   * @brief Writes '--values tag=value...' in one batch, or streams 'tag=value' lines from stdin
+   *        and sends each coalescing window as one batch.
+   */
+  static int write_values( OpcDaClient& client, const vector<string>& pairs, int window_ms, bool async )
+  {
+    WriteBatcher batcher( client );
+    batcher.set_window( window_ms );
+    batcher.set_async( async );
+
+    map<wstring, HRESULT> outcome;
+    long long outstanding = 0;
+    CHandle completed( CreateEvent( NULL, FALSE, FALSE, NULL ) );
+
+    if ( async )
+    {
+      client.set_write_complete(
+        [&]( DWORD, const vector<wstring>& ids, const vector<HRESULT>& errors )
+        {
+          for ( size_t i = 0; i < ids.size(); ++i )
+          {
+            outcome[ids[i]] = errors[i];
+          }
+          --outstanding;
+          SetEvent( completed );
+        } );
+    }
+
+    auto send = [&]( bool force )
+    {
+      vector<OPCDA_WRITE_RESULT> results;
+      HRESULT hr = force ? batcher.flush( results ) : batcher.flush_if_due( results );
+
+      for ( const auto& r : results )
+      {
+        outcome[r.id] = r.error;
+      }
+
+      // a completion may already have arrived while Write was pumping, hence the signed count
+      if ( async && SUCCEEDED( hr ) && any_of( results.begin(), results.end(), []( const OPCDA_WRITE_RESULT& r ) { return SUCCEEDED( r.error ); } ) )
+      {
+        ++outstanding;
+      }
+    };
+
+    for ( const auto& pair : pairs )
+    {
+      wstring id;
+      CComVariant value;
+
+      if ( !parse_write( pair, id, value ) )
+      {
+        ResultFormatter::getInstance().printError( 1, "Expected <tag>=<value>: " + pair );
+        return 1;
+      }
+
+      batcher.submit( id, value );
+    }
+
+    if ( pairs.empty() )
+    {
+      string line;
+      while ( getline( cin, line ) )
+      {
+        wstring id;
+        CComVariant value;
+
+        if ( parse_write( line, id, value ) )
+        {
+          batcher.submit( id, value );
+          send( false );
+        }
+      }
+    }
+
+    send( true );
+
+    // completions are delivered while this thread pumps
+    auto deadline = chrono::steady_clock::now() + chrono::seconds( 10 );
+    while ( async && outstanding > 0 && chrono::steady_clock::now() < deadline )
+    {
+      DWORD signaled = 0;
+      HANDLE wait = completed;
+      CoWaitForMultipleHandles( COWAIT_DISPATCH_CALLS, 100, 1, &wait, &signaled );
+    }
+
+    client.set_write_complete( nullptr );
+
+    Logger::instance().logInfo( "[write] " + to_string( batcher.submitted() ) + " submitted, " + to_string( batcher.coalesced() ) + " coalesced, " + to_string( batcher.batches() ) + " batches" );
+
+    vector<OPCDA_WRITE_RESULT> results;
+    for ( const auto& entry : outcome )
+    {
+      results.push_back( { entry.first, entry.second } );
+    }
+
+    ResultFormatter::getInstance().printWriteResults( results );
+    return all_of( results.begin(), results.end(), []( const OPCDA_WRITE_RESULT& r ) { return SUCCEEDED( r.error ); } ) ? 0 : 1;
+  }
+
+  static int subscribe_on_change( OpcDaClient& client, const vector<wstring>& tags, const vector<wstring>& excludes, const vector<wstring>& columns, int intervalMs, bool showStatus, const string& record_file, const PiParams& pi, const string& queue_dir, int queue_max_mb, int read_threads, int health_ms, DeviceReadScheduler* device )
+  {
+    vector<wstring> item_ids = tags;
+
+    if ( item_ids.empty() )
+    {
+      client.request_readable_tags( L"" );
+      item_ids = client.m_available_tags;
+    }
+
+    item_ids.erase( remove_if( item_ids.begin(), item_ids.end(), [&]( const wstring& id ) { return find( excludes.begin(), excludes.end(), id ) != excludes.end(); } ), item_ids.end() );
+
+    if ( item_ids.empty() )
+    {
+      return 1;
+    }
+
+    unique_ptr<CaptureWriter> recorder;
+    unique_ptr<FormatterSink> printer;
+#ifdef OPCDA_WITH_PIAPI
+    unique_ptr<PiApiArchive> archive;
+    unique_ptr<PiSink> writer;
+#endif
+    unique_ptr<QueueSink> queue;
+    SampleSink* sink = nullptr;
+
+    if ( !record_file.empty() )
+    {
+      recorder.reset( new CaptureWriter() );
+
+      if ( !recorder->open( record_file ) )
+      {
+        ResultFormatter::getInstance().printError( 1, "Failed to open capture file: " + record_file );
+        return 1;
+      }
+
+      sink = recorder.get();
+    }
+
+    if ( !pi.server.empty() )
+    {
+#ifdef OPCDA_WITH_PIAPI
+      if ( sink )
+      {
+        ResultFormatter::getInstance().printError( 1, "--pi-server cannot be combined with --record" );
+        return 1;
+      }
+
+      archive.reset( new PiApiArchive() );
+
+      if ( !archive->open( pi.server ) )
+      {
+        ResultFormatter::getInstance().printError( 1, "Failed to connect to PI server: " + pi.server );
+        return 1;
+      }
+
+      writer.reset( new PiSink( *archive ) );
+      writer->set_batch( static_cast<size_t>( max( 1, pi.batch_samples ) ), pi.batch_ms );
+
+      if ( !pi.map_file.empty() && !writer->load_tag_map( pi.map_file ) )
+      {
+        ResultFormatter::getInstance().printError( 1, "Failed to load PI tag map: " + pi.map_file );
+        return 1;
+      }
+
+      writer->open();
+      sink = writer.get();
+#else
+      ResultFormatter::getInstance().printError( 1, "PI archive output is not available in this build" );
+      return 1;
+#endif
+    }
+
+    if ( !queue_dir.empty() )
+    {
+      if ( !sink )
+      {
+        printer.reset( new FormatterSink() );
+        sink = printer.get();
+      }
+
+      queue.reset( new QueueSink( *sink ) );
+      queue->queue().set_max_segments( max<size_t>( 2, static_cast<size_t>( queue_max_mb ) * 1024 * 1024 / DEFAULT_QUEUE_SEGMENT_BYTES ) );
+
+      if ( !queue->open( queue_dir ) )
+      {
+        ResultFormatter::getInstance().printError( 1, "Failed to open queue directory: " + queue_dir );
+        return 1;
+      }
+
+      sink = queue.get();
+    }
+
+    // the monitor's own connection notices a stalled server even while a read blocks
+    HealthMonitor health;
+
+    if ( health_ms > 0 )
+    {
+      health.set_interval( health_ms );
+      health.subscribe( [&client]( const OPCDA_HEALTH_SAMPLE& s ) { client.supervisor().on_heartbeat( s.running ? S_OK : ( FAILED( s.error ) ? s.error : E_FAIL ) ); } );
+      client.supervisor().set_heartbeat( 0, DEFAULT_HEARTBEAT_MISSES );
+
+      if ( !health.start( client.server_host(), client.server_clsid() ) )
+      {
+        Logger::instance().logWarning( "[cli] Health monitor not started, server CLSID unknown" );
+      }
+    }
+
+    // a round waits at most one interval; tags the budget has not reached stay queued for the next
+    if ( device )
+    {
+      device->set_timeout( intervalMs );
+    }
+
+    g_stop_requested = false;
+    signal( SIGINT, request_stop );
+
+    while ( !g_stop_requested )
+    {
+      auto started = chrono::steady_clock::now();
+
+      vector<OPCDA_TAG> results;
+      vector<HRESULT> errors;
+
+      // heartbeats only run here while reads keep succeeding
+      client.supervise();
+
+      // a polling loop is bulk work; it yields the device budget to interactive reads
+      HRESULT hr = device ? device->read( item_ids, OPCDA_READ_PRIORITY::BULK, results, errors ) : read_tags( client, item_ids, read_threads, results, errors );
+
+      if ( hr == RPC_E_TIMEOUT && device )
+      {
+        size_t kept = 0;
+        for ( size_t i = 0; i < results.size(); ++i )
+        {
+          if ( errors[i] != RPC_E_TIMEOUT )
+          {
+            results[kept++] = move( results[i] );
+          }
+        }
+        results.resize( kept );
+        hr = S_FALSE;
+      }
+
+      if ( SUCCEEDED( hr ) )
+      {
+        if ( sink )
+        {
+          vector<OPCDA_SAMPLE> samples;
+          samples.reserve( results.size() );
+
+          for ( auto& tag : results )
+          {
+            OPCDA::UTILS::tag_to_samples( tag, samples );
+            VariantClear( &tag.value );
+          }
+
+          sink->write( samples );
+        }
+        else
+        {
+          map<string, OPCDA_TAG> result;
+
+          for ( const auto& tag : results )
+          {
+            result[OPCDA::UTILS::wstr_to_str( tag.id )] = tag;
+          }
+
+          ResultFormatter::getInstance().printTagValues( result );
+        }
+      }
+
+      OPCDA_HEALTH_SAMPLE sample;
+      if ( showStatus && health.latest( sample ) )
+      {
+        ResultFormatter::getInstance().printHealthSample( sample );
+      }
+
+      this_thread::sleep_until( started + chrono::milliseconds( intervalMs ) );
+    }
+
+    return 0;
+  }
+
+  static int serve_tags( OpcDaClient& client, const vector<wstring>& tags, const string& pipe_name, int intervalMs )
   {
+    TagServer server( client );
+    server.set_interval( intervalMs );
+
+    if ( !server.start( pipe_name, tags ) )
+    {
+      ResultFormatter::getInstance().printError( 1, "Failed to listen on pipe: " + OPCDA::UTILS::wstr_to_str( TagServer::pipe_path( pipe_name ) ) );
+      return 1;
+    }
+
+    g_stop_requested = false;
+    signal( SIGINT, request_stop );
+
+    server.run( g_stop_requested );
+    return 0;
+  }
+
+  static int managed_read( DiscoveryCache* cache, const OPCDA::CLI::OptionParams& o, const vector<wstring>& tags, bool once )
+  {
+    vector<OPCDA_SERVER_SPEC> specs;
+    string error;
+
+    if ( !ConnectionManager::load_servers( o.servers_file, static_cast<size_t>( max( 1, o.server_sessions ) ), specs, error ) )
+    {
+      ResultFormatter::getInstance().printError( 1, error );
+      return 1;
+    }
+
+    if ( specs.empty() )
+    {
+      ResultFormatter::getInstance().printError( 1, "No servers to read" );
+      return 1;
+    }
+
+    ConnectionManager manager;
+    manager.set_workers( o.workers > 0 ? static_cast<size_t>( o.workers ) : 1 );
+    manager.set_memory_budget( static_cast<size_t>( max( 1, o.memory_budget_mb ) ) * 1024 * 1024 );
+    manager.set_discovery_cache( cache );
+
+    for ( auto& spec : specs )
+    {
+      if ( spec.tags.empty() )
+      {
+        spec.tags = tags;
+      }
+      manager.add_server( spec );
+    }
+
+    if ( !manager.start() )
+    {
+      ResultFormatter::getInstance().printError( 1, "Failed to start the connection manager" );
+      return 1;
+    }
+
+    g_stop_requested = false;
+    signal( SIGINT, request_stop );
+
+    int failed = 0;
+    auto print = [&]( OPCDA_SERVER_RESULT& result )
+    {
+      failed += FAILED( result.error ) ? 1 : 0;
+      ResultFormatter::getInstance().printServerResult( result );
+      manager.release( result );
+    };
+
+    if ( once )
+    {
+      size_t expected = manager.poll();
+
+      while ( expected > 0 && !g_stop_requested )
+      {
+        OPCDA_SERVER_RESULT result;
+        if ( manager.next_result( result, 200 ) )
+        {
+          print( result );
+          --expected;
+        }
+      }
+    }
+
+    while ( !once && !g_stop_requested )
+    {
+      auto next_round = chrono::steady_clock::now() + chrono::milliseconds( o.interval_ms );
+      manager.poll();
+
+      // slow servers deliver into a later round; their sessions are skipped until then
+      for ( auto now = chrono::steady_clock::now(); now < next_round && !g_stop_requested; now = chrono::steady_clock::now() )
+      {
+        OPCDA_SERVER_RESULT result;
+        int remaining = static_cast<int>( chrono::duration_cast<chrono::milliseconds>( next_round - now ).count() );
+
+        if ( manager.next_result( result, max( 1, remaining ) ) )
+        {
+          print( result );
+        }
+      }
+    }
+
+    manager.stop();
+    return failed > 0 ? 1 : 0;
+  }
+
+  static int capture_export( const string& file, const vector<string>& tags, long long from_ms, long long to_ms )
+  {
+    CaptureReader reader;
+
+    if ( !reader.open( file ) )
+    {
+      ResultFormatter::getInstance().printError( 1, "Failed to open capture file: " + file );
+      return 1;
+    }
+
+    vector<string> names = tags.empty() ? reader.tags() : tags;
+    int64_t from = from_ms > 0 ? epoch_ms_to_ticks( from_ms ) : LLONG_MIN;
+    int64_t to = to_ms > 0 ? epoch_ms_to_ticks( to_ms ) : LLONG_MAX;
+
+    map<string, vector<OPCDA_SAMPLE>> result;
+
+    for ( const auto& name : names )
+    {
+      reader.read_range( name, from, to, result[name] );
+    }
+
+    ResultFormatter::getInstance().printCaptureSamples( result );
     return 0;
   }
 
@@ -134,6 +736,18 @@ namespace OPCDA::CLI
     {
       return OPCDA::CLI::Commands::Dialog;
     }
+    else if ( cmd == "--capture-export" )
+    {
+      return OPCDA::CLI::Commands::CaptureExport;
+    }
+    else if ( cmd == "--write-values" )
+    {
+      return OPCDA::CLI::Commands::WriteValues;
+    }
+    else if ( cmd == "--serve" )
+    {
+      return OPCDA::CLI::Commands::Serve;
+    }
 
     return OPCDA::CLI::Commands::NotSet;
   }
@@ -204,6 +818,85 @@ namespace OPCDA::CLI
     o.conn.clsid = getVal( "--clsid" );
     o.interval_ms = stoi( getVal( "--interval", "1000" ) );
     o.show_status = any_of( argv + 1, argv + argc, []( char* a ) { return string( a ) == "--status"; } );
+    o.with_properties = any_of( argv + 1, argv + argc, []( char* a ) { return string( a ) == "--properties"; } );
+    o.record_file = getVal( "--record" );
+    o.pi.server = getVal( "--pi-server" );
+    o.pi.map_file = getVal( "--pi-map" );
+    o.pi.batch_samples = stoi( getVal( "--pi-batch", "500" ) );
+    o.pi.batch_ms = stoi( getVal( "--pi-batch-ms", "1000" ) );
+    o.queue_dir = getVal( "--queue-dir" );
+    o.queue_max_mb = stoi( getVal( "--queue-max-mb", "1024" ) );
+    o.capture_file = getVal( "--capture-export" );
+    o.from_ms = stoll( getVal( "--from", "0" ) );
+    o.to_ms = stoll( getVal( "--to", "0" ) );
+    o.filter = getVal( "--filter" );
+    o.vendor_filter = getVal( "--vendor-filter" );
+    o.type_filter = getVal( "--type-filter" );
+    o.page_size = stoi( getVal( "--page-size", "1000" ) );
+    o.max_age_ms = stoll( getVal( "--max-age", "-1" ) );
+    o.hosts_file = getVal( "--hosts-file" );
+    o.workers = stoi( getVal( "--workers", "32" ) );
+    o.timeout_ms = stoi( getVal( "--timeout", "3000" ) );
+    o.discovery_cache = getVal( "--discovery-cache", DiscoveryCache::default_path() );
+    o.cache_ttl_s = stoi( getVal( "--cache-ttl", "3600" ) );
+    o.servers_file = getVal( "--servers" );
+    o.server_sessions = stoi( getVal( "--server-sessions", "1" ) );
+    o.memory_budget_mb = stoi( getVal( "--memory-budget-mb", "64" ) );
+    o.mta = any_of( argv + 1, argv + argc, []( char* a ) { return string( a ) == "--mta"; } );
+    o.read_threads = stoi( getVal( "--read-threads", "1" ) );
+    o.refresh_discovery = any_of( argv + 1, argv + argc, []( char* a ) { return string( a ) == "--refresh"; } );
+    o.auto_reconnect = !any_of( argv + 1, argv + argc, []( char* a ) { return string( a ) == "--no-reconnect"; } );
+    o.heartbeat_ms = stoi( getVal( "--heartbeat", to_string( DEFAULT_HEARTBEAT_MS ) ) );
+    o.reconnect_max_ms = stoi( getVal( "--reconnect-max", to_string( DEFAULT_RECONNECT_MAX_MS ) ) );
+    o.health_ms = stoi( getVal( "--health", "0" ) );
+    o.write_window_ms = stoi( getVal( "--write-window", to_string( DEFAULT_WRITE_WINDOW_MS ) ) );
+    o.metrics_file = getVal( "--metrics" );
+    o.metrics_interval_ms = stoi( getVal( "--metrics-interval", to_string( DEFAULT_METRICS_INTERVAL_MS ) ) );
+    o.error_report_ms = stoi( getVal( "--error-report", to_string( DEFAULT_ERROR_REPORT_MS ) ) );
+    o.trace_file = getVal( "--trace" );
+    o.pipe_name = getVal( "--pipe", DEFAULT_SERVE_PIPE );
+    o.write_async = any_of( argv + 1, argv + argc, []( char* a ) { return string( a ) == "--async"; } );
+    o.device = any_of( argv + 1, argv + argc, []( char* a ) { return string( a ) == "--device"; } );
+    o.device_rate = stod( getVal( "--device-rate", to_string( DEFAULT_DEVICE_READ_RATE ) ) );
+    o.device_branch_rate = stod( getVal( "--device-branch-rate", to_string( DEFAULT_DEVICE_BRANCH_RATE ) ) );
+
+    for ( int i = 1; i < argc; ++i )
+    {
+      string arg = argv[i];
+
+      if ( arg == "--tag" && i + 1 < argc )
+      {
+        o.tags.push_back( argv[++i] );
+      }
+      else if ( arg == "--tags" )
+      {
+        while ( i + 1 < argc && argv[i + 1][0] != '-' )
+        {
+          o.tags.push_back( argv[++i] );
+        }
+      }
+      else if ( arg == "--hosts" )
+      {
+        while ( i + 1 < argc && argv[i + 1][0] != '-' )
+        {
+          o.hosts.push_back( argv[++i] );
+        }
+      }
+      else if ( arg == "--values" )
+      {
+        while ( i + 1 < argc && argv[i + 1][0] != '-' )
+        {
+          o.write_values.push_back( argv[++i] );
+        }
+      }
+      else if ( arg == "--excludes" )
+      {
+        while ( i + 1 < argc && argv[i + 1][0] != '-' )
+        {
+          o.excludes.push_back( OPCDA::UTILS::str_to_wstr( argv[++i] ) );
+        }
+      }
+    }
 
     return true;
   }
@@ -212,7 +905,59 @@ namespace OPCDA::CLI
   {
     setupCrashHandler();
 
+    // stops on every return path, with one last report and dump of the final counts
+    struct REPORTERS
+    {
+      string trace_file;
+
+      ~REPORTERS()
+      {
+        ItemErrorStats::instance().stop_reporting();
+        MetricsRegistry::instance().stop_export();
+
+        if ( !trace_file.empty() )
+        {
+          Tracer::instance().stop();
+          Tracer::instance().write( trace_file );
+        }
+      }
+    } reporters { o.trace_file };
+
+    if ( !o.metrics_file.empty() )
+    {
+      MetricsRegistry::instance().start_export( o.metrics_file == "stdout" ? "-" : o.metrics_file, o.metrics_interval_ms );
+    }
+
+    if ( o.error_report_ms > 0 )
+    {
+      ItemErrorStats::instance().start_reporting( o.error_report_ms );
+    }
+
+    if ( !o.trace_file.empty() )
+    {
+      Tracer::instance().start();
+    }
+
+    // declared before the client so it outlives every connect that consults it
+    unique_ptr<DiscoveryCache> discovery_cache;
+    if ( o.discovery_cache != "none" )
+    {
+      discovery_cache = make_unique<DiscoveryCache>( o.discovery_cache );
+      discovery_cache->set_ttl( chrono::seconds( max( o.cache_ttl_s, 0 ) ) );
+      discovery_cache->load();
+    }
+
     OpcDaClient client;
+    client.set_apartment( o.mta ? OPCDA_APARTMENT::MTA : OPCDA_APARTMENT::STA );
+
+    if ( o.read_threads > 1 && !o.mta )
+    {
+      Logger::instance().logWarning( "[cli] --read-threads needs --mta, reading on one thread" );
+    }
+    client.set_discovery_cache( discovery_cache.get() );
+    client.set_auto_reconnect( o.auto_reconnect );
+    client.supervisor().set_heartbeat( o.heartbeat_ms, DEFAULT_HEARTBEAT_MISSES );
+    client.supervisor().set_backoff( DEFAULT_RECONNECT_INITIAL_MS, o.reconnect_max_ms );
 
     if ( !client.com_init() )
     {
@@ -220,26 +965,95 @@ namespace OPCDA::CLI
       return 1;
     }
 
+    vector<wstring> tags;
+    for ( const auto& t : o.tags )
+    {
+      tags.push_back( OPCDA::UTILS::str_to_wstr( t ) );
+    }
+
+    if ( !o.servers_file.empty() && ( o.cmd == OPCDA::CLI::Commands::TagValues || o.cmd == OPCDA::CLI::Commands::Subscribe ) )
+    {
+      return managed_read( discovery_cache.get(), o, tags, o.cmd == OPCDA::CLI::Commands::TagValues );
+    }
+
+    switch ( o.cmd )
+    {
+      case OPCDA::CLI::Commands::Discovery:
+      case OPCDA::CLI::Commands::CaptureExport:
+      case OPCDA::CLI::Commands::Help:
+        break;
+
+      default:
+        if ( !connect_server( client, o.conn ) )
+        {
+          ResultFormatter::getInstance().printError( 1, "Failed to connect to server" );
+          return 1;
+        }
+        break;
+    }
+
+    OPCDA_BROWSE_FILTER filter;
+    filter.name = OPCDA::UTILS::str_to_wstr( o.filter );
+    filter.vendor = OPCDA::UTILS::str_to_wstr( o.vendor_filter );
+    filter.data_type = OPCDA::UTILS::str_to_vartype( o.type_filter );
+    if ( !o.type_filter.empty() && filter.data_type == VT_EMPTY )
+    {
+      Logger::instance().logWarning( "[cli] Unknown --type '" + o.type_filter + "', browsing all types" );
+    }
+    filter.page_size = o.page_size > 0 ? static_cast<DWORD>( o.page_size ) : 0;
+    client.set_browse_filter( filter );
+
+    if ( o.max_age_ms >= 0 )
+    {
+      client.set_max_age( static_cast<DWORD>( min<long long>( o.max_age_ms, OPCDA_MAX_AGE_CACHE ) ) );
+    }
+
+    unique_ptr<DeviceReadScheduler> device;
+    if ( o.device )
+    {
+      device = make_unique<DeviceReadScheduler>( client );
+      device->set_server_rate( o.device_rate );
+      device->set_branch_rate( o.device_branch_rate );
+
+      if ( o.read_threads > 1 )
+      {
+        Logger::instance().logWarning( "[cli] --device reads one batch at a time, ignoring --read-threads" );
+      }
+    }
+
     switch ( o.cmd )
     {
       case OPCDA::CLI::Commands::Discovery:
-        return discovery( o.conn.host );
+        if ( !o.hosts.empty() || !o.hosts_file.empty() )
+        {
+          return sweep_discovery( discovery_cache.get(), o.hosts, o.hosts_file, o.workers, o.timeout_ms );
+        }
+        return discovery( discovery_cache.get(), o.conn.host, o.refresh_discovery, client.apartment() );
 
       case OPCDA::CLI::Commands::BrowseAll:
-        return browse_tags( client, o.show_status, false );
+        return browse_tags( client, o.show_status, false, o.with_properties );
 
       case OPCDA::CLI::Commands::BrowseReadable:
-        return browse_tags( client, o.show_status, true );
+        return browse_tags( client, o.show_status, true, o.with_properties );
 
       case OPCDA::CLI::Commands::TagValues:
-        return read_tag_values( client, {}, o.columns, o.show_status );
+        return read_tag_values( client, tags, o.columns, o.show_status, o.with_properties, o.read_threads, device.get() );
 
       case OPCDA::CLI::Commands::Subscribe:
-        return subscribe_on_change( client, o.excludes, o.columns, o.interval_ms, o.show_status );
+        return subscribe_on_change( client, tags, o.excludes, o.columns, o.interval_ms, o.show_status, o.record_file, o.pi, o.queue_dir, o.queue_max_mb, o.read_threads, o.health_ms, device.get() );
 
       case OPCDA::CLI::Commands::Dialog:
         return dialog_session( client, o.columns, o.show_status );
 
+      case OPCDA::CLI::Commands::CaptureExport:
+        return capture_export( o.capture_file, o.tags, o.from_ms, o.to_ms );
+
+      case OPCDA::CLI::Commands::WriteValues:
+        return write_values( client, o.write_values, o.write_window_ms, o.write_async );
+
+      case OPCDA::CLI::Commands::Serve:
+        return serve_tags( client, tags, o.pipe_name, o.interval_ms );
+
       default:
         help();
         return 0;
@@ -255,6 +1069,52 @@ namespace OPCDA::CLI
          << "  --browse-tags-readable List readable tags\n"
          << "  --tag-values           Read tag values\n"
          << "  --subscribe            Subscribe to tag changes\n"
-         << "  --dialog               Interactive mode\n";
+         << "  --dialog               Interactive mode\n"
+         << "  --capture-export <file> Export samples from a capture file\n"
+         << "  --write-values         Write tag values, from --values or 'tag=value' lines on stdin\n"
+         << "  --serve                Keep the connection open and answer READ/BROWSE/SUBSCRIBE on a named pipe\n\n"
+         << "OPTIONS:\n"
+         << "  --hosts <h|cidr>...    Discover several hosts at once (names, IPs or CIDR blocks)\n"
+         << "  --hosts-file <file>    Read --discovery hosts from a file, one or more per line\n"
+         << "  --workers <n>          Hosts probed / server sessions read concurrently (default 32)\n"
+         << "  --timeout <ms>         Per-host discovery deadline (default 3000)\n"
+         << "  --servers <file>       Read many servers in one process, '<name> <host> <progid|clsid> [sessions=N] [tags...]' per line\n"
+         << "  --server-sessions <n>  Connections per server for --servers, the per-server concurrency limit (default 1)\n"
+         << "  --memory-budget-mb <n> Memory for queued --servers results before workers wait (default 64)\n"
+         << "  --refresh              Ignore cached discovery results and query the host again\n"
+         << "  --discovery-cache <f>  Discovery cache file, 'none' disables it (default %LOCALAPPDATA%\\opcda-cli\\discovery.cache)\n"
+         << "  --cache-ttl <s>        Seconds a cached discovery result stays fresh (default 3600)\n"
+         << "  --filter <pattern>     Server-side item name filter for browsing (e.g. 'Temp*')\n"
+         << "  --vendor-filter <s>    Vendor specific browse filter (DA 3.0 servers)\n"
+         << "  --type-filter <vt>     Only browse items of this data type (e.g. VT_R8, R4, 5)\n"
+         << "  --page-size <n>        Elements per IOPCBrowse call, 0 lets the server decide (default 1000)\n"
+         << "  --properties           Add type, rights, EU units/range, description and scan rate\n"
+         << "  --mta                  Use a multithreaded COM apartment so one connection serves many threads\n"
+         << "  --read-threads <n>     Threads sharing one connection for a read, needs --mta (default 1)\n"
+         << "  --no-reconnect         Do not reconnect after the server link drops\n"
+         << "  --heartbeat <ms>       Server status check interval while idle, 0 disables (default 5000)\n"
+         << "  --reconnect-max <ms>   Upper bound of the reconnect backoff (default 30000)\n"
+         << "  --values <t=v>...      Tag/value pairs for --write-values\n"
+         << "  --write-window <ms>    Coalescing window for stdin writes, last value per tag wins (default 100)\n"
+         << "  --async                Send --write-values through IOPCAsyncIO2 and wait for completions\n"
+         << "  --health <ms>          Poll server status on a separate connection while subscribed (default off)\n"
+         << "  --metrics <file>       Export COM call latency and queue metrics in Prometheus format, 'stdout' to print\n"
+         << "  --metrics-interval <ms> Metrics export interval (default 10000)\n"
+         << "  --error-report <ms>    Interval of the failed item summary in the log, 0 disables (default 60000)\n"
+         << "  --trace <file>         Record browse/resolve/read phases and COM calls, written as Chrome trace JSON at exit\n"
+         << "  --pipe <name>          Pipe name for --serve, \\\\.\\pipe\\<name> (default opcda)\n"
+         << "  --max-age <ms>         Oldest acceptable cached value for DA 3.0 reads, 0 reads the device\n"
+         << "  --device               Read --tag-values/--subscribe from the device through the rate limited scheduler\n"
+         << "  --device-rate <n>      Device reads per second for the whole server (default 200)\n"
+         << "  --device-branch-rate <n> Device reads per second for one device branch (default 50)\n"
+         << "  --record <file>        Record --subscribe samples into a capture file\n"
+         << "  --pi-server <node>     Write --subscribe samples to a PI server (x86 build)\n"
+         << "  --pi-map <file>        OPC item to PI tag map, one 'item=tag' per line\n"
+         << "  --pi-batch <n>         Samples per PI snapshot call (default 500)\n"
+         << "  --pi-batch-ms <ms>     Maximum delay before a partial batch is sent (default 1000)\n"
+         << "  --queue-dir <dir>      Buffer --subscribe output in a durable disk queue\n"
+         << "  --queue-max-mb <mb>    Disk budget of the queue (default 1024)\n"
+         << "  --from <epoch_ms>      Start of the --capture-export range\n"
+         << "  --to <epoch_ms>        End of the --capture-export range\n";
   }
 } // namespace OPCDA::CLI
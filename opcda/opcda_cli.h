@@ -19,6 +19,14 @@ namespace OPCDA::CLI
     string clsid;
   };
 
+  struct PiParams
+  {
+    string server;
+    string map_file;
+    int batch_samples = 500;
+    int batch_ms = 1000;
+  };
+
   enum class Commands
   {
     Help,
@@ -28,6 +36,9 @@ namespace OPCDA::CLI
     TagValues,
     Subscribe,
     Dialog,
+    CaptureExport,
+    WriteValues,
+    Serve,
     NotSet
   };
 
@@ -35,17 +46,57 @@ namespace OPCDA::CLI
   {
     Commands cmd = Commands::Help;
     ConnectionParams conn;
+    PiParams pi;
     vector<string> tags;
+    vector<string> hosts;
+    string hosts_file;
+    int workers = 32;
+    int timeout_ms = 3000;
+    string discovery_cache;
+    int cache_ttl_s = 3600;
+    bool refresh_discovery = false;
+    string servers_file;
+    int server_sessions = 1;
+    int memory_budget_mb = 64;
+    bool mta = false;
+    int read_threads = 1;
+    bool auto_reconnect = true;
+    int heartbeat_ms = DEFAULT_HEARTBEAT_MS;
+    int reconnect_max_ms = DEFAULT_RECONNECT_MAX_MS;
+    int health_ms = 0;
+    vector<string> write_values;
+    int write_window_ms = 100;
+    string metrics_file;
+    int metrics_interval_ms = 10000;
+    int error_report_ms = 60000;
+    string trace_file;
+    string pipe_name;
+    bool write_async = false;
+    bool device = false;
+    double device_rate = 200;
+    double device_branch_rate = 50;
     vector<wstring> excludes;
     vector<wstring> columns;
+    string filter;
+    string vendor_filter;
+    string type_filter;
+    int page_size = 1000;
+    long long max_age_ms = -1;
 
     int interval_ms = 1000;
     bool show_status = false;
+    bool with_properties = false;
+    string record_file;
+    string queue_dir;
+    int queue_max_mb = 1024;
+    string capture_file;
+    long long from_ms = 0;
+    long long to_ms = 0;
     LogMode log_mode = LogMode::NONE;
     string log_file = "opcda_client.log";
   };
 
-  bool parseArguments( int argc, char* argv[], OptionParams& opts );
+  bool parse_arguments( int argc, char* argv[], OptionParams& opts );
   int commander( const OptionParams& opts );
   void help();
 
@@ -11,19 +11,23 @@
 #include <iostream>
 #include <opccomn.h>
 #include <opcda.h>
+#include <set>
 #include <sstream>
 #include <string>
 #include <windows.h>
 
 #include "logger.h"
 #include "opcda_client.h"
+#include "opcda_discovery_cache.h"
+#include "opcda_metrics.h"
+#include "opcda_trace.h"
 #include "opcda_utils.h"
 #include "result_formatter.hpp"
 
 
 using namespace std;
 
-OpcDaClient::OpcDaClient() : is_com_init( false ), m_group_handle_server( 0 ), m_max_browse_depth( DEFAULT_MAX_BROWSE_DEPTH ), m_max_string_buffer( DEFAULT_MAX_STRING_BUFFER )
+OpcDaClient::OpcDaClient() : is_com_init( false )
 {
 }
 
@@ -38,6 +42,7 @@ void OpcDaClient::set_max_browse_depth( int depth )
   if ( depth > 0 )
   {
     m_max_browse_depth = depth;
+    m_session.set_max_browse_depth( depth );
   }
 }
 
@@ -76,6 +81,17 @@ void OpcDaClient::debug( const string& message )
   Logger::instance().logDebug( "DEBUG: " + message );
 }
 
+void OpcDaClient::set_apartment( OPCDA_APARTMENT apartment )
+{
+  if ( is_com_init )
+  {
+    debug( "set_apartment", "COM is already initialized, apartment unchanged" );
+    return;
+  }
+
+  m_apartment = apartment;
+}
+
 bool OpcDaClient::com_init()
 {
   if ( is_com_init )
@@ -83,13 +99,14 @@ bool OpcDaClient::com_init()
     return true;
   }
 
-  HRESULT hr = CoInitializeEx( NULL, COINIT_APARTMENTTHREADED );
+  HRESULT hr = CoInitializeEx( NULL, m_apartment == OPCDA_APARTMENT::MTA ? COINIT_MULTITHREADED : COINIT_APARTMENTTHREADED );
 
   if ( SUCCEEDED( hr ) )
   {
     hr = CoInitializeSecurity( NULL, -1, NULL, NULL, RPC_C_AUTHN_LEVEL_CONNECT, RPC_C_IMP_LEVEL_IDENTIFY, NULL, EOAC_NONE, NULL );
 
-    if ( SUCCEEDED( hr ) )
+    // security is process wide; every client after the first one sees RPC_E_TOO_LATE
+    if ( SUCCEEDED( hr ) || hr == RPC_E_TOO_LATE )
     {
       is_com_init = true;
       return true;
@@ -142,31 +159,40 @@ string generate_groupname()
   return group_name;
 }
 
-vector<OPCDA_CONNECT_INFO> OpcDaClient::discovery( const string& host )
+// read_cached hits and misses, exported by --metrics; ComBackend measures the COM calls themselves
+static MetricCounter& s_value_cache_hits = MetricsRegistry::instance().counter( "opcda_value_cache_hits_total", "", "Tags read_cached served without a server read" );
+static MetricCounter& s_value_cache_misses = MetricsRegistry::instance().counter( "opcda_value_cache_misses_total", "", "Tags read_cached had to read from the server" );
+
+vector<OPCDA_CONNECT_INFO> OpcDaClient::discovery( const string& host, OPCDA_APARTMENT apartment )
 {
-  wstring whost = OPCDA::UTILS::str_to_wstr( host );
   vector<OPCDA_CONNECT_INFO> servers;
-  bool com_initialized = false;
 
-  try
+  HRESULT hr = CoInitializeEx( NULL, apartment == OPCDA_APARTMENT::MTA ? COINIT_MULTITHREADED : COINIT_APARTMENTTHREADED );
+  if ( FAILED( hr ) )
   {
+    cerr << "Failed to initialize COM for discovery. HRESULT: 0x" << hex << hr << endl;
+    return servers;
+  }
 
-    HRESULT hr = CoInitializeEx( NULL, COINIT_APARTMENTTHREADED );
-    if ( FAILED( hr ) )
-    {
-      cerr << "Failed to initialize COM for discovery. HRESULT: 0x" << hex << hr << endl;
-      return servers;
-    }
 
-    com_initialized = true;
+  hr = CoInitializeSecurity( NULL, -1, NULL, NULL, RPC_C_AUTHN_LEVEL_CONNECT, RPC_C_IMP_LEVEL_IDENTIFY, NULL, EOAC_NONE, NULL );
+  if ( FAILED( hr ) )
+  {
+    cerr << "Warning: COM security initialization failed. HRESULT: 0x" << hex << hr << endl;
+  }
+
+  enumerate_servers( host, servers );
 
+  CoUninitialize();
+  return servers;
+}
 
-    hr = CoInitializeSecurity( NULL, -1, NULL, NULL, RPC_C_AUTHN_LEVEL_CONNECT, RPC_C_IMP_LEVEL_IDENTIFY, NULL, EOAC_NONE, NULL );
-    if ( FAILED( hr ) )
-    {
-      cerr << "Warning: COM security initialization failed. HRESULT: 0x" << hex << hr << endl;
-    }
+HRESULT OpcDaClient::enumerate_servers( const string& host, vector<OPCDA_CONNECT_INFO>& servers, bool local_fallback, const vector<OPCDA_CONNECT_INFO>* known )
+{
+  wstring whost = OPCDA::UTILS::str_to_wstr( host );
 
+  try
+  {
     CComPtr<IOPCServerList> server_list;
     CComPtr<IEnumCLSID> enum_clsid;
 
@@ -177,31 +203,46 @@ vector<OPCDA_CONNECT_INFO> OpcDaClient::discovery( const string& host )
     info.pwszName = whost.empty() ? NULL : const_cast<LPWSTR>( whost.c_str() );
     mq[0] = { &IID_IOPCServerList, NULL, S_OK };
 
-    hr = CoCreateInstanceEx( CLSID_OPCEnum, NULL, CLSCTX_REMOTE_SERVER | CLSCTX_LOCAL_SERVER, ( whost.empty() ? NULL : &info ), 1, mq );
+    HRESULT hr = CoCreateInstanceEx( CLSID_OPCEnum, NULL, CLSCTX_REMOTE_SERVER | CLSCTX_LOCAL_SERVER, ( whost.empty() ? NULL : &info ), 1, mq );
     if ( FAILED( hr ) || FAILED( mq[0].hr ) )
     {
+      if ( !local_fallback )
+      {
+        return FAILED( hr ) ? hr : mq[0].hr;
+      }
+
       hr = CoCreateInstanceEx( CLSID_OPCEnum, NULL, CLSCTX_INPROC_SERVER, NULL, 1, mq );
       if ( FAILED( hr ) || FAILED( mq[0].hr ) )
       {
         cerr << "Failed to create OPC enum instance. HRESULT: 0x" << hex << hr << endl;
-        CoUninitialize();
-        return servers;
+        return FAILED( hr ) ? hr : mq[0].hr;
       }
     }
 
-    server_list = ( IOPCServerList* )mq[0].pItf;
+    server_list.Attach( reinterpret_cast<IOPCServerList*>( mq[0].pItf ) );
     hr = server_list->EnumClassesOfCategories( 3, da_categories, 0, NULL, &enum_clsid );
     if ( FAILED( hr ) )
     {
       cerr << "Failed to enumerate OPC categories. HRESULT: 0x" << hex << hr << endl;
-      CoUninitialize();
-      return servers;
+      return hr;
     }
 
     CLSID server_clsid;
     ULONG fetched;
     while ( ( hr = enum_clsid->Next( 1, &server_clsid, &fetched ) ) == S_OK && fetched == 1 )
     {
+      // GetClassDetails is a round trip per server; a CLSID resolved before keeps its ProgID
+      if ( known )
+      {
+        auto cached = find_if( known->begin(), known->end(), [&]( const OPCDA_CONNECT_INFO& k ) { return k.available && IsEqualCLSID( k.clsid, server_clsid ); } );
+        if ( cached != known->end() )
+        {
+          servers.push_back( *cached );
+          servers.back().host = host;
+          continue;
+        }
+      }
+
       LPOLESTR prog_id_ole = nullptr;
       LPOLESTR user_type_ole = nullptr;
       HRESULT details_hr = server_list->GetClassDetails( server_clsid, &prog_id_ole, &user_type_ole );
@@ -234,20 +275,16 @@ vector<OPCDA_CONNECT_INFO> OpcDaClient::discovery( const string& host )
     if ( FAILED( hr ) && hr != S_FALSE )
     {
       cerr << "Error during enumeration. HRESULT: 0x" << hex << hr << endl;
+      return hr;
     }
+
+    return S_OK;
   }
   catch ( const exception& e )
   {
     cerr << "Exception during OPC server discovery: " << e.what() << endl;
+    return E_FAIL;
   }
-
-
-  if ( com_initialized )
-  {
-    CoUninitialize();
-  }
-
-  return servers;
 }
 
 bool OpcDaClient::connect( OPCDA_CONNECT_INFO& info )
@@ -284,7 +321,26 @@ bool OpcDaClient::connect_progid( const string& host_name, const string& progid
   try
   {
     CLSID clsid;
-    HRESULT hr = CLSIDFromProgID( OPCDA::UTILS::str_to_wstr( progid ).c_str(), &clsid );
+    wstring wprogid = OPCDA::UTILS::str_to_wstr( progid );
+
+    if ( m_discovery_cache && m_discovery_cache->find_progid( host_name, wprogid, clsid ) )
+    {
+      if ( connect_clsid( host_name, clsid ) )
+      {
+        return true;
+      }
+
+      // the server may have been re-registered under a new CLSID
+      m_discovery_cache->invalidate_host( host_name );
+    }
+
+    HRESULT hr = CLSIDFromProgID( wprogid.c_str(), &clsid );
+
+    // the local registry does not know servers that only exist on the remote host
+    if ( FAILED( hr ) && m_discovery_cache && !m_discovery_cache->discover( host_name, true ).empty() && m_discovery_cache->find_progid( host_name, wprogid, clsid ) )
+    {
+      hr = S_OK;
+    }
 
     if ( FAILED( hr ) )
     {
@@ -292,7 +348,17 @@ bool OpcDaClient::connect_progid( const string& host_name, const string& progid
       return false;
     }
 
-    return connect_clsid( host_name, clsid );
+    if ( !connect_clsid( host_name, clsid ) )
+    {
+      return false;
+    }
+
+    if ( m_discovery_cache )
+    {
+      m_discovery_cache->put_progid( host_name, wprogid, clsid );
+    }
+
+    return true;
   }
   catch ( const exception& e )
   {
@@ -301,11 +367,16 @@ bool OpcDaClient::connect_progid( const string& host_name, const string& progid
   }
 }
 
+void OpcDaClient::set_discovery_cache( DiscoveryCache* cache )
+{
+  m_discovery_cache = cache;
+}
+
 bool OpcDaClient::connect_clsid( const string& host_name, const CLSID& server_clsid )
 {
   try
   {
-    lock_guard<mutex> lock( m_mutex );
+    unique_lock<shared_mutex> lock( m_connection_lock );
 
     disconnect();
 
@@ -315,6 +386,28 @@ bool OpcDaClient::connect_clsid( const string& host_name, const CLSID& server_cl
       return false;
     }
 
+    if ( !open_session( host_name, server_clsid ) )
+    {
+      return false;
+    }
+
+    m_server_host = host_name;
+    m_server_clsid = server_clsid;
+    m_supervisor.on_connected();
+    return true;
+  }
+  catch ( const exception& e )
+  {
+    debug( "connect_clsid", e );
+    disconnect();
+    return false;
+  }
+}
+
+bool OpcDaClient::open_session( const string& host_name, const CLSID& server_clsid )
+{
+  try
+  {
     COSERVERINFO server_info = { 0 };
     wstring w_host_name = host_name.empty() ? L"" : OPCDA::UTILS::str_to_wstr( host_name );
     server_info.pwszName = host_name.empty() ? NULL : const_cast<LPWSTR>( w_host_name.c_str() );
@@ -341,78 +434,90 @@ bool OpcDaClient::connect_clsid( const string& host_name, const CLSID& server_cl
     }
 
 
-    m_server = reinterpret_cast<IOPCServer*>( mq[0].pItf );
-    if ( !m_server )
+    CComPtr<IOPCServer> server;
+    server.Attach( reinterpret_cast<IOPCServer*>( mq[0].pItf ) );
+    if ( !server )
     {
       debug( "connect_clsid", "Failed to get valid IOPCServer interface" );
       return false;
     }
 
+    return bind( server );
+  }
+  catch ( const exception& e )
+  {
+    debug( "open_session", e );
+    m_backend.close();
+    return false;
+  }
+}
 
-    hr = m_server->QueryInterface( IID_IOPCBrowseServerAddressSpace, reinterpret_cast<void**>( &browser ) );
-    if ( FAILED( hr ) || !browser )
-    {
-      debug( "IID_IOPCBrowseServerAddressSpace", hr );
+bool OpcDaClient::attach( IOPCServer* server )
+{
+  try
+  {
+    unique_lock<shared_mutex> lock( m_connection_lock );
 
+    disconnect();
 
-      hr = m_server->QueryInterface( IID_IOPCItemProperties, reinterpret_cast<void**>( &m_item_properties ) );
-      if ( FAILED( hr ) || !m_item_properties )
-      {
-        debug( "IID_IOPCItemProperties", hr );
-        debug( "connect_clsid", "Failed to get browsing interfaces" );
-        return false;
-      }
-      else
-      {
-        m_browse_method = OPCDA_BROWSE_METHOD::ITEM_PROPERTIES;
-      }
-    }
-    else
+    if ( !server )
     {
-      m_browse_method = OPCDA_BROWSE_METHOD::SERVER_ADDRESS_SPACE;
+      return false;
     }
 
+    // an attached server has no CLSID to reconnect with, so it is never supervised
+    m_server_host.clear();
+    m_server_clsid = CLSID_NULL;
 
-    m_default_group = generate_groupname();
-    cout << "m_default_group : " << m_default_group << endl;
-
-    if ( !add_opc_group( m_default_group ) )
+    if ( !bind( server ) )
     {
-      debug( "connect_clsid", "Failed to add OPC group" );
-      disconnect();
       return false;
     }
 
+    m_supervisor.on_connected();
     return true;
   }
   catch ( const exception& e )
   {
-    debug( "connect_clsid", e );
+    debug( "attach", e );
     disconnect();
     return false;
   }
 }
 
-void OpcDaClient::disconnect()
+bool OpcDaClient::bind( IOPCServer* server )
 {
-  try
+  // the group is created on first use, DA 3.0 reads and writes never need one
+  HRESULT hr = m_backend.open( server, m_apartment, OPCDA::UTILS::str_to_wstr( generate_groupname() ) );
+  if ( FAILED( hr ) )
+  {
+    debug( "bind", hr, "Failed to open the backend" );
+    return false;
+  }
+
+  BACKEND_FEATURES features = m_backend.features();
+  if ( !features.browse_elements && !features.address_space && !features.properties )
   {
-    remove_opc_group();
+    debug( "connect_clsid", "Failed to get browsing interfaces" );
+    m_backend.close();
+    return false;
+  }
 
-    if ( browser )
-    {
-      browser.Release();
-    }
+  m_connected = true;
+  return true;
+}
 
-    if ( m_item_properties )
-    {
-      m_item_properties.Release();
-    }
+void OpcDaClient::disconnect()
+{
+  m_connected = false;
 
-    if ( m_server )
-    {
-      m_server.Release();
-    }
+  try
+  {
+    // removing the group removes its items with it, the session only has to forget them
+    m_backend.close();
+    m_session.clear();
+    m_property_cache.clear();
+    m_value_cache.clear();
   }
   catch ( const exception& e )
   {
@@ -420,783 +525,680 @@ void OpcDaClient::disconnect()
   }
 }
 
-void OpcDaClient::get_server_status()
+HRESULT OpcDaClient::reconnect()
 {
+  TraceSpan span( "reconnect" );
+
   try
   {
-    lock_guard<mutex> lock( m_mutex );
+    unique_lock<shared_mutex> lock( m_connection_lock );
 
-    auto server_state_to_string = [this]( DWORD state ) -> string
+    if ( IsEqualCLSID( m_server_clsid, CLSID_NULL ) )
     {
-      switch ( state )
-      {
-        case OPC_STATUS_RUNNING:
-          return "OPC_STATUS_RUNNING";
-        case OPC_STATUS_FAILED:
-          return "OPC_STATUS_FAILED";
-        case OPC_STATUS_NOCONFIG:
-          return "OPC_STATUS_NOCONFIG";
-        case OPC_STATUS_SUSPENDED:
-          return "OPC_STATUS_SUSPENDED";
-        case OPC_STATUS_TEST:
-          return "OPC_STATUS_TEST";
-        case OPC_STATUS_COMM_FAULT:
-          return "OPC_STATUS_COMM_FAULT";
-        default:
-          return "UNKNOWN_" + to_string( state );
-      }
-    };
+      return E_UNEXPECTED;
+    }
 
-    if ( m_server )
+    // proxies of an STA client must stay in the apartment that owns them
+    if ( m_apartment == OPCDA_APARTMENT::STA && m_backend.is_open() && !m_backend.is_home_thread() )
     {
-      if ( !m_status.is_init )
-      {
-        OPCSERVERSTATUS* ss = nullptr;
-        HRESULT hr = m_server->GetStatus( &ss );
+      return RPC_E_WRONG_THREAD;
+    }
 
-        if ( SUCCEEDED( hr ) && ss )
-        {
-          m_status.is_init = true;
-          m_status.server_started_epochtime = OPCDA::UTILS::filetime_to_epochtime( ss->ftStartTime );
-          m_status.status_created_epochtime = OPCDA::UTILS::filetime_to_epochtime( ss->ftCurrentTime );
-          m_status.status_updated_epochtime = OPCDA::UTILS::filetime_to_epochtime( ss->ftLastUpdateTime );
-          m_status.status = ss->dwServerState;
-          m_status.status_string = server_state_to_string( ss->dwServerState );
-          m_status.enabled_group_len = OPCDA::UTILS::dword_to_int( ss->dwGroupCount );
-          m_status.major_version = OPCDA::UTILS::word_to_int( ss->wMajorVersion );
-          m_status.minor_version = OPCDA::UTILS::word_to_int( ss->wMinorVersion );
-          m_status.build_version = OPCDA::UTILS::word_to_int( ss->wBuildNumber );
-
-          if ( ss->szVendorInfo )
-          {
-            m_status.vendor = OPCDA::UTILS::wstr_to_str( ss->szVendorInfo );
-            CoTaskMemFree( ss->szVendorInfo );
-          }
-          else
-          {
-            m_status.vendor = "";
-          }
-
-          CoTaskMemFree( ss );
-        }
-      }
+    // the old server is gone, so nothing here may wait on it: no RemoveGroup
+    m_connected = false;
+    m_backend.close( false );
+
+    if ( !open_session( m_server_host, m_server_clsid ) )
+    {
+      return CO_E_SERVER_EXEC_FAILURE;
     }
+
+    // item IDs were resolved before the outage, one add brings them all back
+    return m_session.restore();
   }
   catch ( const exception& e )
   {
-    debug( "get_server_status", e );
+    debug( "reconnect", e );
+    return E_FAIL;
   }
 }
 
-bool OpcDaClient::is_connected() const
+HRESULT OpcDaClient::heartbeat()
 {
-  return m_server != nullptr;
+  shared_lock<shared_mutex> lock( m_connection_lock );
+
+  BACKEND_STATUS status;
+  HRESULT hr = m_backend.status( status );
+
+  // a server that answers but stopped running counts as a miss
+  if ( SUCCEEDED( hr ) && status.state != OPC_STATUS_RUNNING )
+  {
+    hr = E_FAIL;
+  }
+
+  m_supervisor.on_heartbeat( hr );
+  return hr;
 }
 
-bool OpcDaClient::add_opc_group( const string& gname )
+HRESULT OpcDaClient::supervise()
 {
-  try
+  if ( !m_auto_reconnect || IsEqualCLSID( m_server_clsid, CLSID_NULL ) )
   {
-    wstring group_name = OPCDA::UTILS::str_to_wstr( gname );
+    return S_OK;
+  }
 
-    if ( !m_server )
-    {
-      debug( "add_opc_group", "Server interface not available" );
-      return false;
-    }
+  if ( m_supervisor.heartbeat_due() )
+  {
+    heartbeat();
+  }
 
-    if ( group_name.empty() )
-    {
-      debug( "add_opc_group", "Group name is empty" );
-      return false;
-    }
+  if ( m_supervisor.state() == OPCDA_LINK_STATE::UP )
+  {
+    return S_OK;
+  }
 
-    remove_opc_group();
+  // one thread reconnects, the others fail fast instead of queueing behind it
+  unique_lock<mutex> attempt( m_reconnect_lock, try_to_lock );
+  if ( !attempt.owns_lock() || !m_supervisor.attempt_due() )
+  {
+    return RPC_E_DISCONNECTED;
+  }
 
-    DWORD revised_update_rate = 1000;
-    OPCHANDLE client_group_handle = 1;
+  HRESULT hr = reconnect();
+  m_supervisor.on_attempt( SUCCEEDED( hr ) );
 
-    HRESULT hr = m_server->AddGroup( group_name.c_str(), FALSE, 1000, client_group_handle, NULL, NULL, 0, &m_group_handle_server, &revised_update_rate, IID_IUnknown, &m_group_unknown );
+  if ( FAILED( hr ) )
+  {
+    debug( "supervise", hr, "Reconnect attempt failed" );
+    return RPC_E_DISCONNECTED;
+  }
 
-    if ( FAILED( hr ) || !m_group_unknown )
-    {
-      debug( "AddGroup", hr );
-      m_group_unknown = nullptr;
-      m_group_handle_server = 0;
-      return false;
-    }
+  return S_OK;
+}
+
+void OpcDaClient::set_auto_reconnect( bool enabled )
+{
+  m_auto_reconnect = enabled;
+}
 
+void OpcDaClient::get_server_status()
+{
+  try
+  {
+    shared_lock<shared_mutex> connection( m_connection_lock );
+    lock_guard<mutex> lock( m_status_lock );
 
-    hr = m_group_unknown->QueryInterface( IID_IOPCItemMgt, reinterpret_cast<void**>( &m_opc_item_mgt ) );
-    if ( FAILED( hr ) || !m_opc_item_mgt )
+    if ( !m_backend.is_open() )
     {
-      debug( "IID_IOPCItemMgt", hr );
-      remove_opc_group();
-      return false;
+      return;
     }
 
+    // every call takes a fresh sample, is_init only says one was ever taken
+    BACKEND_STATUS status;
+    HRESULT hr = m_backend.status( status );
+    m_supervisor.on_result( hr );
 
-    hr = m_group_unknown->QueryInterface( IID_IOPCSyncIO, reinterpret_cast<void**>( &m_opc_sync_io ) );
-    if ( FAILED( hr ) || !m_opc_sync_io )
+    if ( FAILED( hr ) )
     {
-      debug( "IID_IOPCSyncIO", hr );
-      remove_opc_group();
-      return false;
-    }
+      debug( "GetStatus", hr );
+      return;
+    }
+
+    m_status.is_init = true;
+    m_status.server_started_epochtime = OPCDA::UTILS::filetime_to_epochtime( OPCDA::UTILS::ticks_to_filetime( status.start_time ) );
+    m_status.status_created_epochtime = OPCDA::UTILS::filetime_to_epochtime( OPCDA::UTILS::ticks_to_filetime( status.current_time ) );
+    m_status.status_updated_epochtime = OPCDA::UTILS::filetime_to_epochtime( OPCDA::UTILS::ticks_to_filetime( status.last_update_time ) );
+    m_status.status = status.state;
+    m_status.status_string = OPCDA::UTILS::server_state_to_str( status.state );
+    m_status.enabled_group_len = OPCDA::UTILS::dword_to_int( status.group_count );
+    m_status.major_version = OPCDA::UTILS::word_to_int( status.major_version );
+    m_status.minor_version = OPCDA::UTILS::word_to_int( status.minor_version );
+    m_status.build_version = OPCDA::UTILS::word_to_int( status.build_number );
+    m_status.vendor = OPCDA::UTILS::wstr_to_str( status.vendor );
+  }
+  catch ( const exception& e )
+  {
+    debug( "get_server_status", e );
+  }
+}
 
+bool OpcDaClient::is_connected() const
+{
+  return m_connected;
+}
 
-    hr = m_group_unknown->QueryInterface( IID_IOPCGroupStateMgt, reinterpret_cast<void**>( &m_opc_group_state ) );
-    if ( FAILED( hr ) || !m_opc_group_state )
-    {
-      debug( "IID_IOPCGroupStateMgt", hr );
-      remove_opc_group();
-      return false;
-    }
+bool OpcDaClient::ensure_group()
+{
+  shared_lock<shared_mutex> lock( m_connection_lock );
+
+  HRESULT hr = m_backend.ensure_group();
+  if ( FAILED( hr ) )
+  {
+    debug( "ensure_group", hr, "AddGroup" );
+    return false;
+  }
+  return true;
+}
 
+void OpcDaClient::set_browse_filter( const OPCDA_BROWSE_FILTER& filter )
+{
+  BACKEND_BROWSE_QUERY query;
+  query.name = filter.name;
+  query.vendor = filter.vendor;
+  query.data_type = filter.data_type;
+  query.page_size = filter.page_size;
+  m_session.set_browse_filter( query );
+}
 
-    BOOL active_state = TRUE;
-    DWORD actual_update_rate = 0;
-    hr = m_opc_group_state->SetState( &revised_update_rate, &actual_update_rate, &active_state, NULL, NULL, NULL, NULL );
+HRESULT OpcDaClient::browse_tags( const wstring& path, vector<wstring>& branches, vector<wstring>& tags )
+{
+  try
+  {
+    shared_lock<shared_mutex> lock( m_connection_lock );
 
+    HRESULT hr = m_session.browse( path, branches, tags );
     if ( FAILED( hr ) )
     {
-      debug( "SetState", hr );
-      remove_opc_group();
-      return false;
+      debug( "browse_tags", hr, "Failed to browse " + OPCDA::UTILS::wstr_to_str( path ) );
     }
-
-    return true;
+    return hr;
   }
   catch ( const exception& e )
   {
-    debug( "add_opc_group", e );
-    return false;
+    debug( "browse_tags", e );
+    return E_FAIL;
   }
 }
 
-
-HRESULT OpcDaClient::browse_tags_iterative( vector<wstring>& all_tags, const wstring& root_path )
+vector<wstring> OpcDaClient::request_browse_all_tags( vector<wstring>& tags, const wstring& path )
 {
-  if ( !browser || m_browse_method != OPCDA_BROWSE_METHOD::SERVER_ADDRESS_SPACE )
+  try
   {
-    debug( "browse_tags_iterative", "Browser not available or wrong browse method" );
-    return E_FAIL;
-  }
+    shared_lock<shared_mutex> lock( m_connection_lock );
 
-  struct BrowsePath
-  {
-    wstring path;
-    int depth;
-  };
+    // DA 3.0 elements carry their data type and access rights, so request_readable_tags needs no property query for them
+    HRESULT hr = m_session.browse_all( tags, path,
+      [this]( const BACKEND_BROWSE_ELEMENT& element )
+      {
+        if ( !element.has_properties )
+        {
+          return;
+        }
 
+        OPCDA_ITEM_PROPERTIES cached;
+        cached.item_id = element.item_id;
+        cached.fetched = cached.present = PROPERTY_DATATYPE | PROPERTY_ACCESS_RIGHTS;
+        cached.data_type = element.data_type;
+        cached.access_rights = element.access_rights;
+        cached.fetched_at = chrono::steady_clock::now();
+        m_property_cache.store( cached );
+      } );
 
-  vector<BrowsePath> paths_to_browse;
-  paths_to_browse.push_back( { root_path, 0 } );
+    if ( FAILED( hr ) )
+    {
+      debug( "get_all_tags", hr, "Failed to browse the address space" );
+    }
+    return tags;
+  }
+  catch ( const exception& e )
+  {
+    debug( "get_all_tags", e );
+    return tags;
+  }
+}
 
-  HRESULT final_result = S_OK;
+HRESULT OpcDaClient::resolve_item_id( const wstring& browse_path, wstring& item_id )
+{
+  try
+  {
+    shared_lock<shared_mutex> lock( m_connection_lock );
+    return m_session.resolve( browse_path, item_id );
+  }
+  catch ( const exception& e )
+  {
+    debug( "resolve_item_id", e );
+    item_id = browse_path;
+    return E_FAIL;
+  }
+}
 
+void OpcDaClient::request_readable_tags( const wstring& path )
+{
+  TraceSpan span( "request_readable_tags" );
 
-  set<wstring> processed_paths;
+  try
+  {
+    m_available_tags.clear();
+    m_all_tags.clear();
 
 
-  while ( !paths_to_browse.empty() )
-  {
+    vector<wstring> tag_list;
+    request_browse_all_tags( tag_list, path );
 
-    BrowsePath current = paths_to_browse.back();
-    paths_to_browse.pop_back();
+    debug( "get_readable_tags", "Found " + to_string( tag_list.size() ) + " total tags" );
 
 
-    if ( processed_paths.find( current.path ) != processed_paths.end() )
+    // IOPCBrowse already cached the access rights, other servers answer one bulk property query
+    vector<OPCDA_ITEM_PROPERTIES> properties;
     {
-      continue;
+      TraceSpan phase( "access_rights", static_cast<int64_t>( tag_list.size() ) );
+      get_item_properties( tag_list, PROPERTY_ACCESS_RIGHTS, properties );
     }
-    processed_paths.insert( current.path );
 
+    auto known = [&]( size_t i ) { return i < properties.size() && SUCCEEDED( properties[i].error ) && ( properties[i].present & PROPERTY_ACCESS_RIGHTS ); };
 
-    if ( current.depth > m_max_browse_depth )
+    // the rest is resolved and validated in one call; validation reports the access rights too
+    vector<wstring> unknown;
+    for ( size_t i = 0; i < tag_list.size(); ++i )
     {
-      debug( "browse_tags_iterative", "Maximum browse depth reached at path: " + OPCDA::UTILS::wstr_to_str( current.path ) );
-      continue;
-    }
-
-
-    HRESULT hr = browser->ChangeBrowsePosition( OPC_BROWSE_TO, current.path.empty() ? L"" : current.path.c_str() );
-
-    if ( FAILED( hr ) )
-    {
-      debug( "ChangeBrowsePosition", hr, "Path: " + OPCDA::UTILS::wstr_to_str( current.path ) );
-      continue;
-    }
-
-
-    vector<wstring> leaves;
-    CComPtr<IEnumString> leaf_enum;
-    hr = browser->BrowseOPCItemIDs( OPC_LEAF, L"", VT_EMPTY, 0, &leaf_enum );
-
-    if ( SUCCEEDED( hr ) && leaf_enum )
-    {
-      LPOLESTR leaf_name;
-      ULONG fetched;
-
-      while ( leaf_enum->Next( 1, &leaf_name, &fetched ) == S_OK && fetched == 1 )
+      if ( !known( i ) )
       {
-        if ( leaf_name && *leaf_name )
-        {
-
-          wstring tag_id = current.path.empty() ? leaf_name : current.path + L"." + leaf_name;
-
-
-          if ( find( all_tags.begin(), all_tags.end(), tag_id ) == all_tags.end() )
-          {
-            all_tags.push_back( tag_id );
-          }
-        }
-        CoTaskMemFree( leaf_name );
+        unknown.push_back( tag_list[i] );
       }
     }
 
+    vector<wstring> readable_ids;
+    if ( !unknown.empty() )
+    {
+      shared_lock<shared_mutex> lock( m_connection_lock );
+      m_session.readable_items( unknown, readable_ids );
+    }
+    set<wstring> readable( readable_ids.begin(), readable_ids.end() );
 
-    CComPtr<IEnumString> branch_enum;
-    hr = browser->BrowseOPCItemIDs( OPC_BRANCH, L"", VT_EMPTY, 0, &branch_enum );
-
-    if ( SUCCEEDED( hr ) && branch_enum )
+    for ( size_t i = 0; i < tag_list.size(); ++i )
     {
-      LPOLESTR branch_name;
-      ULONG fetched;
+      const wstring& browse_path = tag_list[i];
+      m_all_tags.push_back( browse_path );
 
-      while ( branch_enum->Next( 1, &branch_name, &fetched ) == S_OK && fetched == 1 )
+      wstring item_id = m_session.mapped_id( browse_path );
+      if ( known( i ) ? ( properties[i].access_rights & OPC_READABLE ) != 0 : readable.count( item_id ) > 0 )
       {
-        if ( branch_name && *branch_name )
-        {
-          wstring branch_path = current.path.empty() ? branch_name : current.path + L"." + branch_name;
-
-
-          paths_to_browse.push_back( { branch_path, current.depth + 1 } );
-        }
-        CoTaskMemFree( branch_name );
+        m_available_tags.push_back( item_id );
       }
     }
-  }
 
-  return final_result;
+    debug( "get_readable_tags", "Resolved " + to_string( m_available_tags.size() ) + " readable tags from " + to_string( m_all_tags.size() ) + " total tags" );
+  }
+  catch ( const exception& e )
+  {
+    debug( "get_readable_tags", e );
+  }
 }
 
+HRESULT OpcDaClient::check_link( size_t count, vector<HRESULT>& errors )
+{
+  if ( m_auto_reconnect && m_supervisor.state() != OPCDA_LINK_STATE::UP && FAILED( supervise() ) )
+  {
+    errors.assign( count, RPC_E_DISCONNECTED );
+    return RPC_E_DISCONNECTED;
+  }
+  return S_OK;
+}
 
-HRESULT OpcDaClient::browse_tags( const wstring& path, vector<wstring>& branches, vector<wstring>& tags )
+HRESULT OpcDaClient::unregister_items( const vector<wstring>& item_ids )
 {
   try
   {
-    lock_guard<mutex> lock( m_mutex );
-
-    branches.clear();
-    tags.clear();
-
-    if ( m_browse_method == OPCDA_BROWSE_METHOD::NONE )
+    if ( item_ids.empty() )
     {
-      debug( "browse_tags", "Browse method not initialized" );
-      return E_FAIL;
+      return S_OK;
     }
-    else if ( m_browse_method == OPCDA_BROWSE_METHOD::SERVER_ADDRESS_SPACE )
-    {
-      if ( !browser )
-      {
-        debug( "browse_tags", "IOPCBrowseServerAddressSpace interface not available" );
-        return E_NOINTERFACE;
-      }
-
 
-      OPCNAMESPACETYPE namespace_type;
-      HRESULT hr = browser->QueryOrganization( &namespace_type );
-
-      if ( FAILED( hr ) )
-      {
-        debug( "QueryOrganization", hr );
-        namespace_type = OPC_NS_HIERARCHIAL;
-      }
+    shared_lock<shared_mutex> lock( m_connection_lock );
 
+    // handles are not reused, so a read still in flight only fills an orphaned slot
+    invalidate_values( item_ids );
 
-      if ( namespace_type == OPC_NS_HIERARCHIAL )
-      {
-
-        OPCBROWSEDIRECTION direction = path.empty() ? OPC_BROWSE_DOWN : OPC_BROWSE_TO;
-        LPWSTR path_ptr = path.empty() ? NULL : const_cast<LPWSTR>( path.c_str() );
-
-        hr = browser->ChangeBrowsePosition( direction, path_ptr );
-
-        if ( FAILED( hr ) )
-        {
-          debug( "ChangeBrowsePosition", hr, "Failed to change browse position to: " + OPCDA::UTILS::wstr_to_str( path ) );
-          return hr;
-        }
-      }
-
-
-      CComPtr<IEnumString> branch_enum;
-      hr = browser->BrowseOPCItemIDs( OPC_BRANCH, L"", VT_EMPTY, 0, &branch_enum );
-      if ( SUCCEEDED( hr ) && branch_enum )
-      {
-        LPOLESTR branch_name;
-        ULONG fetched;
-        while ( branch_enum->Next( 1, &branch_name, &fetched ) == S_OK && fetched == 1 )
-        {
-          if ( branch_name && *branch_name )
-          {
-            branches.push_back( branch_name );
-          }
-          CoTaskMemFree( branch_name );
-        }
-      }
-
-
-      CComPtr<IEnumString> leaf_enum;
-      hr = browser->BrowseOPCItemIDs( OPC_LEAF, L"", VT_EMPTY, 0, &leaf_enum );
-      if ( SUCCEEDED( hr ) && leaf_enum )
-      {
-        LPOLESTR leaf_name;
-        ULONG fetched;
-        while ( leaf_enum->Next( 1, &leaf_name, &fetched ) == S_OK && fetched == 1 )
-        {
-          if ( leaf_name && *leaf_name )
-          {
-            tags.push_back( leaf_name );
-          }
-          CoTaskMemFree( leaf_name );
-        }
-      }
-
-      return S_OK;
-    }
-    else if ( m_browse_method == OPCDA_BROWSE_METHOD::ITEM_PROPERTIES )
+    // the registration is gone either way: a failed removal must not be restored on reconnect
+    HRESULT hr = m_session.unregister( item_ids );
+    if ( FAILED( hr ) )
     {
-      if ( !m_item_properties )
-      {
-        debug( "browse_tags", "IOPCItemProperties interface not available" );
-        return E_NOINTERFACE;
-      }
-
-
-      debug( "browse_tags", "Using IOPCItemProperties instead of IOPCBrowseServerAddressSpace" );
-      return E_NOTIMPL;
+      debug( "unregister_items", hr, "RemoveItems" );
     }
-
-    return E_FAIL;
+    return hr;
   }
   catch ( const exception& e )
   {
-    debug( "browse_tags", e );
+    debug( "unregister_items", e );
     return E_FAIL;
   }
 }
 
+HRESULT OpcDaClient::read_sync( const vector<wstring>& item_ids, vector<OPCDA_TAG>& results, vector<HRESULT>& errors )
+{
+  return read_items( item_ids, BACKEND_SOURCE::CACHE, results, errors );
+}
 
-vector<wstring> OpcDaClient::request_browse_all_tags( vector<wstring>& tags, const wstring& path )
+HRESULT OpcDaClient::read_device( const vector<wstring>& item_ids, vector<OPCDA_TAG>& results, vector<HRESULT>& errors )
+{
+  return read_items( item_ids, BACKEND_SOURCE::DEVICE, results, errors );
+}
+
+HRESULT OpcDaClient::read_items( const vector<wstring>& item_ids, BACKEND_SOURCE source, vector<OPCDA_TAG>& results, vector<HRESULT>& errors )
 {
+  bool device = source == BACKEND_SOURCE::DEVICE;
+  TraceSpan span( device ? "read_device" : "read_sync", static_cast<int64_t>( item_ids.size() ) );
+
   try
   {
+    results.clear();
+    errors.clear();
 
-    if ( m_browse_method == OPCDA_BROWSE_METHOD::SERVER_ADDRESS_SPACE )
+    if ( item_ids.empty() )
     {
-      HRESULT hr = browse_tags_iterative( tags, path );
-      if ( FAILED( hr ) )
-      {
-        debug( "get_all_tags", hr, "Failed to browse tags iteratively" );
-      }
+      return S_OK;
     }
-    else
-    {
-
-      vector<wstring> branches, leaves;
-      HRESULT hr = browse_tags( path, branches, leaves );
 
-      if ( SUCCEEDED( hr ) )
-      {
+    if ( FAILED( check_link( item_ids.size(), errors ) ) )
+    {
+      return RPC_E_DISCONNECTED;
+    }
 
-        for ( const auto& leaf : leaves )
-        {
-          try
-          {
-            wstring id = path.empty() ? leaf : path + L"." + leaf;
-            if ( find( tags.begin(), tags.end(), id ) == tags.end() )
-            {
-              tags.push_back( id );
-            }
-          }
-          catch ( const exception& e )
-          {
-            debug( "get_all_tags - leaves", e );
-          }
-        }
+    shared_lock<shared_mutex> lock( m_connection_lock );
 
+    // items stay registered once added, so repeated reads skip AddItems entirely
+    vector<BACKEND_VALUE> values;
+    HRESULT hr = m_session.read( item_ids, values, source );
+    m_supervisor.on_result( hr );
 
-        for ( const auto& branch : branches )
-        {
-          if ( m_browse_depth < m_max_browse_depth )
-          {
-            try
-            {
-              m_browse_depth++;
-              wstring branch_path = path.empty() ? branch : path + L"." + branch;
-              request_browse_all_tags( tags, branch_path );
-              m_browse_depth--;
-            }
-            catch ( const exception& e )
-            {
-              m_browse_depth--;
-              debug( "get_all_tags - branches", e );
-            }
-          }
-          else
-          {
-            debug( "get_all_tags", "Maximum browse depth reached" );
-            break;
-          }
-        }
-      }
+    if ( FAILED( hr ) )
+    {
+      debug( device ? "read_device" : "read_sync", hr );
     }
 
-    return tags;
+    to_tags( item_ids, values, results, errors );
+    return any_of( errors.begin(), errors.end(), []( HRESULT e ) { return FAILED( e ); } ) ? S_FALSE : S_OK;
   }
   catch ( const exception& e )
   {
-    debug( "get_all_tags", e );
-    return tags;
+    debug( "read_sync", e );
+    return E_FAIL;
   }
 }
 
-HRESULT OpcDaClient::resolve_item_id( const wstring& browse_path, wstring& item_id )
+void OpcDaClient::set_max_age( DWORD max_age_ms )
+{
+  m_session.set_max_age( max_age_ms );
+}
+
+HRESULT OpcDaClient::read_item_io( const vector<wstring>& item_ids, DWORD max_age_ms, vector<OPCDA_TAG>& results, vector<HRESULT>& errors )
 {
   try
   {
+    results.clear();
+    errors.clear();
 
-    auto it = m_id_mapping.find( browse_path );
-    if ( it != m_id_mapping.end() )
+    if ( item_ids.empty() )
     {
-      item_id = it->second;
       return S_OK;
     }
 
-
-    if ( browser )
+    if ( FAILED( check_link( item_ids.size(), errors ) ) )
     {
-      LPWSTR item_id_str = nullptr;
-      HRESULT hr = browser->GetItemID( const_cast<LPWSTR>( browse_path.c_str() ), &item_id_str );
-
-      if ( SUCCEEDED( hr ) && item_id_str )
-      {
-        wstring candidate = item_id_str;
-        CoTaskMemFree( item_id_str );
-
-        if ( validate_item_id( candidate ) )
-        {
-          item_id = candidate;
-          m_id_mapping[browse_path] = item_id;
-          return S_OK;
-        }
-      }
+      return RPC_E_DISCONNECTED;
     }
 
+    shared_lock<shared_mutex> lock( m_connection_lock );
 
-    for ( const auto& pattern : m_id_patterns )
+    if ( !m_backend.features().item_io )
     {
-      if ( browse_path.rfind( pattern.first, 0 ) == 0 )
-      {
-        wstring transformed = browse_path;
-        transformed.replace( 0, pattern.first.length(), pattern.second );
-
-        if ( validate_item_id( transformed ) )
-        {
-          item_id = transformed;
-          m_id_mapping[browse_path] = item_id;
-          return S_OK;
-        }
-      }
+      debug( "read_item_io", "IOPCItemIO is not available" );
+      return E_NOINTERFACE;
     }
 
+    vector<BACKEND_VALUE> values;
+    HRESULT hr = m_session.read_ids( item_ids, max_age_ms, values );
+    m_supervisor.on_result( hr );
 
-    vector<wstring> candidates;
-    get_item_id_candidates( browse_path, candidates );
-
-    for ( const auto& candidate : candidates )
+    if ( FAILED( hr ) )
     {
-      if ( validate_item_id( candidate ) )
-      {
-        item_id = candidate;
-        m_id_mapping[browse_path] = item_id;
-        learn_id_mapping_pattern( browse_path, candidate );
-        return S_OK;
-      }
+      debug( "read_item_io", hr );
     }
 
-
-    item_id = browse_path;
-    return S_FALSE;
+    to_tags( item_ids, values, results, errors );
+    return FAILED( hr ) ? hr : any_of( errors.begin(), errors.end(), []( HRESULT e ) { return FAILED( e ); } ) ? S_FALSE : S_OK;
   }
   catch ( const exception& e )
   {
-    debug( "resolve_item_id", e );
-    item_id = browse_path;
+    debug( "read_item_io", e );
     return E_FAIL;
   }
 }
 
-
-bool OpcDaClient::validate_item_id( const wstring& item_id )
+void OpcDaClient::to_tags( const vector<wstring>& item_ids, const vector<BACKEND_VALUE>& values, vector<OPCDA_TAG>& results, vector<HRESULT>& errors )
 {
-  try
-  {
-    if ( !m_opc_item_mgt )
-    {
-      return false;
-    }
-
-    OPCITEMDEF item_def = { 0 };
-    item_def.szAccessPath = L"";
-    item_def.szItemID = const_cast<LPWSTR>( item_id.c_str() );
-    item_def.bActive = FALSE;
-    item_def.hClient = 1;
-    item_def.dwBlobSize = 0;
-    item_def.pBlob = NULL;
-    item_def.vtRequestedDataType = VT_EMPTY;
-
-    OPCITEMRESULT* result = nullptr;
-    HRESULT* errors = nullptr;
-
-    HRESULT hr = m_opc_item_mgt->ValidateItems( 1, &item_def, FALSE, &result, &errors );
+  size_t count = item_ids.size();
+  results.resize( count );
+  errors.resize( count );
 
-    bool valid = SUCCEEDED( hr ) && errors && SUCCEEDED( errors[0] );
+  // item IO reads register nothing, their tags keep no access rights
+  vector<BACKEND_ITEM> items;
+  vector<uint32_t> handles;
+  m_session.registrations( item_ids, items );
+  m_session.client_handles( item_ids, handles );
 
+  for ( size_t i = 0; i < count; ++i )
+  {
+    OPCDA_TAG& tag = results[i];
+    tag.id = item_ids[i];
+    tag.access_rights = items[i].access_rights;
+    tag.data_type = items[i].canonical_type;
+    tag.quality = OPC_QUALITY_BAD;
+    VariantInit( &tag.value );
+    errors[i] = i < values.size() ? values[i].error : E_FAIL;
 
-    if ( result )
+    if ( SUCCEEDED( errors[i] ) )
     {
-      if ( result->pBlob )
-      {
-        CoTaskMemFree( result->pBlob );
-      }
-      CoTaskMemFree( result );
+      errors[i] = OPCDA::UTILS::value_to_variant( values[i].value, values[i].type, tag.value );
     }
-    if ( errors )
+
+    if ( SUCCEEDED( errors[i] ) )
     {
-      CoTaskMemFree( errors );
+      tag.quality = values[i].quality;
+      tag.timestamp = OPCDA::UTILS::ticks_to_filetime( values[i].timestamp );
+      tag.data_type = V_VT( &tag.value );
     }
 
-    return valid;
-  }
-  catch ( const exception& e )
-  {
-    debug( "validate_item_id", e );
-    return false;
+    cache_value( handles[i], errors[i], tag );
   }
 }
 
-
-void OpcDaClient::get_item_id_candidates( const wstring& browse_path, vector<wstring>& candidates )
+// scalars keep their whole payload in the 8 bytes of the VARIANT union; strings and arrays do not
+static bool variant_bits( const VARIANT& value, uint64_t& bits )
 {
-  try
+  switch ( V_VT( &value ) )
   {
+    case VT_I1:
+    case VT_UI1:
+    case VT_I2:
+    case VT_UI2:
+    case VT_I4:
+    case VT_UI4:
+    case VT_INT:
+    case VT_UINT:
+    case VT_I8:
+    case VT_UI8:
+    case VT_R4:
+    case VT_R8:
+    case VT_BOOL:
+    case VT_DATE:
+    case VT_CY:
+    case VT_ERROR:
+      bits = 0;
+      memcpy( &bits, &V_I8( &value ), sizeof( bits ) );
+      return true;
 
-    candidates.push_back( browse_path );
-
-
-    vector<wstring> components;
-    size_t start = 0, end = 0;
-
-    while ( ( end = browse_path.find( L'.', start ) ) != wstring::npos )
-    {
-      components.push_back( browse_path.substr( start, end - start ) );
-      start = end + 1;
-    }
-    components.push_back( browse_path.substr( start ) );
-
-
-    if ( components.size() > 1 )
-    {
-      wstring without_first;
-      for ( size_t i = 1; i < components.size(); i++ )
-      {
-        if ( i > 1 )
-        {
-          without_first += L".";
-        }
-        without_first += components[i];
-      }
-      candidates.push_back( without_first );
-    }
+    default:
+      return false;
+  }
+}
 
+void OpcDaClient::invalidate_values( const vector<wstring>& item_ids )
+{
+  vector<uint32_t> handles;
+  m_session.find_client_handles( item_ids, handles );
 
-    for ( size_t i = 0; i < components.size(); i++ )
-    {
-      wstring partial;
-      for ( size_t j = i; j < components.size(); j++ )
-      {
-        if ( j > i )
-        {
-          partial += L".";
-        }
-        partial += components[j];
-      }
-      if ( !partial.empty() && find( candidates.begin(), candidates.end(), partial ) == candidates.end() )
-      {
-        candidates.push_back( partial );
-      }
-    }
+  for ( uint32_t handle : handles )
+  {
+    m_value_cache.invalidate( handle );
+  }
+}
 
+void OpcDaClient::cache_value( uint32_t handle, HRESULT error, const OPCDA_TAG& tag )
+{
+  uint64_t bits = 0;
 
-    if ( !components.empty() )
-    {
-      wstring last_component = components.back();
-      if ( find( candidates.begin(), candidates.end(), last_component ) == candidates.end() )
-      {
-        candidates.push_back( last_component );
-      }
-    }
+  if ( handle && SUCCEEDED( error ) && variant_bits( tag.value, bits ) )
+  {
+    m_value_cache.put( handle, V_VT( &tag.value ), bits, tag.quality, OPCDA::UTILS::filetime_to_ticks( tag.timestamp ) );
   }
-  catch ( const exception& e )
+  else
   {
-    debug( "get_item_id_candidates", e );
+    m_value_cache.invalidate( handle );
   }
 }
 
-
-void OpcDaClient::learn_id_mapping_pattern( const wstring& browse_path, const wstring& valid_id )
+void OpcDaClient::cached_values( const vector<wstring>& item_ids, const vector<uint32_t>& handles, DWORD max_age_ms, vector<OPCDA_TAG>& results, vector<size_t>& stale )
 {
-  try
-  {
+  size_t count = item_ids.size();
+  results.resize( count );
+  stale.clear();
 
-    size_t orig_first_dot = browse_path.find( L'.' );
-    size_t valid_first_dot = valid_id.find( L'.' );
+  int64_t max_age_us = static_cast<int64_t>( max_age_ms ) * 1000;
 
-    if ( orig_first_dot != wstring::npos && ( valid_first_dot != wstring::npos || valid_id.find( L'.' ) == wstring::npos ) )
-    {
-
-      if ( browse_path.substr( orig_first_dot ) == valid_id || browse_path.substr( orig_first_dot + 1 ) == valid_id )
-      {
-        wstring prefix = browse_path.substr( 0, orig_first_dot + 1 );
-        wstring replacement = L"";
+  for ( size_t i = 0; i < count; ++i )
+  {
+    OPCDA_TAG& tag = results[i];
+    tag.id = item_ids[i];
+    VariantInit( &tag.value );
 
+    CACHED_VALUE cached;
+    if ( !handles[i] || !m_value_cache.get( handles[i], max_age_us, cached ) )
+    {
+      stale.push_back( i );
+      continue;
+    }
 
-        bool pattern_exists = false;
-        for ( const auto& pattern : m_id_patterns )
-        {
-          if ( pattern.first == prefix )
-          {
-            pattern_exists = true;
-            break;
-          }
-        }
+    V_VT( &tag.value ) = cached.type;
+    memcpy( &V_I8( &tag.value ), &cached.bits, sizeof( cached.bits ) );
 
-        if ( !pattern_exists )
-        {
-          debug( "learn_id_mapping_pattern", "Found pattern: '" + OPCDA::UTILS::wstr_to_str( prefix ) + "' -> '" + OPCDA::UTILS::wstr_to_str( replacement ) + "'" );
-          m_id_patterns.push_back( make_pair( prefix, replacement ) );
-        }
-      }
-    }
-  }
-  catch ( const exception& e )
-  {
-    debug( "learn_id_mapping_pattern", e );
+    tag.timestamp = OPCDA::UTILS::ticks_to_filetime( cached.timestamp );
+    tag.quality = cached.quality;
+    tag.data_type = cached.type;
   }
+
+  s_value_cache_hits.add( static_cast<int64_t>( count - stale.size() ) );
+  s_value_cache_misses.add( static_cast<int64_t>( stale.size() ) );
 }
 
+void OpcDaClient::peek_cached( const vector<wstring>& item_ids, DWORD max_age_ms, vector<OPCDA_TAG>& results, vector<size_t>& stale )
+{
+  // tags never read have no handle yet; looking them up must not hand one out
+  vector<uint32_t> handles;
+  m_session.find_client_handles( item_ids, handles );
 
-void OpcDaClient::request_readable_tags( const wstring& path )
+  cached_values( item_ids, handles, max_age_ms, results, stale );
+}
+
+HRESULT OpcDaClient::read_cached( const vector<wstring>& item_ids, DWORD max_age_ms, vector<OPCDA_TAG>& results, vector<HRESULT>& errors )
 {
+  TraceSpan span( "read_cached", static_cast<int64_t>( item_ids.size() ) );
+
   try
   {
-    m_available_tags.clear();
-    m_all_tags.clear();
-    m_browse_depth = 0;
+    results.clear();
+    errors.clear();
 
+    if ( item_ids.empty() )
+    {
+      return S_OK;
+    }
 
-    vector<wstring> tag_list;
-    request_browse_all_tags( tag_list, path );
+    vector<uint32_t> handles;
+    m_session.client_handles( item_ids, handles );
 
-    debug( "get_readable_tags", "Found " + to_string( tag_list.size() ) + " total tags" );
+    size_t count = item_ids.size();
+    errors.assign( count, S_OK );
 
+    vector<size_t> stale_indices;
+    cached_values( item_ids, handles, max_age_ms, results, stale_indices );
 
-    for ( const auto& browse_path : tag_list )
+    if ( stale_indices.empty() )
     {
-      wstring item_id;
-      HRESULT hr = resolve_item_id( browse_path, item_id );
+      return S_OK;
+    }
 
+    vector<wstring> stale_ids;
+    stale_ids.reserve( stale_indices.size() );
+    for ( size_t i : stale_indices )
+    {
+      stale_ids.push_back( item_ids[i] );
+    }
 
-      m_all_tags.push_back( browse_path );
+    // only the stale tags go to the server, in one batch; the read refreshes their entries
+    vector<OPCDA_TAG> fetched;
+    vector<HRESULT> fetch_errors;
+    HRESULT hr = read_sync( stale_ids, fetched, fetch_errors );
+
+    for ( size_t j = 0; j < stale_indices.size(); ++j )
+    {
+      size_t i = stale_indices[j];
 
-      if ( SUCCEEDED( hr ) )
+      if ( j < fetched.size() )
       {
-        wstring resolved_tag = item_id;
-        m_available_tags.push_back( resolved_tag );
+        // the result takes over the fetched VARIANT
+        results[i] = fetched[j];
       }
+      else
+      {
+        results[i].quality = OPC_QUALITY_BAD;
+      }
+      errors[i] = j < fetch_errors.size() ? fetch_errors[j] : ( FAILED( hr ) ? hr : E_FAIL );
     }
 
-    debug( "get_readable_tags", "Resolved " + to_string( m_available_tags.size() ) + " readable tags from " + to_string( m_all_tags.size() ) + " total tags" );
+    if ( FAILED( hr ) && fetched.empty() )
+    {
+      return hr;
+    }
+    return any_of( errors.begin(), errors.end(), []( HRESULT e ) { return FAILED( e ); } ) ? S_FALSE : S_OK;
   }
   catch ( const exception& e )
   {
-    debug( "get_readable_tags", e );
+    debug( "read_cached", e );
+    return E_FAIL;
   }
 }
 
-bool OpcDaClient::validate_and_add_tag( const wstring& item_id )
+// VARIANTs to backend values; a value that does not convert keeps its error and stays out of the write
+static void to_backend_values( const vector<wstring>& item_ids, const vector<VARIANT>& values, vector<wstring>& ids, vector<BACKEND_VALUE>& converted, vector<size_t>& positions, vector<HRESULT>& errors )
 {
-  try
-  {
-    if ( !m_opc_item_mgt )
-    {
-      return false;
-    }
-
-    OPCITEMDEF item_def = { 0 };
-    item_def.szAccessPath = L"";
-    item_def.szItemID = const_cast<LPWSTR>( item_id.c_str() );
-    item_def.bActive = TRUE;
-    item_def.hClient = 1;
-    item_def.dwBlobSize = 0;
-    item_def.pBlob = NULL;
-    item_def.vtRequestedDataType = VT_EMPTY;
-
-    OPCITEMRESULT* item_result = nullptr;
-    HRESULT* item_errors = nullptr;
-
-    HRESULT hr = m_opc_item_mgt->ValidateItems( 1, &item_def, FALSE, &item_result, &item_errors );
+  errors.assign( item_ids.size(), S_OK );
 
-    bool valid = SUCCEEDED( hr ) && item_errors && SUCCEEDED( item_errors[0] );
-
-
-    if ( item_result )
-    {
-      if ( item_result->pBlob )
-      {
-        CoTaskMemFree( item_result->pBlob );
-      }
-      CoTaskMemFree( item_result );
-    }
+  for ( size_t i = 0; i < item_ids.size(); ++i )
+  {
+    BACKEND_VALUE value;
+    value.type = V_VT( &values[i] );
+    errors[i] = OPCDA::UTILS::variant_to_value( values[i], value.value );
 
-    if ( item_errors )
+    if ( SUCCEEDED( errors[i] ) )
     {
-      CoTaskMemFree( item_errors );
+      ids.push_back( item_ids[i] );
+      converted.push_back( move( value ) );
+      positions.push_back( i );
     }
-
-    return valid;
-  }
-  catch ( const exception& e )
-  {
-    debug( "validate_and_add_tag", e );
-    return false;
   }
 }
 
-HRESULT OpcDaClient::read_sync( const vector<wstring>& item_ids, vector<OPCDA_TAG>& results, vector<HRESULT>& errors )
+HRESULT OpcDaClient::write_sync( const vector<wstring>& item_ids, const vector<VARIANT>& values, vector<HRESULT>& errors )
 {
   try
   {
-    results.clear();
     errors.clear();
 
-    if ( !m_opc_sync_io || !m_opc_item_mgt )
+    if ( item_ids.size() != values.size() )
     {
-      debug( "read_sync", "!m_opc_sync_io || !m_opc_item_mgt" );
-      return E_POINTER;
+      debug( "write_sync", "Item and value counts differ" );
+      return E_INVALIDARG;
     }
 
     if ( item_ids.empty() )
@@ -1204,392 +1206,220 @@ HRESULT OpcDaClient::read_sync( const vector<wstring>& item_ids, vector<OPCDA_TA
       return S_OK;
     }
 
-    lock_guard<mutex> lock( m_mutex );
-
-    DWORD count = static_cast<DWORD>( item_ids.size() );
-    vector<OPCITEMDEF> item_defs( count );
-
-
-    vector<wstring> resolved_ids( count );
-
-    for ( DWORD i = 0; i < count; ++i )
+    if ( FAILED( check_link( item_ids.size(), errors ) ) )
     {
-      wstring browse_path = item_ids[i];
-      wstring item_id;
-
-
-      auto it = m_id_mapping.find( browse_path );
-      if ( it != m_id_mapping.end() )
-      {
-        item_id = it->second;
-      }
-      else
-      {
-        resolve_item_id( browse_path, item_id );
-      }
-
-      resolved_ids[i] = item_id;
-
-      ZeroMemory( &item_defs[i], sizeof( OPCITEMDEF ) );
-
-      item_defs[i].szAccessPath = L"";
-      item_defs[i].szItemID = const_cast<LPWSTR>( item_id.c_str() );
-      item_defs[i].bActive = TRUE;
-      item_defs[i].hClient = i + 1;
-      item_defs[i].dwBlobSize = 0;
-      item_defs[i].pBlob = NULL;
-      item_defs[i].vtRequestedDataType = VT_EMPTY;
+      return RPC_E_DISCONNECTED;
     }
 
-    results.resize( count );
-    errors.resize( count );
+    shared_lock<shared_mutex> lock( m_connection_lock );
 
-    OPCITEMRESULT* add_results = nullptr;
-    HRESULT* pAddErrors = nullptr;
-    HRESULT hr;
+    vector<wstring> ids;
+    vector<BACKEND_VALUE> converted;
+    vector<size_t> positions;
+    to_backend_values( item_ids, values, ids, converted, positions, errors );
 
+    if ( ids.empty() )
     {
-      hr = m_opc_item_mgt->AddItems( count, item_defs.data(), &add_results, &pAddErrors );
-      if ( FAILED( hr ) )
-      {
-        debug( "AddItems", hr );
+      return S_FALSE;
+    }
 
-        if ( add_results )
-        {
-          for ( DWORD i = 0; i < count; ++i )
-          {
-            if ( add_results[i].pBlob )
-            {
-              CoTaskMemFree( add_results[i].pBlob );
-            }
-          }
-
-          CoTaskMemFree( add_results );
-        }
+    // a written tag is read from the server next time, whatever the outcome
+    invalidate_values( item_ids );
 
-        if ( pAddErrors )
-        {
-          CoTaskMemFree( pAddErrors );
-        }
+    // the session writes each value as its item's canonical type
+    vector<OPCDA_RESULT> write_errors;
+    HRESULT hr = m_session.write( ids, converted, write_errors );
+    m_supervisor.on_result( hr );
 
-        fill( errors.begin(), errors.end(), hr );
-        return hr;
-      }
+    if ( FAILED( hr ) )
+    {
+      debug( "write_sync", hr );
     }
 
-
-    vector<OPCHANDLE> server_handles( count );
+    for ( size_t k = 0; k < positions.size(); ++k )
     {
-      for ( DWORD i = 0; i < count; ++i )
-      {
-        errors[i] = pAddErrors[i];
-        results[i].id = item_ids[i];
-
-        if ( SUCCEEDED( pAddErrors[i] ) && add_results )
-        {
-          server_handles[i] = add_results[i].hServer;
-          results[i].access_rights = add_results[i].dwAccessRights;
-          results[i].data_type = add_results[i].vtCanonicalDataType;
-        }
-        else
-        {
-          server_handles[i] = 0;
-
-          if ( SUCCEEDED( errors[i] ) )
-          {
-            errors[i] = E_FAIL;
-          }
-
-          // wcerr << L"Error: Failed to add item '" << item_ids[i] << L"'. HRESULT: 0x" << hex << errors[i] << endl;
-
-          results[i].access_rights = 0;
-          results[i].data_type = VT_EMPTY;
-          results[i].quality = OPC_QUALITY_BAD;
+      errors[positions[k]] = k < write_errors.size() ? write_errors[k] : hr;
+    }
 
-          VariantInit( &results[i].value );
-          memset( &results[i].timestamp, 0, sizeof( FILETIME ) );
-        }
-      }
+    if ( FAILED( hr ) )
+    {
+      return hr;
     }
 
+    return any_of( errors.begin(), errors.end(), []( HRESULT e ) { return FAILED( e ); } ) ? S_FALSE : S_OK;
+  }
+  catch ( const exception& e )
+  {
+    debug( "write_sync", e );
+    return E_FAIL;
+  }
+}
+
+HRESULT OpcDaClient::write_async( const vector<wstring>& item_ids, const vector<VARIANT>& values, DWORD& transaction, vector<HRESULT>& errors )
+{
+  try
+  {
+    errors.clear();
+    transaction = 0;
 
-    if ( add_results )
+    if ( item_ids.size() != values.size() )
     {
-      for ( DWORD i = 0; i < count; ++i )
-      {
-        if ( add_results[i].pBlob )
-        {
-          CoTaskMemFree( add_results[i].pBlob );
-        }
-      }
-      CoTaskMemFree( add_results );
+      debug( "write_async", "Item and value counts differ" );
+      return E_INVALIDARG;
     }
 
-    if ( pAddErrors )
+    if ( item_ids.empty() )
     {
-      CoTaskMemFree( pAddErrors );
+      return S_OK;
     }
 
-
-    vector<OPCHANDLE> valid_server_handles;
-    vector<DWORD> original_indices;
-    for ( DWORD i = 0; i < count; ++i )
+    if ( FAILED( check_link( item_ids.size(), errors ) ) )
     {
-      if ( server_handles[i] != 0 )
-      {
-        valid_server_handles.push_back( server_handles[i] );
-        original_indices.push_back( i );
-      }
+      return RPC_E_DISCONNECTED;
     }
 
+    shared_lock<shared_mutex> lock( m_connection_lock );
 
-    if ( !valid_server_handles.empty() )
+    vector<wstring> ids;
+    vector<BACKEND_VALUE> converted;
+    vector<size_t> positions;
+    to_backend_values( item_ids, values, ids, converted, positions, errors );
+
+    if ( ids.empty() )
     {
-      OPCITEMSTATE* item_states = nullptr;
-      HRESULT* pReadErrors = nullptr;
-      DWORD valid_count = static_cast<DWORD>( valid_server_handles.size() );
+      return S_FALSE;
+    }
 
-      hr = m_opc_sync_io->Read( OPC_DS_CACHE, valid_count, valid_server_handles.data(), &item_states, &pReadErrors );
-      if ( SUCCEEDED( hr ) )
-      {
-        for ( DWORD i = 0; i < valid_count; ++i )
-        {
-          DWORD original_idx = original_indices[i];
-          errors[original_idx] = pReadErrors[i];
-
-          if ( SUCCEEDED( pReadErrors[i] ) )
-          {
-            results[original_idx].value = item_states[i].vDataValue;
-            results[original_idx].quality = item_states[i].wQuality;
-            results[original_idx].timestamp = item_states[i].ftTimeStamp;
-            results[original_idx].data_type = item_states[i].vDataValue.vt;
-          }
-          else
-          {
-            wcerr << L"Error: Failed to read item '" << item_ids[original_idx] << L"'. HRESULT: 0x" << hex << pReadErrors[i] << endl;
-            results[original_idx].quality = OPC_QUALITY_BAD;
-            VariantClear( &results[original_idx].value );
-            memset( &results[original_idx].timestamp, 0, sizeof( FILETIME ) );
-          }
-
-          VariantClear( &item_states[i].vDataValue );
-        }
-      }
-      else
-      {
-        debug( "IOPCSyncIO::Read", hr );
-        for ( DWORD idx : original_indices )
-        {
-          errors[idx] = hr;
-          results[idx].quality = OPC_QUALITY_BAD;
-          VariantClear( &results[idx].value );
-          memset( &results[idx].timestamp, 0, sizeof( FILETIME ) );
-        }
-      }
+    invalidate_values( item_ids );
 
-      if ( item_states )
-      {
-        CoTaskMemFree( item_states );
-      }
+    // completions come back through a sink advised in the connecting apartment; elsewhere ComBackend answers RPC_E_WRONG_THREAD
+    uint32_t async_transaction = 0;
+    vector<OPCDA_RESULT> write_errors;
+    HRESULT hr = m_session.write_async( ids, converted, async_transaction, write_errors );
+    m_supervisor.on_result( hr );
 
-      if ( pReadErrors )
-      {
-        CoTaskMemFree( pReadErrors );
-      }
+    if ( FAILED( hr ) )
+    {
+      debug( "write_async", hr );
     }
 
-
-    if ( !valid_server_handles.empty() )
+    for ( size_t k = 0; k < positions.size(); ++k )
     {
-      HRESULT* hr_remove_errs = nullptr;
-      HRESULT hr_remove = m_opc_item_mgt->RemoveItems( static_cast<DWORD>( valid_server_handles.size() ), valid_server_handles.data(), &hr_remove_errs );
-      if ( FAILED( hr_remove ) )
-      {
-        debug( "RemoveItems", hr_remove );
-      }
-
-      if ( hr_remove_errs )
-      {
-        CoTaskMemFree( hr_remove_errs );
-      }
+      errors[positions[k]] = k < write_errors.size() ? write_errors[k] : hr;
     }
 
-    bool any_failed = false;
-    for ( HRESULT item_hr : errors )
+    if ( FAILED( hr ) )
     {
-      if ( FAILED( item_hr ) )
-      {
-        any_failed = true;
-        break;
-      }
+      return hr;
     }
-    return any_failed ? S_FALSE : S_OK;
+
+    transaction = async_transaction;
+    return any_of( errors.begin(), errors.end(), []( HRESULT e ) { return FAILED( e ); } ) ? S_FALSE : S_OK;
   }
   catch ( const exception& e )
   {
-    debug( "read_sync", e );
+    debug( "write_async", e );
     return E_FAIL;
   }
 }
 
-void OpcDaClient::remove_opc_group()
+void OpcDaClient::set_write_complete( const WriteCompleteCallback& on_complete )
+{
+  if ( !on_complete )
+  {
+    m_session.set_write_complete( nullptr );
+    return;
+  }
+
+  m_session.set_write_complete( [on_complete]( uint32_t transaction, const vector<wstring>& item_ids, const vector<OPCDA_RESULT>& errors ) { on_complete( transaction, item_ids, vector<HRESULT>( errors.begin(), errors.end() ) ); } );
+}
+
+HRESULT OpcDaClient::get_item_properties( const vector<wstring>& item_ids, unsigned property_set, vector<OPCDA_ITEM_PROPERTIES>& properties )
 {
+  TraceSpan span( "get_item_properties", static_cast<int64_t>( item_ids.size() ) );
+
   try
   {
-    if ( m_opc_sync_io )
+    properties.clear();
+
+    if ( item_ids.empty() )
     {
-      m_opc_sync_io.Release();
+      return S_OK;
     }
 
-    if ( m_opc_item_mgt )
+    shared_lock<shared_mutex> lock( m_connection_lock );
+
+    if ( !m_backend.is_open() )
     {
-      m_opc_item_mgt.Release();
+      return E_POINTER;
     }
 
-    if ( m_opc_group_state )
+    if ( !m_backend.features().properties )
     {
-      m_opc_group_state.Release();
+      debug( "get_item_properties", "Neither IOPCBrowse nor IOPCItemProperties is available" );
+      return E_NOINTERFACE;
     }
 
-    if ( m_group_unknown )
+    vector<wstring> resolved_ids;
+    resolved_ids.reserve( item_ids.size() );
+
+    for ( const auto& id : item_ids )
     {
-      m_group_unknown.Release();
+      resolved_ids.push_back( m_session.mapped_id( id ) );
     }
 
-    if ( m_server && m_group_handle_server != 0 )
-    {
-      HRESULT hr = m_server->RemoveGroup( m_group_handle_server, FALSE );
-      if ( FAILED( hr ) )
-      {
-        debug( "RemoveGroup", hr );
-      }
+    HRESULT hr = m_property_cache.fetch( m_backend, resolved_ids, property_set, properties );
 
-      m_group_handle_server = 0;
+    for ( size_t i = 0; i < properties.size(); ++i )
+    {
+      properties[i].item_id = item_ids[i];
     }
+
+    return hr;
   }
   catch ( const exception& e )
   {
-    debug( "remove_opc_group", e );
+    debug( "get_item_properties", e );
+    return E_FAIL;
   }
 }
 
 HRESULT OpcDaClient::get_item_properties( const wstring& item_id, OPCDA_TAG& properties )
 {
-  try
-  {
-    if ( !m_server )
-    {
-      return E_POINTER;
-    }
-
-    CComPtr<IOPCItemProperties> item_props;
-    HRESULT hr = m_server->QueryInterface( IID_IOPCItemProperties, ( void** )&item_props );
-    if ( FAILED( hr ) )
-    {
-      wcerr << L"Warning: Server does not support IOPCItemProperties. HRESULT: 0x" << hex << hr << endl;
-      return hr;
-    }
-
-    const DWORD OPC_PROP_DATATYPE = 1;
-    const DWORD OPC_PROP_RIGHTS = 5;
-    DWORD property_ids_to_query[] = { OPC_PROP_DATATYPE, OPC_PROP_RIGHTS };
-    DWORD num_properties = sizeof( property_ids_to_query ) / sizeof( DWORD );
-
-    LPWSTR item_id_cstr = const_cast<LPWSTR>( item_id.c_str() );
-    VARIANT* property_values = nullptr;
-    HRESULT* pPropertyErrors = nullptr;
+  properties.id = item_id;
+  properties.data_type = VT_EMPTY;
+  properties.access_rights = 0;
+  VariantInit( &properties.value );
+  properties.quality = OPC_QUALITY_BAD;
+  memset( &properties.timestamp, 0, sizeof( FILETIME ) );
 
-    hr = item_props->GetItemProperties( item_id_cstr, num_properties, property_ids_to_query, &property_values, &pPropertyErrors );
+  vector<OPCDA_ITEM_PROPERTIES> found;
+  HRESULT hr = get_item_properties( vector<wstring>{ item_id }, PROPERTY_DATATYPE | PROPERTY_ACCESS_RIGHTS, found );
 
-    properties.id = item_id;
-    properties.data_type = VT_EMPTY;
-    properties.access_rights = 0;
-    VariantInit( &properties.value );
-    properties.quality = OPC_QUALITY_BAD;
-    memset( &properties.timestamp, 0, sizeof( FILETIME ) );
-
-    if ( FAILED( hr ) )
-    {
-      wcerr << L"Error: GetItemProperties call failed for item '" << item_id.c_str() << L"'. HRESULT: 0x" << hex << hr << endl;
-      if ( property_values )
-      {
-        CoTaskMemFree( property_values );
-      }
-      if ( pPropertyErrors )
-      {
-        CoTaskMemFree( pPropertyErrors );
-      }
-      return hr;
-    }
+  if ( FAILED( hr ) || found.empty() )
+  {
+    return FAILED( hr ) ? hr : E_FAIL;
+  }
 
-    vector<HRESULT> property_errors( num_properties );
-    if ( pPropertyErrors )
-    {
-      memcpy( property_errors.data(), pPropertyErrors, num_properties * sizeof( HRESULT ) );
-    }
-    else
-    {
-      fill( property_errors.begin(), property_errors.end(), E_UNEXPECTED );
-    }
+  if ( FAILED( found[0].error ) )
+  {
+    return found[0].error;
+  }
 
-    for ( DWORD i = 0; i < num_properties; ++i )
-    {
-      if ( SUCCEEDED( property_errors[i] ) && property_values )
-      {
-        switch ( property_ids_to_query[i] )
-        {
-          case OPC_PROP_DATATYPE:
-            if ( property_values[i].vt == VT_I2 || property_values[i].vt == VT_UI2 )
-            {
-              properties.data_type = static_cast<VARTYPE>( property_values[i].iVal );
-            }
-            else
-            {
-              wcerr << L"Warning: Unexpected VARIANT type (" << property_values[i].vt << L") for OPC_PROP_DATATYPE on item " << item_id.c_str() << endl;
-            }
-            break;
-          case OPC_PROP_RIGHTS:
-            if ( property_values[i].vt == VT_I4 || property_values[i].vt == VT_UI4 )
-            {
-              properties.access_rights = property_values[i].ulVal;
-            }
-            else
-            {
-              wcerr << L"Warning: Unexpected VARIANT type (" << property_values[i].vt << L") for OPC_PROP_RIGHTS on item " << item_id.c_str() << endl;
-            }
-            break;
-        }
-        VariantClear( &property_values[i] );
-      }
-      else
-      {
-        wcerr << L"Error: Failed to get property ID " << property_ids_to_query[i] << L" for item '" << item_id.c_str() << L"'. HRESULT: 0x" << hex << property_errors[i] << endl;
-      }
-    }
+  properties.data_type = found[0].data_type;
+  properties.access_rights = found[0].access_rights;
 
-    if ( property_values )
-    {
-      CoTaskMemFree( property_values );
-    }
-    if ( pPropertyErrors )
-    {
-      CoTaskMemFree( pPropertyErrors );
-    }
+  unsigned wanted = PROPERTY_DATATYPE | PROPERTY_ACCESS_RIGHTS;
+  return ( found[0].present & wanted ) == wanted ? S_OK : S_FALSE;
+}
 
-    bool any_prop_failed = false;
-    for ( HRESULT prop_hr : property_errors )
-    {
-      if ( FAILED( prop_hr ) )
-      {
-        any_prop_failed = true;
-        break;
-      }
-    }
-    return any_prop_failed ? S_FALSE : S_OK;
-  }
-  catch ( const exception& e )
+void OpcDaClient::invalidate_item_properties( const wstring& item_id )
+{
+  if ( item_id.empty() )
   {
-    debug( "get_item_properties", e );
-    return E_FAIL;
+    m_property_cache.clear();
+    return;
   }
-}
\ No newline at end of file
+
+  m_property_cache.invalidate( m_session.mapped_id( item_id ) );
+}
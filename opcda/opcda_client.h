@@ -4,16 +4,22 @@
 
 #include <Shlwapi.h>
 #include <atlbase.h>
+#include <atomic>
 #include <comdef.h>
-#include <map>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <opcda.h>
-#include <set>
+#include <shared_mutex>
 #include <string>
-#include <variant>
 #include <vector>
 
+#include "opcda_backend_com.h"
+#include "opcda_backend_session.h"
+#include "opcda_properties.h"
+#include "opcda_supervisor.h"
+#include "opcda_value_cache.h"
+
 using namespace std;
 
 #ifndef CLSID_OPCServerList
@@ -48,6 +54,18 @@ DEFINE_GUID( IID_IOPCItemProperties, 0x39c13a72, 0x011e, 0x11d0, 0x96, 0x75, 0x0
 DEFINE_GUID( IID_IOPCBrowse, 0x39227004, 0xA18F, 0x4B57, 0xA8, 0x5A, 0xF8, 0x24, 0x13, 0x43, 0x7B, 0x33 );
 #endif
 
+#ifndef IID_IOPCAsyncIO2
+DEFINE_GUID( IID_IOPCAsyncIO2, 0x39c13a71, 0x011e, 0x11d0, 0x96, 0x75, 0x00, 0x20, 0xaf, 0xd8, 0xad, 0xb3 );
+#endif
+
+#ifndef IID_IOPCDataCallback
+DEFINE_GUID( IID_IOPCDataCallback, 0x39c13a70, 0x011e, 0x11d0, 0x96, 0x75, 0x00, 0x20, 0xaf, 0xd8, 0xad, 0xb3 );
+#endif
+
+#ifndef IID_IOPCItemIO
+DEFINE_GUID( IID_IOPCItemIO, 0x85C0B427, 0x2893, 0x4CBC, 0xBD, 0x78, 0xE5, 0xFC, 0x51, 0x46, 0xF0, 0x8F );
+#endif
+
 #ifndef CLSID_OPCEnum
 
 static const CLSID CLSID_OPCEnum = { 0x13486D51, 0x4821, 0x11D2, { 0xA4, 0x94, 0x3C, 0xB3, 0x06, 0xC1, 0x00, 0x00 } };
@@ -74,16 +92,20 @@ constexpr GUID CATID_DA30 = { 0xB28A2600, 0x4A0F, 0x11D2, { 0xB1, 0x89, 0x00, 0x
 
 #pragma comment( lib, "Shlwapi.lib" )
 
-constexpr int DEFAULT_MAX_BROWSE_DEPTH = 32;
+constexpr int DEFAULT_MAX_BROWSE_DEPTH = DEFAULT_BACKEND_BROWSE_DEPTH;
 constexpr size_t DEFAULT_MAX_STRING_BUFFER = 4096;
+constexpr DWORD DEFAULT_BROWSE_PAGE_SIZE = DEFAULT_BACKEND_BROWSE_PAGE;
+constexpr DWORD OPCDA_MAX_AGE_CACHE = BACKEND_MAX_AGE_CACHE;
+constexpr DWORD OPCDA_MAX_AGE_DEVICE = BACKEND_MAX_AGE_DEVICE;
 
 using namespace std;
 
-enum class OPCDA_BROWSE_METHOD
+struct OPCDA_BROWSE_FILTER
 {
-  NONE,
-  SERVER_ADDRESS_SPACE,
-  ITEM_PROPERTIES
+  wstring name;
+  wstring vendor;
+  VARTYPE data_type = VT_EMPTY;
+  DWORD page_size = DEFAULT_BROWSE_PAGE_SIZE;
 };
 
 struct OPCDA_CONNECT_INFO
@@ -121,12 +143,38 @@ struct ServerStatus
   int enabled_group_len = 0;
 };
 
+class DiscoveryCache;
+
+using WriteCompleteCallback = function<void( DWORD, const vector<wstring>&, const vector<HRESULT>& )>;
+
+/**
+ * @brief OPC DA session. In MTA mode one client may be shared by many threads.
+ *
+ * Connecting and disconnecting take the connection lock exclusively; every
+ * other call takes it shared, and reads and writes run without any client
+ * lock held, so several threads can have IO in flight on one connection.
+ *
+ * The client owns the COM side of a connection: discovery, CoCreateInstanceEx,
+ * supervision and reconnect, the value cache and the VARIANT conversions.
+ * Browsing, item ID resolution, registration, reads, writes and property
+ * queries go through OpcDaBackend: a ComBackend over the server, driven by the
+ * same BackendSession the bench and the checks run over MemoryBackend.
+ * ComBackend reaches the server from other threads through the Global
+ * Interface Table; address space browsing, group creation and async writes
+ * stay on the connecting apartment.
+ */
 class OpcDaClient
 {
 public:
   OpcDaClient();
   ~OpcDaClient();
 
+  void set_apartment( OPCDA_APARTMENT apartment );
+  OPCDA_APARTMENT apartment() const
+  {
+    return m_apartment;
+  }
+
 
   void set_max_browse_depth( int depth );
   int get_max_browse_depth() const
@@ -148,35 +196,84 @@ public:
   void com_free();
 
 
-  static vector<OPCDA_CONNECT_INFO> discovery( const string& host = "localhost" );
+  static vector<OPCDA_CONNECT_INFO> discovery( const string& host = "localhost", OPCDA_APARTMENT apartment = OPCDA_APARTMENT::STA );
+  static HRESULT enumerate_servers( const string& host, vector<OPCDA_CONNECT_INFO>& servers, bool local_fallback = true, const vector<OPCDA_CONNECT_INFO>* known = nullptr );
   bool connect( OPCDA_CONNECT_INFO& info );
   bool connect_progid( const string& host_name, const string& progid );
   bool connect_clsid( const string& host_name, const CLSID& server_clsid );
+  bool attach( IOPCServer* server );
+  void set_discovery_cache( DiscoveryCache* cache );
   void disconnect();
   bool is_connected() const;
 
 
+  HRESULT reconnect();
+  HRESULT heartbeat();
+  HRESULT supervise();
+  void set_auto_reconnect( bool enabled );
+  LinkSupervisor& supervisor()
+  {
+    return m_supervisor;
+  }
+  const string& server_host() const
+  {
+    return m_server_host;
+  }
+  const CLSID& server_clsid() const
+  {
+    return m_server_clsid;
+  }
+
+
   void get_server_status();
 
 
-  bool add_opc_group( const string& gname );
-  void remove_opc_group();
+  /** @brief Creates the client's group ahead of the first read; only from the connecting apartment. */
+  bool ensure_group();
 
 
+  void set_browse_filter( const OPCDA_BROWSE_FILTER& filter );
   HRESULT browse_tags( const wstring& path, vector<wstring>& branches, vector<wstring>& tags );
   vector<wstring> request_browse_all_tags( vector<wstring>& tags, const wstring& path = L"" );
   void request_readable_tags( const wstring& path = L"" );
-  bool validate_and_add_tag( const wstring& item_id );
 
 
+  /** @brief S_FALSE with item_id = browse_path when no candidate validated. */
   HRESULT resolve_item_id( const wstring& browse_path, wstring& item_id );
-  bool validate_item_id( const wstring& item_id );
-  void get_item_id_candidates( const wstring& browse_path, vector<wstring>& candidates );
-  void learn_id_mapping_pattern( const wstring& browse_path, const wstring& valid_id );
 
 
+  void set_max_age( DWORD max_age_ms );
   HRESULT read_sync( const vector<wstring>& item_ids, vector<OPCDA_TAG>& results, vector<HRESULT>& errors );
+  /** @brief read_sync from OPC_DS_DEVICE (max age 0 on DA 3.0); go through DeviceReadScheduler to keep the field bus load bounded. */
+  HRESULT read_device( const vector<wstring>& item_ids, vector<OPCDA_TAG>& results, vector<HRESULT>& errors );
+  HRESULT read_item_io( const vector<wstring>& item_ids, DWORD max_age_ms, vector<OPCDA_TAG>& results, vector<HRESULT>& errors );
+  /**
+   * @brief Serves values no older than max_age_ms from the client's cache and reads the rest in one read_sync.
+   *
+   * Every read_sync and read_item_io, including the --subscribe loop, feeds the
+   * cache. Scalar values only: strings and arrays are always read.
+   */
+  HRESULT read_cached( const vector<wstring>& item_ids, DWORD max_age_ms, vector<OPCDA_TAG>& results, vector<HRESULT>& errors );
+  /**
+   * @brief The cache half of read_cached: fills results from values no older than max_age_ms
+   *        and lists the indices it could not serve in stale. Makes no COM call, so any thread may use it.
+   */
+  void peek_cached( const vector<wstring>& item_ids, DWORD max_age_ms, vector<OPCDA_TAG>& results, vector<size_t>& stale );
+  /**
+   * @brief Removes items from the client's group and forgets their registration, handle and cached value.
+   *        A later read registers them again; call it from the thread that reads.
+   */
+  HRESULT unregister_items( const vector<wstring>& item_ids );
+  HRESULT write_sync( const vector<wstring>& item_ids, const vector<VARIANT>& values, vector<HRESULT>& errors );
+  HRESULT write_async( const vector<wstring>& item_ids, const vector<VARIANT>& values, DWORD& transaction, vector<HRESULT>& errors );
+  void set_write_complete( const WriteCompleteCallback& on_complete );
   HRESULT get_item_properties( const wstring& item_id, OPCDA_TAG& properties );
+  HRESULT get_item_properties( const vector<wstring>& item_ids, unsigned property_set, vector<OPCDA_ITEM_PROPERTIES>& properties );
+  void invalidate_item_properties( const wstring& item_id = L"" );
+  ItemPropertyCache& property_cache()
+  {
+    return m_property_cache;
+  }
 
 
   void debug( const string& tag, HRESULT& hr, const string& message = "" );
@@ -186,28 +283,40 @@ public:
 
 private:
   bool is_com_init;
-  mutable mutex m_mutex;
-  int m_browse_depth = 0;
+  OPCDA_APARTMENT m_apartment = OPCDA_APARTMENT::STA;
+
+  // lock order: connection, status
+  mutable shared_mutex m_connection_lock;
+  mutex m_status_lock;
+  mutex m_reconnect_lock;
   int m_max_browse_depth = DEFAULT_MAX_BROWSE_DEPTH;
   size_t m_max_string_buffer = DEFAULT_MAX_STRING_BUFFER;
 
-  CComPtr<IOPCServer> m_server;
-  CComPtr<IOPCBrowseServerAddressSpace> browser;
-  CComPtr<IOPCItemProperties> m_item_properties;
-  CComPtr<IUnknown> m_group_unknown;
-  CComPtr<IOPCItemMgt> m_opc_item_mgt;
-  CComPtr<IOPCSyncIO> m_opc_sync_io;
-  CComPtr<IOPCGroupStateMgt> m_opc_group_state;
+  // the session holds on to the backend, so it is declared after it and destroyed first
+  ComBackend m_backend;
+  BackendSession m_session{ m_backend };
+  atomic<bool> m_connected{ false };
 
-  OPCHANDLE m_group_handle_server;
-  string m_default_group;
+  // what a reconnect needs to rebuild the session without browsing again
+  string m_server_host;
+  CLSID m_server_clsid = CLSID_NULL;
+  atomic<bool> m_auto_reconnect{ false };
+  LinkSupervisor m_supervisor;
 
+  // keyed by the session's client handles, which stay fixed per tag for the whole session
+  ValueCache m_value_cache;
 
-  OPCDA_BROWSE_METHOD m_browse_method = OPCDA_BROWSE_METHOD::NONE;
-  map<wstring, wstring> m_id_mapping;
-  vector<pair<wstring, wstring>> m_id_patterns;
+  ItemPropertyCache m_property_cache;
+  DiscoveryCache* m_discovery_cache = nullptr;
 
 
-  HRESULT browse_tags_iterative( vector<wstring>& all_tags, const wstring& root_path = L"" );
+  bool open_session( const string& host_name, const CLSID& server_clsid );
+  bool bind( IOPCServer* server );
+  HRESULT check_link( size_t count, vector<HRESULT>& errors );
+  HRESULT read_items( const vector<wstring>& item_ids, BACKEND_SOURCE source, vector<OPCDA_TAG>& results, vector<HRESULT>& errors );
+  void to_tags( const vector<wstring>& item_ids, const vector<BACKEND_VALUE>& values, vector<OPCDA_TAG>& results, vector<HRESULT>& errors );
+  void invalidate_values( const vector<wstring>& item_ids );
+  void cache_value( uint32_t handle, HRESULT error, const OPCDA_TAG& tag );
+  void cached_values( const vector<wstring>& item_ids, const vector<uint32_t>& handles, DWORD max_age_ms, vector<OPCDA_TAG>& results, vector<size_t>& stale );
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,440 @@
+// opcda_connection_manager.cpp
+#define NOMINMAX
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <windows.h>
+
+#include "logger.h"
+#include "opcda_connection_manager.h"
+#include "opcda_utils.h"
+
+using namespace std;
+
+static size_t estimate_bytes( const vector<OPCDA_TAG>& tags )
+{
+  size_t bytes = tags.capacity() * sizeof( OPCDA_TAG );
+
+  for ( const auto& tag : tags )
+  {
+    bytes += tag.id.capacity() * sizeof( wchar_t );
+
+    if ( V_VT( &tag.value ) == VT_BSTR && V_BSTR( &tag.value ) )
+    {
+      bytes += SysStringByteLen( V_BSTR( &tag.value ) );
+    }
+    else if ( ( V_VT( &tag.value ) & VT_ARRAY ) && !( V_VT( &tag.value ) & VT_BYREF ) && V_ARRAY( &tag.value ) )
+    {
+      SAFEARRAY* array = V_ARRAY( &tag.value );
+      size_t count = 1;
+
+      for ( USHORT d = 0; d < array->cDims; ++d )
+      {
+        count *= array->rgsabound[d].cElements;
+      }
+
+      bytes += count * array->cbElements;
+    }
+  }
+
+  return bytes;
+}
+
+static void clear_tags( vector<OPCDA_TAG>& tags )
+{
+  for ( auto& tag : tags )
+  {
+    VariantClear( &tag.value );
+  }
+
+  tags.clear();
+}
+
+ConnectionManager::ConnectionManager()
+{
+}
+
+ConnectionManager::~ConnectionManager()
+{
+  stop();
+}
+
+void ConnectionManager::set_workers( size_t workers )
+{
+  m_workers = max<size_t>( workers, 1 );
+}
+
+void ConnectionManager::set_memory_budget( size_t bytes )
+{
+  m_budget = max<size_t>( bytes, 1 );
+}
+
+void ConnectionManager::set_discovery_cache( DiscoveryCache* cache )
+{
+  m_discovery_cache = cache;
+}
+
+void ConnectionManager::add_server( const OPCDA_SERVER_SPEC& spec )
+{
+  m_servers.push_back( spec );
+}
+
+bool ConnectionManager::load_servers( const string& file, size_t default_sessions, vector<OPCDA_SERVER_SPEC>& specs, string& error )
+{
+  ifstream in( file );
+  if ( !in )
+  {
+    error = "Failed to open servers file: " + file;
+    return false;
+  }
+
+  string line;
+  size_t number = 0;
+
+  while ( getline( in, line ) )
+  {
+    ++number;
+
+    istringstream words( line.substr( 0, line.find( '#' ) ) );
+    vector<string> fields;
+    string word;
+
+    while ( words >> word )
+    {
+      fields.push_back( word );
+    }
+
+    if ( fields.empty() )
+    {
+      continue;
+    }
+
+    if ( fields.size() < 3 )
+    {
+      error = "Expected '<name> <host> <progid|clsid> [sessions=N] [tags...]' at line " + to_string( number );
+      return false;
+    }
+
+    OPCDA_SERVER_SPEC spec;
+    spec.name = fields[0];
+    spec.host = fields[1];
+    spec.sessions = default_sessions;
+    ( fields[2].front() == '{' ? spec.clsid : spec.progid ) = fields[2];
+
+    for ( size_t i = 3; i < fields.size(); ++i )
+    {
+      if ( fields[i].rfind( "sessions=", 0 ) == 0 )
+      {
+        spec.sessions = static_cast<size_t>( max( 1, atoi( fields[i].c_str() + 9 ) ) );
+      }
+      else
+      {
+        spec.tags.push_back( OPCDA::UTILS::str_to_wstr( fields[i] ) );
+      }
+    }
+
+    specs.push_back( spec );
+  }
+
+  return true;
+}
+
+bool ConnectionManager::start()
+{
+  if ( m_servers.empty() || !m_pool.empty() )
+  {
+    return false;
+  }
+
+  m_stopping = false;
+
+  for ( size_t s = 0; s < m_servers.size(); ++s )
+  {
+    const auto& spec = m_servers[s];
+
+    // without a tag list the only session browses the readable tags itself
+    size_t sessions = spec.tags.empty() ? 1 : min( max<size_t>( spec.sessions, 1 ), spec.tags.size() );
+    size_t chunk = ( spec.tags.size() + sessions - 1 ) / max<size_t>( sessions, 1 );
+
+    for ( size_t i = 0; i < sessions; ++i )
+    {
+      auto session = make_unique<SESSION>();
+      session->server = s;
+      session->index = i;
+
+      if ( !spec.tags.empty() )
+      {
+        auto first = spec.tags.begin() + min( i * chunk, spec.tags.size() );
+        auto last = spec.tags.begin() + min( ( i + 1 ) * chunk, spec.tags.size() );
+        session->tags.assign( first, last );
+      }
+
+      m_sessions.push_back( move( session ) );
+    }
+  }
+
+  size_t workers = min( m_workers, m_sessions.size() );
+
+  // sessions of one server land on different workers so they really run side by side
+  for ( size_t i = 0; i < m_sessions.size(); ++i )
+  {
+    m_sessions[i]->worker = i % workers;
+  }
+
+  for ( size_t w = 0; w < workers; ++w )
+  {
+    auto worker = make_unique<WORKER>();
+    worker->wake = CreateEvent( NULL, FALSE, FALSE, NULL );
+
+    if ( !worker->wake )
+    {
+      Logger::instance().logError( "[manager] Failed to create worker event" );
+      stop();
+      return false;
+    }
+
+    m_pool.push_back( move( worker ) );
+  }
+
+  for ( size_t w = 0; w < workers; ++w )
+  {
+    m_pool[w]->runner = thread( &ConnectionManager::worker_loop, this, w );
+  }
+
+  return true;
+}
+
+void ConnectionManager::stop()
+{
+  m_stopping = true;
+
+  {
+    lock_guard<mutex> lock( m_results_lock );
+    m_budget_freed.notify_all();
+    m_results_ready.notify_all();
+  }
+
+  for ( auto& worker : m_pool )
+  {
+    if ( worker->wake )
+    {
+      SetEvent( worker->wake );
+    }
+  }
+
+  for ( auto& worker : m_pool )
+  {
+    if ( worker->runner.joinable() )
+    {
+      worker->runner.join();
+    }
+
+    if ( worker->wake )
+    {
+      CloseHandle( worker->wake );
+      worker->wake = NULL;
+    }
+  }
+
+  m_pool.clear();
+  m_sessions.clear();
+
+  lock_guard<mutex> lock( m_results_lock );
+  for ( auto& result : m_results )
+  {
+    clear_tags( result.tags );
+  }
+  m_results.clear();
+  m_used_bytes = 0;
+}
+
+size_t ConnectionManager::poll()
+{
+  size_t scheduled = 0;
+
+  for ( auto& session : m_sessions )
+  {
+    bool idle = false;
+
+    if ( !session->busy.compare_exchange_strong( idle, true ) )
+    {
+      ++m_skipped;
+      continue;
+    }
+
+    WORKER& worker = *m_pool[session->worker];
+    {
+      lock_guard<mutex> lock( worker.lock );
+      worker.jobs.push_back( session.get() );
+    }
+    SetEvent( worker.wake );
+    ++scheduled;
+  }
+
+  return scheduled;
+}
+
+bool ConnectionManager::next_result( OPCDA_SERVER_RESULT& result, int timeout_ms )
+{
+  unique_lock<mutex> lock( m_results_lock );
+
+  if ( !m_results_ready.wait_for( lock, chrono::milliseconds( timeout_ms ), [this]() { return !m_results.empty() || m_stopping; } ) || m_results.empty() )
+  {
+    return false;
+  }
+
+  result = move( m_results.front() );
+  m_results.pop_front();
+  return true;
+}
+
+void ConnectionManager::release( OPCDA_SERVER_RESULT& result )
+{
+  clear_tags( result.tags );
+
+  lock_guard<mutex> lock( m_results_lock );
+  m_used_bytes -= min( m_used_bytes, result.bytes );
+  result.bytes = 0;
+  m_budget_freed.notify_all();
+}
+
+void ConnectionManager::push_result( OPCDA_SERVER_RESULT&& result )
+{
+  unique_lock<mutex> lock( m_results_lock );
+
+  // a single result larger than the budget still passes once nothing else is queued
+  m_budget_freed.wait( lock, [&]() { return m_stopping || m_used_bytes == 0 || m_used_bytes + result.bytes <= m_budget; } );
+
+  if ( m_stopping )
+  {
+    clear_tags( result.tags );
+    return;
+  }
+
+  m_used_bytes += result.bytes;
+  m_results.push_back( move( result ) );
+  m_results_ready.notify_one();
+}
+
+bool ConnectionManager::connect_session( SESSION& session )
+{
+  const auto& spec = m_servers[session.server];
+  OpcDaClient& client = *session.client;
+  bool connected = false;
+
+  if ( !spec.clsid.empty() )
+  {
+    CLSID clsid;
+    connected = SUCCEEDED( CLSIDFromString( OPCDA::UTILS::str_to_wstr( spec.clsid ).c_str(), &clsid ) ) && client.connect_clsid( spec.host, clsid );
+  }
+
+  if ( !connected && !spec.progid.empty() )
+  {
+    connected = client.connect_progid( spec.host, spec.progid );
+  }
+
+  if ( !connected )
+  {
+    return false;
+  }
+
+  if ( session.tags.empty() )
+  {
+    client.request_readable_tags( L"" );
+    session.tags = client.m_available_tags;
+  }
+
+  return true;
+}
+
+OPCDA_SERVER_RESULT ConnectionManager::read_session( SESSION& session )
+{
+  OPCDA_SERVER_RESULT result;
+  result.server = m_servers[session.server].name;
+  result.session = session.index;
+
+  auto started = chrono::steady_clock::now();
+
+  if ( !session.client )
+  {
+    session.client = make_unique<OpcDaClient>();
+    session.client->set_discovery_cache( m_discovery_cache );
+    session.client->set_auto_reconnect( true );
+
+    if ( !session.client->com_init() )
+    {
+      Logger::instance().logError( "[manager] COM init failed for " + result.server );
+    }
+  }
+
+  // a dropped link is the supervisor's to restore, only a session that never connected starts over
+  bool down = session.client->supervisor().state() == OPCDA_LINK_STATE::DOWN;
+
+  if ( !down && !session.client->is_connected() && !connect_session( session ) )
+  {
+    result.error = CO_E_SERVER_EXEC_FAILURE;
+  }
+  else if ( session.tags.empty() )
+  {
+    result.error = S_FALSE;
+  }
+  else
+  {
+    vector<HRESULT> errors;
+    result.error = session.client->read_sync( session.tags, result.tags, errors );
+    result.bytes = estimate_bytes( result.tags );
+  }
+
+  result.elapsed_ms = chrono::duration_cast<chrono::milliseconds>( chrono::steady_clock::now() - started ).count();
+  return result;
+}
+
+void ConnectionManager::worker_loop( size_t index )
+{
+  WORKER& worker = *m_pool[index];
+  HRESULT hr = CoInitializeEx( NULL, COINIT_APARTMENTTHREADED );
+
+  if ( FAILED( hr ) )
+  {
+    Logger::instance().logError( "[manager] Worker failed to enter its apartment" );
+  }
+
+  while ( !m_stopping )
+  {
+    SESSION* session = nullptr;
+    {
+      lock_guard<mutex> lock( worker.lock );
+      if ( !worker.jobs.empty() )
+      {
+        session = worker.jobs.front();
+        worker.jobs.pop_front();
+      }
+    }
+
+    if ( !session )
+    {
+      // an STA has to keep pumping while idle
+      DWORD signaled = 0;
+      CoWaitForMultipleHandles( COWAIT_DISPATCH_CALLS, INFINITE, 1, &worker.wake, &signaled );
+      continue;
+    }
+
+    push_result( read_session( *session ) );
+    session->busy = false;
+  }
+
+  // proxies are released in the apartment that created them
+  for ( auto& session : m_sessions )
+  {
+    if ( session->worker == index )
+    {
+      session->client.reset();
+    }
+  }
+
+  if ( SUCCEEDED( hr ) )
+  {
+    CoUninitialize();
+  }
+}
@@ -0,0 +1,126 @@
+// opcda_connection_manager.h
+#ifndef OPCDA_CONNECTION_MANAGER_H
+#define OPCDA_CONNECTION_MANAGER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opcda_client.h"
+
+using namespace std;
+
+class DiscoveryCache;
+
+constexpr size_t DEFAULT_MANAGER_WORKERS = 8;
+constexpr size_t DEFAULT_SERVER_SESSIONS = 1;
+constexpr size_t DEFAULT_MANAGER_MEMORY_MB = 64;
+
+struct OPCDA_SERVER_SPEC
+{
+  string name;
+  string host;
+  string progid;
+  string clsid;
+  size_t sessions = DEFAULT_SERVER_SESSIONS;
+  vector<wstring> tags;
+};
+
+struct OPCDA_SERVER_RESULT
+{
+  string server;
+  size_t session = 0;
+  HRESULT error = S_OK;
+  long long elapsed_ms = 0;
+  size_t bytes = 0;
+  vector<OPCDA_TAG> tags;
+};
+
+/**
+ * @brief Owns the OpcDaClient sessions of many servers and reads them on a fixed
+ *        pool of STA workers.
+ *
+ * Every session is pinned to one worker, which creates, connects, reads and
+ * finally destroys its client, so proxies never leave their apartment. A server
+ * gets at most `sessions` connections (its concurrency limit) with the tag list
+ * split between them, and a session is never scheduled again while its previous
+ * read is still in flight. Results from all servers are merged into one queue;
+ * workers stall once the queued results exceed the shared memory budget, until
+ * the consumer hands them back with release().
+ */
+class ConnectionManager
+{
+public:
+  ConnectionManager();
+  ~ConnectionManager();
+
+  void set_workers( size_t workers );
+  void set_memory_budget( size_t bytes );
+  void set_discovery_cache( DiscoveryCache* cache );
+  void add_server( const OPCDA_SERVER_SPEC& spec );
+
+  bool start();
+  void stop();
+
+  size_t poll();
+  bool next_result( OPCDA_SERVER_RESULT& result, int timeout_ms );
+  void release( OPCDA_SERVER_RESULT& result );
+
+  size_t session_count() const
+  {
+    return m_sessions.size();
+  }
+  size_t skipped_polls() const
+  {
+    return m_skipped;
+  }
+
+  static bool load_servers( const string& file, size_t default_sessions, vector<OPCDA_SERVER_SPEC>& specs, string& error );
+
+private:
+  struct SESSION
+  {
+    size_t server = 0;
+    size_t index = 0;
+    size_t worker = 0;
+    vector<wstring> tags;
+    unique_ptr<OpcDaClient> client;
+    atomic<bool> busy{ false };
+  };
+
+  struct WORKER
+  {
+    thread runner;
+    HANDLE wake = NULL;
+    mutex lock;
+    deque<SESSION*> jobs;
+  };
+
+  size_t m_workers = DEFAULT_MANAGER_WORKERS;
+  size_t m_budget = DEFAULT_MANAGER_MEMORY_MB * 1024 * 1024;
+  DiscoveryCache* m_discovery_cache = nullptr;
+
+  vector<OPCDA_SERVER_SPEC> m_servers;
+  vector<unique_ptr<SESSION>> m_sessions;
+  vector<unique_ptr<WORKER>> m_pool;
+  atomic<bool> m_stopping{ false };
+  atomic<size_t> m_skipped{ 0 };
+
+  mutex m_results_lock;
+  condition_variable m_results_ready;
+  condition_variable m_budget_freed;
+  deque<OPCDA_SERVER_RESULT> m_results;
+  size_t m_used_bytes = 0;
+
+  void worker_loop( size_t index );
+  OPCDA_SERVER_RESULT read_session( SESSION& session );
+  bool connect_session( SESSION& session );
+  void push_result( OPCDA_SERVER_RESULT&& result );
+};
+
+#endif
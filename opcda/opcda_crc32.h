@@ -0,0 +1,46 @@
+// opcda_crc32.h
+#ifndef OPCDA_CRC32_H
+#define OPCDA_CRC32_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief IEEE 802.3 CRC-32. Pass the previous result as crc to checksum data split across buffers.
+ */
+struct CRC32_TABLE
+{
+  uint32_t entries[256];
+
+  CRC32_TABLE()
+  {
+    for ( uint32_t i = 0; i < 256; ++i )
+    {
+      uint32_t c = i;
+      for ( int k = 0; k < 8; ++k )
+      {
+        c = ( c & 1 ) ? 0xEDB88320u ^ ( c >> 1 ) : c >> 1;
+      }
+      entries[i] = c;
+    }
+  }
+};
+
+inline uint32_t crc32_update( uint32_t crc, const uint8_t* data, size_t size )
+{
+  static const CRC32_TABLE table;
+
+  crc ^= 0xFFFFFFFFu;
+  for ( size_t i = 0; i < size; ++i )
+  {
+    crc = table.entries[( crc ^ data[i] ) & 0xFF] ^ ( crc >> 8 );
+  }
+  return crc ^ 0xFFFFFFFFu;
+}
+
+inline uint32_t crc32( const uint8_t* data, size_t size )
+{
+  return crc32_update( 0, data, size );
+}
+
+#endif
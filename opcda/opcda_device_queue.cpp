@@ -0,0 +1,208 @@
+// opcda_device_queue.cpp
+#include <algorithm>
+
+#include "opcda_device_queue.h"
+
+using namespace std;
+
+TokenBucket::TokenBucket( double rate, double burst )
+{
+  configure( rate, burst );
+  m_tokens = m_burst;
+}
+
+void TokenBucket::configure( double rate, double burst )
+{
+  m_rate = max( rate, 0.001 );
+  m_burst = max( burst, 1.0 );
+  m_tokens = min( m_tokens, m_burst );
+  m_refilled = clock::now();
+}
+
+void TokenBucket::refill( clock::time_point now )
+{
+  if ( now > m_refilled )
+  {
+    m_tokens = min( m_burst, m_tokens + chrono::duration<double>( now - m_refilled ).count() * m_rate );
+    m_refilled = now;
+  }
+}
+
+bool TokenBucket::take( double tokens, clock::time_point now )
+{
+  refill( now );
+
+  if ( m_tokens < tokens )
+  {
+    return false;
+  }
+
+  m_tokens -= tokens;
+  return true;
+}
+
+TokenBucket::clock::duration TokenBucket::wait_time( double tokens, clock::time_point now )
+{
+  refill( now );
+
+  if ( m_tokens >= tokens )
+  {
+    return clock::duration::zero();
+  }
+  return chrono::duration_cast<clock::duration>( chrono::duration<double>( ( tokens - m_tokens ) / m_rate ) );
+}
+
+bool TokenBucket::full( clock::time_point now )
+{
+  refill( now );
+  return m_tokens >= m_burst;
+}
+
+void DeviceReadQueue::set_server_rate( double items_per_second, double burst )
+{
+  m_server.configure( items_per_second, burst > 0 ? burst : items_per_second );
+}
+
+void DeviceReadQueue::set_branch_rate( double items_per_second, double burst )
+{
+  m_branch_rate = items_per_second;
+  m_branch_burst = burst > 0 ? burst : items_per_second;
+
+  for ( auto& branch : m_branches )
+  {
+    branch.second.configure( m_branch_rate, m_branch_burst );
+  }
+}
+
+void DeviceReadQueue::set_max_batch( size_t items )
+{
+  m_max_batch = max<size_t>( items, 1 );
+}
+
+wstring DeviceReadQueue::device_branch( const wstring& item_id )
+{
+  size_t split = item_id.find_last_of( L"./\\" );
+  return split == wstring::npos ? wstring() : item_id.substr( 0, split );
+}
+
+size_t DeviceReadQueue::submit( const vector<wstring>& item_ids, OPCDA_READ_PRIORITY priority, const function<shared_ptr<DEVICE_TAG>()>& make_tag, TAGS& request )
+{
+  request.reserve( request.size() + item_ids.size() );
+  size_t coalesced = 0;
+
+  for ( const auto& item_id : item_ids )
+  {
+    auto it = m_pending.find( item_id );
+
+    if ( it != m_pending.end() )
+    {
+      shared_ptr<DEVICE_TAG>& tag = it->second;
+
+      // the stale bulk entry is skipped when the bulk queue reaches it
+      if ( tag->queued && priority == OPCDA_READ_PRIORITY::INTERACTIVE && tag->priority == OPCDA_READ_PRIORITY::BULK )
+      {
+        tag->priority = OPCDA_READ_PRIORITY::INTERACTIVE;
+        m_interactive.push_back( tag );
+      }
+
+      request.push_back( tag );
+      ++coalesced;
+      continue;
+    }
+
+    shared_ptr<DEVICE_TAG> tag = make_tag();
+    tag->item_id = item_id;
+    tag->branch = device_branch( item_id );
+    tag->priority = priority;
+
+    ( priority == OPCDA_READ_PRIORITY::INTERACTIVE ? m_interactive : m_bulk ).push_back( tag );
+    m_pending.emplace( item_id, tag );
+    request.push_back( move( tag ) );
+  }
+
+  m_requested += item_ids.size();
+  m_coalesced += coalesced;
+  return coalesced;
+}
+
+void DeviceReadQueue::admit( list<shared_ptr<DEVICE_TAG>>& queue, OPCDA_READ_PRIORITY priority, clock::time_point now, TAGS& batch, clock::duration& next )
+{
+  for ( auto it = queue.begin(); it != queue.end() && batch.size() < m_max_batch; )
+  {
+    shared_ptr<DEVICE_TAG>& tag = *it;
+
+    if ( !tag->queued || tag->priority != priority )
+    {
+      it = queue.erase( it );
+      continue;
+    }
+
+    clock::duration server_wait = m_server.wait_time( 1, now );
+    if ( server_wait > clock::duration::zero() )
+    {
+      next = min( next, server_wait );
+      return;
+    }
+
+    auto branch = m_branches.find( tag->branch );
+    if ( branch == m_branches.end() )
+    {
+      branch = m_branches.emplace( tag->branch, TokenBucket( m_branch_rate, m_branch_burst ) ).first;
+    }
+
+    if ( !branch->second.take( 1, now ) )
+    {
+      next = min( next, branch->second.wait_time( 1, now ) );
+      ++it;
+      continue;
+    }
+
+    m_server.take( 1, now );
+    tag->queued = false;
+    batch.push_back( tag );
+    it = queue.erase( it );
+  }
+
+  if ( batch.size() >= m_max_batch && !queue.empty() )
+  {
+    next = clock::duration::zero();
+  }
+}
+
+DeviceReadQueue::clock::duration DeviceReadQueue::admit( clock::time_point now, TAGS& batch )
+{
+  clock::duration next = chrono::milliseconds( DEVICE_READ_IDLE_MS );
+
+  admit( m_interactive, OPCDA_READ_PRIORITY::INTERACTIVE, now, batch, next );
+  if ( batch.size() < m_max_batch )
+  {
+    admit( m_bulk, OPCDA_READ_PRIORITY::BULK, now, batch, next );
+  }
+
+  if ( now - m_pruned >= chrono::milliseconds( DEVICE_BRANCH_PRUNE_MS ) )
+  {
+    prune( now );
+  }
+  return next;
+}
+
+void DeviceReadQueue::prune( clock::time_point now )
+{
+  // a full bucket is the same as the one admit() would create, so dropping it loses no budget
+  for ( auto it = m_branches.begin(); it != m_branches.end(); )
+  {
+    it = it->second.full( now ) ? m_branches.erase( it ) : next( it );
+  }
+  m_pruned = now;
+}
+
+void DeviceReadQueue::finish( const shared_ptr<DEVICE_TAG>& tag )
+{
+  tag->done = true;
+
+  auto pending = m_pending.find( tag->item_id );
+  if ( pending != m_pending.end() && pending->second == tag )
+  {
+    m_pending.erase( pending );
+  }
+}
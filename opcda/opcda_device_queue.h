@@ -0,0 +1,122 @@
+// opcda_device_queue.h
+#ifndef OPCDA_DEVICE_QUEUE_H
+#define OPCDA_DEVICE_QUEUE_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+constexpr double DEFAULT_DEVICE_READ_RATE = 200;    // items per second for the whole server
+constexpr double DEFAULT_DEVICE_BRANCH_RATE = 50;   // items per second for one device branch
+constexpr size_t DEFAULT_DEVICE_READ_BATCH = 500;
+constexpr int DEFAULT_DEVICE_READ_TIMEOUT_MS = 30000;
+constexpr int DEVICE_READ_IDLE_MS = 1000;
+constexpr int DEVICE_BRANCH_PRUNE_MS = 10000;
+
+enum class OPCDA_READ_PRIORITY
+{
+  INTERACTIVE,
+  BULK
+};
+
+/** @brief Refills at rate tokens per second up to burst; one token is one item read from the device. */
+class TokenBucket
+{
+public:
+  using clock = chrono::steady_clock;
+
+  TokenBucket( double rate = DEFAULT_DEVICE_READ_RATE, double burst = DEFAULT_DEVICE_READ_RATE );
+
+  void configure( double rate, double burst );
+  bool take( double tokens, clock::time_point now );
+  /** @brief Time until tokens are available, zero when they already are. */
+  clock::duration wait_time( double tokens, clock::time_point now );
+  /** @brief True when the bucket refilled to its burst, which makes it the same as a new one. */
+  bool full( clock::time_point now );
+
+private:
+  double m_rate = 1;
+  double m_burst = 1;
+  double m_tokens = 0;
+  clock::time_point m_refilled;
+
+  void refill( clock::time_point now );
+};
+
+/** @brief One tag waiting for a device read; the reader derives its result fields from it. */
+struct DEVICE_TAG
+{
+  wstring item_id;
+  wstring branch;
+  OPCDA_READ_PRIORITY priority = OPCDA_READ_PRIORITY::BULK;
+  bool queued = true;
+  bool done = false;
+
+  virtual ~DEVICE_TAG() {}
+};
+
+/**
+ * @brief Admission state of DeviceReadScheduler, without the reads themselves.
+ *
+ * A tag already queued or being read is not queued again: submit() hands the
+ * pending tag to every request asking for it, and an interactive request
+ * lifts a queued bulk tag to its own priority. admit() takes interactive tags
+ * before bulk ones and admits a tag only while both the server bucket and the
+ * bucket of its device branch (the item ID up to its last '.', '/' or '\')
+ * hold a token; a throttled branch does not hold back tags of other branches.
+ * Branch buckets that refilled completely are dropped now and then, so
+ * namespaces with many branches do not keep one bucket per branch forever.
+ *
+ * Not thread safe; the scheduler calls it under its own lock.
+ */
+class DeviceReadQueue
+{
+public:
+  using clock = chrono::steady_clock;
+  using TAGS = vector<shared_ptr<DEVICE_TAG>>;
+
+  void set_server_rate( double items_per_second, double burst = 0 );
+  void set_branch_rate( double items_per_second, double burst = 0 );
+  void set_max_batch( size_t items );
+
+  /** @brief Appends one tag per item ID to request, new ones from make_tag; returns how many were already pending. */
+  size_t submit( const vector<wstring>& item_ids, OPCDA_READ_PRIORITY priority, const function<shared_ptr<DEVICE_TAG>()>& make_tag, TAGS& request );
+  /** @brief Moves what the budgets admit at now into batch; returns how long until more can be admitted. */
+  clock::duration admit( clock::time_point now, TAGS& batch );
+  /** @brief Marks an admitted tag read, so the next request for its item queues a new read. */
+  void finish( const shared_ptr<DEVICE_TAG>& tag );
+
+  size_t pending() const { return m_pending.size(); }
+  size_t branches() const { return m_branches.size(); }
+  size_t requested() const { return m_requested; }
+  size_t coalesced() const { return m_coalesced; }
+
+  static wstring device_branch( const wstring& item_id );
+
+private:
+  size_t m_max_batch = DEFAULT_DEVICE_READ_BATCH;
+  unordered_map<wstring, shared_ptr<DEVICE_TAG>> m_pending;
+  list<shared_ptr<DEVICE_TAG>> m_interactive;
+  list<shared_ptr<DEVICE_TAG>> m_bulk;
+  TokenBucket m_server;
+  double m_branch_rate = DEFAULT_DEVICE_BRANCH_RATE;
+  double m_branch_burst = DEFAULT_DEVICE_BRANCH_RATE;
+  map<wstring, TokenBucket> m_branches;
+  clock::time_point m_pruned = clock::now();
+
+  size_t m_requested = 0;
+  size_t m_coalesced = 0;
+
+  void admit( list<shared_ptr<DEVICE_TAG>>& queue, OPCDA_READ_PRIORITY priority, clock::time_point now, TAGS& batch, clock::duration& next );
+  void prune( clock::time_point now );
+};
+
+#endif
@@ -0,0 +1,226 @@
+// opcda_device_read.cpp
+#define NOMINMAX
+#include <algorithm>
+#include <windows.h>
+
+#include "opcda_device_read.h"
+#include "opcda_metrics.h"
+#include "opcda_trace.h"
+
+using namespace std;
+
+static MetricCounter& s_device_coalesced = MetricsRegistry::instance().counter( "opcda_device_reads_coalesced_total", "", "Device read tags served by a read another request already queued" );
+static MetricGauge& s_device_queued = MetricsRegistry::instance().gauge( "opcda_device_reads_queued", "", "Device read tags waiting for a token" );
+static MetricHistogram& s_device_wait = MetricsRegistry::instance().histogram( "opcda_device_read_wait_seconds", "", "Device read request latency including admission" );
+
+DeviceReadScheduler::DeviceReadScheduler( OpcDaClient& client ) : m_client( client )
+{
+}
+
+void DeviceReadScheduler::set_server_rate( double items_per_second, double burst )
+{
+  lock_guard<mutex> lock( m_lock );
+  m_queue.set_server_rate( items_per_second, burst );
+}
+
+void DeviceReadScheduler::set_branch_rate( double items_per_second, double burst )
+{
+  lock_guard<mutex> lock( m_lock );
+  m_queue.set_branch_rate( items_per_second, burst );
+}
+
+void DeviceReadScheduler::set_max_batch( size_t items )
+{
+  lock_guard<mutex> lock( m_lock );
+  m_queue.set_max_batch( items );
+}
+
+void DeviceReadScheduler::set_timeout( int timeout_ms )
+{
+  m_timeout_ms = max( timeout_ms, 0 );
+}
+
+void DeviceReadScheduler::set_notify( const function<void()>& on_submit )
+{
+  m_notify = on_submit;
+}
+
+size_t DeviceReadScheduler::queued() const
+{
+  lock_guard<mutex> lock( m_lock );
+  return m_queue.pending();
+}
+
+size_t DeviceReadScheduler::requested() const
+{
+  lock_guard<mutex> lock( m_lock );
+  return m_queue.requested();
+}
+
+size_t DeviceReadScheduler::coalesced() const
+{
+  lock_guard<mutex> lock( m_lock );
+  return m_queue.coalesced();
+}
+
+shared_ptr<DeviceReadScheduler::REQUEST> DeviceReadScheduler::submit( const vector<wstring>& item_ids, OPCDA_READ_PRIORITY priority )
+{
+  DeviceReadQueue::TAGS tags;
+  size_t coalesced = 0;
+
+  {
+    lock_guard<mutex> lock( m_lock );
+    coalesced = m_queue.submit( item_ids, priority, []() { return make_shared<TAG_READ>(); }, tags );
+    s_device_queued.set( static_cast<int64_t>( m_queue.pending() ) );
+  }
+
+  s_device_coalesced.add( static_cast<int64_t>( coalesced ) );
+
+  auto request = make_shared<REQUEST>();
+  request->reserve( tags.size() );
+  for ( const auto& tag : tags )
+  {
+    request->push_back( static_pointer_cast<TAG_READ>( tag ) );
+  }
+
+  if ( m_notify )
+  {
+    m_notify();
+  }
+  return request;
+}
+
+chrono::milliseconds DeviceReadScheduler::dispatch()
+{
+  unique_lock<mutex> dispatching( m_dispatch_lock, try_to_lock );
+  if ( !dispatching.owns_lock() )
+  {
+    return chrono::milliseconds( 10 );
+  }
+
+  DeviceReadQueue::TAGS batch;
+  clock::duration next;
+  {
+    lock_guard<mutex> lock( m_lock );
+    next = m_queue.admit( clock::now(), batch );
+  }
+
+  if ( !batch.empty() )
+  {
+    TraceSpan span( "device_dispatch", static_cast<int64_t>( batch.size() ) );
+
+    vector<wstring> item_ids;
+    item_ids.reserve( batch.size() );
+    for ( const auto& tag : batch )
+    {
+      item_ids.push_back( tag->item_id );
+    }
+
+    vector<OPCDA_TAG> results;
+    vector<HRESULT> errors;
+    HRESULT hr = m_client.read_device( item_ids, results, errors );
+
+    lock_guard<mutex> lock( m_lock );
+
+    for ( size_t i = 0; i < batch.size(); ++i )
+    {
+      TAG_READ& tag = static_cast<TAG_READ&>( *batch[i] );
+
+      if ( i < results.size() )
+      {
+        // the tag takes over the VARIANT the read handed back
+        tag.value.Attach( &results[i].value );
+        tag.quality = results[i].quality;
+        tag.timestamp = results[i].timestamp;
+      }
+      tag.error = i < errors.size() ? errors[i] : ( FAILED( hr ) ? hr : E_FAIL );
+      m_queue.finish( batch[i] );
+    }
+
+    ++m_batches;
+    s_device_queued.set( static_cast<int64_t>( m_queue.pending() ) );
+    m_done.notify_all();
+  }
+
+  // rounded up: a refill due in under a millisecond must not become a zero wait and a busy loop
+  return chrono::ceil<chrono::milliseconds>( next );
+}
+
+bool DeviceReadScheduler::finished( const REQUEST& request )
+{
+  return all_of( request.begin(), request.end(), []( const shared_ptr<TAG_READ>& tag ) { return tag->done; } );
+}
+
+HRESULT DeviceReadScheduler::wait( const REQUEST& request, int timeout_ms, vector<OPCDA_TAG>& results, vector<HRESULT>& errors )
+{
+  unique_lock<mutex> lock( m_lock );
+  bool complete = m_done.wait_for( lock, chrono::milliseconds( max( timeout_ms, 0 ) ), [&]() { return finished( request ); } );
+
+  results.assign( request.size(), OPCDA_TAG() );
+  errors.assign( request.size(), S_OK );
+
+  for ( size_t i = 0; i < request.size(); ++i )
+  {
+    const TAG_READ& tag = *request[i];
+    OPCDA_TAG& result = results[i];
+
+    result.id = tag.item_id;
+    VariantInit( &result.value );
+
+    // timed out tags stay queued and are still read, for whoever asks next
+    if ( !tag.done )
+    {
+      result.quality = OPC_QUALITY_BAD;
+      errors[i] = RPC_E_TIMEOUT;
+      continue;
+    }
+
+    errors[i] = tag.error;
+    if ( SUCCEEDED( tag.error ) && SUCCEEDED( VariantCopy( &result.value, &tag.value ) ) )
+    {
+      result.quality = tag.quality;
+      result.timestamp = tag.timestamp;
+      result.data_type = V_VT( &result.value );
+    }
+    else
+    {
+      result.quality = OPC_QUALITY_BAD;
+    }
+  }
+
+  if ( !complete )
+  {
+    return RPC_E_TIMEOUT;
+  }
+  return any_of( errors.begin(), errors.end(), []( HRESULT e ) { return FAILED( e ); } ) ? S_FALSE : S_OK;
+}
+
+HRESULT DeviceReadScheduler::read( const vector<wstring>& item_ids, OPCDA_READ_PRIORITY priority, vector<OPCDA_TAG>& results, vector<HRESULT>& errors )
+{
+  if ( item_ids.empty() )
+  {
+    results.clear();
+    errors.clear();
+    return S_OK;
+  }
+
+  MetricTimer timer( s_device_wait );
+  shared_ptr<REQUEST> request = submit( item_ids, priority );
+  clock::time_point deadline = clock::now() + chrono::milliseconds( m_timeout_ms );
+
+  while ( true )
+  {
+    chrono::milliseconds delay = dispatch();
+
+    unique_lock<mutex> lock( m_lock );
+    clock::time_point now = clock::now();
+
+    if ( finished( *request ) || now >= deadline )
+    {
+      break;
+    }
+    m_done.wait_until( lock, min( deadline, now + delay ), [&]() { return finished( *request ); } );
+  }
+
+  return wait( *request, 0, results, errors );
+}
@@ -0,0 +1,86 @@
+// opcda_device_read.h
+#ifndef OPCDA_DEVICE_READ_H
+#define OPCDA_DEVICE_READ_H
+
+#include <atlbase.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "opcda_client.h"
+#include "opcda_device_queue.h"
+
+using namespace std;
+
+/**
+ * @brief Admits OPC_DS_DEVICE reads at a rate the field bus can take.
+ *
+ * Requests are split into tags and admitted by a DeviceReadQueue: duplicate
+ * tags share one device read, interactive tags go before bulk ones, and the
+ * server and per branch token buckets bound the read rate. Each dispatch()
+ * sends the admitted tags to the server in one read_device call.
+ *
+ * dispatch() must run on a thread the client accepts reads from. read() does
+ * that itself and suits a single reading thread; other threads submit() and
+ * wait() while the owner of the client dispatches.
+ */
+class DeviceReadScheduler
+{
+public:
+  struct TAG_READ;
+  using REQUEST = vector<shared_ptr<TAG_READ>>;
+
+  explicit DeviceReadScheduler( OpcDaClient& client );
+
+  void set_server_rate( double items_per_second, double burst = 0 );
+  void set_branch_rate( double items_per_second, double burst = 0 );
+  void set_max_batch( size_t items );
+  void set_timeout( int timeout_ms );
+  /** @brief Called after every submit(), so the dispatching thread can wake up. */
+  void set_notify( const function<void()>& on_submit );
+
+  HRESULT read( const vector<wstring>& item_ids, OPCDA_READ_PRIORITY priority, vector<OPCDA_TAG>& results, vector<HRESULT>& errors );
+
+  shared_ptr<REQUEST> submit( const vector<wstring>& item_ids, OPCDA_READ_PRIORITY priority );
+  /** @brief Waits for the request; tags still pending at the timeout fail with RPC_E_TIMEOUT. */
+  HRESULT wait( const REQUEST& request, int timeout_ms, vector<OPCDA_TAG>& results, vector<HRESULT>& errors );
+  /** @brief Reads what the budgets admit now; returns how long until more can be admitted. */
+  chrono::milliseconds dispatch();
+
+  size_t queued() const;
+  size_t requested() const;
+  size_t coalesced() const;
+  size_t batches() const { return m_batches; }
+
+  struct TAG_READ : DEVICE_TAG
+  {
+    CComVariant value;
+    WORD quality = 0;
+    FILETIME timestamp = { 0, 0 };
+    HRESULT error = S_OK;
+  };
+
+private:
+  using clock = chrono::steady_clock;
+
+  OpcDaClient& m_client;
+  int m_timeout_ms = DEFAULT_DEVICE_READ_TIMEOUT_MS;
+  function<void()> m_notify;
+
+  mutable mutex m_lock;
+  condition_variable m_done;
+  DeviceReadQueue m_queue;
+
+  // one batch at a time keeps the server budget meaningful
+  mutex m_dispatch_lock;
+
+  size_t m_batches = 0;
+
+  static bool finished( const REQUEST& request );
+};
+
+#endif
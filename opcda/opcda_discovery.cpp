@@ -0,0 +1,458 @@
+// opcda_discovery.cpp
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <windows.h>
+
+#include "logger.h"
+#include "opcda_discovery.h"
+
+#pragma comment( lib, "Ws2_32.lib" )
+
+using namespace std;
+
+struct PROBE_STATE
+{
+  mutex lock;
+  condition_variable finished;
+  bool done = false;
+  DWORD thread_id = 0;
+  HRESULT hr = E_PENDING;
+  vector<OPCDA_CONNECT_INFO> servers;
+};
+
+static string trim( const string& s )
+{
+  size_t begin = s.find_first_not_of( " \t\r\n" );
+  size_t end = s.find_last_not_of( " \t\r\n" );
+  return begin == string::npos ? "" : s.substr( begin, end - begin + 1 );
+}
+
+static bool is_local_host( const string& host )
+{
+  if ( host.empty() || host == "." || host == "localhost" || host == "127.0.0.1" )
+  {
+    return true;
+  }
+
+  char name[MAX_COMPUTERNAME_LENGTH + 1] = { 0 };
+  DWORD size = sizeof( name );
+
+  return GetComputerNameA( name, &size ) && _stricmp( name, host.c_str() ) == 0;
+}
+
+/**
+ * @brief Non-blocking connect to host:port, bounded by timeout_ms.
+ */
+static bool tcp_reachable( const string& host, int port, int timeout_ms )
+{
+  addrinfo hints = {};
+  addrinfo* addresses = nullptr;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+
+  if ( getaddrinfo( host.c_str(), to_string( port ).c_str(), &hints, &addresses ) != 0 || !addresses )
+  {
+    return false;
+  }
+
+  bool reachable = false;
+  SOCKET s = socket( addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol );
+
+  if ( s != INVALID_SOCKET )
+  {
+    u_long non_blocking = 1;
+    ioctlsocket( s, FIONBIO, &non_blocking );
+
+    if ( connect( s, addresses->ai_addr, static_cast<int>( addresses->ai_addrlen ) ) == 0 )
+    {
+      reachable = true;
+    }
+    else if ( WSAGetLastError() == WSAEWOULDBLOCK )
+    {
+      fd_set writable;
+      fd_set failed;
+      FD_ZERO( &writable );
+      FD_ZERO( &failed );
+      FD_SET( s, &writable );
+      FD_SET( s, &failed );
+
+      timeval tv;
+      tv.tv_sec = timeout_ms / 1000;
+      tv.tv_usec = ( timeout_ms % 1000 ) * 1000;
+
+      if ( select( 0, NULL, &writable, &failed, &tv ) > 0 && FD_ISSET( s, &writable ) )
+      {
+        int error = 0;
+        int length = sizeof( error );
+        reachable = getsockopt( s, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>( &error ), &length ) == 0 && error == 0;
+      }
+    }
+
+    closesocket( s );
+  }
+
+  freeaddrinfo( addresses );
+  return reachable;
+}
+
+static bool parse_ipv4( const string& text, uint32_t& address )
+{
+  istringstream in( text );
+  string part;
+  address = 0;
+  int parts = 0;
+
+  while ( getline( in, part, '.' ) )
+  {
+    if ( part.empty() || part.size() > 3 || !all_of( part.begin(), part.end(), ::isdigit ) )
+    {
+      return false;
+    }
+
+    int octet = stoi( part );
+    if ( octet > 255 || ++parts > 4 )
+    {
+      return false;
+    }
+
+    address = ( address << 8 ) | static_cast<uint32_t>( octet );
+  }
+
+  return parts == 4;
+}
+
+static string ipv4_to_str( uint32_t address )
+{
+  return to_string( address >> 24 ) + "." + to_string( ( address >> 16 ) & 0xFF ) + "." + to_string( ( address >> 8 ) & 0xFF ) + "." + to_string( address & 0xFF );
+}
+
+static bool expand_spec( const string& spec, vector<string>& hosts, string& error )
+{
+  size_t slash = spec.find( '/' );
+
+  if ( slash == string::npos )
+  {
+    hosts.push_back( spec );
+    return true;
+  }
+
+  uint32_t base = 0;
+  string bits_text = spec.substr( slash + 1 );
+
+  if ( !parse_ipv4( spec.substr( 0, slash ), base ) || bits_text.empty() || !all_of( bits_text.begin(), bits_text.end(), ::isdigit ) )
+  {
+    error = "Invalid CIDR block: " + spec;
+    return false;
+  }
+
+  int bits = stoi( bits_text );
+  if ( bits < 16 || bits > 32 )
+  {
+    error = "CIDR prefix must be between /16 and /32: " + spec;
+    return false;
+  }
+
+  uint32_t mask = bits == 32 ? 0xFFFFFFFFu : ~( 0xFFFFFFFFu >> bits );
+  uint32_t first = base & mask;
+  uint32_t last = first | ~mask;
+
+  // network and broadcast addresses only exist for /30 and wider
+  if ( bits < 31 )
+  {
+    ++first;
+    --last;
+  }
+
+  for ( uint32_t address = first; address <= last && hosts.size() < MAX_DISCOVERY_HOSTS; ++address )
+  {
+    hosts.push_back( ipv4_to_str( address ) );
+
+    if ( address == 0xFFFFFFFFu )
+    {
+      break;
+    }
+  }
+
+  return true;
+}
+
+bool DiscoverySweep::expand_hosts( const vector<string>& specs, const string& hosts_file, vector<string>& hosts, string& error )
+{
+  vector<string> all_specs = specs;
+
+  if ( !hosts_file.empty() )
+  {
+    ifstream in( hosts_file );
+    if ( !in )
+    {
+      error = "Failed to open hosts file: " + hosts_file;
+      return false;
+    }
+
+    string line;
+    while ( getline( in, line ) )
+    {
+      line = trim( line.substr( 0, line.find( '#' ) ) );
+
+      istringstream words( line );
+      string word;
+      while ( words >> word )
+      {
+        all_specs.push_back( word );
+      }
+    }
+  }
+
+  vector<string> expanded;
+  for ( const auto& spec : all_specs )
+  {
+    if ( !expand_spec( trim( spec ), expanded, error ) )
+    {
+      return false;
+    }
+  }
+
+  set<string> seen;
+  for ( auto& host : expanded )
+  {
+    if ( !host.empty() && seen.insert( host ).second )
+    {
+      hosts.push_back( move( host ) );
+    }
+  }
+
+  if ( hosts.size() >= MAX_DISCOVERY_HOSTS )
+  {
+    Logger::instance().logWarning( "[discovery] Host list truncated to " + to_string( MAX_DISCOVERY_HOSTS ) + " entries" );
+  }
+
+  return true;
+}
+
+const char* DiscoverySweep::status_to_str( DISCOVERY_STATUS status )
+{
+  switch ( status )
+  {
+    case DISCOVERY_STATUS::OK:
+      return "ok";
+    case DISCOVERY_STATUS::UNREACHABLE:
+      return "unreachable";
+    case DISCOVERY_STATUS::TIMEOUT:
+      return "timeout";
+    default:
+      return "failed";
+  }
+}
+
+void DiscoverySweep::set_workers( size_t workers )
+{
+  m_workers = max<size_t>( workers, 1 );
+}
+
+void DiscoverySweep::set_timeout( int timeout_ms )
+{
+  m_timeout_ms = max( timeout_ms, 1 );
+}
+
+DISCOVERY_RESULT DiscoverySweep::probe( const string& host )
+{
+  DISCOVERY_RESULT result;
+  result.host = host;
+
+  auto started = chrono::steady_clock::now();
+  auto deadline = started + chrono::milliseconds( m_timeout_ms );
+  auto elapsed = [&]() { return chrono::duration_cast<chrono::milliseconds>( chrono::steady_clock::now() - started ).count(); };
+
+  bool local = is_local_host( host );
+
+  // a dead host fails here in at most the timeout instead of the DCOM activation timeout
+  if ( !local && m_tcp_precheck && !tcp_reachable( host, DISCOVERY_RPC_PORT, m_timeout_ms ) )
+  {
+    result.status = DISCOVERY_STATUS::UNREACHABLE;
+    result.error = HRESULT_FROM_WIN32( RPC_S_SERVER_UNAVAILABLE );
+    result.elapsed_ms = elapsed();
+    return result;
+  }
+
+  auto state = make_shared<PROBE_STATE>();
+
+  thread activation(
+    [state, host, local]()
+    {
+      HRESULT hr = CoInitializeEx( NULL, COINIT_MULTITHREADED );
+      vector<OPCDA_CONNECT_INFO> servers;
+
+      if ( SUCCEEDED( hr ) )
+      {
+        CoEnableCallCancellation( NULL );
+        {
+          lock_guard<mutex> lock( state->lock );
+          state->thread_id = GetCurrentThreadId();
+        }
+
+        hr = OpcDaClient::enumerate_servers( local ? "" : host, servers, local );
+
+        CoDisableCallCancellation( NULL );
+        CoUninitialize();
+      }
+
+      lock_guard<mutex> lock( state->lock );
+      state->hr = hr;
+      state->servers = move( servers );
+      state->done = true;
+      state->finished.notify_all();
+    } );
+
+  unique_lock<mutex> lock( state->lock );
+
+  if ( !state->finished.wait_until( lock, deadline, [&]() { return state->done; } ) )
+  {
+    DWORD thread_id = state->thread_id;
+    lock.unlock();
+
+    if ( thread_id != 0 )
+    {
+      CoCancelCall( thread_id, 0 );
+    }
+
+    lock.lock();
+    state->finished.wait_for( lock, chrono::milliseconds( DISCOVERY_CANCEL_GRACE_MS ), [&]() { return state->done; } );
+  }
+
+  bool done = state->done;
+
+  if ( done )
+  {
+    result.error = state->hr;
+    result.servers = move( state->servers );
+    result.status = SUCCEEDED( state->hr ) ? DISCOVERY_STATUS::OK : ( state->hr == RPC_E_CALL_CANCELED ? DISCOVERY_STATUS::TIMEOUT : DISCOVERY_STATUS::FAILED );
+  }
+  else
+  {
+    result.error = RPC_E_TIMEOUT;
+    result.status = DISCOVERY_STATUS::TIMEOUT;
+  }
+
+  lock.unlock();
+
+  // an activation that ignores the cancel keeps running; the host is reported now and the thread joined by run()
+  if ( done )
+  {
+    activation.join();
+  }
+  else
+  {
+    lock_guard<mutex> abandoned_lock( m_abandoned_lock );
+    m_abandoned.push_back( { move( activation ), state } );
+  }
+
+  result.elapsed_ms = elapsed();
+  return result;
+}
+
+void DiscoverySweep::join_abandoned()
+{
+  vector<ABANDONED_PROBE> abandoned;
+  {
+    lock_guard<mutex> lock( m_abandoned_lock );
+    abandoned.swap( m_abandoned );
+  }
+
+  if ( abandoned.empty() )
+  {
+    return;
+  }
+
+  Logger::instance().logInfo( "[discovery] Waiting for " + to_string( abandoned.size() ) + " timed out activations to return" );
+
+  for ( auto& probe : abandoned )
+  {
+    unique_lock<mutex> lock( probe.state->lock );
+
+    // a cancel sent before the call was in flight has no effect, so keep sending it
+    while ( !probe.state->finished.wait_for( lock, chrono::milliseconds( DISCOVERY_CANCEL_GRACE_MS ), [&]() { return probe.state->done; } ) )
+    {
+      DWORD thread_id = probe.state->thread_id;
+      lock.unlock();
+
+      if ( thread_id != 0 )
+      {
+        CoCancelCall( thread_id, 0 );
+      }
+
+      lock.lock();
+    }
+
+    lock.unlock();
+    probe.worker.join();
+  }
+}
+
+void DiscoverySweep::run( const vector<string>& hosts, const function<void( const DISCOVERY_RESULT& )>& on_result )
+{
+  if ( hosts.empty() )
+  {
+    return;
+  }
+
+  WSADATA wsa_data;
+  bool wsa_started = WSAStartup( MAKEWORD( 2, 2 ), &wsa_data ) == 0;
+  m_tcp_precheck = wsa_started;
+
+  if ( !wsa_started )
+  {
+    Logger::instance().logWarning( "[discovery] WSAStartup failed, hosts are probed through DCOM only" );
+  }
+
+  atomic<size_t> next_host( 0 );
+  mutex output_lock;
+  size_t workers = min( m_workers, hosts.size() );
+  vector<thread> pool;
+
+  for ( size_t w = 0; w < workers; ++w )
+  {
+    pool.emplace_back(
+      [&]()
+      {
+        HRESULT hr = CoInitializeEx( NULL, COINIT_MULTITHREADED );
+
+        for ( size_t i = next_host++; i < hosts.size(); i = next_host++ )
+        {
+          DISCOVERY_RESULT result = probe( hosts[i] );
+
+          lock_guard<mutex> lock( output_lock );
+          on_result( result );
+        }
+
+        if ( SUCCEEDED( hr ) )
+        {
+          CoUninitialize();
+        }
+      } );
+  }
+
+  for ( auto& t : pool )
+  {
+    t.join();
+  }
+
+  join_abandoned();
+
+  if ( wsa_started )
+  {
+    WSACleanup();
+  }
+}
@@ -0,0 +1,85 @@
+// opcda_discovery.h
+#ifndef OPCDA_DISCOVERY_H
+#define OPCDA_DISCOVERY_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opcda_client.h"
+
+using namespace std;
+
+constexpr size_t DEFAULT_DISCOVERY_WORKERS = 32;
+constexpr int DEFAULT_DISCOVERY_TIMEOUT_MS = 3000;
+constexpr int DISCOVERY_CANCEL_GRACE_MS = 500;
+constexpr int DISCOVERY_RPC_PORT = 135;
+
+// largest CIDR block expanded for a sweep (/16)
+constexpr size_t MAX_DISCOVERY_HOSTS = 65536;
+
+enum class DISCOVERY_STATUS
+{
+  OK,
+  UNREACHABLE,
+  TIMEOUT,
+  FAILED
+};
+
+struct PROBE_STATE;
+
+struct DISCOVERY_RESULT
+{
+  string host;
+  DISCOVERY_STATUS status = DISCOVERY_STATUS::FAILED;
+  HRESULT error = S_OK;
+  long long elapsed_ms = 0;
+  vector<OPCDA_CONNECT_INFO> servers;
+};
+
+/**
+ * @brief Sweeps many hosts for OPC DA servers on a bounded pool of workers.
+ *
+ * Hosts that do not accept a TCP connection on the RPC endpoint mapper port are
+ * reported unreachable without touching DCOM. Each OPCEnum activation runs on
+ * its own MTA thread so that a stuck activation can be cancelled with
+ * CoCancelCall and, failing that, reported as a timeout once the per-host
+ * deadline passes. Such a thread is not detached: run() keeps cancelling it
+ * and joins it before returning, so no activation outlives the sweep or its
+ * CoUninitialize. Results are handed to the callback as each host completes;
+ * callbacks are serialized.
+ */
+class DiscoverySweep
+{
+public:
+  void set_workers( size_t workers );
+  void set_timeout( int timeout_ms );
+
+  void run( const vector<string>& hosts, const function<void( const DISCOVERY_RESULT& )>& on_result );
+
+  static bool expand_hosts( const vector<string>& specs, const string& hosts_file, vector<string>& hosts, string& error );
+  static const char* status_to_str( DISCOVERY_STATUS status );
+
+private:
+  size_t m_workers = DEFAULT_DISCOVERY_WORKERS;
+  int m_timeout_ms = DEFAULT_DISCOVERY_TIMEOUT_MS;
+  bool m_tcp_precheck = true;
+
+  struct ABANDONED_PROBE
+  {
+    thread worker;
+    shared_ptr<PROBE_STATE> state;
+  };
+
+  // activations still running past their deadline, joined at the end of run()
+  mutex m_abandoned_lock;
+  vector<ABANDONED_PROBE> m_abandoned;
+
+  DISCOVERY_RESULT probe( const string& host );
+  void join_abandoned();
+};
+
+#endif
@@ -0,0 +1,402 @@
+// opcda_discovery_cache.cpp
+#define NOMINMAX
+#include <algorithm>
+#include <atlbase.h>
+#include <fstream>
+#include <sstream>
+#include <windows.h>
+
+#include "logger.h"
+#include "opcda_discovery_cache.h"
+#include "opcda_utils.h"
+
+using namespace std;
+
+static const char* CACHE_HEADER = "# opcda discovery cache v1";
+
+static long long now_ms()
+{
+  return chrono::duration_cast<chrono::milliseconds>( chrono::system_clock::now().time_since_epoch() ).count();
+}
+
+static string clean_field( const string& s )
+{
+  string out = s;
+  replace_if( out.begin(), out.end(), []( char c ) { return c == '\t' || c == '\r' || c == '\n'; }, ' ' );
+  return out;
+}
+
+static string clsid_to_str( const CLSID& clsid )
+{
+  wchar_t buffer[64] = { 0 };
+  return StringFromGUID2( clsid, buffer, 64 ) > 0 ? OPCDA::UTILS::wstr_to_str( buffer ) : "";
+}
+
+static vector<string> split_tabs( const string& line )
+{
+  vector<string> fields;
+  istringstream in( line );
+  string field;
+
+  while ( getline( in, field, '\t' ) )
+  {
+    fields.push_back( field );
+  }
+
+  return fields;
+}
+
+DiscoveryCache::DiscoveryCache( const string& file ) : m_file( file )
+{
+}
+
+DiscoveryCache::~DiscoveryCache()
+{
+  join_refreshes();
+  save();
+}
+
+void DiscoveryCache::set_ttl( chrono::seconds ttl )
+{
+  lock_guard<mutex> lock( m_mutex );
+  m_ttl = ttl;
+}
+
+string DiscoveryCache::default_path()
+{
+  char base[MAX_PATH] = { 0 };
+  DWORD length = GetEnvironmentVariableA( "LOCALAPPDATA", base, MAX_PATH );
+
+  if ( length == 0 || length >= MAX_PATH )
+  {
+    return "opcda_discovery.cache";
+  }
+
+  return string( base ) + "\\opcda-cli\\discovery.cache";
+}
+
+string DiscoveryCache::host_key( const string& host )
+{
+  string key = host.empty() || host == "." || host == "127.0.0.1" ? "localhost" : host;
+  transform( key.begin(), key.end(), key.begin(), []( char c ) { return static_cast<char>( tolower( static_cast<unsigned char>( c ) ) ); } );
+  return key;
+}
+
+long long DiscoveryCache::age_ms( const HostEntry& entry ) const
+{
+  return now_ms() - entry.updated_ms;
+}
+
+bool DiscoveryCache::is_fresh( const HostEntry& entry ) const
+{
+  long long age = age_ms( entry );
+  return age >= 0 && age < chrono::duration_cast<chrono::milliseconds>( m_ttl ).count();
+}
+
+bool DiscoveryCache::load()
+{
+  ifstream in( m_file );
+  if ( !in )
+  {
+    return false;
+  }
+
+  string line;
+  if ( !getline( in, line ) || line != CACHE_HEADER )
+  {
+    Logger::instance().logWarning( "[discovery] Ignoring cache file with unknown format: " + m_file );
+    return false;
+  }
+
+  lock_guard<mutex> lock( m_mutex );
+  m_hosts.clear();
+
+  while ( getline( in, line ) )
+  {
+    vector<string> fields = split_tabs( line );
+
+    if ( fields.size() == 3 && fields[0] == "H" )
+    {
+      m_hosts[fields[1]].updated_ms = atoll( fields[2].c_str() );
+    }
+    else if ( fields.size() >= 6 && fields[0] == "S" )
+    {
+      OPCDA_CONNECT_INFO info;
+      info.host = fields[1];
+      info.available = fields[3] == "1";
+      info.progid = OPCDA::UTILS::str_to_wstr( fields[4] );
+      info.description = OPCDA::UTILS::str_to_wstr( fields[5] );
+      info.error_code = fields.size() > 6 ? fields[6] : "";
+
+      if ( FAILED( CLSIDFromString( OPCDA::UTILS::str_to_wstr( fields[2] ).c_str(), &info.clsid ) ) )
+      {
+        continue;
+      }
+
+      m_hosts[fields[1]].servers.push_back( info );
+    }
+  }
+
+  m_dirty = false;
+  return true;
+}
+
+bool DiscoveryCache::save()
+{
+  lock_guard<mutex> lock( m_mutex );
+
+  if ( !m_dirty )
+  {
+    return true;
+  }
+
+  size_t slash = m_file.find_last_of( "\\/" );
+  if ( slash != string::npos )
+  {
+    CreateDirectoryA( m_file.substr( 0, slash ).c_str(), NULL );
+  }
+
+  // write aside and swap in, a concurrent run never reads a half-written file
+  string temp = m_file + "." + to_string( GetCurrentProcessId() ) + ".tmp";
+  {
+    ofstream out( temp, ios::trunc );
+    if ( !out )
+    {
+      Logger::instance().logWarning( "[discovery] Failed to write cache file: " + temp );
+      return false;
+    }
+
+    out << CACHE_HEADER << "\n";
+
+    for ( const auto& host : m_hosts )
+    {
+      out << "H\t" << host.first << "\t" << host.second.updated_ms << "\n";
+
+      for ( const auto& s : host.second.servers )
+      {
+        out << "S\t" << host.first << "\t" << clsid_to_str( s.clsid ) << "\t" << ( s.available ? "1" : "0" ) << "\t" << clean_field( OPCDA::UTILS::wstr_to_str( s.progid ) ) << "\t" << clean_field( OPCDA::UTILS::wstr_to_str( s.description ) ) << "\t" << clean_field( s.error_code ) << "\n";
+      }
+    }
+  }
+
+  if ( !MoveFileExA( temp.c_str(), m_file.c_str(), MOVEFILE_REPLACE_EXISTING ) )
+  {
+    Logger::instance().logWarning( "[discovery] Failed to replace cache file: " + m_file );
+    DeleteFileA( temp.c_str() );
+    return false;
+  }
+
+  m_dirty = false;
+  return true;
+}
+
+vector<OPCDA_CONNECT_INFO> DiscoveryCache::discover( const string& host, bool refresh )
+{
+  string key = host_key( host );
+  vector<OPCDA_CONNECT_INFO> known;
+  bool refresh_ahead = false;
+
+  {
+    lock_guard<mutex> lock( m_mutex );
+
+    auto it = m_hosts.find( key );
+    if ( it != m_hosts.end() )
+    {
+      if ( !refresh && is_fresh( it->second ) )
+      {
+        refresh_ahead = age_ms( it->second ) > static_cast<long long>( chrono::duration_cast<chrono::milliseconds>( m_ttl ).count() * DISCOVERY_REFRESH_AHEAD );
+        known = it->second.servers;
+      }
+      else
+      {
+        // still worth keeping: GetClassDetails is skipped for CLSIDs seen before
+        known = it->second.servers;
+        refresh = true;
+      }
+    }
+    else
+    {
+      refresh = true;
+    }
+  }
+
+  if ( !refresh )
+  {
+    if ( refresh_ahead )
+    {
+      refresh_async( host );
+    }
+    return known;
+  }
+
+  vector<OPCDA_CONNECT_INFO> servers;
+  HRESULT hr = OpcDaClient::enumerate_servers( host, servers, key == "localhost", &known );
+
+  if ( SUCCEEDED( hr ) )
+  {
+    put_host( host, servers );
+  }
+
+  return servers;
+}
+
+void DiscoveryCache::put_host( const string& host, const vector<OPCDA_CONNECT_INFO>& servers )
+{
+  lock_guard<mutex> lock( m_mutex );
+
+  HostEntry& entry = m_hosts[host_key( host )];
+  entry.updated_ms = now_ms();
+  entry.servers = servers;
+  m_dirty = true;
+}
+
+void DiscoveryCache::put_progid( const string& host, const wstring& progid, const CLSID& clsid )
+{
+  lock_guard<mutex> lock( m_mutex );
+
+  HostEntry& entry = m_hosts[host_key( host )];
+  auto it = find_if( entry.servers.begin(), entry.servers.end(), [&]( const OPCDA_CONNECT_INFO& s ) { return _wcsicmp( s.progid.c_str(), progid.c_str() ) == 0; } );
+
+  if ( it != entry.servers.end() && IsEqualCLSID( it->clsid, clsid ) && it->available )
+  {
+    return;
+  }
+
+  if ( it == entry.servers.end() )
+  {
+    it = entry.servers.insert( entry.servers.end(), OPCDA_CONNECT_INFO() );
+  }
+
+  it->available = true;
+  it->host = host;
+  it->progid = progid;
+  it->clsid = clsid;
+
+  if ( entry.updated_ms == 0 )
+  {
+    entry.updated_ms = now_ms();
+  }
+
+  m_dirty = true;
+}
+
+bool DiscoveryCache::find_progid( const string& host, const wstring& progid, CLSID& clsid )
+{
+  bool stale = false;
+  bool found = false;
+
+  {
+    lock_guard<mutex> lock( m_mutex );
+
+    auto it = m_hosts.find( host_key( host ) );
+    if ( it == m_hosts.end() )
+    {
+      return false;
+    }
+
+    for ( const auto& s : it->second.servers )
+    {
+      if ( s.available && _wcsicmp( s.progid.c_str(), progid.c_str() ) == 0 )
+      {
+        clsid = s.clsid;
+        found = true;
+        break;
+      }
+    }
+
+    stale = !is_fresh( it->second );
+  }
+
+  if ( found && stale )
+  {
+    refresh_async( host );
+  }
+
+  return found;
+}
+
+void DiscoveryCache::invalidate_host( const string& host )
+{
+  lock_guard<mutex> lock( m_mutex );
+
+  if ( m_hosts.erase( host_key( host ) ) > 0 )
+  {
+    m_dirty = true;
+  }
+}
+
+void DiscoveryCache::refresh_async( const string& host )
+{
+  string key = host_key( host );
+  lock_guard<mutex> lock( m_mutex );
+
+  reap_refreshes();
+
+  if ( m_refreshing.count( key ) )
+  {
+    return;
+  }
+
+  vector<OPCDA_CONNECT_INFO> known;
+  auto it = m_hosts.find( key );
+  if ( it != m_hosts.end() )
+  {
+    known = it->second.servers;
+  }
+
+  m_refreshing[key] = thread(
+    [this, host, key, known]()
+    {
+      HRESULT hr = CoInitializeEx( NULL, COINIT_MULTITHREADED );
+      if ( SUCCEEDED( hr ) )
+      {
+        vector<OPCDA_CONNECT_INFO> servers;
+        if ( SUCCEEDED( OpcDaClient::enumerate_servers( host, servers, key == "localhost", &known ) ) )
+        {
+          put_host( host, servers );
+        }
+
+        CoUninitialize();
+      }
+
+      // last touch of the cache; the next refresh_async for this host joins the thread
+      lock_guard<mutex> done( m_mutex );
+      m_refreshed.insert( key );
+    } );
+}
+
+void DiscoveryCache::reap_refreshes()
+{
+  // called with m_mutex held; finished workers only have to return, so the joins are short
+  for ( const auto& key : m_refreshed )
+  {
+    auto it = m_refreshing.find( key );
+    if ( it != m_refreshing.end() )
+    {
+      if ( it->second.joinable() )
+      {
+        it->second.join();
+      }
+      m_refreshing.erase( it );
+    }
+  }
+  m_refreshed.clear();
+}
+
+void DiscoveryCache::join_refreshes()
+{
+  map<string, thread> running;
+  {
+    lock_guard<mutex> lock( m_mutex );
+    running.swap( m_refreshing );
+    m_refreshed.clear();
+  }
+
+  for ( auto& r : running )
+  {
+    if ( r.second.joinable() )
+    {
+      r.second.join();
+    }
+  }
+}
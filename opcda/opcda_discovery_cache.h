@@ -0,0 +1,74 @@
+// opcda_discovery_cache.h
+#ifndef OPCDA_DISCOVERY_CACHE_H
+#define OPCDA_DISCOVERY_CACHE_H
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opcda_client.h"
+
+using namespace std;
+
+constexpr int DEFAULT_DISCOVERY_CACHE_TTL_S = 3600;
+
+// a fresh entry older than this share of the TTL is refreshed in the background
+constexpr double DISCOVERY_REFRESH_AHEAD = 0.8;
+
+/**
+ * @brief Per-host discovery results persisted between CLI runs.
+ *
+ * Each host keeps its ProgID <-> CLSID pairs, descriptions and availability
+ * with the time they were enumerated. Entries younger than the TTL are served
+ * without DCOM; older ones are still used to connect, but trigger a refresh on
+ * a background thread which is joined (and the file saved) on destruction.
+ * Callers must have COM initialised on the calling thread.
+ */
+class DiscoveryCache
+{
+public:
+  explicit DiscoveryCache( const string& file = default_path() );
+  ~DiscoveryCache();
+
+  void set_ttl( chrono::seconds ttl );
+
+  bool load();
+  bool save();
+
+  vector<OPCDA_CONNECT_INFO> discover( const string& host, bool refresh );
+  void put_host( const string& host, const vector<OPCDA_CONNECT_INFO>& servers );
+  void put_progid( const string& host, const wstring& progid, const CLSID& clsid );
+  bool find_progid( const string& host, const wstring& progid, CLSID& clsid );
+  void invalidate_host( const string& host );
+  void refresh_async( const string& host );
+
+  static string default_path();
+
+private:
+  struct HostEntry
+  {
+    long long updated_ms = 0;
+    vector<OPCDA_CONNECT_INFO> servers;
+  };
+
+  string m_file;
+  chrono::seconds m_ttl{ DEFAULT_DISCOVERY_CACHE_TTL_S };
+
+  mutex m_mutex;
+  map<string, HostEntry> m_hosts;
+  map<string, thread> m_refreshing;
+  set<string> m_refreshed;
+  bool m_dirty = false;
+
+  static string host_key( const string& host );
+  long long age_ms( const HostEntry& entry ) const;
+  bool is_fresh( const HostEntry& entry ) const;
+  void join_refreshes();
+  void reap_refreshes();
+};
+
+#endif
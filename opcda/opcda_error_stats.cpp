@@ -0,0 +1,362 @@
+// opcda_error_stats.cpp
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#include "logger.h"
+#include "opcda_error_stats.h"
+#include "opcda_metrics.h"
+#include "opcda_utf.h"
+
+using namespace std;
+
+static int64_t now_ms()
+{
+  return chrono::duration_cast<chrono::milliseconds>( chrono::system_clock::now().time_since_epoch() ).count();
+}
+
+static string code_to_hex( int32_t code )
+{
+  char buffer[16];
+  snprintf( buffer, sizeof( buffer ), "0x%08X", static_cast<unsigned>( code ) );
+  return buffer;
+}
+
+static string to_utf8( const wstring& text )
+{
+  string out;
+  OPCDA::UTILS::append_utf8( text.data(), text.size(), out );
+  return out;
+}
+
+ItemErrorStats& ItemErrorStats::instance()
+{
+  static ItemErrorStats stats;
+  return stats;
+}
+
+ItemErrorStats::~ItemErrorStats()
+{
+  stop_reporting();
+}
+
+uint64_t ItemErrorStats::code_key( const string& operation, int32_t code )
+{
+  return static_cast<uint64_t>( hash<string>()( operation ) ) * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>( code );
+}
+
+uint64_t ItemErrorStats::entry_key( uint64_t code_key, const wstring& item_id )
+{
+  return ( code_key ^ static_cast<uint64_t>( hash<wstring>()( item_id ) ) ) * 0x9E3779B97F4A7C15ull;
+}
+
+void ItemErrorStats::record( const string& operation, const wstring& item_id, uint32_t handle, int32_t code )
+{
+  uint64_t codes = code_key( operation, code );
+  uint64_t key = entry_key( codes, item_id );
+  SHARD& shard = m_shards[key % ERROR_STATS_SHARDS];
+
+  bool first = false;
+  bool overflow = false;
+  MetricCounter* counter = nullptr;
+
+  m_total.fetch_add( 1, memory_order_relaxed );
+
+  {
+    lock_guard<mutex> lock( shard.lock );
+
+    CODE_ENTRY& code_entry = shard.codes[codes];
+    if ( !code_entry.counter )
+    {
+      code_entry.operation = operation;
+      code_entry.code = code;
+      code_entry.counter = &MetricsRegistry::instance().counter( "opcda_item_errors_total", "operation=\"" + operation + "\",code=\"" + code_to_hex( code ) + "\"", "Failed items by operation and result code" );
+    }
+    ++code_entry.count;
+    counter = code_entry.counter;
+
+    auto it = shard.entries.find( key );
+
+    if ( it != shard.entries.end() && it->second.stat.code == code && it->second.stat.item_id == item_id && it->second.stat.operation == operation )
+    {
+      ITEM_ERROR_STAT& stat = it->second.stat;
+      ++stat.count;
+      stat.handle = handle;
+      stat.last_seen_ms = now_ms();
+    }
+    else if ( it == shard.entries.end() && m_entry_count.load( memory_order_relaxed ) < m_max_tags.load( memory_order_relaxed ) )
+    {
+      int64_t now = now_ms();
+      ENTRY& entry = shard.entries[key];
+      entry.stat.operation = operation;
+      entry.stat.item_id = item_id;
+      entry.stat.handle = handle;
+      entry.stat.code = code;
+      entry.stat.category = ErrorConverter::getInstance().fromOpcDaResult( code ).getCategory();
+      entry.stat.count = 1;
+      entry.stat.first_seen_ms = now;
+      entry.stat.last_seen_ms = now;
+      m_entry_count.fetch_add( 1, memory_order_relaxed );
+
+      ++code_entry.tags;
+      if ( code_entry.example_item_id.empty() )
+      {
+        code_entry.example_item_id = item_id;
+      }
+      first = true;
+    }
+    else
+    {
+      // over the limit, or a key collision with another item: counted per code only
+      ++code_entry.overflow;
+      overflow = !m_overflowed.exchange( true );
+    }
+  }
+
+  counter->add();
+
+  if ( first )
+  {
+    Logger::instance().logWarning( "[errors] " + operation + " '" + to_utf8( item_id ) + "': " + ErrorConverter::getInstance().fromOpcDaResult( code, code_to_hex( code ), operation ).toString( false ) );
+  }
+  else if ( overflow )
+  {
+    Logger::instance().logWarning( "[errors] More than " + to_string( m_max_tags.load() ) + " failing items, failures of further items are only counted per code" );
+  }
+}
+
+vector<ITEM_ERROR_STAT> ItemErrorStats::snapshot() const
+{
+  vector<ITEM_ERROR_STAT> stats;
+  stats.reserve( m_entry_count.load( memory_order_relaxed ) );
+
+  for ( const auto& shard : m_shards )
+  {
+    lock_guard<mutex> lock( shard.lock );
+    for ( const auto& entry : shard.entries )
+    {
+      stats.push_back( entry.second.stat );
+    }
+  }
+
+  sort( stats.begin(), stats.end(), []( const ITEM_ERROR_STAT& a, const ITEM_ERROR_STAT& b ) { return a.count > b.count; } );
+  return stats;
+}
+
+vector<ERROR_CODE_STAT> ItemErrorStats::by_code() const
+{
+  map<pair<string, int32_t>, ERROR_CODE_STAT> merged;
+
+  for ( const auto& shard : m_shards )
+  {
+    lock_guard<mutex> lock( shard.lock );
+    for ( const auto& entry : shard.codes )
+    {
+      const CODE_ENTRY& code = entry.second;
+      ERROR_CODE_STAT& stat = merged[make_pair( code.operation, code.code )];
+      stat.operation = code.operation;
+      stat.code = code.code;
+      stat.count += code.count;
+      stat.tags += code.tags;
+      if ( stat.example_item_id.empty() )
+      {
+        stat.example_item_id = code.example_item_id;
+      }
+    }
+  }
+
+  vector<ERROR_CODE_STAT> stats;
+  for ( auto& stat : merged )
+  {
+    if ( stat.second.count > 0 )
+    {
+      stats.push_back( move( stat.second ) );
+    }
+  }
+
+  sort( stats.begin(), stats.end(), []( const ERROR_CODE_STAT& a, const ERROR_CODE_STAT& b ) { return a.count > b.count; } );
+  return stats;
+}
+
+uint64_t ItemErrorStats::failures( const wstring& item_id ) const
+{
+  uint64_t count = 0;
+
+  for ( const auto& shard : m_shards )
+  {
+    lock_guard<mutex> lock( shard.lock );
+    for ( const auto& entry : shard.entries )
+    {
+      if ( entry.second.stat.item_id == item_id )
+      {
+        count += entry.second.stat.count;
+      }
+    }
+  }
+  return count;
+}
+
+uint64_t ItemErrorStats::total() const
+{
+  return m_total.load( memory_order_relaxed );
+}
+
+void ItemErrorStats::reset()
+{
+  for ( auto& shard : m_shards )
+  {
+    lock_guard<mutex> lock( shard.lock );
+
+    // the metric counters are monotonic and keep their totals
+    for ( auto& entry : shard.codes )
+    {
+      CODE_ENTRY& code = entry.second;
+      code.count = 0;
+      code.reported = 0;
+      code.tags = 0;
+      code.overflow = 0;
+      code.example_item_id.clear();
+    }
+    shard.entries.clear();
+  }
+
+  m_entry_count = 0;
+  m_total = 0;
+  m_overflowed = false;
+}
+
+void ItemErrorStats::set_max_tags( size_t max_tags )
+{
+  m_max_tags = max<size_t>( max_tags, 1 );
+}
+
+string ItemErrorStats::summary( size_t top )
+{
+  struct DELTA
+  {
+    int32_t code;
+    uint64_t count;
+    uint64_t tags;
+    wstring example_item_id;
+  };
+
+  map<pair<string, int32_t>, DELTA> merged;
+
+  for ( auto& shard : m_shards )
+  {
+    lock_guard<mutex> lock( shard.lock );
+
+    for ( auto& entry : shard.codes )
+    {
+      CODE_ENTRY& code = entry.second;
+      if ( code.count > code.reported )
+      {
+        DELTA& delta = merged.emplace( make_pair( code.operation, code.code ), DELTA { code.code, 0, 0, wstring() } ).first->second;
+        delta.count += code.count - code.reported;
+        delta.tags += code.tags;
+        if ( delta.example_item_id.empty() )
+        {
+          delta.example_item_id = code.example_item_id;
+        }
+        code.reported = code.count;
+      }
+    }
+  }
+
+  map<string, vector<DELTA>> changes;
+  for ( auto& delta : merged )
+  {
+    changes[delta.first.first].push_back( move( delta.second ) );
+  }
+
+  string out;
+  for ( auto& change : changes )
+  {
+    vector<DELTA>& deltas = change.second;
+    sort( deltas.begin(), deltas.end(), []( const DELTA& a, const DELTA& b ) { return a.count > b.count; } );
+
+    uint64_t count = 0;
+    for ( const auto& delta : deltas )
+    {
+      count += delta.count;
+    }
+
+    string line = "[errors] " + change.first + ": " + to_string( count ) + " failures since the last report";
+    for ( size_t i = 0; i < deltas.size() && i < top; ++i )
+    {
+      const DELTA& delta = deltas[i];
+      UnifiedError error = ErrorConverter::getInstance().fromOpcDaResult( delta.code );
+
+      line += i == 0 ? ", " : "; ";
+      line += code_to_hex( delta.code ) + " " + error.getErrorMessage() + " x" + to_string( delta.count ) + " on " + to_string( delta.tags ) + " tags";
+      if ( !delta.example_item_id.empty() )
+      {
+        line += " (e.g. '" + to_utf8( delta.example_item_id ) + "')";
+      }
+    }
+    if ( deltas.size() > top )
+    {
+      line += "; " + to_string( deltas.size() - top ) + " more codes";
+    }
+    out += line + "\n";
+  }
+  return out;
+}
+
+void ItemErrorStats::report()
+{
+  string text = summary();
+  size_t start = 0;
+  size_t end;
+
+  while ( ( end = text.find( '\n', start ) ) != string::npos )
+  {
+    Logger::instance().logWarning( text.substr( start, end - start ) );
+    start = end + 1;
+  }
+}
+
+void ItemErrorStats::start_reporting( int interval_ms )
+{
+  stop_reporting();
+
+  lock_guard<mutex> lock( m_report_lock );
+  m_reporting = true;
+  m_report_thread = thread( &ItemErrorStats::report_loop, this, max( interval_ms, 1000 ) );
+}
+
+void ItemErrorStats::stop_reporting()
+{
+  {
+    lock_guard<mutex> lock( m_report_lock );
+    if ( !m_reporting )
+    {
+      return;
+    }
+    m_reporting = false;
+  }
+
+  m_report_wake.notify_all();
+  if ( m_report_thread.joinable() )
+  {
+    m_report_thread.join();
+  }
+  report();
+}
+
+void ItemErrorStats::report_loop( int interval_ms )
+{
+  unique_lock<mutex> lock( m_report_lock );
+
+  while ( m_reporting )
+  {
+    if ( m_report_wake.wait_for( lock, chrono::milliseconds( interval_ms ), [&]() { return !m_reporting; } ) )
+    {
+      break;
+    }
+
+    lock.unlock();
+    report();
+    lock.lock();
+  }
+}
@@ -0,0 +1,141 @@
+// opcda_error_stats.h
+#ifndef OPCDA_ERROR_STATS_H
+#define OPCDA_ERROR_STATS_H
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "libs/includes/unified_errors/unified_errors.h"
+
+using namespace std;
+
+class MetricCounter;
+
+constexpr int DEFAULT_ERROR_REPORT_MS = 60000;
+constexpr size_t DEFAULT_ERROR_STATS_MAX_TAGS = 100000;
+constexpr size_t DEFAULT_ERROR_REPORT_TOP = 5;
+constexpr size_t ERROR_STATS_SHARDS = 16;
+
+/** @brief Failures of one item with one result code. */
+struct ITEM_ERROR_STAT
+{
+  string operation;
+  wstring item_id;
+  uint32_t handle = 0;
+  int32_t code = 0;
+  U_ErrorCategory category = U_ErrorCategory::NONE;
+  uint64_t count = 0;
+  int64_t first_seen_ms = 0;
+  int64_t last_seen_ms = 0;
+};
+
+/** @brief Failures of one operation with one result code, over every item. */
+struct ERROR_CODE_STAT
+{
+  string operation;
+  int32_t code = 0;
+  uint64_t count = 0;
+  uint64_t tags = 0;
+  wstring example_item_id;
+};
+
+/**
+ * @brief Per item error counters for the read and property paths.
+ *
+ * Replaces a console line per failed item and poll: each (item, code) pair
+ * is logged once, through ErrorConverter, when it is first seen, and after
+ * that only counted. report() logs what changed since the previous report,
+ * grouped by code, so a few hundred bad tags cost one summary per interval.
+ *
+ * Entries are keyed by a hash of operation, item ID and code, computed on the
+ * caller's wide string without converting or copying it. Handles are not
+ * usable as the key: they are per client (the connection manager runs many)
+ * and server handles are reassigned on reconnect; the last one is kept for
+ * reference. The entries are spread over ERROR_STATS_SHARDS independently
+ * locked shards, so a poll with many bad tags does not serialize on one lock.
+ * The item ID is copied once when an entry is created and converted to UTF-8
+ * only when it is logged. Past max_tags entries new items are only counted per
+ * code. Thread-safe.
+ */
+class ItemErrorStats
+{
+public:
+  static ItemErrorStats& instance();
+
+  void record( const string& operation, const wstring& item_id, uint32_t handle, int32_t code );
+
+  vector<ITEM_ERROR_STAT> snapshot() const;
+  /** @brief Failure counts grouped by operation and code, largest first. */
+  vector<ERROR_CODE_STAT> by_code() const;
+  /** @brief Failures of one item over every operation and code. */
+  uint64_t failures( const wstring& item_id ) const;
+  uint64_t total() const;
+  void reset();
+
+  void set_max_tags( size_t max_tags );
+
+  /** @brief Changes since the previous call, one line per operation, empty when nothing failed. */
+  string summary( size_t top = DEFAULT_ERROR_REPORT_TOP );
+  void report();
+
+  void start_reporting( int interval_ms = DEFAULT_ERROR_REPORT_MS );
+  /** @brief Stops the report thread after one last report. */
+  void stop_reporting();
+
+private:
+  ItemErrorStats() = default;
+  ~ItemErrorStats();
+  ItemErrorStats( const ItemErrorStats& ) = delete;
+  ItemErrorStats& operator=( const ItemErrorStats& ) = delete;
+
+  struct ENTRY
+  {
+    ITEM_ERROR_STAT stat;
+    uint64_t reported = 0;
+  };
+
+  struct CODE_ENTRY
+  {
+    string operation;
+    int32_t code = 0;
+    uint64_t count = 0;
+    uint64_t reported = 0;
+    uint64_t tags = 0;
+    uint64_t overflow = 0;
+    wstring example_item_id;
+    MetricCounter* counter = nullptr;
+  };
+
+  // entries land in the shard of their key; each shard counts its own codes, merged when read
+  struct SHARD
+  {
+    mutable mutex lock;
+    unordered_map<uint64_t, ENTRY> entries;
+    unordered_map<uint64_t, CODE_ENTRY> codes;
+  };
+
+  array<SHARD, ERROR_STATS_SHARDS> m_shards;
+  atomic<size_t> m_entry_count{ 0 };
+  atomic<size_t> m_max_tags{ DEFAULT_ERROR_STATS_MAX_TAGS };
+  atomic<uint64_t> m_total{ 0 };
+  atomic<bool> m_overflowed{ false };
+
+  mutex m_report_lock;
+  condition_variable m_report_wake;
+  thread m_report_thread;
+  bool m_reporting = false;
+
+  static uint64_t code_key( const string& operation, int32_t code );
+  static uint64_t entry_key( uint64_t code_key, const wstring& item_id );
+  void report_loop( int interval_ms );
+};
+
+#endif
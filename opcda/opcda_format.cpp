@@ -0,0 +1,171 @@
+// opcda_format.cpp
+#include <charconv>
+#include <cmath>
+
+#include "opcda_format.h"
+#include "opcda_sample.h"
+
+using namespace std;
+
+namespace OPCDA::UTILS
+{
+  static const int64_t TICKS_PER_SECOND = 10000000LL;
+  static const int64_t SECONDS_PER_DAY = 86400LL;
+
+  // 2^53: every integral double below this converts to int64_t exactly
+  static const double EXACT_INTEGER_LIMIT = 9007199254740992.0;
+
+  static char* put_digits( char* first, char* last, int value, int width )
+  {
+    if ( last - first < width )
+    {
+      return nullptr;
+    }
+
+    unsigned digits = static_cast<unsigned>( value < 0 ? 0 : value );
+
+    for ( char* p = first + width - 1; p >= first; --p )
+    {
+      *p = static_cast<char>( '0' + digits % 10 );
+      digits /= 10;
+    }
+
+    return first + width;
+  }
+
+  static char* put_int( char* first, char* last, int64_t value )
+  {
+    auto r = to_chars( first, last, value );
+    return r.ec == errc() ? r.ptr : nullptr;
+  }
+
+  static char* put_char( char* first, char* last, char c )
+  {
+    if ( !first || first == last )
+    {
+      return nullptr;
+    }
+
+    *first = c;
+    return first + 1;
+  }
+
+  /**
+   * @brief Days since 1970-01-01 to a proleptic Gregorian date (H. Hinnant's civil_from_days).
+   */
+  static void civil_from_days( int64_t days, int& year, int& month, int& day )
+  {
+    days += 719468;
+    int64_t era = ( days >= 0 ? days : days - 146096 ) / 146097;
+    unsigned doe = static_cast<unsigned>( days - era * 146097 );
+    unsigned yoe = ( doe - doe / 1460 + doe / 36524 - doe / 146096 ) / 365;
+    unsigned doy = doe - ( 365 * yoe + yoe / 4 - yoe / 100 );
+    unsigned mp = ( 5 * doy + 2 ) / 153;
+
+    day = static_cast<int>( doy - ( 153 * mp + 2 ) / 5 + 1 );
+    month = static_cast<int>( mp < 10 ? mp + 3 : mp - 9 );
+    year = static_cast<int>( static_cast<int64_t>( yoe ) + era * 400 + ( month <= 2 ? 1 : 0 ) );
+  }
+
+  /**
+   * @brief The helpers above chain on nullptr; the public functions hand back
+   *        first instead, so [first, result) is always a valid, maybe empty, range.
+   */
+  static char* written( char* first, char* end )
+  {
+    return end ? end : first;
+  }
+
+  static char* put_date_time( char* first, char* last, int year, int month, int day, int hour, int minute, int second, char separator )
+  {
+    char* p = year > 9999 ? put_int( first, last, year ) : put_digits( first, last, year, 4 );
+
+    p = put_char( p, last, '-' );
+    p = p ? put_digits( p, last, month, 2 ) : nullptr;
+    p = put_char( p, last, '-' );
+    p = p ? put_digits( p, last, day, 2 ) : nullptr;
+    p = put_char( p, last, separator );
+    p = p ? put_digits( p, last, hour, 2 ) : nullptr;
+    p = put_char( p, last, ':' );
+    p = p ? put_digits( p, last, minute, 2 ) : nullptr;
+    p = put_char( p, last, ':' );
+    return p ? put_digits( p, last, second, 2 ) : nullptr;
+  }
+
+  char* format_int( char* first, char* last, int64_t value )
+  {
+    return written( first, put_int( first, last, value ) );
+  }
+
+  char* format_uint( char* first, char* last, uint64_t value )
+  {
+    auto r = to_chars( first, last, value );
+    return r.ec == errc() ? r.ptr : first;
+  }
+
+  char* format_double( char* first, char* last, double value )
+  {
+    if ( value == floor( value ) && fabs( value ) < EXACT_INTEGER_LIMIT && !( value == 0.0 && signbit( value ) ) )
+    {
+      return format_int( first, last, static_cast<int64_t>( value ) );
+    }
+
+    auto r = to_chars( first, last, value );
+    return r.ec == errc() ? r.ptr : first;
+  }
+
+  char* format_float( char* first, char* last, float value )
+  {
+    auto r = to_chars( first, last, value );
+    return r.ec == errc() ? r.ptr : first;
+  }
+
+  char* format_date_time( char* first, char* last, int year, int month, int day, int hour, int minute, int second, char separator )
+  {
+    return written( first, put_date_time( first, last, year, month, day, hour, minute, second, separator ) );
+  }
+
+  char* format_iso8601( char* first, char* last, int year, int month, int day, int hour, int minute, int second, int millisecond )
+  {
+    char* p = put_date_time( first, last, year, month, day, hour, minute, second, 'T' );
+
+    p = put_char( p, last, '.' );
+    p = p ? put_digits( p, last, millisecond, 3 ) : nullptr;
+    return written( first, put_char( p, last, 'Z' ) );
+  }
+
+  char* format_iso8601( char* first, char* last, int64_t ticks )
+  {
+    int64_t since_epoch = ticks - FILETIME_UNIX_EPOCH_TICKS;
+    int64_t seconds = since_epoch / TICKS_PER_SECOND;
+    int64_t fraction = since_epoch % TICKS_PER_SECOND;
+
+    if ( fraction < 0 )
+    {
+      fraction += TICKS_PER_SECOND;
+      --seconds;
+    }
+
+    int64_t days = seconds / SECONDS_PER_DAY;
+    int64_t second_of_day = seconds % SECONDS_PER_DAY;
+
+    if ( second_of_day < 0 )
+    {
+      second_of_day += SECONDS_PER_DAY;
+      --days;
+    }
+
+    int year;
+    int month;
+    int day;
+    civil_from_days( days, year, month, day );
+
+    return format_iso8601( first, last, year, month, day, static_cast<int>( second_of_day / 3600 ), static_cast<int>( second_of_day / 60 % 60 ), static_cast<int>( second_of_day % 60 ), static_cast<int>( fraction / FILETIME_TICKS_PER_MS ) );
+  }
+
+  char* format_epoch_ms( char* first, char* last, int64_t ticks )
+  {
+    return format_int( first, last, ticks_to_epoch_ms( ticks ) );
+  }
+
+} // namespace OPCDA::UTILS
@@ -0,0 +1,33 @@
+// opcda_format.h
+#ifndef OPCDA_FORMAT_H
+#define OPCDA_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Locale-independent number and time formatting into caller buffers.
+ *
+ * Every function writes into [first, last) without a terminating NUL and
+ * returns one past the last character written, or first when the buffer is
+ * too small, so string( first, result ) is always safe. Doubles use the shortest representation that round-trips.
+ * Timestamps are FILETIME ticks (100 ns since 1601-01-01 UTC).
+ */
+namespace OPCDA::UTILS
+{
+  constexpr size_t FORMAT_NUMBER_CHARS = 32;
+  constexpr size_t FORMAT_TIME_CHARS = 32;
+
+  char* format_int( char* first, char* last, int64_t value );
+  char* format_uint( char* first, char* last, uint64_t value );
+  char* format_double( char* first, char* last, double value );
+  char* format_float( char* first, char* last, float value );
+
+  char* format_date_time( char* first, char* last, int year, int month, int day, int hour, int minute, int second, char separator );
+  char* format_iso8601( char* first, char* last, int year, int month, int day, int hour, int minute, int second, int millisecond );
+  char* format_iso8601( char* first, char* last, int64_t ticks );
+  char* format_epoch_ms( char* first, char* last, int64_t ticks );
+
+} // namespace OPCDA::UTILS
+
+#endif
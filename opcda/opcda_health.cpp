@@ -0,0 +1,339 @@
+// opcda_health.cpp
+#define NOMINMAX
+#include <algorithm>
+#include <sstream>
+#include <windows.h>
+
+#include "logger.h"
+#include "opcda_client.h"
+#include "opcda_health.h"
+#include "opcda_metrics.h"
+#include "opcda_utils.h"
+
+using namespace std;
+
+// probes share the client's GetStatus series, see --metrics
+static CallMetrics s_get_status_call( "GetStatus" );
+
+static long long now_epochtime()
+{
+  return chrono::duration_cast<chrono::milliseconds>( chrono::system_clock::now().time_since_epoch() ).count();
+}
+
+static long long filetime_diff_ms( const FILETIME& later, const FILETIME& earlier )
+{
+  ULARGE_INTEGER a, b;
+  a.LowPart = later.dwLowDateTime;
+  a.HighPart = later.dwHighDateTime;
+  b.LowPart = earlier.dwLowDateTime;
+  b.HighPart = earlier.dwHighDateTime;
+
+  if ( b.QuadPart == 0 || a.QuadPart < b.QuadPart )
+  {
+    return 0;
+  }
+
+  return static_cast<long long>( ( a.QuadPart - b.QuadPart ) / 10000 );
+}
+
+HealthMonitor::HealthMonitor()
+{
+}
+
+HealthMonitor::~HealthMonitor()
+{
+  stop();
+}
+
+void HealthMonitor::set_interval( int interval_ms )
+{
+  m_interval_ms = max( interval_ms, 10 );
+}
+
+void HealthMonitor::set_stall_timeout( int timeout_ms )
+{
+  m_stall_ms = max( timeout_ms, 10 );
+}
+
+size_t HealthMonitor::subscribe( const SampleCallback& on_sample, const RunningCallback& on_running )
+{
+  lock_guard<mutex> lock( m_subscriber_lock );
+
+  SUBSCRIBER subscriber;
+  subscriber.id = m_next_id++;
+  subscriber.on_sample = on_sample;
+  subscriber.on_running = on_running;
+  m_subscribers.push_back( subscriber );
+
+  return subscriber.id;
+}
+
+void HealthMonitor::unsubscribe( size_t id )
+{
+  lock_guard<mutex> lock( m_subscriber_lock );
+  m_subscribers.erase( remove_if( m_subscribers.begin(), m_subscribers.end(), [id]( const SUBSCRIBER& s ) { return s.id == id; } ), m_subscribers.end() );
+}
+
+bool HealthMonitor::start( const string& host, const CLSID& clsid )
+{
+  if ( m_poller.joinable() || IsEqualCLSID( clsid, CLSID_NULL ) )
+  {
+    return false;
+  }
+
+  m_host = host;
+  m_clsid = clsid;
+  m_stopping = false;
+
+  m_poller = thread( &HealthMonitor::poll_loop, this );
+  m_watchdog = thread( &HealthMonitor::watchdog_loop, this );
+  return true;
+}
+
+void HealthMonitor::stop()
+{
+  DWORD poll_thread = 0;
+  bool in_call = false;
+  {
+    lock_guard<mutex> lock( m_lock );
+    m_stopping = true;
+    poll_thread = m_poll_thread;
+    in_call = m_in_call;
+    m_wake.notify_all();
+  }
+
+  if ( in_call && poll_thread != 0 )
+  {
+    CoCancelCall( poll_thread, 0 );
+  }
+
+  if ( m_watchdog.joinable() )
+  {
+    m_watchdog.join();
+  }
+
+  if ( m_poller.joinable() )
+  {
+    m_poller.join();
+  }
+}
+
+bool HealthMonitor::latest( OPCDA_HEALTH_SAMPLE& sample ) const
+{
+  lock_guard<mutex> lock( m_sample_lock );
+  sample = m_latest;
+  return m_has_sample;
+}
+
+void HealthMonitor::begin_call()
+{
+  lock_guard<mutex> lock( m_lock );
+  m_in_call = true;
+  ++m_call_seq;
+  m_call_started = chrono::steady_clock::now();
+  m_wake.notify_all();
+}
+
+void HealthMonitor::end_call()
+{
+  lock_guard<mutex> lock( m_lock );
+  m_in_call = false;
+  m_wake.notify_all();
+}
+
+HRESULT HealthMonitor::open( CComPtr<IOPCServer>& server )
+{
+  COSERVERINFO server_info = { 0 };
+  wstring w_host = OPCDA::UTILS::str_to_wstr( m_host );
+  server_info.pwszName = const_cast<LPWSTR>( w_host.c_str() );
+
+  MULTI_QI mq[1] = {};
+  mq[0].pIID = &IID_IOPCServer;
+
+  begin_call();
+  HRESULT hr = CoCreateInstanceEx( m_clsid, NULL, CLSCTX_LOCAL_SERVER | CLSCTX_REMOTE_SERVER, m_host.empty() ? NULL : &server_info, 1, mq );
+  end_call();
+
+  if ( FAILED( hr ) || FAILED( mq[0].hr ) || !mq[0].pItf )
+  {
+    return FAILED( hr ) ? hr : ( FAILED( mq[0].hr ) ? mq[0].hr : E_NOINTERFACE );
+  }
+
+  server.Attach( reinterpret_cast<IOPCServer*>( mq[0].pItf ) );
+  return S_OK;
+}
+
+OPCDA_HEALTH_SAMPLE HealthMonitor::sample( IOPCServer* server )
+{
+  OPCDA_HEALTH_SAMPLE result;
+  result.sampled_epochtime = now_epochtime();
+
+  OPCSERVERSTATUS* status = nullptr;
+
+  begin_call();
+  auto started = chrono::steady_clock::now();
+  HRESULT hr = s_get_status_call.measure( [&]() { return server->GetStatus( &status ); } );
+  result.rtt_us = chrono::duration_cast<chrono::microseconds>( chrono::steady_clock::now() - started ).count();
+  end_call();
+
+  result.error = hr == RPC_E_CALL_CANCELED ? RPC_E_TIMEOUT : hr;
+
+  if ( status )
+  {
+    if ( SUCCEEDED( hr ) )
+    {
+      result.state = status->dwServerState;
+      result.running = status->dwServerState == OPC_STATUS_RUNNING;
+      result.group_count = OPCDA::UTILS::dword_to_int( status->dwGroupCount );
+      result.server_epochtime = OPCDA::UTILS::filetime_to_epochtime( status->ftCurrentTime );
+      result.update_lag_ms = filetime_diff_ms( status->ftCurrentTime, status->ftLastUpdateTime );
+    }
+
+    CoTaskMemFree( status->szVendorInfo );
+    CoTaskMemFree( status );
+  }
+
+  return result;
+}
+
+void HealthMonitor::publish( OPCDA_HEALTH_SAMPLE& sample )
+{
+  {
+    lock_guard<mutex> lock( m_sample_lock );
+
+    // subscribers assume a running server until told otherwise
+    bool was_running = m_has_sample ? m_latest.running : true;
+    sample.state_changed = was_running != sample.running;
+
+    m_latest = sample;
+    m_has_sample = true;
+  }
+
+  if ( sample.state_changed )
+  {
+    ostringstream oss;
+    oss << "[health] Server " << ( sample.running ? "running" : "not running" ) << " (" << OPCDA::UTILS::server_state_to_str( sample.state ) << ", 0x" << hex << static_cast<unsigned long>( sample.error ) << ")";
+
+    if ( sample.running )
+    {
+      Logger::instance().logInfo( oss.str() );
+    }
+    else
+    {
+      Logger::instance().logWarning( oss.str() );
+    }
+  }
+
+  vector<SUBSCRIBER> subscribers;
+  {
+    lock_guard<mutex> lock( m_subscriber_lock );
+    subscribers = m_subscribers;
+  }
+
+  for ( const auto& subscriber : subscribers )
+  {
+    if ( subscriber.on_sample )
+    {
+      subscriber.on_sample( sample );
+    }
+
+    if ( sample.state_changed && subscriber.on_running )
+    {
+      subscriber.on_running( sample.running, sample );
+    }
+  }
+}
+
+void HealthMonitor::poll_loop()
+{
+  HRESULT init = CoInitializeEx( NULL, COINIT_MULTITHREADED );
+
+  if ( FAILED( init ) )
+  {
+    Logger::instance().logError( "[health] Poll thread failed to enter the MTA" );
+    return;
+  }
+
+  CoEnableCallCancellation( NULL );
+  {
+    lock_guard<mutex> lock( m_lock );
+    m_poll_thread = GetCurrentThreadId();
+  }
+
+  CComPtr<IOPCServer> server;
+
+  while ( !m_stopping )
+  {
+    auto next_tick = chrono::steady_clock::now() + chrono::milliseconds( m_interval_ms );
+    OPCDA_HEALTH_SAMPLE result;
+
+    HRESULT hr = server ? S_OK : open( server );
+
+    if ( SUCCEEDED( hr ) )
+    {
+      result = sample( server );
+    }
+    else
+    {
+      result.sampled_epochtime = now_epochtime();
+      result.error = hr == RPC_E_CALL_CANCELED ? RPC_E_TIMEOUT : hr;
+    }
+
+    // a failed call leaves the proxy in doubt, the next tick connects again
+    if ( FAILED( result.error ) )
+    {
+      server.Release();
+    }
+
+    if ( !m_stopping )
+    {
+      publish( result );
+    }
+
+    unique_lock<mutex> lock( m_lock );
+    m_wake.wait_until( lock, next_tick, [this]() { return m_stopping.load(); } );
+  }
+
+  server.Release();
+
+  {
+    lock_guard<mutex> lock( m_lock );
+    m_poll_thread = 0;
+  }
+
+  CoDisableCallCancellation( NULL );
+  CoUninitialize();
+}
+
+void HealthMonitor::watchdog_loop()
+{
+  unique_lock<mutex> lock( m_lock );
+
+  while ( !m_stopping )
+  {
+    if ( !m_in_call )
+    {
+      m_wake.wait( lock, [this]() { return m_stopping || m_in_call; } );
+      continue;
+    }
+
+    unsigned seq = m_call_seq;
+    auto deadline = m_call_started + chrono::milliseconds( m_stall_ms );
+
+    if ( m_wake.wait_until( lock, deadline, [&]() { return m_stopping || !m_in_call || m_call_seq != seq; } ) )
+    {
+      continue;
+    }
+
+    DWORD poll_thread = m_poll_thread;
+    lock.unlock();
+
+    if ( poll_thread != 0 )
+    {
+      CoCancelCall( poll_thread, 0 );
+    }
+
+    lock.lock();
+    m_wake.wait( lock, [&]() { return m_stopping || !m_in_call || m_call_seq != seq; } );
+  }
+}
@@ -0,0 +1,106 @@
+// opcda_health.h
+#ifndef OPCDA_HEALTH_H
+#define OPCDA_HEALTH_H
+
+#include <atlbase.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <opcda.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+constexpr int DEFAULT_HEALTH_INTERVAL_MS = 1000;
+constexpr int DEFAULT_HEALTH_STALL_MS = 3000;
+
+struct OPCDA_HEALTH_SAMPLE
+{
+  long long sampled_epochtime = 0;
+  HRESULT error = S_OK;
+  long long rtt_us = 0;
+  DWORD state = 0;
+  bool running = false;
+  bool state_changed = false;
+  int group_count = 0;
+  long long server_epochtime = 0;
+  long long update_lag_ms = 0; // server time minus ftLastUpdateTime, 0 if the server never set it
+};
+
+/**
+ * @brief Polls IOPCServer::GetStatus on a dedicated MTA thread and connection.
+ *
+ * The monitor never shares proxies with the OpcDaClient it watches, so a busy or
+ * blocked client cannot delay a sample. A GetStatus call still pending after the
+ * stall timeout is cancelled with CoCancelCall and reported as RPC_E_TIMEOUT;
+ * the monitor then drops its connection and opens a fresh one on the next tick.
+ * Subscribers run on the poll thread, one sample at a time; the running
+ * callback fires only when the server enters or leaves OPC_STATUS_RUNNING.
+ */
+class HealthMonitor
+{
+public:
+  using SampleCallback = function<void( const OPCDA_HEALTH_SAMPLE& )>;
+  using RunningCallback = function<void( bool, const OPCDA_HEALTH_SAMPLE& )>;
+
+  HealthMonitor();
+  ~HealthMonitor();
+
+  void set_interval( int interval_ms );
+  void set_stall_timeout( int timeout_ms );
+
+  size_t subscribe( const SampleCallback& on_sample, const RunningCallback& on_running = nullptr );
+  void unsubscribe( size_t id );
+
+  bool start( const string& host, const CLSID& clsid );
+  void stop();
+
+  bool latest( OPCDA_HEALTH_SAMPLE& sample ) const;
+
+private:
+  struct SUBSCRIBER
+  {
+    size_t id = 0;
+    SampleCallback on_sample;
+    RunningCallback on_running;
+  };
+
+  string m_host;
+  CLSID m_clsid = CLSID_NULL;
+  int m_interval_ms = DEFAULT_HEALTH_INTERVAL_MS;
+  int m_stall_ms = DEFAULT_HEALTH_STALL_MS;
+
+  thread m_poller;
+  thread m_watchdog;
+  atomic<bool> m_stopping{ false };
+
+  // poll thread and watchdog meet here around every blocking COM call
+  mutable mutex m_lock;
+  condition_variable m_wake;
+  DWORD m_poll_thread = 0;
+  bool m_in_call = false;
+  unsigned m_call_seq = 0;
+  chrono::steady_clock::time_point m_call_started;
+
+  mutable mutex m_sample_lock;
+  OPCDA_HEALTH_SAMPLE m_latest;
+  bool m_has_sample = false;
+
+  mutex m_subscriber_lock;
+  vector<SUBSCRIBER> m_subscribers;
+  size_t m_next_id = 1;
+
+  void poll_loop();
+  void watchdog_loop();
+  HRESULT open( CComPtr<IOPCServer>& server );
+  OPCDA_HEALTH_SAMPLE sample( IOPCServer* server );
+  void publish( OPCDA_HEALTH_SAMPLE& sample );
+  void begin_call();
+  void end_call();
+};
+
+#endif
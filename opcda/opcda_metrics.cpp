@@ -0,0 +1,452 @@
+// opcda_metrics.cpp
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "logger.h"
+#include "opcda_metrics.h"
+
+using namespace std;
+
+namespace
+{
+  // Prometheus le bounds in microseconds, 1-2-5 steps from 10 us to 100 s
+  const vector<int64_t>& export_bounds()
+  {
+    static const vector<int64_t> bounds = []()
+    {
+      vector<int64_t> b;
+      for ( int64_t decade = 10; decade <= 100000000; decade *= 10 )
+      {
+        b.push_back( decade );
+        if ( decade < 100000000 )
+        {
+          b.push_back( decade * 2 );
+          b.push_back( decade * 5 );
+        }
+      }
+      return b;
+    }();
+    return bounds;
+  }
+
+  size_t shard_index()
+  {
+    static atomic<size_t> next { 0 };
+    thread_local size_t index = next.fetch_add( 1, memory_order_relaxed ) % METRICS_SHARDS;
+    return index;
+  }
+
+  int highest_bit( uint64_t v )
+  {
+#ifdef _MSC_VER
+    unsigned long index = 0;
+    _BitScanReverse64( &index, v );
+    return static_cast<int>( index );
+#else
+    return 63 - __builtin_clzll( v );
+#endif
+  }
+
+  string seconds( int64_t micros )
+  {
+    char buffer[32];
+    snprintf( buffer, sizeof( buffer ), "%g", micros / 1e6 );
+    return buffer;
+  }
+
+  string series( const string& name, const string& labels, const string& extra = "" )
+  {
+    if ( labels.empty() && extra.empty() )
+    {
+      return name;
+    }
+    if ( labels.empty() || extra.empty() )
+    {
+      return name + "{" + labels + extra + "}";
+    }
+    return name + "{" + labels + "," + extra + "}";
+  }
+} // namespace
+
+void MetricCounter::add( int64_t delta )
+{
+  m_cells[shard_index()].value.fetch_add( delta, memory_order_relaxed );
+}
+
+int64_t MetricCounter::value() const
+{
+  int64_t total = 0;
+  for ( const auto& cell : m_cells )
+  {
+    total += cell.value.load( memory_order_relaxed );
+  }
+  return total;
+}
+
+void MetricGauge::set( int64_t value )
+{
+  m_value.store( value, memory_order_relaxed );
+}
+
+void MetricGauge::add( int64_t delta )
+{
+  m_value.fetch_add( delta, memory_order_relaxed );
+}
+
+int64_t MetricGauge::value() const
+{
+  return m_value.load( memory_order_relaxed );
+}
+
+MetricHistogram::MetricHistogram()
+{
+  for ( auto& shard : m_shards )
+  {
+    shard.buckets.reset( new atomic<int64_t>[METRICS_BUCKETS] );
+    for ( size_t i = 0; i < METRICS_BUCKETS; ++i )
+    {
+      shard.buckets[i].store( 0, memory_order_relaxed );
+    }
+  }
+}
+
+size_t MetricHistogram::bucket_of( int64_t micros )
+{
+  constexpr int64_t sub_buckets = int64_t( 1 ) << METRICS_SUB_BUCKET_BITS;
+
+  if ( micros < sub_buckets )
+  {
+    return static_cast<size_t>( max<int64_t>( micros, 0 ) );
+  }
+
+  int shift = highest_bit( static_cast<uint64_t>( micros ) ) - METRICS_SUB_BUCKET_BITS;
+  if ( shift >= METRICS_MAX_EXPONENT )
+  {
+    return METRICS_BUCKETS - 1;
+  }
+
+  // (shift + 1) selects the power of two, the next 4 bits below the top one the step within it
+  return ( static_cast<size_t>( shift + 1 ) << METRICS_SUB_BUCKET_BITS ) + static_cast<size_t>( ( micros >> shift ) - sub_buckets );
+}
+
+int64_t MetricHistogram::bucket_upper( size_t bucket )
+{
+  constexpr int64_t sub_buckets = int64_t( 1 ) << METRICS_SUB_BUCKET_BITS;
+
+  if ( bucket < static_cast<size_t>( sub_buckets ) )
+  {
+    return static_cast<int64_t>( bucket );
+  }
+
+  int shift = static_cast<int>( bucket >> METRICS_SUB_BUCKET_BITS ) - 1;
+  int64_t step = static_cast<int64_t>( bucket & ( sub_buckets - 1 ) ) + sub_buckets;
+  return ( ( step + 1 ) << shift ) - 1;
+}
+
+void MetricHistogram::record( int64_t micros )
+{
+  SHARD& shard = m_shards[shard_index()];
+  shard.buckets[bucket_of( micros )].fetch_add( 1, memory_order_relaxed );
+  shard.count.value.fetch_add( 1, memory_order_relaxed );
+  shard.sum.value.fetch_add( max<int64_t>( micros, 0 ), memory_order_relaxed );
+}
+
+void MetricHistogram::record( chrono::steady_clock::duration elapsed )
+{
+  record( static_cast<int64_t>( chrono::duration_cast<chrono::microseconds>( elapsed ).count() ) );
+}
+
+int64_t MetricHistogram::count() const
+{
+  int64_t total = 0;
+  for ( const auto& shard : m_shards )
+  {
+    total += shard.count.value.load( memory_order_relaxed );
+  }
+  return total;
+}
+
+int64_t MetricHistogram::sum_micros() const
+{
+  int64_t total = 0;
+  for ( const auto& shard : m_shards )
+  {
+    total += shard.sum.value.load( memory_order_relaxed );
+  }
+  return total;
+}
+
+vector<int64_t> MetricHistogram::snapshot() const
+{
+  vector<int64_t> buckets( METRICS_BUCKETS, 0 );
+  for ( const auto& shard : m_shards )
+  {
+    for ( size_t i = 0; i < METRICS_BUCKETS; ++i )
+    {
+      buckets[i] += shard.buckets[i].load( memory_order_relaxed );
+    }
+  }
+  return buckets;
+}
+
+int64_t MetricHistogram::percentile( double quantile ) const
+{
+  vector<int64_t> buckets = snapshot();
+
+  int64_t total = 0;
+  for ( int64_t n : buckets )
+  {
+    total += n;
+  }
+  if ( total == 0 )
+  {
+    return 0;
+  }
+
+  int64_t rank = max<int64_t>( 1, static_cast<int64_t>( quantile * total + 0.5 ) );
+  int64_t seen = 0;
+
+  for ( size_t i = 0; i < buckets.size(); ++i )
+  {
+    seen += buckets[i];
+    if ( seen >= rank )
+    {
+      return bucket_upper( i );
+    }
+  }
+  return bucket_upper( buckets.size() - 1 );
+}
+
+CallMetrics::CallMetrics( const string& call )
+    : m_call( call ), m_latency( MetricsRegistry::instance().histogram( "opcda_com_call_duration_seconds", "call=\"" + call + "\"", "Round trip time of OPC COM calls" ) ),
+      m_errors( MetricsRegistry::instance().counter( "opcda_com_call_errors_total", "call=\"" + call + "\"", "OPC COM calls that returned a failure HRESULT" ) )
+{
+}
+
+MetricsRegistry& MetricsRegistry::instance()
+{
+  static MetricsRegistry registry;
+  return registry;
+}
+
+MetricsRegistry::~MetricsRegistry()
+{
+  stop_export();
+}
+
+MetricsRegistry::FAMILY& MetricsRegistry::family( const string& name, METRIC_KIND kind, const string& help )
+{
+  auto inserted = m_families.emplace( name, FAMILY() );
+  FAMILY& f = inserted.first->second;
+
+  if ( inserted.second )
+  {
+    f.kind = kind;
+  }
+  else if ( f.kind != kind )
+  {
+    Logger::instance().logWarning( "[metrics] " + name + " is registered with another type" );
+  }
+
+  if ( f.help.empty() )
+  {
+    f.help = help;
+  }
+  return f;
+}
+
+MetricCounter& MetricsRegistry::counter( const string& name, const string& labels, const string& help )
+{
+  lock_guard<mutex> lock( m_lock );
+  auto& slot = family( name, METRIC_KIND::COUNTER, help ).counters[labels];
+  if ( !slot )
+  {
+    slot = make_unique<MetricCounter>();
+  }
+  return *slot;
+}
+
+MetricGauge& MetricsRegistry::gauge( const string& name, const string& labels, const string& help )
+{
+  lock_guard<mutex> lock( m_lock );
+  auto& slot = family( name, METRIC_KIND::GAUGE, help ).gauges[labels];
+  if ( !slot )
+  {
+    slot = make_unique<MetricGauge>();
+  }
+  return *slot;
+}
+
+MetricHistogram& MetricsRegistry::histogram( const string& name, const string& labels, const string& help )
+{
+  lock_guard<mutex> lock( m_lock );
+  auto& slot = family( name, METRIC_KIND::HISTOGRAM, help ).histograms[labels];
+  if ( !slot )
+  {
+    slot = make_unique<MetricHistogram>();
+  }
+  return *slot;
+}
+
+string MetricsRegistry::to_prometheus() const
+{
+  lock_guard<mutex> lock( m_lock );
+  string out;
+
+  for ( const auto& entry : m_families )
+  {
+    const string& name = entry.first;
+    const FAMILY& f = entry.second;
+
+    if ( !f.help.empty() )
+    {
+      out += "# HELP " + name + " " + f.help + "\n";
+    }
+
+    switch ( f.kind )
+    {
+    case METRIC_KIND::COUNTER:
+      out += "# TYPE " + name + " counter\n";
+      for ( const auto& metric : f.counters )
+      {
+        out += series( name, metric.first ) + " " + to_string( metric.second->value() ) + "\n";
+      }
+      break;
+
+    case METRIC_KIND::GAUGE:
+      out += "# TYPE " + name + " gauge\n";
+      for ( const auto& metric : f.gauges )
+      {
+        out += series( name, metric.first ) + " " + to_string( metric.second->value() ) + "\n";
+      }
+      break;
+
+    case METRIC_KIND::HISTOGRAM:
+      out += "# TYPE " + name + " histogram\n";
+      for ( const auto& metric : f.histograms )
+      {
+        const MetricHistogram& h = *metric.second;
+        vector<int64_t> buckets = h.snapshot();
+
+        // exported buckets are cumulative; an internal bucket counts once its upper bound fits
+        int64_t cumulative = 0;
+        size_t next = 0;
+        for ( int64_t bound : export_bounds() )
+        {
+          while ( next < buckets.size() && MetricHistogram::bucket_upper( next ) <= bound )
+          {
+            cumulative += buckets[next++];
+          }
+          out += series( name + "_bucket", metric.first, "le=\"" + seconds( bound ) + "\"" ) + " " + to_string( cumulative ) + "\n";
+        }
+
+        int64_t count = h.count();
+        out += series( name + "_bucket", metric.first, "le=\"+Inf\"" ) + " " + to_string( count ) + "\n";
+        out += series( name + "_sum", metric.first ) + " " + seconds( h.sum_micros() ) + "\n";
+        out += series( name + "_count", metric.first ) + " " + to_string( count ) + "\n";
+
+        if ( count > 0 )
+        {
+          // comment lines are ignored by scrapers but save a query when reading a dump by eye
+          out += "# " + series( name, metric.first ) + " p50=" + seconds( h.percentile( 0.5 ) ) + " p90=" + seconds( h.percentile( 0.9 ) ) +
+                 " p99=" + seconds( h.percentile( 0.99 ) ) + " max=" + seconds( h.percentile( 1.0 ) ) + "\n";
+        }
+      }
+      break;
+    }
+  }
+  return out;
+}
+
+bool MetricsRegistry::write( const string& path ) const
+{
+  string text = to_prometheus();
+
+  if ( path == "-" )
+  {
+    cout << text << flush;
+    return true;
+  }
+
+  // node_exporter's textfile collector must never see a half written file
+  string temp = path + ".tmp";
+  {
+    ofstream file( temp, ios::binary | ios::trunc );
+    if ( !file )
+    {
+      Logger::instance().logError( "[metrics] Cannot open " + temp );
+      return false;
+    }
+    file << text;
+    if ( !file.flush() )
+    {
+      Logger::instance().logError( "[metrics] Cannot write " + temp );
+      return false;
+    }
+  }
+
+  error_code ec;
+  filesystem::rename( temp, path, ec );
+  if ( ec )
+  {
+    Logger::instance().logError( "[metrics] Cannot replace " + path + ": " + ec.message() );
+    return false;
+  }
+  return true;
+}
+
+void MetricsRegistry::start_export( const string& path, int interval_ms )
+{
+  stop_export();
+
+  lock_guard<mutex> lock( m_export_lock );
+  m_export_path = path;
+  m_exporting = true;
+  m_export_thread = thread( &MetricsRegistry::export_loop, this, max( interval_ms, 100 ) );
+}
+
+void MetricsRegistry::stop_export()
+{
+  string path;
+  {
+    lock_guard<mutex> lock( m_export_lock );
+    if ( !m_exporting )
+    {
+      return;
+    }
+    m_exporting = false;
+    path = m_export_path;
+  }
+
+  m_export_wake.notify_all();
+  if ( m_export_thread.joinable() )
+  {
+    m_export_thread.join();
+  }
+  write( path );
+}
+
+void MetricsRegistry::export_loop( int interval_ms )
+{
+  unique_lock<mutex> lock( m_export_lock );
+
+  while ( m_exporting )
+  {
+    if ( m_export_wake.wait_for( lock, chrono::milliseconds( interval_ms ), [&]() { return !m_exporting; } ) )
+    {
+      break;
+    }
+
+    string path = m_export_path;
+    lock.unlock();
+    write( path );
+    lock.lock();
+  }
+}
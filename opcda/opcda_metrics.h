@@ -0,0 +1,206 @@
+// opcda_metrics.h
+#ifndef OPCDA_METRICS_H
+#define OPCDA_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opcda_trace.h"
+
+using namespace std;
+
+constexpr int DEFAULT_METRICS_INTERVAL_MS = 10000;
+
+// counters and histograms spread updates over this many cache lines, picked per thread
+constexpr size_t METRICS_SHARDS = 16;
+
+// histogram buckets: 16 linear steps per power of two of microseconds, longer than 2^44 us is clamped
+constexpr int METRICS_SUB_BUCKET_BITS = 4;
+constexpr int METRICS_MAX_EXPONENT = 40;
+constexpr size_t METRICS_BUCKETS = ( METRICS_MAX_EXPONENT + 1 ) << METRICS_SUB_BUCKET_BITS;
+
+struct alignas( 64 ) METRIC_CELL
+{
+  atomic<int64_t> value { 0 };
+};
+
+/** @brief Monotonic counter; add() is a relaxed increment of the calling thread's shard. */
+class MetricCounter
+{
+public:
+  void add( int64_t delta = 1 );
+  int64_t value() const;
+
+private:
+  array<METRIC_CELL, METRICS_SHARDS> m_cells;
+};
+
+/** @brief Point-in-time value such as a queue depth. */
+class MetricGauge
+{
+public:
+  void set( int64_t value );
+  void add( int64_t delta );
+  int64_t value() const;
+
+private:
+  atomic<int64_t> m_value { 0 };
+};
+
+/**
+ * @brief Log-linear latency histogram in microseconds.
+ *
+ * Same layout as an HDR histogram with 4 significant bits: a value falls in
+ * one of 16 equal steps of its power of two, so the relative error of a
+ * percentile stays under 1/16 from 1 us to days. Recording is one relaxed
+ * increment of a bucket and of the count and sum of the thread's shard.
+ */
+class MetricHistogram
+{
+public:
+  MetricHistogram();
+
+  void record( int64_t micros );
+  void record( chrono::steady_clock::duration elapsed );
+
+  int64_t count() const;
+  int64_t sum_micros() const;
+  /** @brief Upper bound of the bucket holding the given quantile (0..1), 0 when empty. */
+  int64_t percentile( double quantile ) const;
+  /** @brief Bucket counts merged over all shards. */
+  vector<int64_t> snapshot() const;
+
+  static size_t bucket_of( int64_t micros );
+  static int64_t bucket_upper( size_t bucket );
+
+private:
+  struct SHARD
+  {
+    unique_ptr<atomic<int64_t>[]> buckets;
+    METRIC_CELL count;
+    METRIC_CELL sum;
+  };
+
+  array<SHARD, METRICS_SHARDS> m_shards;
+};
+
+/**
+ * @brief Process wide registry of named metrics with Prometheus text export.
+ *
+ * counter(), gauge() and histogram() register on first use and return a
+ * reference that stays valid for the life of the process, so call sites look
+ * a metric up once and keep it. Labels are given preformatted, for example
+ * call="Read". The export thread rewrites the file atomically every interval;
+ * a path of "-" dumps to stdout instead.
+ */
+class MetricsRegistry
+{
+public:
+  static MetricsRegistry& instance();
+
+  MetricCounter& counter( const string& name, const string& labels = "", const string& help = "" );
+  MetricGauge& gauge( const string& name, const string& labels = "", const string& help = "" );
+  MetricHistogram& histogram( const string& name, const string& labels = "", const string& help = "" );
+
+  string to_prometheus() const;
+  bool write( const string& path ) const;
+
+  void start_export( const string& path, int interval_ms = DEFAULT_METRICS_INTERVAL_MS );
+  /** @brief Stops the export thread after one last dump. */
+  void stop_export();
+
+private:
+  MetricsRegistry() = default;
+  ~MetricsRegistry();
+  MetricsRegistry( const MetricsRegistry& ) = delete;
+  MetricsRegistry& operator=( const MetricsRegistry& ) = delete;
+
+  enum class METRIC_KIND
+  {
+    COUNTER,
+    GAUGE,
+    HISTOGRAM
+  };
+
+  struct FAMILY
+  {
+    METRIC_KIND kind = METRIC_KIND::COUNTER;
+    string help;
+    map<string, unique_ptr<MetricCounter>> counters;
+    map<string, unique_ptr<MetricGauge>> gauges;
+    map<string, unique_ptr<MetricHistogram>> histograms;
+  };
+
+  mutable mutex m_lock;
+  map<string, FAMILY> m_families;
+
+  mutex m_export_lock;
+  condition_variable m_export_wake;
+  thread m_export_thread;
+  string m_export_path;
+  bool m_exporting = false;
+
+  FAMILY& family( const string& name, METRIC_KIND kind, const string& help );
+  void export_loop( int interval_ms );
+};
+
+/** @brief Records the time from construction to destruction into a histogram. */
+class MetricTimer
+{
+public:
+  explicit MetricTimer( MetricHistogram& histogram ) : m_histogram( histogram ), m_start( chrono::steady_clock::now() ) {}
+  ~MetricTimer() { m_histogram.record( chrono::steady_clock::now() - m_start ); }
+
+  MetricTimer( const MetricTimer& ) = delete;
+  MetricTimer& operator=( const MetricTimer& ) = delete;
+
+private:
+  MetricHistogram& m_histogram;
+  chrono::steady_clock::time_point m_start;
+};
+
+/**
+ * @brief Latency and failures of one remote method, labelled call="name".
+ *
+ * measure() times a callable returning an HRESULT or OPCDA_RESULT and counts
+ * negative results as errors. The time covers the whole round trip, proxy
+ * marshaling included, so comparing it with the server's own timing tells
+ * DCOM overhead apart from server work. With --trace each call is also a
+ * span named after the method.
+ */
+class CallMetrics
+{
+public:
+  explicit CallMetrics( const string& call );
+
+  template <typename F>
+  auto measure( F&& call ) -> decltype( call() )
+  {
+    TraceSpan span( m_call.c_str() );
+    auto start = chrono::steady_clock::now();
+    auto result = call();
+    m_latency.record( chrono::steady_clock::now() - start );
+    if ( result < 0 )
+    {
+      m_errors.add();
+    }
+    return result;
+  }
+
+private:
+  string m_call;
+  MetricHistogram& m_latency;
+  MetricCounter& m_errors;
+};
+
+#endif
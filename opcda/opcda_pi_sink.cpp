@@ -0,0 +1,581 @@
+// opcda_pi_sink.cpp
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <fstream>
+
+#include "libs/includes/unified_errors/unified_errors.h"
+#include "logger.h"
+#include "opcda_metrics.h"
+#include "opcda_pi_sink.h"
+
+#ifdef OPCDA_WITH_PIAPI
+#include <windows.h>
+#endif
+
+using namespace std;
+
+static MetricGauge& s_pending_samples = MetricsRegistry::instance().gauge( "opcda_pi_pending_samples", "", "Samples waiting for the PI writer thread" );
+static MetricCounter& s_refused_samples = MetricsRegistry::instance().counter( "opcda_pi_refused_samples_total", "", "Samples refused because the PI writer was behind" );
+static MetricCounter& s_rejected_samples = MetricsRegistry::instance().counter( "opcda_pi_rejected_samples_total", "", "Samples the PI archive did not accept" );
+static MetricHistogram& s_put_latency = MetricsRegistry::instance().histogram( "opcda_pi_put_snapshots_duration_seconds", "", "Round trip time of pisn_putsnapshotsx" );
+
+static string trim( const string& s )
+{
+  size_t begin = s.find_first_not_of( " \t\r\n" );
+  size_t end = s.find_last_not_of( " \t\r\n" );
+  return begin == string::npos ? "" : s.substr( begin, end - begin + 1 );
+}
+
+PiSink::PiSink( PiArchive& archive ) : m_archive( archive )
+{
+}
+
+PiSink::~PiSink()
+{
+  close();
+}
+
+void PiSink::set_batch( size_t samples, int interval_ms )
+{
+  m_batch_samples = max<size_t>( 1, samples );
+  m_batch_interval = chrono::milliseconds( max( 1, interval_ms ) );
+}
+
+void PiSink::set_max_pending( size_t samples, int block_timeout_ms )
+{
+  m_max_pending = max<size_t>( 1, samples );
+  m_block_timeout = chrono::milliseconds( max( 0, block_timeout_ms ) );
+}
+
+void PiSink::set_retry( int attempts, int outage_retry_ms )
+{
+  m_retry_limit = max( 0, attempts );
+  m_outage_retry = chrono::milliseconds( max( 1, outage_retry_ms ) );
+}
+
+void PiSink::set_tag_map( const map<string, string>& tag_map )
+{
+  m_tag_map = tag_map;
+  m_points.clear();
+}
+
+bool PiSink::load_tag_map( const string& file )
+{
+  ifstream in( file );
+
+  if ( !in )
+  {
+    Logger::instance().logError( "Failed to open PI tag map: " + file );
+    return false;
+  }
+
+  map<string, string> tag_map;
+  string line;
+
+  while ( getline( in, line ) )
+  {
+    line = trim( line );
+
+    if ( line.empty() || line[0] == '#' )
+    {
+      continue;
+    }
+
+    size_t pos = line.find( '=' );
+
+    if ( pos == string::npos )
+    {
+      Logger::instance().logWarning( "Ignoring PI tag map line: " + line );
+      continue;
+    }
+
+    tag_map[trim( line.substr( 0, pos ) )] = trim( line.substr( pos + 1 ) );
+  }
+
+  set_tag_map( tag_map );
+  return true;
+}
+
+bool PiSink::open()
+{
+  lock_guard<mutex> lock( m_lock );
+
+  if ( m_running )
+  {
+    return true;
+  }
+
+  m_running = true;
+  m_writer = thread( &PiSink::write_loop, this );
+  return true;
+}
+
+void PiSink::close()
+{
+  {
+    lock_guard<mutex> lock( m_lock );
+    m_running = false;
+  }
+
+  m_not_empty.notify_all();
+  m_not_full.notify_all();
+
+  if ( m_writer.joinable() )
+  {
+    m_writer.join();
+  }
+}
+
+bool PiSink::write( const vector<OPCDA_SAMPLE>& samples )
+{
+  unique_lock<mutex> lock( m_lock );
+
+  if ( !m_running )
+  {
+    return false;
+  }
+
+  // all-or-nothing so that a caller retrying a rejected batch never duplicates samples
+  auto has_room = [&]() { return !m_running || m_pending.empty() || m_pending.size() + samples.size() <= m_max_pending; };
+
+  if ( !has_room() )
+  {
+    m_not_empty.notify_one();
+
+    if ( !m_not_full.wait_for( lock, m_block_timeout, has_room ) || !m_running )
+    {
+      Logger::instance().logWarning( "PI writer is behind, " + to_string( m_pending.size() ) + " samples pending" );
+      s_refused_samples.add( static_cast<int64_t>( samples.size() ) );
+      return false;
+    }
+  }
+
+  m_pending.insert( m_pending.end(), samples.begin(), samples.end() );
+  s_pending_samples.set( static_cast<int64_t>( m_pending.size() ) );
+
+  if ( m_pending.size() >= m_batch_samples )
+  {
+    m_not_empty.notify_one();
+  }
+
+  return true;
+}
+
+bool PiSink::flush()
+{
+  unique_lock<mutex> lock( m_lock );
+
+  if ( !m_running )
+  {
+    return m_pending.empty();
+  }
+
+  // gives up at the first failed attempt instead of waiting out the outage; the caller retries
+  uint64_t outages = m_outages;
+
+  m_flush_requested = true;
+  m_not_empty.notify_one();
+  m_drained.wait( lock, [&]() { return !m_running || m_outages != outages || ( m_pending.empty() && !m_busy ); } );
+
+  return m_pending.empty() && !m_busy;
+}
+
+string PiSink::last_error() const
+{
+  lock_guard<mutex> lock( m_lock );
+  return m_last_error;
+}
+
+uint64_t PiSink::written() const
+{
+  lock_guard<mutex> lock( m_lock );
+  return m_written;
+}
+
+uint64_t PiSink::rejected() const
+{
+  lock_guard<mutex> lock( m_lock );
+  return m_rejected;
+}
+
+PI_SNAPSHOT PiSink::to_snapshot( const OPCDA_SAMPLE& sample, double value, int32_t point )
+{
+  using namespace OpcConstants;
+
+  PI_SNAPSHOT snapshot;
+  snapshot.point = point;
+  snapshot.timestamp = sample.timestamp;
+
+  switch ( sample.quality & U_OPC_QUALITY_MASK )
+  {
+    case U_OPC_QUALITY_GOOD:
+      snapshot.value = value;
+      break;
+
+    case U_OPC_QUALITY_UNCERTAIN:
+      snapshot.value = value;
+      snapshot.flags = PI_M_QFLAG;
+      break;
+
+    default:
+      snapshot.status = PI_STATE_BAD_INPUT;
+      break;
+  }
+
+  return snapshot;
+}
+
+bool PiSink::transient( int32_t code )
+{
+  U_ErrorCategory category = ErrorConverter::getInstance().fromPiError( code ).getCategory();
+  return category == U_ErrorCategory::CONNECTION || category == U_ErrorCategory::TIMEOUT;
+}
+
+bool PiSink::resolve( const string& id, int32_t& point )
+{
+  auto cached = m_points.find( id );
+
+  if ( cached != m_points.end() )
+  {
+    point = cached->second;
+    return point > 0;
+  }
+
+  auto mapped = m_tag_map.find( id );
+  const string& tag = mapped != m_tag_map.end() ? mapped->second : id;
+
+  point = 0;
+  int32_t result = m_archive.find_point( tag, point );
+
+  if ( result != 0 || point <= 0 )
+  {
+    record_error( result != 0 ? result : -5, tag );
+    point = 0;
+
+    // only a definite answer is remembered; a lookup that failed on the way is asked again
+    if ( result != 0 && ErrorConverter::getInstance().fromPiError( result ).getCategory() != U_ErrorCategory::TAG )
+    {
+      return false;
+    }
+  }
+
+  m_points[id] = point;
+  return point > 0;
+}
+
+void PiSink::record_error( int32_t code, const string& source )
+{
+  UnifiedError error = ErrorConverter::getInstance().fromPiError( code, m_archive.error_message( code ), source );
+  string message = source + ": " + error.toString();
+
+  Logger::instance().logError( message );
+
+  lock_guard<mutex> lock( m_lock );
+  m_last_error = message;
+}
+
+bool PiSink::send_batch( const vector<OPCDA_SAMPLE>& batch )
+{
+  vector<PI_SNAPSHOT> snapshots;
+  vector<const string*> ids;
+  deque<string> element_ids;
+  uint64_t rejected = 0;
+  uint64_t written = 0;
+
+  snapshots.reserve( batch.size() );
+  ids.reserve( batch.size() );
+
+  auto add = [&]( const string& id, const OPCDA_SAMPLE& s, double value ) -> bool
+  {
+    int32_t point;
+
+    if ( !resolve( id, point ) )
+    {
+      // a point that could not be looked up at all makes the whole batch wait for the archive
+      if ( m_points.find( id ) == m_points.end() )
+      {
+        return false;
+      }
+
+      ++rejected;
+      return true;
+    }
+
+    snapshots.push_back( to_snapshot( s, value, point ) );
+    ids.push_back( &id );
+    return true;
+  };
+
+  for ( const auto& s : batch )
+  {
+    if ( s.elements.empty() )
+    {
+      if ( !add( s.id, s, s.value ) )
+      {
+        return false;
+      }
+      continue;
+    }
+
+    // PI points are scalar, so an array sample fans out to one point per element named id[n]
+    for ( size_t k = 0; k < s.elements.size(); ++k )
+    {
+      element_ids.push_back( s.id + "[" + to_string( k ) + "]" );
+      if ( !add( element_ids.back(), s, s.elements[k] ) )
+      {
+        return false;
+      }
+    }
+  }
+
+  if ( !snapshots.empty() )
+  {
+    vector<int32_t> errors;
+    int32_t result = 0;
+
+    for ( int attempt = 0; attempt <= m_retry_limit; ++attempt )
+    {
+      {
+        MetricTimer timer( s_put_latency );
+        result = m_archive.put_snapshots( snapshots, errors );
+      }
+
+      if ( result == 0 )
+      {
+        break;
+      }
+
+      record_error( result, "pisn_putsnapshotsx" );
+
+      if ( !transient( result ) )
+      {
+        break;
+      }
+
+      if ( attempt == m_retry_limit )
+      {
+        return false;
+      }
+
+      this_thread::sleep_for( chrono::milliseconds( 200 << attempt ) );
+    }
+
+    if ( result != 0 )
+    {
+      rejected += snapshots.size();
+    }
+    else
+    {
+      for ( size_t i = 0; i < snapshots.size(); ++i )
+      {
+        int32_t code = i < errors.size() ? errors[i] : 0;
+
+        if ( code != 0 )
+        {
+          record_error( code, *ids[i] );
+          ++rejected;
+        }
+        else
+        {
+          ++written;
+        }
+      }
+    }
+  }
+
+  s_rejected_samples.add( static_cast<int64_t>( rejected ) );
+
+  lock_guard<mutex> lock( m_lock );
+  m_written += written;
+  m_rejected += rejected;
+  return true;
+}
+
+void PiSink::write_loop()
+{
+  unique_lock<mutex> lock( m_lock );
+
+  while ( true )
+  {
+    m_not_empty.wait_for( lock, m_batch_interval, [&]() { return !m_running || m_flush_requested || m_pending.size() >= m_batch_samples; } );
+
+    if ( m_pending.empty() )
+    {
+      m_flush_requested = false;
+      m_drained.notify_all();
+
+      if ( !m_running )
+      {
+        break;
+      }
+
+      continue;
+    }
+
+    size_t count = min( m_pending.size(), m_batch_samples );
+    vector<OPCDA_SAMPLE> batch( make_move_iterator( m_pending.begin() ), make_move_iterator( m_pending.begin() + count ) );
+    m_pending.erase( m_pending.begin(), m_pending.begin() + count );
+    s_pending_samples.set( static_cast<int64_t>( m_pending.size() ) );
+
+    m_busy = true;
+    lock.unlock();
+    m_not_full.notify_all();
+
+    bool answered = send_batch( batch );
+
+    lock.lock();
+    m_busy = false;
+
+    if ( !answered )
+    {
+      // back to the front, in order, so nothing is lost or reordered while the archive is away
+      m_pending.insert( m_pending.begin(), make_move_iterator( batch.begin() ), make_move_iterator( batch.end() ) );
+      s_pending_samples.set( static_cast<int64_t>( m_pending.size() ) );
+      ++m_outages;
+      m_drained.notify_all();
+
+      if ( !m_running )
+      {
+        Logger::instance().logWarning( "PI archive unreachable at close, " + to_string( m_pending.size() ) + " samples not written" );
+        break;
+      }
+
+      m_not_empty.wait_for( lock, m_outage_retry, [&]() { return !m_running; } );
+      continue;
+    }
+
+    if ( m_pending.empty() )
+    {
+      m_drained.notify_all();
+    }
+  }
+}
+
+#ifdef OPCDA_WITH_PIAPI
+
+#ifndef PIPROC
+#define PIPROC __stdcall
+#endif
+
+extern "C"
+{
+  typedef struct
+  {
+    int32_t month;
+    int32_t year;
+    int32_t day;
+    int32_t hour;
+    int32_t minute;
+    int32_t tzinfo;
+    double second;
+  } PITIMESTAMP;
+
+  int32_t PIPROC piut_setservernode( const char* servername );
+  int32_t PIPROC piut_disconnect();
+  int32_t PIPROC piut_strerror( int32_t stat, char* msgstr, int32_t* msglen, const char* srcstr );
+  int32_t PIPROC pipt_findpoint( char* tagname, int32_t* pt );
+  int32_t PIPROC pisn_putsnapshotsx( int32_t count, int32_t* ptnum, double* drval, int32_t* ival, void** bval, uint32_t* bsize, int32_t* istat, int16_t* flags, PITIMESTAMP* timestamp, int32_t* errors );
+}
+
+static PITIMESTAMP to_pitimestamp( int64_t ticks )
+{
+  PITIMESTAMP ts = {};
+  FILETIME utc;
+  FILETIME local;
+  SYSTEMTIME st;
+
+  utc.dwLowDateTime = static_cast<DWORD>( ticks & 0xFFFFFFFF );
+  utc.dwHighDateTime = static_cast<DWORD>( static_cast<uint64_t>( ticks ) >> 32 );
+
+  // PI API timestamps are expressed in the local time of the client
+  if ( FileTimeToLocalFileTime( &utc, &local ) && FileTimeToSystemTime( &local, &st ) )
+  {
+    ts.year = st.wYear;
+    ts.month = st.wMonth;
+    ts.day = st.wDay;
+    ts.hour = st.wHour;
+    ts.minute = st.wMinute;
+    ts.second = st.wSecond + static_cast<double>( ticks % 10000000 ) / 10000000.0;
+  }
+
+  return ts;
+}
+
+PiApiArchive::~PiApiArchive()
+{
+  close();
+}
+
+bool PiApiArchive::open( const string& server )
+{
+  int32_t result = piut_setservernode( server.c_str() );
+
+  if ( result != 0 )
+  {
+    Logger::instance().logError( ErrorConverter::getInstance().fromPiError( result, error_message( result ), server ).toString() );
+    return false;
+  }
+
+  m_connected = true;
+  return true;
+}
+
+void PiApiArchive::close()
+{
+  if ( m_connected )
+  {
+    piut_disconnect();
+    m_connected = false;
+  }
+}
+
+int32_t PiApiArchive::find_point( const string& tag, int32_t& point )
+{
+  vector<char> name( tag.begin(), tag.end() );
+  name.push_back( '\0' );
+
+  return pipt_findpoint( name.data(), &point );
+}
+
+int32_t PiApiArchive::put_snapshots( const vector<PI_SNAPSHOT>& snapshots, vector<int32_t>& errors )
+{
+  size_t count = snapshots.size();
+
+  vector<int32_t> points( count );
+  vector<double> values( count );
+  vector<int32_t> ivalues( count, 0 );
+  vector<void*> bvalues( count, nullptr );
+  vector<uint32_t> bsizes( count, 0 );
+  vector<int32_t> status( count );
+  vector<int16_t> flags( count );
+  vector<PITIMESTAMP> times( count );
+
+  for ( size_t i = 0; i < count; ++i )
+  {
+    points[i] = snapshots[i].point;
+    values[i] = snapshots[i].value;
+    status[i] = snapshots[i].status;
+    flags[i] = snapshots[i].flags;
+    times[i] = to_pitimestamp( snapshots[i].timestamp );
+  }
+
+  errors.assign( count, 0 );
+
+  return pisn_putsnapshotsx( static_cast<int32_t>( count ), points.data(), values.data(), ivalues.data(), bvalues.data(), bsizes.data(), status.data(), flags.data(), times.data(), errors.data() );
+}
+
+string PiApiArchive::error_message( int32_t code )
+{
+  char buffer[256] = {};
+  int32_t length = sizeof( buffer );
+
+  if ( piut_strerror( code, buffer, &length, "opcda-cli" ) != 0 )
+  {
+    return "";
+  }
+
+  return string( buffer, strnlen( buffer, sizeof( buffer ) ) );
+}
+
+#endif
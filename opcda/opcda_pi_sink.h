@@ -0,0 +1,147 @@
+// opcda_pi_sink.h
+#ifndef OPCDA_PI_SINK_H
+#define OPCDA_PI_SINK_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opcda_sample.h"
+
+using namespace std;
+
+constexpr size_t DEFAULT_PI_BATCH_SAMPLES = 500;
+constexpr int DEFAULT_PI_BATCH_INTERVAL_MS = 1000;
+constexpr size_t DEFAULT_PI_MAX_PENDING = 100000;
+constexpr int DEFAULT_PI_BLOCK_TIMEOUT_MS = 5000;
+constexpr int DEFAULT_PI_RETRY_LIMIT = 3;
+constexpr int DEFAULT_PI_OUTAGE_RETRY_MS = 5000;
+
+// PI API snapshot flags and the system digital state written for bad OPC quality
+constexpr int16_t PI_M_QFLAG = 0x0002;
+constexpr int32_t PI_STATE_BAD_INPUT = -307;
+
+struct PI_SNAPSHOT
+{
+  int32_t point = 0;
+  double value = 0.0;
+  int32_t status = 0;
+  int16_t flags = 0;
+  int64_t timestamp = 0;
+};
+
+/**
+ * @brief Minimal PI archive surface used by PiSink. PiApiArchive talks to a real
+ *        server through piapi32; a fake can stand in for it when exercising the
+ *        batching and tag mapping without a PI server.
+ */
+class PiArchive
+{
+public:
+  virtual ~PiArchive()
+  {
+  }
+
+  virtual int32_t find_point( const string& tag, int32_t& point ) = 0;
+  virtual int32_t put_snapshots( const vector<PI_SNAPSHOT>& snapshots, vector<int32_t>& errors ) = 0;
+  virtual string error_message( int32_t )
+  {
+    return "";
+  }
+};
+
+#ifdef OPCDA_WITH_PIAPI
+class PiApiArchive : public PiArchive
+{
+public:
+  ~PiApiArchive();
+
+  bool open( const string& server );
+  void close();
+
+  int32_t find_point( const string& tag, int32_t& point ) override;
+  int32_t put_snapshots( const vector<PI_SNAPSHOT>& snapshots, vector<int32_t>& errors ) override;
+  string error_message( int32_t code ) override;
+
+private:
+  bool m_connected = false;
+};
+#endif
+
+/**
+ * @brief Writes samples to PI points from a dedicated writer thread. Samples are
+ *        sent in bulk put-snapshot calls once a batch fills or the batch interval
+ *        elapses. write() blocks while the pending queue is full and reports
+ *        failure when it stays full, so an upstream QueueSink keeps the data.
+ *
+ * A batch that cannot reach the archive (connection or timeout errors past the
+ * retry limit) goes back to the front of the queue and is retried, it is never
+ * dropped. flush() succeeds only once the archive has answered for everything
+ * queued before it; samples the archive refused one by one, or whose point does
+ * not exist, count as delivered and rejected.
+ */
+class PiSink : public SampleSink
+{
+public:
+  explicit PiSink( PiArchive& archive );
+  ~PiSink();
+
+  void set_batch( size_t samples, int interval_ms );
+  void set_max_pending( size_t samples, int block_timeout_ms );
+  void set_retry( int attempts, int outage_retry_ms );
+  void set_tag_map( const map<string, string>& tag_map );
+  bool load_tag_map( const string& file );
+
+  bool open();
+  void close();
+
+  bool write( const vector<OPCDA_SAMPLE>& samples ) override;
+  bool flush() override;
+
+  string last_error() const;
+  uint64_t written() const;
+  uint64_t rejected() const;
+
+  static PI_SNAPSHOT to_snapshot( const OPCDA_SAMPLE& sample, double value, int32_t point );
+
+private:
+  PiArchive& m_archive;
+  map<string, string> m_tag_map;
+  map<string, int32_t> m_points;
+
+  size_t m_batch_samples = DEFAULT_PI_BATCH_SAMPLES;
+  chrono::milliseconds m_batch_interval{ DEFAULT_PI_BATCH_INTERVAL_MS };
+  size_t m_max_pending = DEFAULT_PI_MAX_PENDING;
+  chrono::milliseconds m_block_timeout{ DEFAULT_PI_BLOCK_TIMEOUT_MS };
+  int m_retry_limit = DEFAULT_PI_RETRY_LIMIT;
+  chrono::milliseconds m_outage_retry{ DEFAULT_PI_OUTAGE_RETRY_MS };
+
+  mutable mutex m_lock;
+  condition_variable m_not_empty;
+  condition_variable m_not_full;
+  condition_variable m_drained;
+  deque<OPCDA_SAMPLE> m_pending;
+  thread m_writer;
+  bool m_running = false;
+  bool m_busy = false;
+  bool m_flush_requested = false;
+
+  string m_last_error;
+  uint64_t m_written = 0;
+  uint64_t m_rejected = 0;
+  uint64_t m_outages = 0;
+
+  static bool transient( int32_t code );
+  bool resolve( const string& id, int32_t& point );
+  bool send_batch( const vector<OPCDA_SAMPLE>& batch );
+  void record_error( int32_t code, const string& source );
+  void write_loop();
+};
+
+#endif
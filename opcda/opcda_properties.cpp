@@ -0,0 +1,390 @@
+// opcda_properties.cpp
+#define NOMINMAX
+#include <algorithm>
+#include <atlbase.h>
+#include <atomic>
+#include <cwchar>
+#include <opcda.h>
+#include <thread>
+#include <windows.h>
+
+#include "logger.h"
+#include "opcda_error_stats.h"
+#include "opcda_trace.h"
+#include "opcda_properties.h"
+
+using namespace std;
+
+struct PROPERTY_ID_MAP
+{
+  unsigned bit;
+  uint32_t id;
+};
+
+static const PROPERTY_ID_MAP PROPERTY_IDS[] = {
+  { PROPERTY_DATATYPE, OPC_PROPERTY_DATATYPE },
+  { PROPERTY_ACCESS_RIGHTS, OPC_PROPERTY_ACCESS_RIGHTS },
+  { PROPERTY_EU_UNITS, OPC_PROPERTY_EU_UNITS },
+  { PROPERTY_EU_RANGE, OPC_PROPERTY_LOW_EU },
+  { PROPERTY_EU_RANGE, OPC_PROPERTY_HIGH_EU },
+  { PROPERTY_DESCRIPTION, OPC_PROPERTY_DESCRIPTION },
+  { PROPERTY_SCAN_RATE, OPC_PROPERTY_SCAN_RATE },
+};
+
+static vector<uint32_t> property_ids_for( unsigned property_set )
+{
+  vector<uint32_t> ids;
+
+  for ( const auto& p : PROPERTY_IDS )
+  {
+    if ( property_set & p.bit )
+    {
+      ids.push_back( p.id );
+    }
+  }
+
+  return ids;
+}
+
+static bool value_as_number( const OPCDA_VALUE& value, double& number )
+{
+  if ( holds_alternative<int64_t>( value ) )
+  {
+    number = static_cast<double>( get<int64_t>( value ) );
+  }
+  else if ( holds_alternative<double>( value ) )
+  {
+    number = get<double>( value );
+  }
+  else if ( holds_alternative<bool>( value ) )
+  {
+    number = get<bool>( value ) ? 1.0 : 0.0;
+  }
+  else if ( holds_alternative<wstring>( value ) )
+  {
+    wchar_t* end = nullptr;
+    const wstring& text = get<wstring>( value );
+    number = wcstod( text.c_str(), &end );
+    return !text.empty() && end && *end == L'\0';
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+static void apply_property( OPCDA_ITEM_PROPERTIES& item, uint32_t id, const OPCDA_VALUE& value )
+{
+  double number = 0.0;
+
+  switch ( id )
+  {
+    case OPC_PROPERTY_DATATYPE:
+      if ( value_as_number( value, number ) )
+      {
+        item.data_type = static_cast<VARTYPE>( number );
+        item.present |= PROPERTY_DATATYPE;
+      }
+      break;
+
+    case OPC_PROPERTY_ACCESS_RIGHTS:
+      if ( value_as_number( value, number ) )
+      {
+        item.access_rights = static_cast<DWORD>( number );
+        item.present |= PROPERTY_ACCESS_RIGHTS;
+      }
+      break;
+
+    case OPC_PROPERTY_EU_UNITS:
+    case OPC_PROPERTY_DESCRIPTION:
+      if ( holds_alternative<wstring>( value ) )
+      {
+        if ( id == OPC_PROPERTY_EU_UNITS )
+        {
+          item.eu_units = get<wstring>( value );
+          item.present |= PROPERTY_EU_UNITS;
+        }
+        else
+        {
+          item.description = get<wstring>( value );
+          item.present |= PROPERTY_DESCRIPTION;
+        }
+      }
+      break;
+
+    case OPC_PROPERTY_LOW_EU:
+    case OPC_PROPERTY_HIGH_EU:
+      if ( value_as_number( value, number ) )
+      {
+        ( id == OPC_PROPERTY_LOW_EU ? item.eu_low : item.eu_high ) = number;
+        item.present |= PROPERTY_EU_RANGE;
+      }
+      break;
+
+    case OPC_PROPERTY_SCAN_RATE:
+      if ( value_as_number( value, number ) )
+      {
+        item.scan_rate = static_cast<float>( number );
+        item.present |= PROPERTY_SCAN_RATE;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+/** @brief Queries items [first, last) of item_ids into results with one backend call. */
+static void fetch_chunk( OpcDaBackend& backend, const char* operation, const vector<wstring>& item_ids, const vector<size_t>& indices, size_t first, size_t last, const vector<uint32_t>& property_ids, vector<OPCDA_ITEM_PROPERTIES>& results )
+{
+  TraceSpan span( "fetch_properties", static_cast<int64_t>( last - first ) );
+
+  vector<wstring> ids;
+  for ( size_t i = first; i < last; ++i )
+  {
+    ids.push_back( item_ids[indices[i]] );
+  }
+
+  vector<BACKEND_PROPERTIES> found;
+  OPCDA_RESULT hr = backend.properties( ids, property_ids, found );
+
+  for ( size_t i = first; i < last; ++i )
+  {
+    OPCDA_ITEM_PROPERTIES& item = results[indices[i]];
+
+    if ( opcda_failed( hr ) )
+    {
+      item.error = hr;
+      continue;
+    }
+
+    const BACKEND_PROPERTIES& props = found[i - first];
+    item.error = props.error;
+    if ( opcda_failed( item.error ) )
+    {
+      ItemErrorStats::instance().record( operation, item.item_id, 0, item.error );
+      continue;
+    }
+
+    for ( const auto& prop : props.properties )
+    {
+      if ( !opcda_failed( prop.error ) )
+      {
+        apply_property( item, prop.id, prop.value );
+      }
+    }
+  }
+}
+
+void ItemPropertyCache::set_workers( size_t workers )
+{
+  lock_guard<mutex> lock( m_mutex );
+  m_workers = max<size_t>( workers, 1 );
+}
+
+void ItemPropertyCache::set_ttl( chrono::milliseconds ttl )
+{
+  lock_guard<mutex> lock( m_mutex );
+  m_ttl = ttl;
+}
+
+bool ItemPropertyCache::is_fresh( const OPCDA_ITEM_PROPERTIES& entry, unsigned property_set ) const
+{
+  return ( entry.fetched & property_set ) == property_set && chrono::steady_clock::now() - entry.fetched_at < m_ttl;
+}
+
+bool ItemPropertyCache::lookup( const wstring& item_id, unsigned property_set, OPCDA_ITEM_PROPERTIES& properties ) const
+{
+  lock_guard<mutex> lock( m_mutex );
+
+  auto it = m_items.find( item_id );
+  if ( it == m_items.end() || !is_fresh( it->second, property_set ) )
+  {
+    return false;
+  }
+
+  properties = it->second;
+  return true;
+}
+
+void ItemPropertyCache::store( const OPCDA_ITEM_PROPERTIES& properties )
+{
+  lock_guard<mutex> lock( m_mutex );
+
+  OPCDA_ITEM_PROPERTIES& entry = m_items[properties.item_id];
+
+  // keep what an earlier, wider query returned unless it has expired
+  if ( chrono::steady_clock::now() - entry.fetched_at >= m_ttl )
+  {
+    entry = OPCDA_ITEM_PROPERTIES();
+  }
+
+  unsigned present = entry.present;
+  unsigned fetched = entry.fetched;
+  OPCDA_ITEM_PROPERTIES merged = properties;
+
+  if ( ( present & ~properties.fetched ) & PROPERTY_DATATYPE )
+  {
+    merged.data_type = entry.data_type;
+  }
+  if ( ( present & ~properties.fetched ) & PROPERTY_ACCESS_RIGHTS )
+  {
+    merged.access_rights = entry.access_rights;
+  }
+  if ( ( present & ~properties.fetched ) & PROPERTY_EU_UNITS )
+  {
+    merged.eu_units = entry.eu_units;
+  }
+  if ( ( present & ~properties.fetched ) & PROPERTY_EU_RANGE )
+  {
+    merged.eu_low = entry.eu_low;
+    merged.eu_high = entry.eu_high;
+  }
+  if ( ( present & ~properties.fetched ) & PROPERTY_DESCRIPTION )
+  {
+    merged.description = entry.description;
+  }
+  if ( ( present & ~properties.fetched ) & PROPERTY_SCAN_RATE )
+  {
+    merged.scan_rate = entry.scan_rate;
+  }
+
+  merged.present = properties.present | ( present & ~properties.fetched );
+  merged.fetched = properties.fetched | fetched;
+  merged.fetched_at = properties.fetched_at;
+  entry = move( merged );
+}
+
+void ItemPropertyCache::invalidate( const wstring& item_id )
+{
+  lock_guard<mutex> lock( m_mutex );
+  m_items.erase( item_id );
+}
+
+void ItemPropertyCache::clear()
+{
+  lock_guard<mutex> lock( m_mutex );
+  m_items.clear();
+}
+
+size_t ItemPropertyCache::size() const
+{
+  lock_guard<mutex> lock( m_mutex );
+  return m_items.size();
+}
+
+HRESULT ItemPropertyCache::fetch( OpcDaBackend& backend, const vector<wstring>& item_ids, unsigned property_set, vector<OPCDA_ITEM_PROPERTIES>& results )
+{
+  results.assign( item_ids.size(), OPCDA_ITEM_PROPERTIES() );
+
+  if ( !backend.features().properties )
+  {
+    return E_NOINTERFACE;
+  }
+
+  vector<size_t> missing;
+
+  for ( size_t i = 0; i < item_ids.size(); ++i )
+  {
+    if ( !lookup( item_ids[i], property_set, results[i] ) )
+    {
+      results[i].item_id = item_ids[i];
+      results[i].fetched = property_set;
+      missing.push_back( i );
+    }
+  }
+
+  if ( !missing.empty() )
+  {
+    fetch_parallel( backend, item_ids, missing, property_set, results );
+  }
+
+  size_t failed = 0;
+  auto now = chrono::steady_clock::now();
+
+  for ( size_t i : missing )
+  {
+    results[i].fetched_at = now;
+
+    if ( FAILED( results[i].error ) )
+    {
+      ++failed;
+      continue;
+    }
+
+    store( results[i] );
+  }
+
+  if ( failed > 0 )
+  {
+    Logger::instance().logWarning( "[properties] " + to_string( failed ) + " of " + to_string( missing.size() ) + " items returned no properties" );
+  }
+
+  return failed > 0 ? S_FALSE : S_OK;
+}
+
+void ItemPropertyCache::fetch_parallel( OpcDaBackend& backend, const vector<wstring>& item_ids, const vector<size_t>& missing, unsigned property_set, vector<OPCDA_ITEM_PROPERTIES>& results )
+{
+  vector<uint32_t> property_ids = property_ids_for( property_set );
+  bool bulk = backend.features().browse_elements;
+  const char* operation = bulk ? "GetProperties" : "GetItemProperties";
+  size_t chunk_size = bulk ? PROPERTY_BATCH_ITEMS : PROPERTY_BATCH_ITEMS_DA2;
+  size_t chunks = ( missing.size() + chunk_size - 1 ) / chunk_size;
+  size_t workers = min( chunks, m_workers );
+  atomic<size_t> next_chunk( 0 );
+
+  auto run_chunks = [&]()
+  {
+    for ( size_t chunk = next_chunk++; chunk < chunks; chunk = next_chunk++ )
+    {
+      size_t first = chunk * chunk_size;
+      fetch_chunk( backend, operation, item_ids, missing, first, min( first + chunk_size, missing.size() ), property_ids, results );
+    }
+  };
+
+  if ( workers <= 1 )
+  {
+    run_chunks();
+    return;
+  }
+
+  atomic<size_t> running( workers );
+  HANDLE done = CreateEvent( NULL, TRUE, FALSE, NULL );
+  vector<thread> pool;
+
+  for ( size_t w = 0; w < workers; ++w )
+  {
+    pool.emplace_back(
+      [&]()
+      {
+        // the backend hands MTA threads a GIT proxy, this one only needs an apartment
+        HRESULT hr = CoInitializeEx( NULL, COINIT_MULTITHREADED );
+
+        if ( SUCCEEDED( hr ) )
+        {
+          run_chunks();
+          CoUninitialize();
+        }
+
+        if ( --running == 0 )
+        {
+          SetEvent( done );
+        }
+      } );
+  }
+
+  // keep pumping messages while waiting, an apartment-threaded server may call back into this STA
+  DWORD index = 0;
+  CoWaitForMultipleHandles( 0, INFINITE, 1, &done, &index );
+
+  for ( auto& t : pool )
+  {
+    t.join();
+  }
+
+  CloseHandle( done );
+
+  // chunks no worker could take (no apartment) are queried here
+  run_chunks();
+}
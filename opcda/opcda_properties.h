@@ -0,0 +1,85 @@
+// opcda_properties.h
+#ifndef OPCDA_PROPERTIES_H
+#define OPCDA_PROPERTIES_H
+
+#include <atlbase.h>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <opcda.h>
+#include <string>
+#include <vector>
+
+#include "opcda_backend.h"
+
+using namespace std;
+
+constexpr size_t DEFAULT_PROPERTY_WORKERS = 4;
+constexpr int DEFAULT_PROPERTY_TTL_MS = 300000;
+
+// items per IOPCBrowse::GetProperties call, and per worker hand-out on DA 2.0 servers
+constexpr size_t PROPERTY_BATCH_ITEMS = 256;
+constexpr size_t PROPERTY_BATCH_ITEMS_DA2 = 16;
+
+enum OPCDA_PROPERTY_SET : unsigned
+{
+  PROPERTY_DATATYPE = 0x01,
+  PROPERTY_ACCESS_RIGHTS = 0x02,
+  PROPERTY_EU_UNITS = 0x04,
+  PROPERTY_EU_RANGE = 0x08,
+  PROPERTY_DESCRIPTION = 0x10,
+  PROPERTY_SCAN_RATE = 0x20,
+  PROPERTY_ALL = 0x3F
+};
+
+struct OPCDA_ITEM_PROPERTIES
+{
+  wstring item_id;
+  HRESULT error = S_OK;
+  unsigned fetched = 0; // OPCDA_PROPERTY_SET bits that were asked for
+  unsigned present = 0; // bits the server returned a value for
+  VARTYPE data_type = VT_EMPTY;
+  DWORD access_rights = 0;
+  wstring eu_units;
+  double eu_low = 0.0;
+  double eu_high = 0.0;
+  wstring description;
+  float scan_rate = 0.0f;
+  chrono::steady_clock::time_point fetched_at;
+};
+
+/**
+ * @brief Per-item property cache filled by bulk queries.
+ *
+ * Queries go through OpcDaBackend::properties in chunks: PROPERTY_BATCH_ITEMS
+ * items for backends with DA 3.0 browsing, which answer a chunk in one call,
+ * PROPERTY_BATCH_ITEMS_DA2 for the rest, which need one call per item. The
+ * chunks are spread over a small pool of MTA worker threads; the backend
+ * reaches the server from them through the GIT. Entries expire after the TTL
+ * or when invalidated.
+ */
+class ItemPropertyCache
+{
+public:
+  void set_workers( size_t workers );
+  void set_ttl( chrono::milliseconds ttl );
+
+  HRESULT fetch( OpcDaBackend& backend, const vector<wstring>& item_ids, unsigned property_set, vector<OPCDA_ITEM_PROPERTIES>& results );
+  void store( const OPCDA_ITEM_PROPERTIES& properties );
+  bool lookup( const wstring& item_id, unsigned property_set, OPCDA_ITEM_PROPERTIES& properties ) const;
+
+  void invalidate( const wstring& item_id );
+  void clear();
+  size_t size() const;
+
+private:
+  mutable mutex m_mutex;
+  map<wstring, OPCDA_ITEM_PROPERTIES> m_items;
+  size_t m_workers = DEFAULT_PROPERTY_WORKERS;
+  chrono::milliseconds m_ttl = chrono::milliseconds( DEFAULT_PROPERTY_TTL_MS );
+
+  bool is_fresh( const OPCDA_ITEM_PROPERTIES& entry, unsigned property_set ) const;
+  void fetch_parallel( OpcDaBackend& backend, const vector<wstring>& item_ids, const vector<size_t>& missing, unsigned property_set, vector<OPCDA_ITEM_PROPERTIES>& results );
+};
+
+#endif
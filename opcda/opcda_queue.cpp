@@ -0,0 +1,1002 @@
+// opcda_queue.cpp
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "logger.h"
+#include "opcda_crc32.h"
+#include "opcda_metrics.h"
+#include "opcda_queue.h"
+
+using namespace std;
+
+static const uint32_t QUEUE_SKIP_MARKER = 0xFFFFFFFFu;
+static const size_t QUEUE_RECORD_HEADER = 8;
+static const size_t QUEUE_MAX_FREE_SEGMENTS = 4;
+static const uint32_t QUEUE_RECORD_ARRAYS = 0x80000000u;
+
+static MetricGauge& s_pending_bytes = MetricsRegistry::instance().gauge( "opcda_queue_pending_bytes", "", "Bytes in the disk queue not yet committed downstream" );
+static MetricCounter& s_dropped_bytes = MetricsRegistry::instance().counter( "opcda_queue_dropped_bytes_total", "", "Uncommitted bytes discarded because the disk queue was full" );
+static const char* QUEUE_OFFSET_FILE = "consumer.offset";
+
+enum
+{
+  RECORD_NONE = 0,
+  RECORD_OK = 1,
+  RECORD_SKIP = 2
+};
+
+static uint32_t load_u32( const uint8_t* p )
+{
+  return static_cast<uint32_t>( p[0] ) | ( static_cast<uint32_t>( p[1] ) << 8 ) | ( static_cast<uint32_t>( p[2] ) << 16 ) | ( static_cast<uint32_t>( p[3] ) << 24 );
+}
+
+static void store_u32( uint8_t* p, uint32_t v )
+{
+  for ( int i = 0; i < 4; ++i )
+  {
+    p[i] = static_cast<uint8_t>( v >> ( i * 8 ) );
+  }
+}
+
+static uint32_t record_crc( uint64_t offset, const uint8_t* payload, size_t length )
+{
+  uint8_t o[8];
+  for ( int i = 0; i < 8; ++i )
+  {
+    o[i] = static_cast<uint8_t>( offset >> ( i * 8 ) );
+  }
+  return crc32_update( crc32( o, sizeof( o ) ), payload, length );
+}
+
+class MappedSegment
+{
+public:
+  uint64_t base = 0;
+
+  ~MappedSegment()
+  {
+#ifdef _WIN32
+    if ( m_data )
+    {
+      UnmapViewOfFile( m_data );
+    }
+    if ( m_mapping )
+    {
+      CloseHandle( m_mapping );
+    }
+    if ( m_file != INVALID_HANDLE_VALUE )
+    {
+      CloseHandle( m_file );
+    }
+#else
+    if ( m_data )
+    {
+      munmap( m_data, m_size );
+    }
+    if ( m_fd >= 0 )
+    {
+      ::close( m_fd );
+    }
+#endif
+  }
+
+  static shared_ptr<MappedSegment> open( const string& path, size_t size, uint64_t base )
+  {
+    shared_ptr<MappedSegment> s( new MappedSegment() );
+    s->base = base;
+    s->m_size = size;
+
+#ifdef _WIN32
+    s->m_file = CreateFileA( path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+    if ( s->m_file == INVALID_HANDLE_VALUE )
+    {
+      return nullptr;
+    }
+
+    LARGE_INTEGER li;
+    li.QuadPart = static_cast<LONGLONG>( size );
+    s->m_mapping = CreateFileMappingA( s->m_file, NULL, PAGE_READWRITE, static_cast<DWORD>( li.HighPart ), li.LowPart, NULL );
+    if ( !s->m_mapping )
+    {
+      return nullptr;
+    }
+
+    s->m_data = static_cast<uint8_t*>( MapViewOfFile( s->m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size ) );
+    if ( !s->m_data )
+    {
+      return nullptr;
+    }
+#else
+    s->m_fd = ::open( path.c_str(), O_RDWR | O_CREAT, 0644 );
+    if ( s->m_fd < 0 )
+    {
+      return nullptr;
+    }
+
+    struct stat st;
+    if ( fstat( s->m_fd, &st ) != 0 || ( static_cast<size_t>( st.st_size ) < size && ftruncate( s->m_fd, static_cast<off_t>( size ) ) != 0 ) )
+    {
+      return nullptr;
+    }
+
+    void* data = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, s->m_fd, 0 );
+    if ( data == MAP_FAILED )
+    {
+      return nullptr;
+    }
+    s->m_data = static_cast<uint8_t*>( data );
+#endif
+
+    return s;
+  }
+
+  uint8_t* data()
+  {
+    return m_data;
+  }
+
+  void sync()
+  {
+#ifdef _WIN32
+    FlushViewOfFile( m_data, m_size );
+    FlushFileBuffers( m_file );
+#else
+    msync( m_data, m_size, MS_SYNC );
+#endif
+  }
+
+private:
+  MappedSegment()
+  {
+  }
+
+#ifdef _WIN32
+  HANDLE m_file = INVALID_HANDLE_VALUE;
+  HANDLE m_mapping = NULL;
+#else
+  int m_fd = -1;
+#endif
+  uint8_t* m_data = nullptr;
+  size_t m_size = 0;
+};
+
+DiskQueue::DiskQueue()
+{
+}
+
+DiskQueue::~DiskQueue()
+{
+  close();
+}
+
+void DiskQueue::set_segment_bytes( size_t bytes )
+{
+  if ( bytes >= 4096 )
+  {
+    m_segment_bytes = bytes;
+  }
+}
+
+void DiskQueue::set_max_segments( size_t segments )
+{
+  m_max_segments = max<size_t>( segments, 2 );
+}
+
+void DiskQueue::set_sync_policy( size_t records, int interval_ms )
+{
+  if ( records > 0 )
+  {
+    m_sync_records = records;
+  }
+
+  if ( interval_ms > 0 )
+  {
+    m_sync_interval = chrono::milliseconds( interval_ms );
+  }
+}
+
+string DiskQueue::segment_path( uint64_t base ) const
+{
+  char name[32];
+  snprintf( name, sizeof( name ), "%020llu.seg", static_cast<unsigned long long>( base ) );
+  return ( filesystem::path( m_dir ) / name ).string();
+}
+
+bool DiskQueue::open( const string& dir )
+{
+  close();
+
+  lock_guard<mutex> lock( m_lock );
+
+  m_dir = dir;
+  m_live.clear();
+  m_free.clear();
+  m_dropped_bytes = 0;
+
+  error_code ec;
+  filesystem::create_directories( m_dir, ec );
+
+  for ( const auto& entry : filesystem::directory_iterator( m_dir, ec ) )
+  {
+    string name = entry.path().filename().string();
+
+    if ( entry.path().extension() == ".seg" && name.size() == 24 && all_of( name.begin(), name.begin() + 20, ::isdigit ) )
+    {
+      uint64_t base = stoull( name.substr( 0, 20 ) );
+      if ( base % m_segment_bytes == 0 && entry.file_size( ec ) == m_segment_bytes )
+      {
+        m_live.insert( base );
+      }
+    }
+  }
+
+  if ( ec )
+  {
+    Logger::instance().logError( "[queue] Failed to read queue directory " + m_dir + ": " + ec.message() );
+    return false;
+  }
+
+  m_committed_offset = m_live.empty() ? 0 : *m_live.begin();
+
+  FILE* f = fopen( ( filesystem::path( m_dir ) / QUEUE_OFFSET_FILE ).string().c_str(), "rb" );
+  if ( f )
+  {
+    uint8_t buf[12];
+    if ( fread( buf, 1, sizeof( buf ), f ) == sizeof( buf ) && load_u32( buf + 8 ) == crc32( buf, 8 ) )
+    {
+      m_committed_offset = static_cast<uint64_t>( load_u32( buf ) ) | ( static_cast<uint64_t>( load_u32( buf + 4 ) ) << 32 );
+    }
+    fclose( f );
+  }
+
+  if ( m_live.empty() )
+  {
+    m_write_offset = segment_base( m_committed_offset ) == m_committed_offset ? m_committed_offset : segment_base( m_committed_offset ) + m_segment_bytes;
+    m_committed_offset = m_write_offset;
+  }
+  else
+  {
+    m_write_offset = scan_end( *m_live.rbegin() );
+
+    if ( m_committed_offset < *m_live.begin() )
+    {
+      Logger::instance().logWarning( "[queue] Committed offset precedes the oldest segment, records were dropped" );
+      m_committed_offset = *m_live.begin();
+    }
+
+    if ( m_committed_offset > m_write_offset )
+    {
+      Logger::instance().logWarning( "[queue] Committed offset is past the end of the queue, resetting" );
+      m_committed_offset = m_write_offset;
+    }
+  }
+
+  m_read_offset = m_committed_offset;
+  m_persisted_offset = m_committed_offset;
+  recycle_consumed();
+  s_pending_bytes.set( static_cast<int64_t>( m_write_offset - m_committed_offset ) );
+
+  m_running = true;
+  m_sync_thread = thread( &DiskQueue::sync_loop, this );
+
+  Logger::instance().logInfo( "[queue] Opened " + m_dir + ", replaying " + to_string( m_write_offset - m_read_offset ) + " bytes from offset " + to_string( m_read_offset ) );
+  return true;
+}
+
+void DiskQueue::close()
+{
+  {
+    lock_guard<mutex> lock( m_lock );
+    if ( !m_running )
+    {
+      return;
+    }
+    m_running = false;
+  }
+
+  m_sync_wakeup.notify_all();
+  m_data_ready.notify_all();
+
+  if ( m_sync_thread.joinable() )
+  {
+    m_sync_thread.join();
+  }
+
+  sync();
+
+  lock_guard<mutex> lock( m_lock );
+  m_write_segment.reset();
+  m_read_segment.reset();
+  m_unsynced.clear();
+}
+
+shared_ptr<MappedSegment> DiskQueue::map_segment( uint64_t base )
+{
+  if ( m_write_segment && m_write_segment->base == base )
+  {
+    return m_write_segment;
+  }
+
+  if ( m_read_segment && m_read_segment->base == base )
+  {
+    return m_read_segment;
+  }
+
+  shared_ptr<MappedSegment> segment = MappedSegment::open( segment_path( base ), m_segment_bytes, base );
+  if ( !segment )
+  {
+    Logger::instance().logError( "[queue] Failed to map segment " + segment_path( base ) );
+  }
+  return segment;
+}
+
+int DiskQueue::record_at( MappedSegment& segment, uint64_t offset, const uint8_t*& payload, uint32_t& length )
+{
+  size_t pos = static_cast<size_t>( offset % m_segment_bytes );
+
+  if ( pos + QUEUE_RECORD_HEADER > m_segment_bytes )
+  {
+    return RECORD_SKIP;
+  }
+
+  const uint8_t* p = segment.data() + pos;
+  uint32_t len = load_u32( p );
+  uint32_t crc = load_u32( p + 4 );
+
+  if ( len == QUEUE_SKIP_MARKER )
+  {
+    return crc == record_crc( offset, nullptr, 0 ) ? RECORD_SKIP : RECORD_NONE;
+  }
+
+  if ( len == 0 || pos + QUEUE_RECORD_HEADER + len > m_segment_bytes || crc != record_crc( offset, p + QUEUE_RECORD_HEADER, len ) )
+  {
+    return RECORD_NONE;
+  }
+
+  payload = p + QUEUE_RECORD_HEADER;
+  length = len;
+  return RECORD_OK;
+}
+
+uint64_t DiskQueue::scan_end( uint64_t base )
+{
+  shared_ptr<MappedSegment> segment = map_segment( base );
+  if ( !segment )
+  {
+    return base + m_segment_bytes;
+  }
+
+  uint64_t offset = base;
+  while ( offset < base + m_segment_bytes )
+  {
+    const uint8_t* payload = nullptr;
+    uint32_t length = 0;
+    int rc = record_at( *segment, offset, payload, length );
+
+    if ( rc == RECORD_OK )
+    {
+      offset += QUEUE_RECORD_HEADER + length;
+    }
+    else if ( rc == RECORD_SKIP )
+    {
+      return base + m_segment_bytes;
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  m_write_segment = segment;
+  return offset;
+}
+
+bool DiskQueue::start_segment( uint64_t base, uint64_t& drop_offset )
+{
+  while ( m_live.size() >= m_max_segments )
+  {
+    uint64_t oldest = *m_live.begin();
+    uint64_t oldest_end = oldest + m_segment_bytes;
+
+    if ( m_read_offset < oldest_end )
+    {
+      uint64_t dropped = min( m_write_offset, oldest_end ) - m_read_offset;
+      m_dropped_bytes += dropped;
+      s_dropped_bytes.add( static_cast<int64_t>( dropped ) );
+      m_read_offset = oldest_end;
+      Logger::instance().logWarning( "[queue] Queue full, dropping oldest segment " + to_string( oldest ) );
+    }
+
+    // persisted by append() once the lock is released; until then a restart starts inside the dropped segment and skips ahead
+    if ( m_committed_offset < oldest_end )
+    {
+      m_committed_offset = oldest_end;
+      drop_offset = oldest_end;
+    }
+
+    if ( m_read_segment && m_read_segment->base == oldest )
+    {
+      m_read_segment.reset();
+    }
+
+    m_live.erase( oldest );
+    m_free.push_back( segment_path( oldest ) );
+  }
+
+  string path = segment_path( base );
+  error_code ec;
+
+  if ( !m_free.empty() )
+  {
+    string recycled = m_free.back();
+    m_free.pop_back();
+
+    filesystem::rename( recycled, path, ec );
+    if ( ec )
+    {
+      filesystem::remove( recycled, ec );
+    }
+  }
+
+  shared_ptr<MappedSegment> segment = MappedSegment::open( path, m_segment_bytes, base );
+  if ( !segment )
+  {
+    Logger::instance().logError( "[queue] Failed to create segment " + path );
+    return false;
+  }
+
+  m_live.insert( base );
+  m_write_segment = segment;
+  trim_free();
+  return true;
+}
+
+void DiskQueue::trim_free()
+{
+  // recycled files take disk space like live ones, so both count against the segment budget
+  while ( !m_free.empty() && ( m_free.size() > QUEUE_MAX_FREE_SEGMENTS || m_live.size() + m_free.size() > m_max_segments ) )
+  {
+    error_code ec;
+    filesystem::remove( m_free.front(), ec );
+    m_free.erase( m_free.begin() );
+  }
+}
+
+void DiskQueue::recycle_consumed()
+{
+  uint64_t write_base = segment_base( m_write_offset );
+
+  while ( !m_live.empty() )
+  {
+    uint64_t oldest = *m_live.begin();
+    if ( oldest + m_segment_bytes > m_persisted_offset.load() || oldest == write_base )
+    {
+      break;
+    }
+
+    if ( m_read_segment && m_read_segment->base == oldest )
+    {
+      m_read_segment.reset();
+    }
+
+    m_live.erase( oldest );
+    m_free.push_back( segment_path( oldest ) );
+  }
+
+  trim_free();
+}
+
+bool DiskQueue::append( const vector<uint8_t>& record )
+{
+  if ( record.empty() || record.size() + QUEUE_RECORD_HEADER > m_segment_bytes )
+  {
+    return false;
+  }
+
+  uint64_t drop_offset = 0;
+  bool appended = false;
+  {
+    lock_guard<mutex> lock( m_lock );
+    appended = append_locked( record, drop_offset );
+  }
+
+  // a queue full drop moved the committed offset; producers do not wait for the offset file to be flushed
+  if ( drop_offset != 0 && !write_committed( drop_offset ) )
+  {
+    Logger::instance().logError( "[queue] Failed to persist committed offset " + to_string( drop_offset ) );
+  }
+
+  return appended;
+}
+
+bool DiskQueue::append_locked( const vector<uint8_t>& record, uint64_t& drop_offset )
+{
+  if ( !m_running )
+  {
+    return false;
+  }
+
+  uint64_t base = segment_base( m_write_offset );
+  if ( !m_write_segment || m_write_segment->base != base )
+  {
+    if ( m_live.count( base ) )
+    {
+      m_write_segment = map_segment( base );
+    }
+    else if ( !start_segment( base, drop_offset ) )
+    {
+      return false;
+    }
+
+    if ( !m_write_segment )
+    {
+      return false;
+    }
+  }
+
+  size_t need = QUEUE_RECORD_HEADER + record.size();
+  size_t pos = static_cast<size_t>( m_write_offset - base );
+
+  if ( pos + need > m_segment_bytes )
+  {
+    if ( pos + QUEUE_RECORD_HEADER <= m_segment_bytes )
+    {
+      uint8_t* p = m_write_segment->data() + pos;
+      store_u32( p, QUEUE_SKIP_MARKER );
+      store_u32( p + 4, record_crc( m_write_offset, nullptr, 0 ) );
+    }
+
+    m_unsynced.push_back( m_write_segment );
+    m_write_offset = base + m_segment_bytes;
+
+    if ( !start_segment( m_write_offset, drop_offset ) )
+    {
+      return false;
+    }
+
+    pos = 0;
+  }
+
+  uint8_t* p = m_write_segment->data() + pos;
+  memcpy( p + QUEUE_RECORD_HEADER, record.data(), record.size() );
+  store_u32( p, static_cast<uint32_t>( record.size() ) );
+  store_u32( p + 4, record_crc( m_write_offset, record.data(), record.size() ) );
+
+  m_write_offset += need;
+  s_pending_bytes.set( static_cast<int64_t>( m_write_offset - m_committed_offset ) );
+
+  if ( ++m_unsynced_records >= m_sync_records )
+  {
+    m_sync_wakeup.notify_one();
+  }
+
+  m_data_ready.notify_all();
+  return true;
+}
+
+bool DiskQueue::read( uint64_t& offset, vector<uint8_t>& record, uint64_t& next_offset, chrono::milliseconds wait )
+{
+  unique_lock<mutex> lock( m_lock );
+  auto deadline = chrono::steady_clock::now() + wait;
+
+  while ( m_running )
+  {
+    if ( m_read_offset >= m_write_offset )
+    {
+      if ( m_data_ready.wait_until( lock, deadline ) == cv_status::timeout && m_read_offset >= m_write_offset )
+      {
+        return false;
+      }
+      continue;
+    }
+
+    uint64_t base = segment_base( m_read_offset );
+
+    if ( !m_live.count( base ) )
+    {
+      auto it = m_live.upper_bound( base );
+      m_read_offset = ( it == m_live.end() ) ? m_write_offset : *it;
+      continue;
+    }
+
+    if ( !m_read_segment || m_read_segment->base != base )
+    {
+      m_read_segment = map_segment( base );
+      if ( !m_read_segment )
+      {
+        return false;
+      }
+    }
+
+    const uint8_t* payload = nullptr;
+    uint32_t length = 0;
+    int rc = record_at( *m_read_segment, m_read_offset, payload, length );
+
+    if ( rc == RECORD_OK )
+    {
+      offset = m_read_offset;
+      record.assign( payload, payload + length );
+      m_read_offset += QUEUE_RECORD_HEADER + length;
+      next_offset = m_read_offset;
+      return true;
+    }
+
+    if ( rc == RECORD_NONE )
+    {
+      Logger::instance().logWarning( "[queue] Corrupt record at offset " + to_string( m_read_offset ) + ", skipping to next segment" );
+    }
+
+    m_read_offset = ( segment_base( m_write_offset ) == base ) ? m_write_offset : base + m_segment_bytes;
+  }
+
+  return false;
+}
+
+bool DiskQueue::write_committed( uint64_t offset )
+{
+  lock_guard<mutex> lock( m_offset_lock );
+
+  // a queue full drop may already have persisted a later offset
+  if ( offset <= m_persisted_offset )
+  {
+    return true;
+  }
+
+  uint8_t buf[12];
+  store_u32( buf, static_cast<uint32_t>( offset ) );
+  store_u32( buf + 4, static_cast<uint32_t>( offset >> 32 ) );
+  store_u32( buf + 8, crc32( buf, 8 ) );
+
+  filesystem::path target = filesystem::path( m_dir ) / QUEUE_OFFSET_FILE;
+  filesystem::path temp = target;
+  temp += ".tmp";
+
+  // the data reaches the disk before the rename publishes it, so a crash leaves the old or the new offset
+#ifdef _WIN32
+  HANDLE f = CreateFileA( temp.string().c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+  if ( f == INVALID_HANDLE_VALUE )
+  {
+    return false;
+  }
+
+  DWORD written = 0;
+  bool ok = WriteFile( f, buf, sizeof( buf ), &written, NULL ) && written == sizeof( buf ) && FlushFileBuffers( f );
+  CloseHandle( f );
+
+  ok = ok && MoveFileExA( temp.string().c_str(), target.string().c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH );
+#else
+  int fd = ::open( temp.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+  if ( fd < 0 )
+  {
+    return false;
+  }
+
+  bool ok = ::write( fd, buf, sizeof( buf ) ) == static_cast<ssize_t>( sizeof( buf ) ) && fsync( fd ) == 0;
+  ::close( fd );
+
+  ok = ok && ::rename( temp.string().c_str(), target.string().c_str() ) == 0;
+
+  if ( ok )
+  {
+    int dir = ::open( m_dir.c_str(), O_RDONLY );
+    if ( dir >= 0 )
+    {
+      fsync( dir );
+      ::close( dir );
+    }
+  }
+#endif
+
+  if ( ok )
+  {
+    m_persisted_offset = offset;
+  }
+  return ok;
+}
+
+bool DiskQueue::commit( uint64_t next_offset )
+{
+  {
+    lock_guard<mutex> lock( m_lock );
+
+    if ( next_offset <= m_committed_offset || next_offset > m_write_offset )
+    {
+      return false;
+    }
+
+    m_committed_offset = next_offset;
+    s_pending_bytes.set( static_cast<int64_t>( m_write_offset - m_committed_offset ) );
+  }
+
+  // append() keeps running while the offset file is written and flushed
+  if ( !write_committed( next_offset ) )
+  {
+    Logger::instance().logError( "[queue] Failed to persist committed offset " + to_string( next_offset ) );
+    return false;
+  }
+
+  lock_guard<mutex> lock( m_lock );
+  recycle_consumed();
+  return true;
+}
+
+void DiskQueue::sync()
+{
+  vector<shared_ptr<MappedSegment>> segments;
+
+  {
+    lock_guard<mutex> lock( m_lock );
+    segments.swap( m_unsynced );
+
+    if ( m_write_segment && m_unsynced_records > 0 )
+    {
+      segments.push_back( m_write_segment );
+    }
+    m_unsynced_records = 0;
+  }
+
+  for ( auto& segment : segments )
+  {
+    segment->sync();
+  }
+}
+
+void DiskQueue::sync_loop()
+{
+  unique_lock<mutex> lock( m_lock );
+
+  while ( m_running )
+  {
+    m_sync_wakeup.wait_for( lock, m_sync_interval, [this]() { return !m_running || m_unsynced_records >= m_sync_records; } );
+
+    lock.unlock();
+    sync();
+    lock.lock();
+  }
+}
+
+uint64_t DiskQueue::pending_bytes() const
+{
+  lock_guard<mutex> lock( m_lock );
+  return m_write_offset - m_committed_offset;
+}
+
+QueueSink::QueueSink( SampleSink& downstream ) : m_downstream( downstream )
+{
+}
+
+QueueSink::~QueueSink()
+{
+  close();
+}
+
+bool QueueSink::open( const string& dir )
+{
+  close();
+
+  if ( !m_queue.open( dir ) )
+  {
+    return false;
+  }
+
+  m_running = true;
+  m_forwarder = thread( &QueueSink::forward, this );
+  return true;
+}
+
+void QueueSink::close()
+{
+  m_running = false;
+
+  if ( m_forwarder.joinable() )
+  {
+    m_forwarder.join();
+  }
+
+  m_queue.close();
+}
+
+bool QueueSink::write( const vector<OPCDA_SAMPLE>& samples )
+{
+  if ( samples.empty() )
+  {
+    return true;
+  }
+
+  vector<uint8_t> record;
+  encode( samples, record );
+  return m_queue.append( record );
+}
+
+bool QueueSink::flush()
+{
+  // durable in the queue is delivered as far as the acquisition side is concerned
+  m_queue.sync();
+  return true;
+}
+
+void QueueSink::forward()
+{
+  uint64_t uncommitted = 0;
+  auto last_commit = chrono::steady_clock::now();
+
+  auto commit = [&]()
+  {
+    // records the downstream has not confirmed stay uncommitted and are replayed after a restart
+    if ( uncommitted != 0 && m_downstream.flush() )
+    {
+      m_queue.commit( uncommitted );
+      uncommitted = 0;
+    }
+    last_commit = chrono::steady_clock::now();
+  };
+
+  while ( m_running )
+  {
+    uint64_t offset = 0;
+    uint64_t next_offset = 0;
+    vector<uint8_t> record;
+
+    if ( !m_queue.read( offset, record, next_offset, chrono::milliseconds( 200 ) ) )
+    {
+      commit();
+      continue;
+    }
+
+    vector<OPCDA_SAMPLE> samples;
+    if ( !decode( record, samples ) )
+    {
+      Logger::instance().logWarning( "[queue] Skipping undecodable record at offset " + to_string( offset ) );
+      uncommitted = next_offset;
+      continue;
+    }
+
+    int backoff_ms = 100;
+    bool delivered = false;
+
+    while ( m_running && !( delivered = m_downstream.write( samples ) ) )
+    {
+      this_thread::sleep_for( chrono::milliseconds( backoff_ms ) );
+      backoff_ms = min( backoff_ms * 2, 5000 );
+    }
+
+    if ( !delivered )
+    {
+      break;
+    }
+
+    uncommitted = next_offset;
+
+    if ( chrono::steady_clock::now() - last_commit >= m_commit_interval )
+    {
+      commit();
+    }
+  }
+
+  commit();
+}
+
+void QueueSink::encode( const vector<OPCDA_SAMPLE>& samples, vector<uint8_t>& record )
+{
+  auto put = [&]( uint64_t v, int bytes )
+  {
+    for ( int i = 0; i < bytes; ++i )
+    {
+      record.push_back( static_cast<uint8_t>( v >> ( i * 8 ) ) );
+    }
+  };
+
+  // records holding an array sample set the top bit of the count and carry
+  // u32 element count + f64 elements after every sample; older records stay readable
+  bool arrays = any_of( samples.begin(), samples.end(), []( const OPCDA_SAMPLE& s ) { return !s.elements.empty(); } );
+
+  record.clear();
+  put( samples.size() | ( arrays ? QUEUE_RECORD_ARRAYS : 0 ), 4 );
+
+  for ( const auto& s : samples )
+  {
+    uint64_t value_bits;
+    memcpy( &value_bits, &s.value, sizeof( value_bits ) );
+
+    size_t id_len = min<size_t>( s.id.size(), 0xFFFF );
+    put( id_len, 2 );
+    record.insert( record.end(), s.id.begin(), s.id.begin() + id_len );
+    put( static_cast<uint64_t>( s.timestamp ), 8 );
+    put( value_bits, 8 );
+    put( s.quality, 2 );
+
+    if ( arrays )
+    {
+      put( s.elements.size(), 4 );
+      for ( double element : s.elements )
+      {
+        memcpy( &value_bits, &element, sizeof( value_bits ) );
+        put( value_bits, 8 );
+      }
+    }
+  }
+}
+
+bool QueueSink::decode( const vector<uint8_t>& record, vector<OPCDA_SAMPLE>& samples )
+{
+  size_t pos = 0;
+
+  auto get = [&]( int bytes, uint64_t& v ) -> bool
+  {
+    if ( pos + bytes > record.size() )
+    {
+      return false;
+    }
+
+    v = 0;
+    for ( int i = 0; i < bytes; ++i )
+    {
+      v |= static_cast<uint64_t>( record[pos + i] ) << ( i * 8 );
+    }
+    pos += bytes;
+    return true;
+  };
+
+  uint64_t count = 0;
+  if ( !get( 4, count ) )
+  {
+    return false;
+  }
+
+  bool arrays = ( count & QUEUE_RECORD_ARRAYS ) != 0;
+  count &= ~static_cast<uint64_t>( QUEUE_RECORD_ARRAYS );
+
+  samples.clear();
+  samples.reserve( static_cast<size_t>( min<uint64_t>( count, record.size() / 20 ) ) );
+
+  for ( uint64_t i = 0; i < count; ++i )
+  {
+    uint64_t id_len, timestamp, value_bits, quality;
+    if ( !get( 2, id_len ) || pos + id_len > record.size() )
+    {
+      return false;
+    }
+
+    OPCDA_SAMPLE s;
+    s.id.assign( reinterpret_cast<const char*>( record.data() + pos ), static_cast<size_t>( id_len ) );
+    pos += static_cast<size_t>( id_len );
+
+    if ( !get( 8, timestamp ) || !get( 8, value_bits ) || !get( 2, quality ) )
+    {
+      return false;
+    }
+
+    s.timestamp = static_cast<int64_t>( timestamp );
+    memcpy( &s.value, &value_bits, sizeof( s.value ) );
+    s.quality = static_cast<uint16_t>( quality );
+
+    uint64_t elements = 0;
+    if ( arrays && ( !get( 4, elements ) || elements > ( record.size() - pos ) / 8 ) )
+    {
+      return false;
+    }
+
+    s.elements.resize( static_cast<size_t>( elements ) );
+    for ( auto& element : s.elements )
+    {
+      get( 8, value_bits );
+      memcpy( &element, &value_bits, sizeof( element ) );
+    }
+
+    samples.push_back( move( s ) );
+  }
+
+  return pos == record.size();
+}
@@ -0,0 +1,148 @@
+// opcda_queue.h
+#ifndef OPCDA_QUEUE_H
+#define OPCDA_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opcda_sample.h"
+
+using namespace std;
+
+constexpr size_t DEFAULT_QUEUE_SEGMENT_BYTES = 16 * 1024 * 1024;
+constexpr size_t DEFAULT_QUEUE_MAX_SEGMENTS = 64;
+constexpr size_t DEFAULT_QUEUE_SYNC_RECORDS = 256;
+constexpr int DEFAULT_QUEUE_SYNC_INTERVAL_MS = 200;
+constexpr int DEFAULT_QUEUE_COMMIT_INTERVAL_MS = 1000;
+
+class MappedSegment;
+
+/**
+ * @brief Durable FIFO of byte records stored in memory-mapped segment files.
+ *
+ * Records are addressed by their global byte offset. Each record is framed as
+ * u32 length, u32 crc32(offset + payload); folding the offset into the checksum makes
+ * stale bytes left in a recycled segment fail validation, so no zero fill is needed.
+ * The consumer cursor restarts from the last committed offset after a restart.
+ */
+class DiskQueue
+{
+public:
+  DiskQueue();
+  ~DiskQueue();
+
+  void set_segment_bytes( size_t bytes );
+  void set_max_segments( size_t segments );
+  void set_sync_policy( size_t records, int interval_ms );
+
+  bool open( const string& dir );
+  void close();
+
+  bool append( const vector<uint8_t>& record );
+  bool read( uint64_t& offset, vector<uint8_t>& record, uint64_t& next_offset, chrono::milliseconds wait );
+  bool commit( uint64_t next_offset );
+  void sync();
+
+  uint64_t pending_bytes() const;
+  uint64_t dropped_bytes() const
+  {
+    return m_dropped_bytes;
+  }
+
+private:
+  string m_dir;
+  size_t m_segment_bytes = DEFAULT_QUEUE_SEGMENT_BYTES;
+  size_t m_max_segments = DEFAULT_QUEUE_MAX_SEGMENTS;
+  size_t m_sync_records = DEFAULT_QUEUE_SYNC_RECORDS;
+  chrono::milliseconds m_sync_interval{ DEFAULT_QUEUE_SYNC_INTERVAL_MS };
+
+  mutable mutex m_lock;
+  condition_variable m_data_ready;
+  condition_variable m_sync_wakeup;
+  thread m_sync_thread;
+  bool m_running = false;
+
+  uint64_t m_write_offset = 0;
+  uint64_t m_read_offset = 0;
+  uint64_t m_committed_offset = 0;
+  atomic<uint64_t> m_dropped_bytes{ 0 };
+
+  // serializes consumer.offset writes, which run outside m_lock; segments are
+  // recycled only once the offset past them is on disk
+  mutex m_offset_lock;
+  atomic<uint64_t> m_persisted_offset{ 0 };
+
+  set<uint64_t> m_live;
+  vector<string> m_free;
+  shared_ptr<MappedSegment> m_write_segment;
+  shared_ptr<MappedSegment> m_read_segment;
+  vector<shared_ptr<MappedSegment>> m_unsynced;
+  size_t m_unsynced_records = 0;
+
+  string segment_path( uint64_t base ) const;
+  uint64_t segment_base( uint64_t offset ) const
+  {
+    return offset - offset % m_segment_bytes;
+  }
+
+  shared_ptr<MappedSegment> map_segment( uint64_t base );
+  bool append_locked( const vector<uint8_t>& record, uint64_t& drop_offset );
+  bool start_segment( uint64_t base, uint64_t& drop_offset );
+  void recycle_consumed();
+  void trim_free();
+  uint64_t scan_end( uint64_t base );
+  int record_at( MappedSegment& segment, uint64_t offset, const uint8_t*& payload, uint32_t& length );
+  bool write_committed( uint64_t offset );
+  void sync_loop();
+};
+
+/**
+ * @brief Decouples acquisition from a slow downstream sink: write() appends to a
+ *        DiskQueue and returns, a forwarder thread replays the queue into the sink.
+ *        Offsets are committed only after the downstream sink has been flushed.
+ *
+ * Delivery is at-least-once: a crash after the downstream write but before the
+ * commit replays those records on restart, so sinks see them twice. This is
+ * deliberate: exactly-once needs a sink that stores the offset in the same
+ * write as the samples, and neither the PI archive, the capture file nor the
+ * console can. The replayed window is at most one commit interval.
+ */
+class QueueSink : public SampleSink
+{
+public:
+  explicit QueueSink( SampleSink& downstream );
+  ~QueueSink();
+
+  DiskQueue& queue()
+  {
+    return m_queue;
+  }
+
+  bool open( const string& dir );
+  void close();
+
+  bool write( const vector<OPCDA_SAMPLE>& samples ) override;
+  bool flush() override;
+
+  static void encode( const vector<OPCDA_SAMPLE>& samples, vector<uint8_t>& record );
+  static bool decode( const vector<uint8_t>& record, vector<OPCDA_SAMPLE>& samples );
+
+private:
+  SampleSink& m_downstream;
+  DiskQueue m_queue;
+  thread m_forwarder;
+  atomic<bool> m_running{ false };
+  chrono::milliseconds m_commit_interval{ DEFAULT_QUEUE_COMMIT_INTERVAL_MS };
+
+  void forward();
+};
+
+#endif
@@ -0,0 +1,54 @@
+// opcda_sample.h
+#ifndef OPCDA_SAMPLE_H
+#define OPCDA_SAMPLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+constexpr int64_t FILETIME_UNIX_EPOCH_TICKS = 116444736000000000LL;
+constexpr int64_t FILETIME_TICKS_PER_MS = 10000LL;
+
+/**
+ * @brief Portable acquisition sample handed from the read loop to output sinks.
+ *        timestamp is in FILETIME ticks (100 ns since 1601-01-01 UTC).
+ *        An array tag stays one sample: elements holds its values in memory
+ *        order and value repeats the first element; scalars leave it empty.
+ */
+struct OPCDA_SAMPLE
+{
+  string id;
+  int64_t timestamp = 0;
+  double value = 0.0;
+  uint16_t quality = 0;
+  vector<double> elements;
+};
+
+/**
+ * @brief Output of the acquisition loop. flush() returns true once everything
+ *        written so far has been delivered; a QueueSink commits only then.
+ */
+class SampleSink
+{
+public:
+  virtual ~SampleSink()
+  {
+  }
+
+  virtual bool write( const vector<OPCDA_SAMPLE>& samples ) = 0;
+  virtual bool flush() = 0;
+};
+
+inline int64_t ticks_to_epoch_ms( int64_t ticks )
+{
+  return ticks < FILETIME_UNIX_EPOCH_TICKS ? 0 : ( ticks - FILETIME_UNIX_EPOCH_TICKS ) / FILETIME_TICKS_PER_MS;
+}
+
+inline int64_t epoch_ms_to_ticks( int64_t ms )
+{
+  return ms * FILETIME_TICKS_PER_MS + FILETIME_UNIX_EPOCH_TICKS;
+}
+
+#endif
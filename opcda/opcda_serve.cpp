@@ -0,0 +1,1049 @@
+// opcda_serve.cpp
+#define NOMINMAX
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <future>
+#include <iterator>
+
+#include "logger.h"
+#include "opcda_format.h"
+#include "opcda_metrics.h"
+#include "opcda_serve.h"
+#include "opcda_trace.h"
+#include "opcda_utf.h"
+#include "opcda_utils.h"
+
+using namespace std;
+
+constexpr DWORD SERVE_PIPE_BUFFER = 64 * 1024;
+constexpr int SERVE_WAKE_MS = 200;
+
+static MetricHistogram& s_poll_latency = MetricsRegistry::instance().histogram( "opcda_serve_poll_duration_seconds", "", "Read of the whole --serve watch set" );
+static MetricHistogram& s_read_latency = MetricsRegistry::instance().histogram( "opcda_serve_request_duration_seconds", "command=\"READ\"", "--serve request latency, pipe I/O excluded" );
+static MetricHistogram& s_browse_latency = MetricsRegistry::instance().histogram( "opcda_serve_request_duration_seconds", "command=\"BROWSE\"" );
+static MetricCounter& s_cache_misses = MetricsRegistry::instance().counter( "opcda_serve_cache_misses_total", "", "Requested tags --serve had no fresh cached value for" );
+static MetricGauge& s_watched_tags = MetricsRegistry::instance().gauge( "opcda_serve_watched_tags", "", "Tags read by every --serve poll" );
+static MetricCounter& s_expired_tags = MetricsRegistry::instance().counter( "opcda_serve_expired_tags_total", "", "Tags dropped from the --serve watch set after going unrequested" );
+static MetricGauge& s_clients = MetricsRegistry::instance().gauge( "opcda_serve_clients", "", "Connected --serve clients" );
+
+static string to_utf8( const wstring& text )
+{
+  string out;
+  OPCDA::UTILS::append_utf8( text.data(), text.size(), out );
+  return out;
+}
+
+static wstring to_wide( const string& text )
+{
+  wstring out;
+  OPCDA::UTILS::append_wide( text.data(), text.size(), out );
+  return out;
+}
+
+// fields are tab separated and records end at a newline, so neither may appear inside one
+static void append_field( string& out, const string& field )
+{
+  for ( char c : field )
+  {
+    out += ( c == '\t' || c == '\r' || c == '\n' ) ? ' ' : c;
+  }
+}
+
+static string hresult_hex( HRESULT hr )
+{
+  char code[16];
+  snprintf( code, sizeof( code ), "0x%08X", static_cast<unsigned>( hr ) );
+  return code;
+}
+
+static string error_line( HRESULT hr, const string& message )
+{
+  return "ERR " + hresult_hex( hr ) + " " + message + "\n";
+}
+
+static int64_t filetime_ticks( const FILETIME& ft )
+{
+  return static_cast<int64_t>( ( static_cast<uint64_t>( ft.dwHighDateTime ) << 32 ) | ft.dwLowDateTime );
+}
+
+// one READ or SUBSCRIBE value line: tag, value, quality, ISO 8601 timestamp, result
+static void append_value_line( string& out, const wstring& item_id, const string& value, WORD quality, int64_t timestamp, HRESULT error )
+{
+  char time[OPCDA::UTILS::FORMAT_TIME_CHARS];
+  char* time_end = timestamp ? OPCDA::UTILS::format_iso8601( time, time + sizeof( time ), timestamp ) : time;
+
+  append_field( out, to_utf8( item_id ) );
+  out += '\t';
+  append_field( out, value );
+  out += '\t' + to_string( quality ) + '\t' + string( time, time_end ) + '\t' + hresult_hex( error ) + '\n';
+}
+
+static void append_tag_line( string& out, const wstring& item_id, OPCDA_TAG& tag, HRESULT error )
+{
+  if ( FAILED( error ) )
+  {
+    append_value_line( out, item_id, "", 0, 0, error );
+  }
+  else
+  {
+    append_value_line( out, item_id, OPCDA::UTILS::variant_to_str( tag.value ), tag.quality, filetime_ticks( tag.timestamp ), error );
+  }
+}
+
+/**
+ * @brief Waits for an overlapped pipe operation, or cancels it once stop is signalled.
+ */
+static bool complete_io( HANDLE pipe, OVERLAPPED& ov, HANDLE stop, BOOL started, DWORD& bytes )
+{
+  bytes = 0;
+
+  if ( !started && GetLastError() != ERROR_IO_PENDING )
+  {
+    return false;
+  }
+
+  HANDLE waits[2] = { ov.hEvent, stop };
+  if ( WaitForMultipleObjects( 2, waits, FALSE, INFINITE ) != WAIT_OBJECT_0 )
+  {
+    CancelIoEx( pipe, &ov );
+    GetOverlappedResult( pipe, &ov, &bytes, TRUE );
+    return false;
+  }
+
+  return GetOverlappedResult( pipe, &ov, &bytes, FALSE ) != FALSE;
+}
+
+TagServer::TagServer( OpcDaClient& client )
+    : m_client( client )
+{
+  m_stop_event = CreateEvent( NULL, TRUE, FALSE, NULL );
+}
+
+TagServer::~TagServer()
+{
+  stop();
+
+  if ( m_stop_event )
+  {
+    CloseHandle( m_stop_event );
+  }
+}
+
+void TagServer::set_interval( int interval_ms )
+{
+  m_interval_ms = max( interval_ms, 10 );
+}
+
+void TagServer::set_timeout( int timeout_ms )
+{
+  m_timeout_ms = max( timeout_ms, 100 );
+}
+
+void TagServer::set_max_tags( size_t max_tags )
+{
+  m_max_tags = max<size_t>( max_tags, 1 );
+}
+
+wstring TagServer::pipe_path( const string& pipe_name )
+{
+  wstring name = to_wide( pipe_name.empty() ? DEFAULT_SERVE_PIPE : pipe_name );
+  return name.rfind( L"\\\\", 0 ) == 0 ? name : L"\\\\.\\pipe\\" + name;
+}
+
+HANDLE TagServer::create_pipe( bool first )
+{
+  // local clients only; a second server on the same name fails instead of sharing it
+  DWORD open_mode = PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | ( first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0 );
+  DWORD pipe_mode = PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS;
+
+  return CreateNamedPipeW( m_pipe_path.c_str(), open_mode, pipe_mode, PIPE_UNLIMITED_INSTANCES, SERVE_PIPE_BUFFER, SERVE_PIPE_BUFFER, 0, NULL );
+}
+
+bool TagServer::start( const string& pipe_name, const vector<wstring>& tags )
+{
+  if ( !m_stop_event || m_acceptor.joinable() )
+  {
+    return false;
+  }
+
+  m_pipe_path = pipe_path( pipe_name );
+  m_listen = create_pipe( true );
+
+  if ( m_listen == INVALID_HANDLE_VALUE )
+  {
+    Logger::instance().logError( "[serve] Cannot create pipe " + to_utf8( m_pipe_path ) + ", error " + to_string( GetLastError() ) );
+    return false;
+  }
+
+  if ( !tags.empty() )
+  {
+    if ( !watch( tags, true ) )
+    {
+      Logger::instance().logWarning( "[serve] " + to_string( tags.size() ) + " tags exceed the watch limit of " + to_string( m_max_tags ) + ", none watched" );
+    }
+
+    vector<OPCDA_TAG> results;
+    vector<HRESULT> errors;
+
+    if ( SUCCEEDED( m_client.read_sync( m_watch_ids, results, errors ) ) )
+    {
+      update( m_watch_ids, results, errors, false );
+    }
+
+    for ( auto& tag : results )
+    {
+      VariantClear( &tag.value );
+    }
+  }
+
+  {
+    lock_guard<mutex> lock( m_job_lock );
+    m_running = true;
+  }
+
+  ResetEvent( m_stop_event );
+  m_acceptor = thread( &TagServer::accept_loop, this );
+
+  Logger::instance().logInfo( "[serve] Listening on " + to_utf8( m_pipe_path ) + ", " + to_string( m_watch_ids.size() ) + " tags watched" );
+  return true;
+}
+
+void TagServer::stop()
+{
+  {
+    lock_guard<mutex> lock( m_job_lock );
+    m_running = false;
+    m_jobs.clear();
+  }
+
+  if ( m_stop_event )
+  {
+    SetEvent( m_stop_event );
+  }
+
+  {
+    lock_guard<mutex> lock( m_subscriber_lock );
+    for ( auto& subscriber : m_subscribers )
+    {
+      lock_guard<mutex> subscriber_lock( subscriber->lock );
+      subscriber->closed = true;
+      subscriber->wake.notify_all();
+    }
+  }
+
+  if ( m_acceptor.joinable() )
+  {
+    m_acceptor.join();
+  }
+
+  list<unique_ptr<CONNECTION>> connections;
+  {
+    lock_guard<mutex> lock( m_connection_lock );
+    connections.swap( m_connections );
+  }
+
+  for ( auto& connection : connections )
+  {
+    if ( connection->worker.joinable() )
+    {
+      connection->worker.join();
+    }
+  }
+
+  if ( m_listen != INVALID_HANDLE_VALUE )
+  {
+    CloseHandle( m_listen );
+    m_listen = INVALID_HANDLE_VALUE;
+  }
+}
+
+void TagServer::run( const atomic<bool>& stop_requested )
+{
+  auto next_poll = chrono::steady_clock::now();
+
+  while ( !stop_requested )
+  {
+    run_jobs();
+
+    auto now = chrono::steady_clock::now();
+    if ( now >= next_poll )
+    {
+      // heartbeats and reconnects only run here while reads keep succeeding
+      m_client.supervise();
+      poll();
+      expire();
+
+      next_poll += chrono::milliseconds( m_interval_ms );
+      if ( next_poll < now )
+      {
+        next_poll = now + chrono::milliseconds( m_interval_ms );
+      }
+    }
+
+    unique_lock<mutex> lock( m_job_lock );
+    m_job_wake.wait_until( lock, min( next_poll, chrono::steady_clock::now() + chrono::milliseconds( SERVE_WAKE_MS ) ), [&]() { return !m_jobs.empty(); } );
+  }
+
+  stop();
+}
+
+void TagServer::run_jobs()
+{
+  vector<function<void()>> jobs;
+  {
+    lock_guard<mutex> lock( m_job_lock );
+    jobs.swap( m_jobs );
+  }
+
+  for ( auto& job : jobs )
+  {
+    job();
+  }
+}
+
+HRESULT TagServer::post( const function<HRESULT()>& job )
+{
+  auto result = make_shared<promise<HRESULT>>();
+  future<HRESULT> done = result->get_future();
+
+  {
+    lock_guard<mutex> lock( m_job_lock );
+    if ( !m_running )
+    {
+      return E_ABORT;
+    }
+
+    m_jobs.push_back(
+      [job, result]()
+      {
+        HRESULT hr = E_FAIL;
+        try
+        {
+          hr = job();
+        }
+        catch ( const exception& e )
+        {
+          Logger::instance().logError( string( "[serve] Request failed: " ) + e.what() );
+        }
+        result->set_value( hr );
+      } );
+  }
+  m_job_wake.notify_one();
+
+  // a job dropped by stop() breaks its promise, which also ends the wait
+  if ( done.wait_for( chrono::milliseconds( m_timeout_ms ) ) != future_status::ready )
+  {
+    return RPC_E_TIMEOUT;
+  }
+
+  try
+  {
+    return done.get();
+  }
+  catch ( const future_error& )
+  {
+    return E_ABORT;
+  }
+}
+
+void TagServer::poll()
+{
+  if ( m_watch_ids.empty() )
+  {
+    return;
+  }
+
+  TraceSpan span( "serve_poll", static_cast<int64_t>( m_watch_ids.size() ) );
+  auto started = chrono::steady_clock::now();
+
+  vector<OPCDA_TAG> results;
+  vector<HRESULT> errors;
+  HRESULT hr = m_client.read_sync( m_watch_ids, results, errors );
+
+  auto elapsed = chrono::steady_clock::now() - started;
+  s_poll_latency.record( elapsed );
+  m_poll_us = chrono::duration_cast<chrono::microseconds>( elapsed ).count();
+  ++m_polls;
+
+  if ( FAILED( hr ) )
+  {
+    // the cached values age past max_age_ms() and READs fall through to the server, which reports the error
+    if ( !m_poll_failed )
+    {
+      Logger::instance().logWarning( "[serve] Poll of " + to_string( m_watch_ids.size() ) + " tags failed: " + OPCDA::UTILS::to_str( hr ) );
+      m_poll_failed = true;
+    }
+  }
+  else
+  {
+    if ( m_poll_failed )
+    {
+      Logger::instance().logInfo( "[serve] Polling again" );
+      m_poll_failed = false;
+    }
+
+    update( m_watch_ids, results, errors, true );
+  }
+
+  for ( auto& tag : results )
+  {
+    VariantClear( &tag.value );
+  }
+}
+
+void TagServer::update( const vector<wstring>& item_ids, vector<OPCDA_TAG>& results, const vector<HRESULT>& errors, bool notify )
+{
+  // only this thread writes the change marks, so comparing against them needs no lock
+  map<wstring, string> changes;
+
+  for ( size_t i = 0; i < item_ids.size() && i < results.size(); ++i )
+  {
+    auto it = m_watched.find( item_ids[i] );
+    if ( it == m_watched.end() )
+    {
+      continue;
+    }
+
+    OPCDA_TAG& tag = results[i];
+    HRESULT error = i < errors.size() ? errors[i] : E_FAIL;
+    bool ok = SUCCEEDED( error );
+
+    string value = ok ? OPCDA::UTILS::variant_to_str( tag.value ) : string();
+    size_t value_hash = hash<string>()( value );
+    WORD quality = ok ? tag.quality : 0;
+    int64_t timestamp = ok ? filetime_ticks( tag.timestamp ) : 0;
+
+    WATCHED& watched = it->second;
+    if ( watched.seen && watched.error == error && watched.quality == quality && watched.timestamp == timestamp && watched.value_hash == value_hash )
+    {
+      continue;
+    }
+
+    watched.seen = true;
+    watched.value_hash = value_hash;
+    watched.quality = quality;
+    watched.timestamp = timestamp;
+    watched.error = error;
+
+    if ( notify )
+    {
+      append_value_line( changes[item_ids[i]], item_ids[i], value, quality, timestamp, error );
+    }
+  }
+
+  if ( !changes.empty() )
+  {
+    publish( changes );
+  }
+}
+
+void TagServer::publish( const map<wstring, string>& changes )
+{
+  lock_guard<mutex> lock( m_subscriber_lock );
+
+  for ( auto& subscriber : m_subscribers )
+  {
+    lock_guard<mutex> subscriber_lock( subscriber->lock );
+    bool woken = false;
+
+    for ( const auto& change : changes )
+    {
+      if ( subscriber->tags.count( change.first ) )
+      {
+        subscriber->pending[change.first] = change.second;
+        woken = true;
+      }
+    }
+
+    if ( woken )
+    {
+      subscriber->wake.notify_one();
+    }
+  }
+}
+
+void TagServer::expire()
+{
+  uint64_t polls = m_polls;
+  if ( polls <= DEFAULT_SERVE_IDLE_POLLS )
+  {
+    return;
+  }
+
+  // only this thread changes the watch set, so finding idle tags needs no lock
+  vector<wstring> idle;
+  for ( const auto& watched : m_watched )
+  {
+    if ( !watched.second.pinned && polls - watched.second.used.load( memory_order_relaxed ) > DEFAULT_SERVE_IDLE_POLLS )
+    {
+      idle.push_back( watched.first );
+    }
+  }
+
+  if ( idle.empty() )
+  {
+    return;
+  }
+
+  // a subscription keeps its tags in use however long they go without a READ
+  vector<wstring> subscribed;
+  {
+    lock_guard<mutex> lock( m_subscriber_lock );
+    for ( auto& subscriber : m_subscribers )
+    {
+      lock_guard<mutex> subscriber_lock( subscriber->lock );
+      auto kept = partition( idle.begin(), idle.end(), [&]( const wstring& tag ) { return !subscriber->tags.count( tag ); } );
+      subscribed.insert( subscribed.end(), make_move_iterator( kept ), make_move_iterator( idle.end() ) );
+      idle.erase( kept, idle.end() );
+    }
+  }
+
+  for ( const auto& tag : subscribed )
+  {
+    m_watched.find( tag )->second.used = polls;
+  }
+
+  vector<wstring> expired;
+  {
+    unique_lock<shared_mutex> lock( m_watch_lock );
+
+    for ( const auto& tag : idle )
+    {
+      // a request may have named the tag since it was found idle
+      auto it = m_watched.find( tag );
+      if ( polls - it->second.used.load( memory_order_relaxed ) > DEFAULT_SERVE_IDLE_POLLS )
+      {
+        m_watched.erase( it );
+        expired.push_back( tag );
+      }
+    }
+
+    if ( !expired.empty() )
+    {
+      m_watch_ids.erase( remove_if( m_watch_ids.begin(), m_watch_ids.end(), [&]( const wstring& tag ) { return !m_watched.count( tag ); } ), m_watch_ids.end() );
+      s_watched_tags.set( static_cast<int64_t>( m_watch_ids.size() ) );
+    }
+  }
+
+  if ( !expired.empty() )
+  {
+    // the items leave the group too, so the server stops scanning them; a later request re-adds them
+    m_client.unregister_items( expired );
+  }
+
+  s_expired_tags.add( static_cast<int64_t>( expired.size() ) );
+}
+
+bool TagServer::watch( const vector<wstring>& tags, bool pinned )
+{
+  uint64_t polls = m_polls;
+  unique_lock<shared_mutex> lock( m_watch_lock );
+
+  size_t unwatched = count_if( tags.begin(), tags.end(), [&]( const wstring& tag ) { return !m_watched.count( tag ); } );
+  if ( m_watched.size() + unwatched > m_max_tags )
+  {
+    return false;
+  }
+
+  for ( const auto& tag : tags )
+  {
+    auto inserted = m_watched.try_emplace( tag );
+    if ( inserted.second )
+    {
+      inserted.first->second.used = polls;
+      m_watch_ids.push_back( tag );
+    }
+    inserted.first->second.pinned = inserted.first->second.pinned || pinned;
+  }
+
+  s_watched_tags.set( static_cast<int64_t>( m_watch_ids.size() ) );
+  return true;
+}
+
+DWORD TagServer::max_age_ms() const
+{
+  // a polled value stays fresh until the poll after next has had time to finish
+  return static_cast<DWORD>( 2 * m_interval_ms + m_poll_us.load() / 1000 );
+}
+
+string TagServer::read_lines( const vector<wstring>& tags )
+{
+  vector<wstring> unwatched;
+  size_t watched = 0;
+  uint64_t polls = m_polls;
+  {
+    shared_lock<shared_mutex> lock( m_watch_lock );
+    for ( const auto& tag : tags )
+    {
+      auto it = m_watched.find( tag );
+      if ( it == m_watched.end() )
+      {
+        unwatched.push_back( tag );
+      }
+      else
+      {
+        it->second.used.store( polls, memory_order_relaxed );
+      }
+    }
+    watched = m_watched.size();
+  }
+
+  if ( watched + unwatched.size() > m_max_tags )
+  {
+    return error_line( E_OUTOFMEMORY, "watch set full" );
+  }
+
+  // the poll keeps watched scalars fresh in the client's cache, which needs no COM call to read
+  vector<OPCDA_TAG> results;
+  vector<size_t> stale;
+  m_client.peek_cached( tags, max_age_ms(), results, stale );
+
+  // shared with the job, which may still run after a timed out request returned
+  auto lines = make_shared<vector<string>>( stale.size() );
+
+  if ( !stale.empty() || !unwatched.empty() )
+  {
+    s_cache_misses.add( static_cast<int64_t>( stale.size() ) );
+
+    vector<wstring> stale_ids;
+    stale_ids.reserve( stale.size() );
+    for ( size_t i : stale )
+    {
+      stale_ids.push_back( tags[i] );
+    }
+
+    // new tags join the watch set, and stale ones are read, on the thread that owns the group
+    HRESULT hr = post(
+      [this, unwatched, stale_ids, lines]() -> HRESULT
+      {
+        if ( !watch( unwatched, false ) )
+        {
+          return E_OUTOFMEMORY;
+        }
+
+        if ( stale_ids.empty() )
+        {
+          return S_OK;
+        }
+
+        vector<OPCDA_TAG> fetched;
+        vector<HRESULT> errors;
+        HRESULT hr = m_client.read_cached( stale_ids, max_age_ms(), fetched, errors );
+
+        if ( SUCCEEDED( hr ) )
+        {
+          update( stale_ids, fetched, errors, true );
+
+          for ( size_t j = 0; j < stale_ids.size() && j < fetched.size(); ++j )
+          {
+            append_tag_line( ( *lines )[j], stale_ids[j], fetched[j], j < errors.size() ? errors[j] : E_FAIL );
+          }
+        }
+
+        for ( auto& tag : fetched )
+        {
+          VariantClear( &tag.value );
+        }
+        return hr;
+      } );
+
+    if ( FAILED( hr ) )
+    {
+      return error_line( hr, hr == E_OUTOFMEMORY ? "watch set full" : hr == RPC_E_TIMEOUT ? "read timed out" : "read failed" );
+    }
+  }
+
+  string out = "OK " + to_string( tags.size() ) + "\n";
+  size_t next_stale = 0;
+
+  for ( size_t i = 0; i < tags.size(); ++i )
+  {
+    if ( next_stale < stale.size() && stale[next_stale] == i )
+    {
+      const string& line = ( *lines )[next_stale++];
+      if ( line.empty() )
+      {
+        append_value_line( out, tags[i], "", 0, 0, E_FAIL );
+      }
+      else
+      {
+        out += line;
+      }
+      continue;
+    }
+
+    append_tag_line( out, tags[i], results[i], S_OK );
+  }
+  return out;
+}
+
+string TagServer::browse_lines( const wstring& path )
+{
+  auto result = make_shared<BROWSE_RESULT>();
+  bool cached = false;
+  {
+    lock_guard<mutex> lock( m_browse_lock );
+    auto it = m_browse_cache.find( path );
+    if ( it != m_browse_cache.end() && chrono::steady_clock::now() - it->second.fetched < chrono::milliseconds( DEFAULT_SERVE_BROWSE_TTL_MS ) )
+    {
+      *result = it->second;
+      cached = true;
+    }
+  }
+
+  if ( !cached )
+  {
+    // shared with the job, which may still run after a timed out request returned
+    HRESULT hr = post(
+      [this, path, result]()
+      {
+        result->hr = m_client.browse_tags( path, result->branches, result->tags );
+        result->fetched = chrono::steady_clock::now();
+        return result->hr;
+      } );
+
+    if ( FAILED( hr ) )
+    {
+      return error_line( hr, hr == RPC_E_TIMEOUT ? "browse timed out" : "browse failed" );
+    }
+
+    lock_guard<mutex> lock( m_browse_lock );
+    auto now = chrono::steady_clock::now();
+
+    // entries past their TTL are never served again, drop them before adding this one
+    for ( auto it = m_browse_cache.begin(); it != m_browse_cache.end(); )
+    {
+      it = now - it->second.fetched >= chrono::milliseconds( DEFAULT_SERVE_BROWSE_TTL_MS ) ? m_browse_cache.erase( it ) : next( it );
+    }
+    m_browse_cache[path] = *result;
+  }
+
+  string out = "OK " + to_string( result->branches.size() + result->tags.size() ) + "\n";
+  for ( const auto& branch : result->branches )
+  {
+    out += "B\t";
+    append_field( out, to_utf8( branch ) );
+    out += '\n';
+  }
+  for ( const auto& tag : result->tags )
+  {
+    out += "L\t";
+    append_field( out, to_utf8( tag ) );
+    out += '\n';
+  }
+  return out;
+}
+
+string TagServer::status_line() const
+{
+  size_t watched = 0;
+  {
+    shared_lock<shared_mutex> lock( m_watch_lock );
+    watched = m_watched.size();
+  }
+
+  return "watched=" + to_string( watched ) + "\tclients=" + to_string( s_clients.value() ) + "\tpolls=" + to_string( m_polls.load() ) + "\tpoll_us=" + to_string( m_poll_us.load() ) + "\trequests=" + to_string( m_requests.load() ) + "\n";
+}
+
+bool TagServer::write_pipe( HANDLE pipe, const string& data )
+{
+  OVERLAPPED ov = {};
+  ov.hEvent = CreateEvent( NULL, TRUE, FALSE, NULL );
+  if ( !ov.hEvent )
+  {
+    return false;
+  }
+
+  size_t written = 0;
+  bool ok = true;
+
+  while ( ok && written < data.size() )
+  {
+    DWORD bytes = 0;
+    DWORD chunk = static_cast<DWORD>( min<size_t>( data.size() - written, SERVE_PIPE_BUFFER ) );
+
+    ResetEvent( ov.hEvent );
+    BOOL started = WriteFile( pipe, data.data() + written, chunk, NULL, &ov );
+    ok = complete_io( pipe, ov, m_stop_event, started, bytes ) && bytes > 0;
+    written += bytes;
+  }
+
+  CloseHandle( ov.hEvent );
+  return ok;
+}
+
+void TagServer::accept_loop()
+{
+  HANDLE pipe = m_listen;
+  m_listen = INVALID_HANDLE_VALUE;
+
+  OVERLAPPED ov = {};
+  ov.hEvent = CreateEvent( NULL, TRUE, FALSE, NULL );
+
+  while ( ov.hEvent && WaitForSingleObject( m_stop_event, 0 ) != WAIT_OBJECT_0 )
+  {
+    if ( pipe == INVALID_HANDLE_VALUE )
+    {
+      pipe = create_pipe( false );
+      if ( pipe == INVALID_HANDLE_VALUE )
+      {
+        Logger::instance().logError( "[serve] Cannot create pipe instance, error " + to_string( GetLastError() ) );
+        WaitForSingleObject( m_stop_event, 1000 );
+        continue;
+      }
+    }
+
+    DWORD bytes = 0;
+    ResetEvent( ov.hEvent );
+    BOOL connected = ConnectNamedPipe( pipe, &ov );
+
+    // a client that connected between CreateNamedPipe and ConnectNamedPipe is already there
+    bool early = !connected && GetLastError() == ERROR_PIPE_CONNECTED;
+
+    if ( !early && !complete_io( pipe, ov, m_stop_event, connected, bytes ) )
+    {
+      if ( WaitForSingleObject( m_stop_event, 0 ) != WAIT_OBJECT_0 )
+      {
+        DisconnectNamedPipe( pipe );
+        continue;
+      }
+      break;
+    }
+
+    lock_guard<mutex> lock( m_connection_lock );
+
+    for ( auto it = m_connections.begin(); it != m_connections.end(); )
+    {
+      if ( ( *it )->done )
+      {
+        ( *it )->worker.join();
+        it = m_connections.erase( it );
+      }
+      else
+      {
+        ++it;
+      }
+    }
+
+    auto connection = make_unique<CONNECTION>();
+    connection->pipe = pipe;
+    connection->worker = thread( &TagServer::serve_connection, this, connection.get() );
+    m_connections.push_back( move( connection ) );
+    pipe = INVALID_HANDLE_VALUE;
+  }
+
+  if ( pipe != INVALID_HANDLE_VALUE )
+  {
+    CloseHandle( pipe );
+  }
+  if ( ov.hEvent )
+  {
+    CloseHandle( ov.hEvent );
+  }
+}
+
+void TagServer::serve_connection( CONNECTION* connection )
+{
+  HANDLE pipe = connection->pipe;
+  s_clients.add( 1 );
+
+  OVERLAPPED ov = {};
+  ov.hEvent = CreateEvent( NULL, TRUE, FALSE, NULL );
+
+  shared_ptr<SUBSCRIBER> subscriber;
+  string buffer;
+  char chunk[4096];
+  bool open = ov.hEvent != NULL;
+
+  while ( open && !subscriber )
+  {
+    DWORD bytes = 0;
+    ResetEvent( ov.hEvent );
+    BOOL started = ReadFile( pipe, chunk, sizeof( chunk ), NULL, &ov );
+
+    if ( !complete_io( pipe, ov, m_stop_event, started, bytes ) || bytes == 0 )
+    {
+      break;
+    }
+    buffer.append( chunk, bytes );
+
+    size_t start = 0;
+    size_t end;
+    while ( open && !subscriber && ( end = buffer.find( '\n', start ) ) != string::npos )
+    {
+      string request = buffer.substr( start, end - start );
+      if ( !request.empty() && request.back() == '\r' )
+      {
+        request.pop_back();
+      }
+      start = end + 1;
+
+      if ( !request.empty() )
+      {
+        open = handle_request( pipe, request, subscriber );
+      }
+    }
+    buffer.erase( 0, start );
+
+    if ( buffer.size() > SERVE_MAX_REQUEST_BYTES )
+    {
+      write_pipe( pipe, error_line( E_INVALIDARG, "request too long" ) );
+      break;
+    }
+  }
+
+  if ( subscriber )
+  {
+    stream( pipe, *subscriber );
+
+    lock_guard<mutex> lock( m_subscriber_lock );
+    m_subscribers.erase( remove( m_subscribers.begin(), m_subscribers.end(), subscriber ), m_subscribers.end() );
+  }
+
+  if ( ov.hEvent )
+  {
+    CloseHandle( ov.hEvent );
+  }
+
+  FlushFileBuffers( pipe );
+  DisconnectNamedPipe( pipe );
+  CloseHandle( pipe );
+
+  s_clients.add( -1 );
+  connection->done = true;
+}
+
+bool TagServer::handle_request( HANDLE pipe, const string& request, shared_ptr<SUBSCRIBER>& subscriber )
+{
+  ++m_requests;
+
+  size_t split = request.find_first_of( " \t" );
+  string command = request.substr( 0, split );
+  transform( command.begin(), command.end(), command.begin(), []( unsigned char c ) { return static_cast<char>( toupper( c ) ); } );
+
+  vector<wstring> args;
+  if ( split != string::npos )
+  {
+    size_t start = split + 1;
+    while ( start <= request.size() )
+    {
+      size_t end = request.find( '\t', start );
+      if ( end == string::npos )
+      {
+        end = request.size();
+      }
+      if ( end > start )
+      {
+        args.push_back( to_wide( request.substr( start, end - start ) ) );
+      }
+      start = end + 1;
+    }
+  }
+
+  if ( command == "PING" )
+  {
+    return write_pipe( pipe, "OK 0\n" );
+  }
+
+  if ( command == "STATUS" )
+  {
+    return write_pipe( pipe, "OK 1\n" + status_line() );
+  }
+
+  if ( command == "READ" )
+  {
+    if ( args.empty() )
+    {
+      return write_pipe( pipe, error_line( E_INVALIDARG, "no tags" ) );
+    }
+
+    TraceSpan span( "serve_read", static_cast<int64_t>( args.size() ) );
+    string response;
+    {
+      MetricTimer timer( s_read_latency );
+      response = read_lines( args );
+    }
+    return write_pipe( pipe, response );
+  }
+
+  if ( command == "BROWSE" )
+  {
+    TraceSpan span( "serve_browse" );
+    string response;
+    {
+      MetricTimer timer( s_browse_latency );
+      response = browse_lines( args.empty() ? L"" : args[0] );
+    }
+    return write_pipe( pipe, response );
+  }
+
+  if ( command == "SUBSCRIBE" )
+  {
+    if ( args.empty() )
+    {
+      return write_pipe( pipe, error_line( E_INVALIDARG, "no tags" ) );
+    }
+
+    // registered before the first read so no change between the two is lost
+    auto candidate = make_shared<SUBSCRIBER>();
+    candidate->tags.insert( args.begin(), args.end() );
+    {
+      lock_guard<mutex> lock( m_subscriber_lock );
+      m_subscribers.push_back( candidate );
+    }
+
+    string response = read_lines( args );
+    if ( response.compare( 0, 3, "OK " ) != 0 )
+    {
+      lock_guard<mutex> lock( m_subscriber_lock );
+      m_subscribers.erase( remove( m_subscribers.begin(), m_subscribers.end(), candidate ), m_subscribers.end() );
+      return write_pipe( pipe, response );
+    }
+
+    subscriber = candidate;
+    return write_pipe( pipe, response );
+  }
+
+  return write_pipe( pipe, error_line( E_INVALIDARG, "unknown command '" + command + "'" ) );
+}
+
+void TagServer::stream( HANDLE pipe, SUBSCRIBER& subscriber )
+{
+  while ( WaitForSingleObject( m_stop_event, 0 ) != WAIT_OBJECT_0 )
+  {
+    map<wstring, string> pending;
+    {
+      unique_lock<mutex> lock( subscriber.lock );
+      subscriber.wake.wait_for( lock, chrono::milliseconds( SERVE_WAKE_MS ), [&]() { return subscriber.closed || !subscriber.pending.empty(); } );
+
+      if ( subscriber.closed )
+      {
+        return;
+      }
+      pending.swap( subscriber.pending );
+    }
+
+    if ( pending.empty() )
+    {
+      // nothing to send; notice a client that went away without waiting for the next change
+      DWORD available = 0;
+      if ( !PeekNamedPipe( pipe, NULL, 0, NULL, &available, NULL ) )
+      {
+        return;
+      }
+      continue;
+    }
+
+    string out;
+    for ( const auto& change : pending )
+    {
+      out += change.second;
+    }
+
+    if ( !write_pipe( pipe, out ) )
+    {
+      return;
+    }
+  }
+}
@@ -0,0 +1,170 @@
+// opcda_serve.h
+#ifndef OPCDA_SERVE_H
+#define OPCDA_SERVE_H
+
+#include <windows.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "opcda_client.h"
+
+using namespace std;
+
+constexpr const char* DEFAULT_SERVE_PIPE = "opcda";
+constexpr int DEFAULT_SERVE_INTERVAL_MS = 1000;
+constexpr int DEFAULT_SERVE_TIMEOUT_MS = 10000;
+constexpr int DEFAULT_SERVE_BROWSE_TTL_MS = 60000;
+constexpr uint64_t DEFAULT_SERVE_IDLE_POLLS = 600;
+constexpr size_t DEFAULT_SERVE_MAX_TAGS = 100000;
+constexpr size_t SERVE_MAX_REQUEST_BYTES = 1 << 20;
+
+/**
+ * @brief Keeps one connection warm and answers local clients from the client's value cache.
+ *
+ * Clients connect to \\.\pipe\<name> and send one request per line, UTF-8,
+ * the command followed by tab separated arguments:
+ *
+ *   PING                     OK 0
+ *   STATUS                   OK 1, then one 'key=value' line
+ *   READ <tag>...            OK <n>, then '<tag> <value> <quality> <timestamp> <result>' per tag
+ *   BROWSE [path]            OK <n>, then 'B <branch>' or 'L <tag>' per element
+ *   SUBSCRIBE <tag>...       as READ, then a value line whenever a tag changes
+ *
+ * Response fields are tab separated as well; failures answer 'ERR <hresult> <message>'.
+ * A SUBSCRIBE turns the connection into a stream until the client closes it.
+ *
+ * Every tag asked for joins the watch set, which run() reads in one batch per
+ * interval. That read feeds the client's ValueCache, and a READ takes what is
+ * fresh there without touching COM; strings and arrays never fit the cache and
+ * go to the server like any other miss. A tag no request or subscriber named
+ * for DEFAULT_SERVE_IDLE_POLLS polls leaves the set and the client's group
+ * again, unless it was given to start(). Only the thread calling run() uses the client for COM, so the
+ * connection, its group and its item handles stay in the apartment they were
+ * created in, and pipe threads hand cache misses and browses to it as jobs.
+ * Subscribers get the latest value per tag: a slow reader skips intermediate
+ * values instead of holding back the poll.
+ */
+class TagServer
+{
+public:
+  explicit TagServer( OpcDaClient& client );
+  ~TagServer();
+
+  void set_interval( int interval_ms );
+  void set_timeout( int timeout_ms );
+  void set_max_tags( size_t max_tags );
+
+  /** @brief Starts listening; tags are watched from the start. */
+  bool start( const string& pipe_name, const vector<wstring>& tags = {} );
+  /** @brief Polls and runs COM jobs on the calling thread until stop_requested is set. */
+  void run( const atomic<bool>& stop_requested );
+  void stop();
+
+  static wstring pipe_path( const string& pipe_name );
+
+private:
+  struct SUBSCRIBER
+  {
+    mutex lock;
+    condition_variable wake;
+    unordered_set<wstring> tags;
+    map<wstring, string> pending;
+    bool closed = false;
+  };
+
+  struct CONNECTION
+  {
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+    thread worker;
+    atomic<bool> done { false };
+  };
+
+  OpcDaClient& m_client;
+  int m_interval_ms = DEFAULT_SERVE_INTERVAL_MS;
+  int m_timeout_ms = DEFAULT_SERVE_TIMEOUT_MS;
+  size_t m_max_tags = DEFAULT_SERVE_MAX_TAGS;
+  wstring m_pipe_path;
+
+  HANDLE m_stop_event = NULL;
+  HANDLE m_listen = INVALID_HANDLE_VALUE;
+  thread m_acceptor;
+  mutex m_connection_lock;
+  list<unique_ptr<CONNECTION>> m_connections;
+
+  // enough of the last value read to notice a change; the value itself lives in the client's ValueCache
+  struct WATCHED
+  {
+    bool seen = false;
+    size_t value_hash = 0;
+    WORD quality = 0;
+    int64_t timestamp = 0;
+    HRESULT error = S_OK;
+    atomic<uint64_t> used { 0 };  // m_polls when a request last named the tag
+    bool pinned = false;          // given to start(), never expires
+  };
+
+  // the watch set; changed by the COM thread only, pipe threads look up and mark use
+  mutable shared_mutex m_watch_lock;
+  unordered_map<wstring, WATCHED> m_watched;
+  vector<wstring> m_watch_ids;
+
+  // work for the COM thread, queued by pipe threads
+  mutex m_job_lock;
+  condition_variable m_job_wake;
+  vector<function<void()>> m_jobs;
+  bool m_running = false;
+
+  mutex m_subscriber_lock;
+  vector<shared_ptr<SUBSCRIBER>> m_subscribers;
+
+  struct BROWSE_RESULT
+  {
+    HRESULT hr = S_OK;
+    vector<wstring> branches;
+    vector<wstring> tags;
+    chrono::steady_clock::time_point fetched;
+  };
+  mutex m_browse_lock;
+  map<wstring, BROWSE_RESULT> m_browse_cache;
+
+  atomic<uint64_t> m_polls { 0 };
+  atomic<int64_t> m_poll_us { 0 };
+  atomic<uint64_t> m_requests { 0 };
+  bool m_poll_failed = false;
+
+  void accept_loop();
+  void serve_connection( CONNECTION* connection );
+  bool handle_request( HANDLE pipe, const string& request, shared_ptr<SUBSCRIBER>& subscriber );
+  void stream( HANDLE pipe, SUBSCRIBER& subscriber );
+
+  string read_lines( const vector<wstring>& tags );
+  string browse_lines( const wstring& path );
+  string status_line() const;
+  DWORD max_age_ms() const;
+  HRESULT post( const function<HRESULT()>& job );
+
+  void run_jobs();
+  void poll();
+  void expire();
+  bool watch( const vector<wstring>& tags, bool pinned );
+  void update( const vector<wstring>& item_ids, vector<OPCDA_TAG>& results, const vector<HRESULT>& errors, bool notify );
+  void publish( const map<wstring, string>& changes );
+
+  HANDLE create_pipe( bool first );
+  bool write_pipe( HANDLE pipe, const string& data );
+};
+
+#endif
@@ -0,0 +1,241 @@
+// opcda_sim_namespace.cpp
+#include <algorithm>
+#include <chrono>
+#include <cwchar>
+#include <sstream>
+#include <thread>
+
+#include "opcda_sample.h"
+#include "opcda_sim_namespace.h"
+#include "opcda_utf.h"
+
+using namespace std;
+
+bool SIM_CONFIG::parse( const string& spec, string& error )
+{
+  istringstream fields( spec );
+  string field;
+
+  while ( getline( fields, field, ',' ) )
+  {
+    if ( field.empty() )
+    {
+      continue;
+    }
+
+    size_t eq = field.find( '=' );
+    string key = field.substr( 0, eq );
+    string value = eq == string::npos ? "1" : field.substr( eq + 1 );
+
+    try
+    {
+      if ( key == "depth" )
+        depth = stoul( value );
+      else if ( key == "branches" )
+        branches = max<size_t>( stoul( value ), 1 );
+      else if ( key == "leaves" )
+        leaves = stoul( value );
+      else if ( key == "flat" )
+        flat = value != "0";
+      else if ( key == "item_io" )
+        item_io = value != "0";
+      else if ( key == "browse_da3" )
+        browse_da3 = value != "0";
+      else if ( key == "id_prefix" )
+        {
+        id_prefix.clear();
+        OPCDA::UTILS::append_wide( value.data(), value.size(), id_prefix );
+      }
+      else if ( key == "latency_us" )
+        latency_us = stoi( value );
+      else if ( key == "churn_ms" )
+        churn_ms = max( stoi( value ), 1 );
+      else if ( key == "unreadable_every" )
+        unreadable_every = stoul( value );
+      else if ( key == "string_every" )
+        string_every = stoul( value );
+      else if ( key == "string_chars" )
+        string_chars = stoul( value );
+      else if ( key == "array_every" )
+        array_every = stoul( value );
+      else if ( key == "array_length" )
+        array_length = max<size_t>( stoul( value ), 1 );
+      else
+      {
+        error = "Unknown simulator setting: " + key;
+        return false;
+      }
+    }
+    catch ( const exception& )
+    {
+      error = "Invalid value for simulator setting " + key + ": " + value;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+size_t SIM_CONFIG::item_count() const
+{
+  size_t count = leaves;
+  for ( size_t level = 0; level < depth; ++level )
+  {
+    count *= branches;
+  }
+  return count;
+}
+
+SimNamespace::SimNamespace( const SIM_CONFIG& config ) : m_config( config )
+{
+  m_items.reserve( config.item_count() );
+  build( L"", 0 );
+
+  for ( size_t i = 0; i < m_items.size(); ++i )
+  {
+    SIM_ITEM& item = m_items[i];
+    size_t n = i + 1;
+
+    if ( m_config.string_every && n % m_config.string_every == 0 )
+    {
+      item.type = OPCDA_TYPE_BSTR;
+    }
+    else if ( m_config.array_every && n % m_config.array_every == 0 )
+    {
+      item.type = OPCDA_TYPE_ARRAY | OPCDA_TYPE_R8;
+    }
+    else
+    {
+      static const uint16_t scalar_types[] = { OPCDA_TYPE_R8, OPCDA_TYPE_I4, OPCDA_TYPE_R4, OPCDA_TYPE_BOOL };
+      item.type = scalar_types[i % 4];
+    }
+
+    if ( m_config.unreadable_every && n % m_config.unreadable_every == 0 )
+    {
+      item.access_rights = OPCDA_ACCESS_WRITEABLE;
+    }
+
+    m_item_index[item.item_id] = i;
+    m_path_index[item.browse_path] = i;
+  }
+}
+
+void SimNamespace::build( const wstring& path, size_t level )
+{
+  size_t index = m_branches.size();
+  m_branches.push_back( SIM_BRANCH() );
+  m_branches[index].path = path;
+  m_branch_index[path] = index;
+
+  wchar_t name[32];
+
+  if ( level < m_config.depth )
+  {
+    for ( size_t b = 0; b < m_config.branches; ++b )
+    {
+      swprintf( name, 32, L"Branch%03zu", b );
+      m_branches[index].branch_names.push_back( name );
+      build( path.empty() ? wstring( name ) : path + L"." + name, level + 1 );
+    }
+    return;
+  }
+
+  for ( size_t l = 0; l < m_config.leaves; ++l )
+  {
+    swprintf( name, 32, L"Item%05zu", l );
+    m_branches[index].leaf_names.push_back( name );
+
+    SIM_ITEM item;
+    item.browse_path = path.empty() ? wstring( name ) : path + L"." + name;
+    item.item_id = m_config.id_prefix + item.browse_path;
+    m_items.push_back( item );
+  }
+}
+
+const SIM_BRANCH* SimNamespace::branch( const wstring& path ) const
+{
+  auto it = m_branch_index.find( path );
+  return it == m_branch_index.end() ? nullptr : &m_branches[it->second];
+}
+
+long SimNamespace::find_item( const wstring& item_id ) const
+{
+  auto it = m_item_index.find( item_id );
+  return it == m_item_index.end() ? -1 : static_cast<long>( it->second );
+}
+
+long SimNamespace::find_browse_path( const wstring& browse_path ) const
+{
+  auto it = m_path_index.find( browse_path );
+  return it == m_path_index.end() ? -1 : static_cast<long>( it->second );
+}
+
+void SimNamespace::value( size_t index, OPCDA_VALUE& value, int64_t& timestamp ) const
+{
+  int64_t now = chrono::duration_cast<chrono::milliseconds>( chrono::system_clock::now().time_since_epoch() ).count();
+  int64_t period = now / m_config.churn_ms;
+  int64_t seed = static_cast<int64_t>( index ) * 7919 + period;
+
+  timestamp = epoch_ms_to_ticks( period * m_config.churn_ms );
+
+  switch ( m_items[index].type )
+  {
+    case OPCDA_TYPE_I4:
+      value = static_cast<int64_t>( seed % 100000 );
+      break;
+
+    case OPCDA_TYPE_R4:
+      value = static_cast<double>( static_cast<float>( seed % 10000 ) / 10.0f );
+      break;
+
+    case OPCDA_TYPE_BOOL:
+      value = ( seed & 1 ) != 0;
+      break;
+
+    case OPCDA_TYPE_BSTR:
+    {
+      wstring text( m_config.string_chars, L'a' );
+      for ( size_t c = 0; c < text.size(); ++c )
+      {
+        text[c] = static_cast<wchar_t>( L'a' + ( seed + c ) % 26 );
+      }
+      value = move( text );
+      break;
+    }
+
+    case OPCDA_TYPE_ARRAY | OPCDA_TYPE_R8:
+    {
+      vector<double> data( m_config.array_length );
+      for ( size_t k = 0; k < data.size(); ++k )
+      {
+        data[k] = static_cast<double>( ( seed + k ) % 10000 ) / 100.0;
+      }
+      value = move( data );
+      break;
+    }
+
+    default:
+      value = static_cast<double>( seed % 100000 ) / 100.0;
+      break;
+  }
+}
+
+void SimNamespace::simulate_latency() const
+{
+  if ( m_config.latency_us <= 0 )
+  {
+    return;
+  }
+
+  // Sleep is too coarse below a couple of milliseconds, spin instead
+  if ( m_config.latency_us >= 2000 )
+  {
+    this_thread::sleep_for( chrono::microseconds( m_config.latency_us ) );
+    return;
+  }
+
+  auto until = chrono::steady_clock::now() + chrono::microseconds( m_config.latency_us );
+  while ( chrono::steady_clock::now() < until )
+  {
+  }
+}
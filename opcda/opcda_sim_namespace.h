@@ -0,0 +1,90 @@
+// opcda_sim_namespace.h
+#ifndef OPCDA_SIM_NAMESPACE_H
+#define OPCDA_SIM_NAMESPACE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "opcda_backend.h"
+
+using namespace std;
+
+struct SIM_CONFIG
+{
+  size_t depth = 2;           // branch levels below the root
+  size_t branches = 10;       // child branches per branch
+  size_t leaves = 100;        // items per branch on the last level
+  bool flat = false;          // report OPC_NS_FLAT instead of a hierarchy
+  bool item_io = false;       // COM simulator exposes IOPCItemIO, the client then reads without a group
+  bool browse_da3 = false;    // MemoryBackend answers DA 3.0 paged browse; the COM simulator has no IOPCBrowse
+  wstring id_prefix;          // item ID = prefix + browse path, forces ID resolution when set
+  int latency_us = 0;         // added to every server call
+  int churn_ms = 1000;        // how long a value stays the same
+  size_t unreadable_every = 0;  // every Nth item is write-only
+  size_t string_every = 0;    // every Nth item is a string
+  size_t string_chars = 32;
+  size_t array_every = 0;     // every Nth item is an array of doubles
+  size_t array_length = 16;
+
+  bool parse( const string& spec, string& error );
+  size_t item_count() const;
+};
+
+struct SIM_ITEM
+{
+  wstring browse_path;
+  wstring item_id;
+  uint16_t type = OPCDA_TYPE_R8;
+  uint32_t access_rights = OPCDA_ACCESS_READABLE | OPCDA_ACCESS_WRITEABLE;
+};
+
+struct SIM_BRANCH
+{
+  wstring path;
+  vector<wstring> branch_names;
+  vector<wstring> leaf_names;
+};
+
+/**
+ * @brief Namespace and value model behind the simulated server.
+ *
+ * Built once from a SIM_CONFIG and read-only afterwards, so any number of
+ * server objects and threads can share it. Values are a pure function of the
+ * item index and the current churn period, which keeps runs reproducible.
+ * Portable: the COM simulator and MemoryBackend both serve from it.
+ */
+class SimNamespace
+{
+public:
+  explicit SimNamespace( const SIM_CONFIG& config );
+
+  const SIM_CONFIG& config() const
+  {
+    return m_config;
+  }
+  const vector<SIM_ITEM>& items() const
+  {
+    return m_items;
+  }
+
+  const SIM_BRANCH* branch( const wstring& path ) const;
+  long find_item( const wstring& item_id ) const;
+  long find_browse_path( const wstring& browse_path ) const;
+
+  void value( size_t index, OPCDA_VALUE& value, int64_t& timestamp ) const;
+  void simulate_latency() const;
+
+private:
+  SIM_CONFIG m_config;
+  vector<SIM_ITEM> m_items;
+  vector<SIM_BRANCH> m_branches;
+  unordered_map<wstring, size_t> m_branch_index;
+  unordered_map<wstring, size_t> m_item_index;
+  unordered_map<wstring, size_t> m_path_index;
+
+  void build( const wstring& path, size_t level );
+};
+
+#endif
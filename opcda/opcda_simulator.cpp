@@ -0,0 +1,813 @@
+// opcda_simulator.cpp
+#define NOMINMAX
+#include <Shlwapi.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <opcerror.h>
+#include <windows.h>
+
+#include "opcda_backend_com.h"
+#include "opcda_client.h"
+#include "opcda_simulator.h"
+#include "opcda_utils.h"
+
+using namespace std;
+
+static void sim_value( const SimNamespace& space, size_t index, VARIANT& value, FILETIME& timestamp )
+{
+  OPCDA_VALUE generated;
+  int64_t ticks = 0;
+
+  space.value( index, generated, ticks );
+  OPCDA::UTILS::value_to_variant( generated, space.items()[index].type, value );
+  timestamp = OPCDA::UTILS::ticks_to_filetime( ticks );
+}
+
+template <typename T>
+static T* sim_alloc( size_t count )
+{
+  T* memory = static_cast<T*>( CoTaskMemAlloc( max<size_t>( count, 1 ) * sizeof( T ) ) );
+  if ( memory )
+  {
+    ZeroMemory( memory, max<size_t>( count, 1 ) * sizeof( T ) );
+  }
+  return memory;
+}
+
+static LPWSTR sim_strdup( const wstring& s )
+{
+  LPWSTR copy = sim_alloc<wchar_t>( s.size() + 1 );
+  if ( copy )
+  {
+    copy_n( s.c_str(), s.size() + 1, copy );
+  }
+  return copy;
+}
+
+/**
+ * @brief Reference count and free-threaded marshaler shared by the simulator objects.
+ */
+class SimObject
+{
+protected:
+  atomic<ULONG> m_refs{ 1 };
+  CComPtr<IUnknown> m_ftm;
+
+  virtual ~SimObject()
+  {
+  }
+
+  ULONG add_ref()
+  {
+    return ++m_refs;
+  }
+
+  ULONG release()
+  {
+    ULONG refs = --m_refs;
+    if ( refs == 0 )
+    {
+      delete this;
+    }
+    return refs;
+  }
+
+  HRESULT query_marshal( IUnknown* self, REFIID riid, void** ppv )
+  {
+    if ( riid != IID_IMarshal )
+    {
+      *ppv = nullptr;
+      return E_NOINTERFACE;
+    }
+
+    if ( !m_ftm && FAILED( CoCreateFreeThreadedMarshaler( self, &m_ftm ) ) )
+    {
+      *ppv = nullptr;
+      return E_NOINTERFACE;
+    }
+
+    return m_ftm->QueryInterface( riid, ppv );
+  }
+};
+
+class SimEnumString : public IEnumString, public SimObject
+{
+public:
+  explicit SimEnumString( vector<wstring> names, size_t position = 0 ) : m_names( move( names ) ), m_position( position )
+  {
+  }
+
+  STDMETHODIMP QueryInterface( REFIID riid, void** ppv ) override
+  {
+    if ( !ppv )
+    {
+      return E_POINTER;
+    }
+    if ( riid == IID_IUnknown || riid == IID_IEnumString )
+    {
+      *ppv = static_cast<IEnumString*>( this );
+      AddRef();
+      return S_OK;
+    }
+    return query_marshal( static_cast<IEnumString*>( this ), riid, ppv );
+  }
+  STDMETHODIMP_( ULONG ) AddRef() override
+  {
+    return add_ref();
+  }
+  STDMETHODIMP_( ULONG ) Release() override
+  {
+    return release();
+  }
+
+  STDMETHODIMP Next( ULONG count, LPOLESTR* names, ULONG* fetched ) override
+  {
+    ULONG n = 0;
+    while ( n < count && m_position < m_names.size() )
+    {
+      names[n++] = sim_strdup( m_names[m_position++] );
+    }
+
+    if ( fetched )
+    {
+      *fetched = n;
+    }
+    return n == count ? S_OK : S_FALSE;
+  }
+  STDMETHODIMP Skip( ULONG count ) override
+  {
+    m_position = min( m_position + count, m_names.size() );
+    return m_position < m_names.size() ? S_OK : S_FALSE;
+  }
+  STDMETHODIMP Reset() override
+  {
+    m_position = 0;
+    return S_OK;
+  }
+  STDMETHODIMP Clone( IEnumString** copy ) override
+  {
+    *copy = new SimEnumString( m_names, m_position );
+    return S_OK;
+  }
+
+private:
+  vector<wstring> m_names;
+  size_t m_position;
+};
+
+class SimGroup : public IOPCItemMgt, public IOPCSyncIO, public IOPCGroupStateMgt, public SimObject
+{
+public:
+  SimGroup( const shared_ptr<const SimNamespace>& space, const wstring& name, OPCHANDLE client_group, OPCHANDLE server_group, DWORD update_rate, BOOL active )
+    : m_space( space ), m_name( name ), m_client_group( client_group ), m_server_group( server_group ), m_update_rate( update_rate ), m_active( active )
+  {
+  }
+
+  STDMETHODIMP QueryInterface( REFIID riid, void** ppv ) override
+  {
+    if ( !ppv )
+    {
+      return E_POINTER;
+    }
+
+    if ( riid == IID_IUnknown || riid == IID_IOPCItemMgt )
+      *ppv = static_cast<IOPCItemMgt*>( this );
+    else if ( riid == IID_IOPCSyncIO )
+      *ppv = static_cast<IOPCSyncIO*>( this );
+    else if ( riid == IID_IOPCGroupStateMgt )
+      *ppv = static_cast<IOPCGroupStateMgt*>( this );
+    else
+      return query_marshal( static_cast<IOPCItemMgt*>( this ), riid, ppv );
+
+    AddRef();
+    return S_OK;
+  }
+  STDMETHODIMP_( ULONG ) AddRef() override
+  {
+    return add_ref();
+  }
+  STDMETHODIMP_( ULONG ) Release() override
+  {
+    return release();
+  }
+
+  // IOPCItemMgt
+  STDMETHODIMP AddItems( DWORD count, OPCITEMDEF* defs, OPCITEMRESULT** results, HRESULT** errors ) override
+  {
+    return add_or_validate( count, defs, results, errors, true );
+  }
+  STDMETHODIMP ValidateItems( DWORD count, OPCITEMDEF* defs, BOOL, OPCITEMRESULT** results, HRESULT** errors ) override
+  {
+    return add_or_validate( count, defs, results, errors, false );
+  }
+  STDMETHODIMP RemoveItems( DWORD count, OPCHANDLE* handles, HRESULT** errors ) override
+  {
+    m_space->simulate_latency();
+    *errors = sim_alloc<HRESULT>( count );
+
+    lock_guard<mutex> lock( m_lock );
+    bool all_ok = true;
+
+    for ( DWORD i = 0; i < count; ++i )
+    {
+      ( *errors )[i] = m_items.erase( handles[i] ) ? S_OK : OPC_E_INVALIDHANDLE;
+      all_ok = all_ok && SUCCEEDED( ( *errors )[i] );
+    }
+    return all_ok ? S_OK : S_FALSE;
+  }
+  STDMETHODIMP SetActiveState( DWORD count, OPCHANDLE*, BOOL, HRESULT** errors ) override
+  {
+    *errors = sim_alloc<HRESULT>( count );
+    return S_OK;
+  }
+  STDMETHODIMP SetClientHandles( DWORD count, OPCHANDLE* handles, OPCHANDLE* clients, HRESULT** errors ) override
+  {
+    *errors = sim_alloc<HRESULT>( count );
+
+    lock_guard<mutex> lock( m_lock );
+    for ( DWORD i = 0; i < count; ++i )
+    {
+      auto it = m_items.find( handles[i] );
+      if ( it == m_items.end() )
+      {
+        ( *errors )[i] = OPC_E_INVALIDHANDLE;
+        continue;
+      }
+      it->second.client = clients[i];
+    }
+    return S_OK;
+  }
+  STDMETHODIMP SetDatatypes( DWORD count, OPCHANDLE*, VARTYPE*, HRESULT** errors ) override
+  {
+    *errors = sim_alloc<HRESULT>( count );
+    return S_OK;
+  }
+  STDMETHODIMP CreateEnumerator( REFIID, LPUNKNOWN* unknown ) override
+  {
+    *unknown = nullptr;
+    return E_NOTIMPL;
+  }
+
+  // IOPCSyncIO
+  STDMETHODIMP Read( OPCDATASOURCE, DWORD count, OPCHANDLE* handles, OPCITEMSTATE** states, HRESULT** errors ) override
+  {
+    m_space->simulate_latency();
+    *states = sim_alloc<OPCITEMSTATE>( count );
+    *errors = sim_alloc<HRESULT>( count );
+
+    lock_guard<mutex> lock( m_lock );
+    bool all_ok = true;
+
+    for ( DWORD i = 0; i < count; ++i )
+    {
+      auto it = m_items.find( handles[i] );
+      OPCITEMSTATE& state = ( *states )[i];
+
+      if ( it == m_items.end() )
+      {
+        ( *errors )[i] = OPC_E_INVALIDHANDLE;
+      }
+      else if ( !( m_space->items()[it->second.index].access_rights & OPC_READABLE ) )
+      {
+        state.hClient = it->second.client;
+        ( *errors )[i] = OPC_E_BADRIGHTS;
+      }
+      else
+      {
+        state.hClient = it->second.client;
+        state.wQuality = OPC_QUALITY_GOOD;
+        sim_value( *m_space, it->second.index, state.vDataValue, state.ftTimeStamp );
+      }
+
+      all_ok = all_ok && SUCCEEDED( ( *errors )[i] );
+    }
+    return all_ok ? S_OK : S_FALSE;
+  }
+  STDMETHODIMP Write( DWORD count, OPCHANDLE* handles, VARIANT*, HRESULT** errors ) override
+  {
+    m_space->simulate_latency();
+    *errors = sim_alloc<HRESULT>( count );
+
+    lock_guard<mutex> lock( m_lock );
+    bool all_ok = true;
+
+    for ( DWORD i = 0; i < count; ++i )
+    {
+      auto it = m_items.find( handles[i] );
+      ( *errors )[i] = it == m_items.end() ? OPC_E_INVALIDHANDLE : ( ( m_space->items()[it->second.index].access_rights & OPC_WRITEABLE ) ? S_OK : OPC_E_BADRIGHTS );
+      all_ok = all_ok && SUCCEEDED( ( *errors )[i] );
+    }
+    return all_ok ? S_OK : S_FALSE;
+  }
+
+  // IOPCGroupStateMgt
+  STDMETHODIMP GetState( DWORD* update_rate, BOOL* active, LPWSTR* name, LONG* time_bias, FLOAT* deadband, DWORD* lcid, OPCHANDLE* client_group, OPCHANDLE* server_group ) override
+  {
+    *update_rate = m_update_rate;
+    *active = m_active;
+    *name = sim_strdup( m_name );
+    *time_bias = 0;
+    *deadband = 0.0f;
+    *lcid = 0;
+    *client_group = m_client_group;
+    *server_group = m_server_group;
+    return S_OK;
+  }
+  STDMETHODIMP SetState( DWORD* requested_rate, DWORD* revised_rate, BOOL* active, LONG*, FLOAT*, DWORD*, OPCHANDLE* client_group ) override
+  {
+    if ( requested_rate )
+    {
+      m_update_rate = *requested_rate;
+    }
+    if ( revised_rate )
+    {
+      *revised_rate = m_update_rate;
+    }
+    if ( active )
+    {
+      m_active = *active;
+    }
+    if ( client_group )
+    {
+      m_client_group = *client_group;
+    }
+    return S_OK;
+  }
+  STDMETHODIMP SetName( LPCWSTR name ) override
+  {
+    m_name = name ? name : L"";
+    return S_OK;
+  }
+  STDMETHODIMP CloneGroup( LPCWSTR, REFIID, LPUNKNOWN* unknown ) override
+  {
+    *unknown = nullptr;
+    return E_NOTIMPL;
+  }
+
+private:
+  struct GROUP_ITEM
+  {
+    size_t index = 0;
+    OPCHANDLE client = 0;
+  };
+
+  shared_ptr<const SimNamespace> m_space;
+  wstring m_name;
+  OPCHANDLE m_client_group;
+  OPCHANDLE m_server_group;
+  DWORD m_update_rate;
+  BOOL m_active;
+
+  mutex m_lock;
+  map<OPCHANDLE, GROUP_ITEM> m_items;
+  OPCHANDLE m_next_handle = 1;
+
+  HRESULT add_or_validate( DWORD count, OPCITEMDEF* defs, OPCITEMRESULT** results, HRESULT** errors, bool add )
+  {
+    m_space->simulate_latency();
+    *results = sim_alloc<OPCITEMRESULT>( count );
+    *errors = sim_alloc<HRESULT>( count );
+
+    lock_guard<mutex> lock( m_lock );
+    bool all_ok = true;
+
+    for ( DWORD i = 0; i < count; ++i )
+    {
+      long index = m_space->find_item( defs[i].szItemID ? defs[i].szItemID : L"" );
+
+      if ( index < 0 )
+      {
+        ( *errors )[i] = OPC_E_UNKNOWNITEMID;
+        all_ok = false;
+        continue;
+      }
+
+      const SIM_ITEM& item = m_space->items()[index];
+      OPCITEMRESULT& result = ( *results )[i];
+      result.vtCanonicalDataType = item.type;
+      result.dwAccessRights = item.access_rights;
+
+      if ( add )
+      {
+        result.hServer = m_next_handle++;
+        m_items[result.hServer] = { static_cast<size_t>( index ), defs[i].hClient };
+      }
+    }
+    return all_ok ? S_OK : S_FALSE;
+  }
+};
+
+class SimServer : public IOPCServer, public IOPCBrowseServerAddressSpace, public IOPCItemProperties, public IOPCItemIO, public SimObject
+{
+public:
+  explicit SimServer( const shared_ptr<const SimNamespace>& space ) : m_space( space )
+  {
+    GetSystemTimeAsFileTime( &m_started );
+  }
+
+  STDMETHODIMP QueryInterface( REFIID riid, void** ppv ) override
+  {
+    if ( !ppv )
+    {
+      return E_POINTER;
+    }
+
+    if ( riid == IID_IUnknown || riid == IID_IOPCServer )
+      *ppv = static_cast<IOPCServer*>( this );
+    else if ( riid == IID_IOPCBrowseServerAddressSpace )
+      *ppv = static_cast<IOPCBrowseServerAddressSpace*>( this );
+    else if ( riid == IID_IOPCItemProperties )
+      *ppv = static_cast<IOPCItemProperties*>( this );
+    else if ( riid == IID_IOPCItemIO && m_space->config().item_io )
+      *ppv = static_cast<IOPCItemIO*>( this );
+    else
+      return query_marshal( static_cast<IOPCServer*>( this ), riid, ppv );
+
+    AddRef();
+    return S_OK;
+  }
+  STDMETHODIMP_( ULONG ) AddRef() override
+  {
+    return add_ref();
+  }
+  STDMETHODIMP_( ULONG ) Release() override
+  {
+    return release();
+  }
+
+  // IOPCServer
+  STDMETHODIMP AddGroup( LPCWSTR name, BOOL active, DWORD update_rate, OPCHANDLE client_group, LONG*, FLOAT*, DWORD, OPCHANDLE* server_group, DWORD* revised_rate, REFIID riid, LPUNKNOWN* unknown ) override
+  {
+    m_space->simulate_latency();
+
+    lock_guard<mutex> lock( m_lock );
+    OPCHANDLE handle = m_next_group++;
+
+    CComPtr<IUnknown> group;
+    group.Attach( static_cast<IOPCItemMgt*>( new SimGroup( m_space, name ? name : L"", client_group, handle, update_rate, active ) ) );
+
+    HRESULT hr = group->QueryInterface( riid, reinterpret_cast<void**>( unknown ) );
+    if ( FAILED( hr ) )
+    {
+      return hr;
+    }
+
+    m_groups[handle] = group;
+    *server_group = handle;
+    *revised_rate = update_rate;
+    return S_OK;
+  }
+  STDMETHODIMP GetErrorString( HRESULT, LCID, LPWSTR* text ) override
+  {
+    *text = nullptr;
+    return E_NOTIMPL;
+  }
+  STDMETHODIMP GetGroupByName( LPCWSTR, REFIID, LPUNKNOWN* unknown ) override
+  {
+    *unknown = nullptr;
+    return E_NOTIMPL;
+  }
+  STDMETHODIMP GetStatus( OPCSERVERSTATUS** status ) override
+  {
+    m_space->simulate_latency();
+
+    *status = sim_alloc<OPCSERVERSTATUS>( 1 );
+    FILETIME now;
+    GetSystemTimeAsFileTime( &now );
+
+    ( *status )->ftStartTime = m_started;
+    ( *status )->ftCurrentTime = now;
+    ( *status )->ftLastUpdateTime = now;
+    ( *status )->dwServerState = OPC_STATUS_RUNNING;
+    ( *status )->wMajorVersion = 1;
+    ( *status )->szVendorInfo = sim_strdup( L"opcda-cli simulator" );
+
+    lock_guard<mutex> lock( m_lock );
+    ( *status )->dwGroupCount = static_cast<DWORD>( m_groups.size() );
+    return S_OK;
+  }
+  STDMETHODIMP RemoveGroup( OPCHANDLE server_group, BOOL ) override
+  {
+    m_space->simulate_latency();
+
+    lock_guard<mutex> lock( m_lock );
+    return m_groups.erase( server_group ) ? S_OK : E_INVALIDARG;
+  }
+  STDMETHODIMP CreateGroupEnumerator( OPCENUMSCOPE, REFIID, LPUNKNOWN* unknown ) override
+  {
+    *unknown = nullptr;
+    return E_NOTIMPL;
+  }
+
+  // IOPCBrowseServerAddressSpace
+  STDMETHODIMP QueryOrganization( OPCNAMESPACETYPE* type ) override
+  {
+    *type = m_space->config().flat ? OPC_NS_FLAT : OPC_NS_HIERARCHIAL;
+    return S_OK;
+  }
+  STDMETHODIMP ChangeBrowsePosition( OPCBROWSEDIRECTION direction, LPCWSTR target ) override
+  {
+    m_space->simulate_latency();
+
+    lock_guard<mutex> lock( m_lock );
+    wstring name = target ? target : L"";
+    wstring next;
+
+    switch ( direction )
+    {
+      case OPC_BROWSE_TO:
+        next = name;
+        break;
+
+      case OPC_BROWSE_DOWN:
+        next = m_position.empty() ? name : m_position + L"." + name;
+        break;
+
+      case OPC_BROWSE_UP:
+        if ( m_position.empty() )
+        {
+          return E_FAIL;
+        }
+        next = m_position.rfind( L'.' ) == wstring::npos ? L"" : m_position.substr( 0, m_position.rfind( L'.' ) );
+        break;
+
+      default:
+        return E_INVALIDARG;
+    }
+
+    if ( !m_space->branch( next ) )
+    {
+      return E_INVALIDARG;
+    }
+
+    m_position = next;
+    return S_OK;
+  }
+  STDMETHODIMP BrowseOPCItemIDs( OPCBROWSETYPE type, LPCWSTR filter, VARTYPE data_type, DWORD access_rights, LPENUMSTRING* names ) override
+  {
+    m_space->simulate_latency();
+
+    wstring position;
+    {
+      lock_guard<mutex> lock( m_lock );
+      position = m_position;
+    }
+
+    wstring pattern = filter ? filter : L"";
+    auto matches = [&]( const wstring& name, long index )
+    {
+      if ( !pattern.empty() && !PathMatchSpecW( name.c_str(), pattern.c_str() ) )
+      {
+        return false;
+      }
+      if ( index < 0 )
+      {
+        return true;
+      }
+
+      const SIM_ITEM& item = m_space->items()[index];
+      return ( data_type == VT_EMPTY || item.type == data_type ) && ( access_rights == 0 || ( item.access_rights & access_rights ) == access_rights );
+    };
+
+    vector<wstring> result;
+    const SIM_BRANCH* current = m_space->branch( position );
+
+    // a flat space has nothing but leaves, all of them under the root
+    if ( type == OPC_FLAT || ( m_space->config().flat && type == OPC_LEAF ) )
+    {
+      for ( size_t i = 0; i < m_space->items().size(); ++i )
+      {
+        if ( matches( m_space->items()[i].item_id, static_cast<long>( i ) ) )
+        {
+          result.push_back( m_space->items()[i].item_id );
+        }
+      }
+    }
+    else if ( current && !m_space->config().flat && type == OPC_BRANCH )
+    {
+      for ( const auto& name : current->branch_names )
+      {
+        if ( matches( name, -1 ) )
+        {
+          result.push_back( name );
+        }
+      }
+    }
+    else if ( current && !m_space->config().flat && type == OPC_LEAF )
+    {
+      for ( const auto& name : current->leaf_names )
+      {
+        if ( matches( name, m_space->find_browse_path( position.empty() ? name : position + L"." + name ) ) )
+        {
+          result.push_back( name );
+        }
+      }
+    }
+
+    HRESULT hr = result.empty() ? S_FALSE : S_OK;
+    *names = new SimEnumString( move( result ) );
+    return hr;
+  }
+  STDMETHODIMP GetItemID( LPWSTR data_id, LPWSTR* item_id ) override
+  {
+    m_space->simulate_latency();
+
+    wstring name = data_id ? data_id : L"";
+    wstring position;
+    {
+      lock_guard<mutex> lock( m_lock );
+      position = m_position;
+    }
+
+    // relative to the browse position first, then as a full browse path
+    long index = position.empty() ? -1 : m_space->find_browse_path( position + L"." + name );
+    if ( index < 0 )
+    {
+      index = m_space->find_browse_path( name );
+    }
+
+    if ( index >= 0 )
+    {
+      *item_id = sim_strdup( m_space->items()[index].item_id );
+      return S_OK;
+    }
+
+    if ( m_space->branch( name ) )
+    {
+      *item_id = sim_strdup( m_space->config().id_prefix + name );
+      return S_OK;
+    }
+
+    *item_id = nullptr;
+    return OPC_E_UNKNOWNITEMID;
+  }
+  STDMETHODIMP BrowseAccessPaths( LPCWSTR, LPENUMSTRING* paths ) override
+  {
+    *paths = nullptr;
+    return E_NOTIMPL;
+  }
+
+  // IOPCItemProperties
+  STDMETHODIMP QueryAvailableProperties( LPWSTR item_id, DWORD* count, DWORD** ids, LPWSTR** descriptions, VARTYPE** types ) override
+  {
+    m_space->simulate_latency();
+
+    if ( m_space->find_item( item_id ? item_id : L"" ) < 0 )
+    {
+      return OPC_E_UNKNOWNITEMID;
+    }
+
+    static const DWORD property_ids[] = { 1, 2, 3, 4, 5, 6, 101 };
+    static const wchar_t* property_names[] = { L"Item Canonical DataType", L"Item Value", L"Item Quality", L"Item Timestamp", L"Item Access Rights", L"Server Scan Rate", L"Item Description" };
+    static const VARTYPE property_types[] = { VT_I2, VT_VARIANT, VT_I2, VT_DATE, VT_I4, VT_R4, VT_BSTR };
+    DWORD n = static_cast<DWORD>( size( property_ids ) );
+
+    *count = n;
+    *ids = sim_alloc<DWORD>( n );
+    *descriptions = sim_alloc<LPWSTR>( n );
+    *types = sim_alloc<VARTYPE>( n );
+
+    for ( DWORD i = 0; i < n; ++i )
+    {
+      ( *ids )[i] = property_ids[i];
+      ( *descriptions )[i] = sim_strdup( property_names[i] );
+      ( *types )[i] = property_types[i];
+    }
+    return S_OK;
+  }
+  STDMETHODIMP GetItemProperties( LPWSTR item_id, DWORD count, DWORD* property_ids, VARIANT** values, HRESULT** errors ) override
+  {
+    m_space->simulate_latency();
+
+    long index = m_space->find_item( item_id ? item_id : L"" );
+    if ( index < 0 )
+    {
+      *values = nullptr;
+      *errors = nullptr;
+      return OPC_E_UNKNOWNITEMID;
+    }
+
+    const SIM_ITEM& item = m_space->items()[index];
+    *values = sim_alloc<VARIANT>( count );
+    *errors = sim_alloc<HRESULT>( count );
+    bool all_ok = true;
+
+    for ( DWORD i = 0; i < count; ++i )
+    {
+      VARIANT& v = ( *values )[i];
+      FILETIME timestamp;
+
+      switch ( property_ids[i] )
+      {
+        case 1:
+          V_VT( &v ) = VT_I2;
+          V_I2( &v ) = static_cast<SHORT>( item.type );
+          break;
+        case 2:
+          sim_value( *m_space, index, v, timestamp );
+          break;
+        case 3:
+          V_VT( &v ) = VT_I2;
+          V_I2( &v ) = static_cast<SHORT>( OPC_QUALITY_GOOD );
+          break;
+        case 5:
+          V_VT( &v ) = VT_I4;
+          V_I4( &v ) = static_cast<LONG>( item.access_rights );
+          break;
+        case 6:
+          V_VT( &v ) = VT_R4;
+          V_R4( &v ) = 100.0f;
+          break;
+        case 101:
+          V_VT( &v ) = VT_BSTR;
+          V_BSTR( &v ) = SysAllocString( item.browse_path.c_str() );
+          break;
+        default:
+          ( *errors )[i] = OPC_E_INVALID_PID;
+          all_ok = false;
+          break;
+      }
+    }
+    return all_ok ? S_OK : S_FALSE;
+  }
+  STDMETHODIMP LookupItemIDs( LPWSTR, DWORD count, DWORD*, LPWSTR** item_ids, HRESULT** errors ) override
+  {
+    *item_ids = sim_alloc<LPWSTR>( count );
+    *errors = sim_alloc<HRESULT>( count );
+    for ( DWORD i = 0; i < count; ++i )
+    {
+      ( *errors )[i] = OPC_E_INVALID_PID;
+    }
+    return S_FALSE;
+  }
+
+  // IOPCItemIO
+  STDMETHODIMP Read( DWORD count, LPCWSTR* item_ids, DWORD*, VARIANT** values, WORD** qualities, FILETIME** timestamps, HRESULT** errors ) override
+  {
+    m_space->simulate_latency();
+    *values = sim_alloc<VARIANT>( count );
+    *qualities = sim_alloc<WORD>( count );
+    *timestamps = sim_alloc<FILETIME>( count );
+    *errors = sim_alloc<HRESULT>( count );
+    bool all_ok = true;
+
+    for ( DWORD i = 0; i < count; ++i )
+    {
+      long index = m_space->find_item( item_ids[i] ? item_ids[i] : L"" );
+
+      if ( index < 0 )
+      {
+        ( *errors )[i] = OPC_E_UNKNOWNITEMID;
+      }
+      else if ( !( m_space->items()[index].access_rights & OPC_READABLE ) )
+      {
+        ( *errors )[i] = OPC_E_BADRIGHTS;
+      }
+      else
+      {
+        ( *qualities )[i] = OPC_QUALITY_GOOD;
+        sim_value( *m_space, index, ( *values )[i], ( *timestamps )[i] );
+      }
+
+      all_ok = all_ok && SUCCEEDED( ( *errors )[i] );
+    }
+    return all_ok ? S_OK : S_FALSE;
+  }
+  STDMETHODIMP WriteVQT( DWORD count, LPCWSTR* item_ids, OPCITEMVQT*, HRESULT** errors ) override
+  {
+    m_space->simulate_latency();
+    *errors = sim_alloc<HRESULT>( count );
+    bool all_ok = true;
+
+    for ( DWORD i = 0; i < count; ++i )
+    {
+      long index = m_space->find_item( item_ids[i] ? item_ids[i] : L"" );
+      ( *errors )[i] = index < 0 ? OPC_E_UNKNOWNITEMID : ( ( m_space->items()[index].access_rights & OPC_WRITEABLE ) ? S_OK : OPC_E_BADRIGHTS );
+      all_ok = all_ok && SUCCEEDED( ( *errors )[i] );
+    }
+    return all_ok ? S_OK : S_FALSE;
+  }
+
+private:
+  shared_ptr<const SimNamespace> m_space;
+  FILETIME m_started;
+
+  mutex m_lock;
+  wstring m_position;
+  map<OPCHANDLE, CComPtr<IUnknown>> m_groups;
+  OPCHANDLE m_next_group = 1;
+};
+
+HRESULT create_sim_server( const shared_ptr<const SimNamespace>& space, IOPCServer** server )
+{
+  if ( !server || !space )
+  {
+    return E_POINTER;
+  }
+
+  // the new object starts with one reference, which the caller now owns
+  *server = static_cast<IOPCServer*>( new SimServer( space ) );
+  return S_OK;
+}
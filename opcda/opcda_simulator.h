@@ -0,0 +1,24 @@
+// opcda_simulator.h
+#ifndef OPCDA_SIMULATOR_H
+#define OPCDA_SIMULATOR_H
+
+#include <atlbase.h>
+#include <memory>
+#include <opcda.h>
+
+#include "opcda_sim_namespace.h"
+
+using namespace std;
+
+/**
+ * @brief Creates an in-process OPC DA server over a shared namespace.
+ *
+ * The returned object implements IOPCServer, IOPCBrowseServerAddressSpace,
+ * IOPCItemProperties and, when configured, IOPCItemIO; its groups implement
+ * IOPCItemMgt, IOPCSyncIO and IOPCGroupStateMgt. All objects aggregate the
+ * free-threaded marshaler, so they can be handed to OpcDaClient::attach from
+ * any apartment.
+ */
+HRESULT create_sim_server( const shared_ptr<const SimNamespace>& space, IOPCServer** server );
+
+#endif
@@ -0,0 +1,161 @@
+// opcda_supervisor.cpp
+#define NOMINMAX
+#include <algorithm>
+#include <sstream>
+#include <windows.h>
+
+#include "logger.h"
+#include "opcda_supervisor.h"
+
+using namespace std;
+
+static string hr_to_str( HRESULT hr )
+{
+  ostringstream oss;
+  oss << "0x" << hex << static_cast<unsigned long>( hr );
+  return oss.str();
+}
+
+LinkSupervisor::LinkSupervisor() : m_random( random_device{}() )
+{
+  m_last_ok = clock::now();
+}
+
+void LinkSupervisor::set_backoff( int initial_ms, int max_ms )
+{
+  lock_guard<mutex> lock( m_lock );
+  m_initial_ms = max( initial_ms, 1 );
+  m_max_ms = max( max_ms, m_initial_ms );
+}
+
+void LinkSupervisor::set_heartbeat( int interval_ms, int misses )
+{
+  lock_guard<mutex> lock( m_lock );
+  m_heartbeat_ms = max( interval_ms, 0 );
+  m_heartbeat_misses = max( misses, 1 );
+}
+
+bool LinkSupervisor::is_link_error( HRESULT hr )
+{
+  switch ( hr )
+  {
+    case RPC_E_DISCONNECTED:
+    case RPC_E_SERVER_DIED:
+    case RPC_E_SERVER_DIED_DNE:
+    case RPC_E_TIMEOUT:
+    case CO_E_OBJNOTCONNECTED:
+    case __HRESULT_FROM_WIN32( RPC_S_SERVER_UNAVAILABLE ):
+    case __HRESULT_FROM_WIN32( RPC_S_CALL_FAILED ):
+    case __HRESULT_FROM_WIN32( RPC_S_CALL_FAILED_DNE ):
+    case __HRESULT_FROM_WIN32( RPC_S_UNKNOWN_IF ):
+    case __HRESULT_FROM_WIN32( RPC_S_COMM_FAILURE ):
+      return true;
+    default:
+      return false;
+  }
+}
+
+void LinkSupervisor::on_connected()
+{
+  lock_guard<mutex> lock( m_lock );
+  m_state = OPCDA_LINK_STATE::UP;
+  m_last_ok = clock::now();
+  m_misses = 0;
+  m_attempts = 0;
+}
+
+void LinkSupervisor::mark_down( HRESULT hr, const string& reason )
+{
+  if ( m_state == OPCDA_LINK_STATE::DOWN )
+  {
+    return;
+  }
+
+  m_state = OPCDA_LINK_STATE::DOWN;
+  m_down_since = clock::now();
+  m_next_attempt = m_down_since;
+  m_attempts = 0;
+
+  Logger::instance().logWarning( "[supervisor] Link down (" + reason + ", " + hr_to_str( hr ) + ")" );
+}
+
+void LinkSupervisor::on_result( HRESULT hr )
+{
+  lock_guard<mutex> lock( m_lock );
+
+  if ( is_link_error( hr ) )
+  {
+    mark_down( hr, "call failed" );
+  }
+  else if ( m_state == OPCDA_LINK_STATE::UP )
+  {
+    m_last_ok = clock::now();
+    m_misses = 0;
+  }
+}
+
+void LinkSupervisor::on_heartbeat( HRESULT hr )
+{
+  lock_guard<mutex> lock( m_lock );
+
+  if ( SUCCEEDED( hr ) )
+  {
+    m_last_ok = clock::now();
+    m_misses = 0;
+    return;
+  }
+
+  // a link error is conclusive, anything else has to repeat before it counts
+  if ( is_link_error( hr ) || ++m_misses >= m_heartbeat_misses )
+  {
+    mark_down( hr, "heartbeat missed" );
+  }
+}
+
+bool LinkSupervisor::heartbeat_due() const
+{
+  lock_guard<mutex> lock( m_lock );
+  return m_state == OPCDA_LINK_STATE::UP && m_heartbeat_ms > 0 && clock::now() - m_last_ok >= chrono::milliseconds( m_heartbeat_ms );
+}
+
+bool LinkSupervisor::attempt_due() const
+{
+  lock_guard<mutex> lock( m_lock );
+  return m_state == OPCDA_LINK_STATE::DOWN && clock::now() >= m_next_attempt;
+}
+
+void LinkSupervisor::on_attempt( bool recovered )
+{
+  lock_guard<mutex> lock( m_lock );
+
+  if ( recovered )
+  {
+    auto down_ms = chrono::duration_cast<chrono::milliseconds>( clock::now() - m_down_since ).count();
+    Logger::instance().logInfo( "[supervisor] Reconnected after " + to_string( down_ms ) + " ms and " + to_string( m_attempts + 1 ) + " attempt(s)" );
+
+    m_state = OPCDA_LINK_STATE::UP;
+    m_last_ok = clock::now();
+    m_misses = 0;
+    m_attempts = 0;
+    return;
+  }
+
+  // full jitter keeps many clients from hammering a restarting server in step
+  long long ceiling = min<long long>( m_max_ms, static_cast<long long>( m_initial_ms ) << min( m_attempts, 16u ) );
+  uniform_int_distribution<long long> jitter( ceiling / 2, ceiling );
+
+  ++m_attempts;
+  m_next_attempt = clock::now() + chrono::milliseconds( jitter( m_random ) );
+}
+
+OPCDA_LINK_STATE LinkSupervisor::state() const
+{
+  lock_guard<mutex> lock( m_lock );
+  return m_state;
+}
+
+unsigned LinkSupervisor::attempts() const
+{
+  lock_guard<mutex> lock( m_lock );
+  return m_attempts;
+}
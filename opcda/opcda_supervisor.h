@@ -0,0 +1,75 @@
+// opcda_supervisor.h
+#ifndef OPCDA_SUPERVISOR_H
+#define OPCDA_SUPERVISOR_H
+
+#include <atlbase.h>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+
+using namespace std;
+
+constexpr int DEFAULT_RECONNECT_INITIAL_MS = 250;
+constexpr int DEFAULT_RECONNECT_MAX_MS = 30000;
+constexpr int DEFAULT_HEARTBEAT_MS = 5000;
+constexpr int DEFAULT_HEARTBEAT_MISSES = 2;
+
+enum class OPCDA_LINK_STATE
+{
+  UP,
+  DOWN
+};
+
+/**
+ * @brief Link health and reconnect schedule of one OpcDaClient.
+ *
+ * Holds no COM pointers. The client reports call results and heartbeats; once
+ * a link-class HRESULT or enough missed heartbeats mark the link down, the
+ * supervisor hands out reconnect attempts on a jittered exponential backoff.
+ * The attempt itself runs on the caller's thread, which keeps STA clients on
+ * their own apartment.
+ */
+class LinkSupervisor
+{
+public:
+  LinkSupervisor();
+
+  void set_backoff( int initial_ms, int max_ms );
+  void set_heartbeat( int interval_ms, int misses );
+
+  static bool is_link_error( HRESULT hr );
+
+  void on_connected();
+  void on_result( HRESULT hr );
+  void on_heartbeat( HRESULT hr );
+
+  bool heartbeat_due() const;
+  bool attempt_due() const;
+  void on_attempt( bool recovered );
+
+  OPCDA_LINK_STATE state() const;
+  unsigned attempts() const;
+
+private:
+  using clock = chrono::steady_clock;
+
+  mutable mutex m_lock;
+  OPCDA_LINK_STATE m_state = OPCDA_LINK_STATE::UP;
+
+  int m_initial_ms = DEFAULT_RECONNECT_INITIAL_MS;
+  int m_max_ms = DEFAULT_RECONNECT_MAX_MS;
+  int m_heartbeat_ms = DEFAULT_HEARTBEAT_MS;
+  int m_heartbeat_misses = DEFAULT_HEARTBEAT_MISSES;
+
+  clock::time_point m_last_ok;
+  clock::time_point m_down_since;
+  clock::time_point m_next_attempt;
+  int m_misses = 0;
+  unsigned m_attempts = 0;
+  mt19937 m_random;
+
+  void mark_down( HRESULT hr, const string& reason );
+};
+
+#endif
@@ -0,0 +1,165 @@
+// opcda_trace.cpp
+#include <algorithm>
+#include <fstream>
+
+#include "logger.h"
+#include "opcda_trace.h"
+
+using namespace std;
+
+atomic<bool> Tracer::s_enabled { false };
+
+static void append_json_string( string& out, const char* text )
+{
+  out += '"';
+  for ( const char* p = text ? text : ""; *p; ++p )
+  {
+    if ( *p == '"' || *p == '\\' )
+    {
+      out += '\\';
+    }
+    out += static_cast<unsigned char>( *p ) < 0x20 ? ' ' : *p;
+  }
+  out += '"';
+}
+
+Tracer& Tracer::instance()
+{
+  static Tracer tracer;
+  return tracer;
+}
+
+int64_t Tracer::now_us()
+{
+  static const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+  return chrono::duration_cast<chrono::microseconds>( chrono::steady_clock::now() - epoch ).count();
+}
+
+void Tracer::start( size_t max_events_per_thread )
+{
+  m_max_events = max<size_t>( max_events_per_thread, 1 );
+  now_us();
+  s_enabled.store( true, memory_order_relaxed );
+}
+
+void Tracer::stop()
+{
+  s_enabled.store( false, memory_order_relaxed );
+}
+
+void Tracer::clear()
+{
+  lock_guard<mutex> lock( m_lock );
+  m_buffers.clear();
+  m_dropped = 0;
+  ++m_generation;
+}
+
+Tracer::TRACE_BUFFER& Tracer::local_buffer()
+{
+  struct LOCAL
+  {
+    shared_ptr<TRACE_BUFFER> buffer;
+    uint64_t generation = 0;
+  };
+  thread_local LOCAL local;
+
+  uint64_t generation = m_generation.load( memory_order_relaxed );
+  if ( !local.buffer || local.generation != generation )
+  {
+    auto buffer = make_shared<TRACE_BUFFER>();
+    buffer->events.reserve( 1024 );
+
+    lock_guard<mutex> lock( m_lock );
+    buffer->tid = static_cast<uint32_t>( m_buffers.size() + 1 );
+    m_buffers.push_back( buffer );
+
+    local.buffer = move( buffer );
+    local.generation = generation;
+  }
+  return *local.buffer;
+}
+
+void Tracer::complete( const char* name, int64_t start_us, int64_t duration_us, int64_t items )
+{
+  TRACE_BUFFER& buffer = local_buffer();
+  lock_guard<mutex> lock( buffer.lock );
+
+  try
+  {
+    if ( buffer.events.size() < m_max_events.load( memory_order_relaxed ) )
+    {
+      buffer.events.push_back( { name, start_us, duration_us, items } );
+      return;
+    }
+  }
+  catch ( const bad_alloc& )
+  {
+    // called from destructors, so running out of memory only costs the span
+  }
+  m_dropped.fetch_add( 1, memory_order_relaxed );
+}
+
+size_t Tracer::dropped() const
+{
+  return m_dropped.load( memory_order_relaxed );
+}
+
+bool Tracer::write( const string& path ) const
+{
+  vector<shared_ptr<TRACE_BUFFER>> buffers;
+  {
+    lock_guard<mutex> lock( m_lock );
+    buffers = m_buffers;
+  }
+
+  ofstream file( path, ios::binary | ios::trunc );
+  if ( !file )
+  {
+    Logger::instance().logError( "[trace] Cannot open " + path );
+    return false;
+  }
+
+  string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  out += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"opcda\"}}";
+  size_t count = 0;
+
+  for ( const auto& buffer : buffers )
+  {
+    string tid = to_string( buffer->tid );
+    out += ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + tid + ",\"args\":{\"name\":\"thread " + tid + "\"}}";
+
+    lock_guard<mutex> lock( buffer->lock );
+    for ( const auto& event : buffer->events )
+    {
+      out += ",\n{\"name\":";
+      append_json_string( out, event.name );
+      out += ",\"cat\":\"opcda\",\"ph\":\"X\",\"pid\":1,\"tid\":" + tid + ",\"ts\":" + to_string( event.start_us ) + ",\"dur\":" + to_string( event.duration_us );
+      if ( event.items >= 0 )
+      {
+        out += ",\"args\":{\"items\":" + to_string( event.items ) + "}";
+      }
+      out += "}";
+
+      // written in pieces so a long trace never needs a second full copy in memory
+      if ( out.size() >= ( 1 << 20 ) )
+      {
+        file << out;
+        out.clear();
+      }
+    }
+    count += buffer->events.size();
+  }
+
+  out += "\n]}\n";
+  file << out;
+
+  if ( !file.flush() )
+  {
+    Logger::instance().logError( "[trace] Cannot write " + path );
+    return false;
+  }
+
+  Logger::instance().logInfo( "[trace] Wrote " + to_string( count ) + " spans to " + path + ( dropped() ? ", " + to_string( dropped() ) + " dropped" : "" ) );
+  return true;
+}
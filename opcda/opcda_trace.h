@@ -0,0 +1,110 @@
+// opcda_trace.h
+#ifndef OPCDA_TRACE_H
+#define OPCDA_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// events kept per thread; a long trace keeps its beginning rather than growing without bound
+constexpr size_t DEFAULT_TRACE_MAX_EVENTS = 1 << 20;
+
+struct TRACE_EVENT
+{
+  const char* name = nullptr;
+  int64_t start_us = 0;
+  int64_t duration_us = 0;
+  int64_t items = -1;
+};
+
+/**
+ * @brief Collects completed spans and writes them as Chrome Trace Event JSON.
+ *
+ * Each thread appends to its own buffer, so recording never contends with
+ * other threads; the buffer lock is only ever taken by write() as well.
+ * Buffers outlive their threads until the next clear(). While disabled a
+ * span costs one relaxed load. Span names must be string literals or
+ * otherwise live for the whole process. Open the output in Perfetto or
+ * chrome://tracing.
+ */
+class Tracer
+{
+public:
+  static Tracer& instance();
+
+  static bool enabled() { return s_enabled.load( memory_order_relaxed ); }
+  static int64_t now_us();
+
+  void start( size_t max_events_per_thread = DEFAULT_TRACE_MAX_EVENTS );
+  void stop();
+  void clear();
+
+  void complete( const char* name, int64_t start_us, int64_t duration_us, int64_t items );
+
+  /** @brief Writes every span recorded so far; tracing continues. */
+  bool write( const string& path ) const;
+  size_t dropped() const;
+
+private:
+  Tracer() = default;
+  Tracer( const Tracer& ) = delete;
+  Tracer& operator=( const Tracer& ) = delete;
+
+  struct TRACE_BUFFER
+  {
+    mutex lock;
+    vector<TRACE_EVENT> events;
+    uint32_t tid = 0;
+  };
+
+  static atomic<bool> s_enabled;
+
+  mutable mutex m_lock;
+  vector<shared_ptr<TRACE_BUFFER>> m_buffers;
+  atomic<size_t> m_max_events { DEFAULT_TRACE_MAX_EVENTS };
+  atomic<size_t> m_dropped { 0 };
+  atomic<uint64_t> m_generation { 0 };
+
+  TRACE_BUFFER& local_buffer();
+};
+
+/** @brief Records the scope it lives in as one span, when tracing is on. */
+class TraceSpan
+{
+public:
+  explicit TraceSpan( const char* name, int64_t items = -1 ) : m_name( name ), m_items( items ), m_active( Tracer::enabled() )
+  {
+    if ( m_active )
+    {
+      m_start_us = Tracer::now_us();
+    }
+  }
+
+  ~TraceSpan()
+  {
+    if ( m_active )
+    {
+      Tracer::instance().complete( m_name, m_start_us, Tracer::now_us() - m_start_us, m_items );
+    }
+  }
+
+  void set_items( int64_t items ) { m_items = items; }
+
+  TraceSpan( const TraceSpan& ) = delete;
+  TraceSpan& operator=( const TraceSpan& ) = delete;
+
+private:
+  const char* m_name;
+  int64_t m_items;
+  int64_t m_start_us = 0;
+  bool m_active;
+};
+
+#endif
@@ -0,0 +1,309 @@
+// opcda_utf.cpp
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+
+#include "opcda_utf.h"
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define OPCDA_UTF_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace OPCDA::UTILS
+{
+  static const uint32_t REPLACEMENT_CHAR = 0xFFFD;
+
+#ifdef OPCDA_UTF_SSE2
+  /**
+   * @brief Narrows the leading ASCII run of src, 16 code units per step.
+   * @return number of code units consumed
+   */
+  template <typename CharT>
+  static size_t narrow_ascii( const CharT* src, size_t len, char*& dst )
+  {
+    const __m128i* p = reinterpret_cast<const __m128i*>( src );
+    size_t i = 0;
+
+    if constexpr ( sizeof( CharT ) == 2 )
+    {
+      const __m128i mask = _mm_set1_epi16( static_cast<short>( 0xFF80 ) );
+
+      for ( ; i + 16 <= len; i += 16, p += 2 )
+      {
+        __m128i a = _mm_loadu_si128( p );
+        __m128i b = _mm_loadu_si128( p + 1 );
+
+        if ( _mm_movemask_epi8( _mm_cmpeq_epi16( _mm_and_si128( _mm_or_si128( a, b ), mask ), _mm_setzero_si128() ) ) != 0xFFFF )
+        {
+          break;
+        }
+
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( dst ), _mm_packus_epi16( a, b ) );
+        dst += 16;
+      }
+    }
+    else
+    {
+      const __m128i mask = _mm_set1_epi32( static_cast<int>( 0xFFFFFF80 ) );
+
+      for ( ; i + 16 <= len; i += 16, p += 4 )
+      {
+        __m128i a = _mm_loadu_si128( p );
+        __m128i b = _mm_loadu_si128( p + 1 );
+        __m128i c = _mm_loadu_si128( p + 2 );
+        __m128i d = _mm_loadu_si128( p + 3 );
+        __m128i any = _mm_or_si128( _mm_or_si128( a, b ), _mm_or_si128( c, d ) );
+
+        if ( _mm_movemask_epi8( _mm_cmpeq_epi32( _mm_and_si128( any, mask ), _mm_setzero_si128() ) ) != 0xFFFF )
+        {
+          break;
+        }
+
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( dst ), _mm_packus_epi16( _mm_packs_epi32( a, b ), _mm_packs_epi32( c, d ) ) );
+        dst += 16;
+      }
+    }
+
+    return i;
+  }
+
+  /**
+   * @brief Widens the leading ASCII run of src, 16 bytes per step.
+   * @return number of bytes consumed
+   */
+  template <typename CharT>
+  static size_t widen_ascii( const uint8_t* src, size_t len, CharT*& dst )
+  {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+
+    for ( ; i + 16 <= len; i += 16 )
+    {
+      __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + i ) );
+
+      if ( _mm_movemask_epi8( v ) != 0 )
+      {
+        break;
+      }
+
+      __m128i lo = _mm_unpacklo_epi8( v, zero );
+      __m128i hi = _mm_unpackhi_epi8( v, zero );
+      __m128i* out = reinterpret_cast<__m128i*>( dst );
+
+      if constexpr ( sizeof( CharT ) == 2 )
+      {
+        _mm_storeu_si128( out, lo );
+        _mm_storeu_si128( out + 1, hi );
+      }
+      else
+      {
+        _mm_storeu_si128( out, _mm_unpacklo_epi16( lo, zero ) );
+        _mm_storeu_si128( out + 1, _mm_unpackhi_epi16( lo, zero ) );
+        _mm_storeu_si128( out + 2, _mm_unpacklo_epi16( hi, zero ) );
+        _mm_storeu_si128( out + 3, _mm_unpackhi_epi16( hi, zero ) );
+      }
+
+      dst += 16;
+    }
+
+    return i;
+  }
+#endif
+
+  template <typename CharT>
+  static void encode_utf8( const CharT* src, size_t len, string& out )
+  {
+    using unit_t = conditional_t<sizeof( CharT ) == 2, uint16_t, uint32_t>;
+
+    // worst case: 3 bytes per UTF-16 unit, 4 bytes per UTF-32 unit
+    size_t base = out.size();
+    out.resize( base + len * ( sizeof( CharT ) == 2 ? 3 : 4 ) );
+
+    char* begin = &out[0];
+    char* dst = begin + base;
+    size_t i = 0;
+
+    while ( i < len )
+    {
+#ifdef OPCDA_UTF_SSE2
+      i += narrow_ascii( src + i, len - i, dst );
+#endif
+      // scalar tail, or the code point that ended the ASCII run
+      size_t stop = min( len, i + 16 );
+
+      while ( i < stop )
+      {
+        uint32_t c = static_cast<unit_t>( src[i++] );
+
+        if ( c < 0x80 )
+        {
+          *dst++ = static_cast<char>( c );
+          continue;
+        }
+
+        if ( c < 0x800 )
+        {
+          *dst++ = static_cast<char>( 0xC0 | ( c >> 6 ) );
+          *dst++ = static_cast<char>( 0x80 | ( c & 0x3F ) );
+          continue;
+        }
+
+        if ( c >= 0xD800 && c <= 0xDFFF )
+        {
+          uint32_t next = ( sizeof( CharT ) == 2 && i < len ) ? static_cast<unit_t>( src[i] ) : 0;
+
+          if ( c <= 0xDBFF && next >= 0xDC00 && next <= 0xDFFF )
+          {
+            c = 0x10000 + ( ( c - 0xD800 ) << 10 ) + ( next - 0xDC00 );
+            ++i;
+          }
+          else
+          {
+            c = REPLACEMENT_CHAR;
+          }
+        }
+        else if ( c > 0x10FFFF )
+        {
+          c = REPLACEMENT_CHAR;
+        }
+
+        if ( c < 0x10000 )
+        {
+          *dst++ = static_cast<char>( 0xE0 | ( c >> 12 ) );
+          *dst++ = static_cast<char>( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+          *dst++ = static_cast<char>( 0x80 | ( c & 0x3F ) );
+        }
+        else
+        {
+          *dst++ = static_cast<char>( 0xF0 | ( c >> 18 ) );
+          *dst++ = static_cast<char>( 0x80 | ( ( c >> 12 ) & 0x3F ) );
+          *dst++ = static_cast<char>( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+          *dst++ = static_cast<char>( 0x80 | ( c & 0x3F ) );
+        }
+      }
+    }
+
+    out.resize( static_cast<size_t>( dst - begin ) );
+  }
+
+  template <typename CharT>
+  static void decode_utf8( const char* src, size_t len, basic_string<CharT>& out )
+  {
+    // every byte yields at most one unit; a 4-byte sequence yields a surrogate pair
+    size_t base = out.size();
+    out.resize( base + len );
+
+    CharT* begin = &out[0];
+    CharT* dst = begin + base;
+    const uint8_t* s = reinterpret_cast<const uint8_t*>( src );
+    size_t i = 0;
+
+    while ( i < len )
+    {
+#ifdef OPCDA_UTF_SSE2
+      i += widen_ascii( s + i, len - i, dst );
+#endif
+      size_t stop = min( len, i + 16 );
+
+      while ( i < stop )
+      {
+        uint32_t c = s[i];
+
+        if ( c < 0x80 )
+        {
+          *dst++ = static_cast<CharT>( c );
+          ++i;
+          continue;
+        }
+
+        size_t n = 0;
+        uint32_t cp = 0;
+        uint8_t lo = 0x80;
+        uint8_t hi = 0xBF;
+
+        if ( c >= 0xC2 && c <= 0xDF )
+        {
+          n = 1;
+          cp = c & 0x1F;
+        }
+        else if ( c >= 0xE0 && c <= 0xEF )
+        {
+          n = 2;
+          cp = c & 0x0F;
+          lo = ( c == 0xE0 ) ? 0xA0 : 0x80;
+          hi = ( c == 0xED ) ? 0x9F : 0xBF;
+        }
+        else if ( c >= 0xF0 && c <= 0xF4 )
+        {
+          n = 3;
+          cp = c & 0x07;
+          lo = ( c == 0xF0 ) ? 0x90 : 0x80;
+          hi = ( c == 0xF4 ) ? 0x8F : 0xBF;
+        }
+
+        size_t j = 1;
+
+        for ( ; n > 0 && j <= n && i + j < len; ++j )
+        {
+          uint8_t b = s[i + j];
+
+          if ( b < lo || b > hi )
+          {
+            break;
+          }
+
+          cp = ( cp << 6 ) | ( b & 0x3F );
+          lo = 0x80;
+          hi = 0xBF;
+        }
+
+        // malformed: replace the maximal valid prefix with one U+FFFD
+        if ( n == 0 || j <= n )
+        {
+          *dst++ = static_cast<CharT>( REPLACEMENT_CHAR );
+          i += j;
+          continue;
+        }
+
+        i += n + 1;
+
+        if ( sizeof( CharT ) == 2 && cp >= 0x10000 )
+        {
+          cp -= 0x10000;
+          *dst++ = static_cast<CharT>( 0xD800 + ( cp >> 10 ) );
+          *dst++ = static_cast<CharT>( 0xDC00 + ( cp & 0x3FF ) );
+        }
+        else
+        {
+          *dst++ = static_cast<CharT>( cp );
+        }
+      }
+    }
+
+    out.resize( static_cast<size_t>( dst - begin ) );
+  }
+
+  void append_utf8( const char16_t* src, size_t len, string& out )
+  {
+    encode_utf8( src, len, out );
+  }
+
+  void append_utf8( const wchar_t* src, size_t len, string& out )
+  {
+    encode_utf8( src, len, out );
+  }
+
+  void append_wide( const char* src, size_t len, u16string& out )
+  {
+    decode_utf8( src, len, out );
+  }
+
+  void append_wide( const char* src, size_t len, wstring& out )
+  {
+    decode_utf8( src, len, out );
+  }
+
+} // namespace OPCDA::UTILS
@@ -0,0 +1,27 @@
+// opcda_utf.h
+#ifndef OPCDA_UTF_H
+#define OPCDA_UTF_H
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+/**
+ * @brief UTF-8 <-> UTF-16/UTF-32 transcoding without Win32 calls or length limits.
+ *
+ * Output is appended to the caller's buffer so hot paths can reuse one string.
+ * wchar_t input is treated as UTF-16 where it is 16 bits wide (Windows) and as
+ * UTF-32 otherwise. Unpaired surrogates and malformed UTF-8 become U+FFFD,
+ * matching WideCharToMultiByte / MultiByteToWideChar without error flags.
+ */
+namespace OPCDA::UTILS
+{
+  void append_utf8( const char16_t* src, size_t len, string& out );
+  void append_utf8( const wchar_t* src, size_t len, string& out );
+  void append_wide( const char* src, size_t len, u16string& out );
+  void append_wide( const char* src, size_t len, wstring& out );
+
+} // namespace OPCDA::UTILS
+
+#endif
@@ -6,25 +6,170 @@
 #include <Lmcons.h>
 #include <algorithm>
 #include <atlbase.h>
+#include <cerrno>
 #include <chrono>
 #include <comutil.h>
+#include <cstdlib>
 #include <cstring>
 #include <functional>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <opccomn.h>
 #include <opcda.h>
 #include <sstream>
 #include <string>
+#include <type_traits>
+#include <vector>
 #include <windows.h>
 
 #include "logger.h"
 #include "opcda_client.h"
+#include "opcda_format.h"
+#include "opcda_utf.h"
 #include "opcda_utils.h"
 #include "result_formatter.hpp"
 
 namespace OPCDA::UTILS
 {
+  static string int_to_str( int64_t value )
+  {
+    char buffer[FORMAT_NUMBER_CHARS];
+    return string( buffer, format_int( buffer, buffer + sizeof( buffer ), value ) );
+  }
+
+  static string uint_to_str( uint64_t value )
+  {
+    char buffer[FORMAT_NUMBER_CHARS];
+    return string( buffer, format_uint( buffer, buffer + sizeof( buffer ), value ) );
+  }
+
+  static string double_to_str( double value )
+  {
+    char buffer[FORMAT_NUMBER_CHARS];
+    return string( buffer, format_double( buffer, buffer + sizeof( buffer ), value ) );
+  }
+
+  template <typename T>
+  static void append_number( string& out, T value )
+  {
+    char buffer[FORMAT_NUMBER_CHARS];
+    char* end;
+
+    if constexpr ( is_same_v<T, float> )
+    {
+      end = format_float( buffer, buffer + sizeof( buffer ), value );
+    }
+    else if constexpr ( is_floating_point_v<T> )
+    {
+      end = format_double( buffer, buffer + sizeof( buffer ), value );
+    }
+    else if constexpr ( is_signed_v<T> )
+    {
+      end = format_int( buffer, buffer + sizeof( buffer ), value );
+    }
+    else
+    {
+      end = format_uint( buffer, buffer + sizeof( buffer ), value );
+    }
+
+    out.append( buffer, end );
+  }
+
+  /**
+   * @brief Element counts and strides of a SAFEARRAY. Dimension 1 (the leftmost
+   *        index) varies fastest in memory.
+   */
+  struct SAFEARRAY_SHAPE
+  {
+    vector<size_t> count;
+    vector<size_t> stride;
+    size_t total = 0;
+  };
+
+  static bool array_shape( SAFEARRAY* psa, SAFEARRAY_SHAPE& shape )
+  {
+    UINT dims = SafeArrayGetDim( psa );
+
+    if ( dims == 0 )
+    {
+      return false;
+    }
+
+    shape.count.resize( dims );
+    shape.stride.resize( dims );
+
+    size_t stride = 1;
+
+    for ( UINT d = 0; d < dims; ++d )
+    {
+      LONG lower;
+      LONG upper;
+
+      if ( FAILED( SafeArrayGetLBound( psa, d + 1, &lower ) ) || FAILED( SafeArrayGetUBound( psa, d + 1, &upper ) ) )
+      {
+        return false;
+      }
+
+      shape.count[d] = upper >= lower ? static_cast<size_t>( upper - lower ) + 1 : 0;
+      shape.stride[d] = stride;
+      stride *= shape.count[d];
+    }
+
+    shape.total = stride;
+    return true;
+  }
+
+  /**
+   * @brief Writes nested lists, outermost list = dimension 1, emitting each element
+   *        through a typed callback so the per-element work is resolved once per array.
+   */
+  template <typename Emit>
+  static void walk_array( string& out, const SAFEARRAY_SHAPE& shape, size_t dim, size_t offset, Emit& emit )
+  {
+    out += '[';
+
+    for ( size_t i = 0; i < shape.count[dim]; ++i )
+    {
+      if ( i > 0 )
+      {
+        out += ", ";
+      }
+
+      size_t at = offset + i * shape.stride[dim];
+
+      if ( dim + 1 == shape.count.size() )
+      {
+        emit( out, at );
+      }
+      else
+      {
+        walk_array( out, shape, dim + 1, at, emit );
+      }
+    }
+
+    out += ']';
+  }
+
+  template <typename T>
+  static void walk_numbers( string& out, const SAFEARRAY_SHAPE& shape, const void* data )
+  {
+    const T* values = static_cast<const T*>( data );
+    auto emit = [values]( string& s, size_t at ) { append_number( s, values[at] ); };
+    walk_array( out, shape, 0, 0, emit );
+  }
+
+  template <typename T>
+  static void widen_all( const void* data, size_t count, double* out )
+  {
+    const T* values = static_cast<const T*>( data );
+
+    for ( size_t i = 0; i < count; ++i )
+    {
+      out[i] = static_cast<double>( values[i] );
+    }
+  }
+
   wstring access_to_str( DWORD rights )
   {
     wstring s;
@@ -47,6 +192,27 @@ namespace OPCDA::UTILS
     return s;
   }
 
+  string server_state_to_str( DWORD state )
+  {
+    switch ( state )
+    {
+      case OPC_STATUS_RUNNING:
+        return "OPC_STATUS_RUNNING";
+      case OPC_STATUS_FAILED:
+        return "OPC_STATUS_FAILED";
+      case OPC_STATUS_NOCONFIG:
+        return "OPC_STATUS_NOCONFIG";
+      case OPC_STATUS_SUSPENDED:
+        return "OPC_STATUS_SUSPENDED";
+      case OPC_STATUS_TEST:
+        return "OPC_STATUS_TEST";
+      case OPC_STATUS_COMM_FAULT:
+        return "OPC_STATUS_COMM_FAULT";
+      default:
+        return "UNKNOWN_" + to_string( state );
+    }
+  }
+
   wstring quality_to_str( WORD quality )
   {
     wstring q_str;
@@ -80,30 +246,50 @@ namespace OPCDA::UTILS
 
   string wstr_to_str( const wstring& wstr )
   {
-    if ( wstr.empty() )
+    string result;
+    append_utf8( wstr.data(), wstr.size(), result );
+    return result;
+  }
+
+  /**
+   * @brief Accepts "VT_R8", "r8" or a numeric VARTYPE; VT_EMPTY when unknown or out of range.
+   */
+  VARTYPE str_to_vartype( const string& name )
+  {
+    if ( name.empty() )
     {
-      return string();
+      return VT_EMPTY;
     }
 
-
-    int size_needed = WideCharToMultiByte( CP_UTF8, 0, wstr.c_str(), static_cast<int>( wstr.length() ), nullptr, 0, nullptr, nullptr );
-
-
-    if ( size_needed <= 0 || size_needed > DEFAULT_MAX_STRING_BUFFER )
+    if ( all_of( name.begin(), name.end(), []( char c ) { return c >= '0' && c <= '9'; } ) )
     {
-      cerr << "Warning: String conversion buffer size issue: " << size_needed << endl;
-      size_needed = min( size_needed, static_cast<int>( DEFAULT_MAX_STRING_BUFFER ) );
-      if ( size_needed <= 0 )
-        return string();
+      // user input from --type: too many digits is a bad type, not an exception
+      errno = 0;
+      unsigned long value = strtoul( name.c_str(), nullptr, 10 );
+      if ( errno == ERANGE || value > numeric_limits<VARTYPE>::max() )
+      {
+        return VT_EMPTY;
+      }
+      return static_cast<VARTYPE>( value );
     }
 
+    string wanted = name;
+    transform( wanted.begin(), wanted.end(), wanted.begin(), []( char c ) { return static_cast<char>( toupper( static_cast<unsigned char>( c ) ) ); } );
 
-    string result( size_needed, 0 );
-
+    if ( wanted.rfind( "VT_", 0 ) != 0 )
+    {
+      wanted = "VT_" + wanted;
+    }
 
-    WideCharToMultiByte( CP_UTF8, 0, wstr.c_str(), static_cast<int>( wstr.length() ), &result[0], size_needed, nullptr, nullptr );
+    for ( VARTYPE type = VT_EMPTY; type <= VT_VERSIONED_STREAM; ++type )
+    {
+      if ( vartype_to_str( type ) == wanted )
+      {
+        return type;
+      }
+    }
 
-    return result;
+    return VT_EMPTY;
   }
 
   string vartype_to_str( VARTYPE& type )
@@ -217,10 +403,22 @@ namespace OPCDA::UTILS
 
   string variant_to_str( VARIANT& va )
   {
+    if ( ( V_VT( &va ) & VT_ARRAY ) && !( V_VT( &va ) & VT_BYREF ) )
+    {
+      return array_to_str( va );
+    }
+
     switch ( V_VT( &va ) )
     {
       case VT_BSTR:
-        return string( _bstr_t( V_BSTR( &va ) ) );
+      {
+        string result;
+        if ( V_BSTR( &va ) )
+        {
+          append_utf8( V_BSTR( &va ), SysStringLen( V_BSTR( &va ) ), result );
+        }
+        return result;
+      }
 
       case VT_BOOL:
         return V_BOOL( &va ) ? "TRUE" : "FALSE";
@@ -232,125 +430,61 @@ namespace OPCDA::UTILS
         return "NULL";
 
       case VT_I4:
-        return std::to_string( V_I4( &va ) );
+        return int_to_str( V_I4( &va ) );
       case VT_R8:
-        return std::to_string( V_R8( &va ) );
+        return double_to_str( V_R8( &va ) );
       case VT_UI1:
-        return std::to_string( V_UI1( &va ) );
+        return uint_to_str( V_UI1( &va ) );
       case VT_I1:
-        return std::to_string( V_I1( &va ) );
+        return int_to_str( V_I1( &va ) );
       case VT_UI2:
-        return std::to_string( V_UI2( &va ) );
+        return uint_to_str( V_UI2( &va ) );
       case VT_I2:
-        return std::to_string( V_I2( &va ) );
+        return int_to_str( V_I2( &va ) );
       case VT_UI4:
-        return std::to_string( V_UI4( &va ) );
+        return uint_to_str( V_UI4( &va ) );
       case VT_INT:
-        return std::to_string( V_INT( &va ) );
+        return int_to_str( V_INT( &va ) );
       case VT_UINT:
-        return std::to_string( V_UINT( &va ) );
+        return uint_to_str( V_UINT( &va ) );
       case VT_R4:
-        return std::to_string( V_R4( &va ) );
+      {
+        char buffer[FORMAT_NUMBER_CHARS];
+        return string( buffer, format_float( buffer, buffer + sizeof( buffer ), V_R4( &va ) ) );
+      }
 
       case VT_DATE:
       {
         SYSTEMTIME st;
         VariantTimeToSystemTime( V_DATE( &va ), &st );
-        ostringstream oss;
-        oss << st.wYear << "-" << setw( 2 ) << setfill( '0' ) << st.wMonth << "-" << setw( 2 ) << setfill( '0' ) << st.wDay << " " << setw( 2 ) << setfill( '0' ) << st.wHour << ":" << setw( 2 ) << setfill( '0' ) << st.wMinute << ":" << setw( 2 ) << setfill( '0' ) << st.wSecond;
-        return oss.str();
+        char buffer[FORMAT_TIME_CHARS];
+        return string( buffer, format_date_time( buffer, buffer + sizeof( buffer ), st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, ' ' ) );
       }
 
       case VT_CY:
       {
-        ostringstream oss;
-        oss << V_CY( &va ).int64 / 10000.0;
-        return oss.str();
+        return double_to_str( V_CY( &va ).int64 / 10000.0 );
       }
 
       case VT_DECIMAL:
       {
-        DECIMAL dec = V_DECIMAL( &va );
-        ostringstream oss;
-        oss << dec.Lo32 + ( dec.Lo64 / 1000000000.0 );
-        return oss.str();
+        double value = 0.0;
+        VarR8FromDec( &V_DECIMAL( &va ), &value );
+        return double_to_str( value );
       }
 
-      case VT_ARRAY:
-      case VT_ARRAY | VT_I1:
-      case VT_ARRAY | VT_I2:
-      case VT_ARRAY | VT_UI2:
-      case VT_ARRAY | VT_I4:
-      case VT_ARRAY | VT_UI4:
-      case VT_ARRAY | VT_R4:
-      case VT_ARRAY | VT_R8:
-      case VT_ARRAY | VT_BOOL:
-      case VT_ARRAY | VT_BSTR:
-      case VT_ARRAY | VT_VARIANT:
-      case VT_ARRAY | VT_UI1:
-      {
-        SAFEARRAY* psa = V_ARRAY( &va );
-        if ( psa )
-        {
-          long start_bount, end_bound;
-
-          SafeArrayGetLBound( psa, 1, &start_bount );
-          SafeArrayGetUBound( psa, 1, &end_bound );
-
-          ostringstream stream;
-          stream << "[";
-
-          for ( long i = start_bount; i <= end_bound; ++i )
-          {
-            VARIANT element;
-            VariantInit( &element );
-
-            if ( i > start_bount )
-            {
-              stream << ", ";
-            }
-
-            HRESULT hr = SafeArrayGetElement( psa, &i, &element );
-            if ( SUCCEEDED( hr ) )
-            {
-              stream << variant_to_str( element );
-            }
-            else
-            {
-              stream << "ERROR";
-            }
-
-            VariantClear( &element );
-          }
-
-          stream << "]";
-          return stream.str();
-        }
-
-        return "[]";
-      }
       case VT_I8:
-      {
-        ostringstream oss;
-        oss << V_I8( &va );
-        return oss.str();
-      }
+        return int_to_str( V_I8( &va ) );
 
       case VT_UI8:
-      {
-        ULONGLONG value = V_UI8( &va );
-        ostringstream oss;
-        oss << value;
-        return oss.str();
-      }
-      break;
+        return uint_to_str( V_UI8( &va ) );
 
 
       case VT_CLSID:
       {
         LPOLESTR clsid_str = nullptr;
         StringFromCLSID( *reinterpret_cast<CLSID*>( V_UNKNOWN( &va ) ), &clsid_str );
-        string result = clsid_str ? string( _bstr_t( clsid_str ) ) : "";
+        string result = clsid_str ? wstr_to_str( clsid_str ) : "";
 
         CoTaskMemFree( clsid_str );
 
@@ -370,13 +504,20 @@ namespace OPCDA::UTILS
         return "IUnknown pointer";
 
       case VT_BYREF | VT_I4:
-        return std::to_string( *V_I4REF( &va ) );
+        return int_to_str( *V_I4REF( &va ) );
 
       case VT_BYREF | VT_R8:
-        return std::to_string( *V_R8REF( &va ) );
+        return double_to_str( *V_R8REF( &va ) );
 
       case VT_BYREF | VT_BSTR:
-        return V_BSTRREF( &va ) ? string( _bstr_t( *V_BSTRREF( &va ) ) ) : "";
+      {
+        string result;
+        if ( V_BSTRREF( &va ) && *V_BSTRREF( &va ) )
+        {
+          append_utf8( *V_BSTRREF( &va ), SysStringLen( *V_BSTRREF( &va ) ), result );
+        }
+        return result;
+      }
 
       case VT_BYREF | VT_BOOL:
         return *V_BOOLREF( &va ) ? "TRUE" : "FALSE";
@@ -389,58 +530,256 @@ namespace OPCDA::UTILS
     }
   }
 
-  wstring str_to_wstr( const string& str )
+  string array_to_str( const VARIANT& va )
   {
-    if ( str.empty() )
+    SAFEARRAY* psa = V_ARRAY( &va );
+    SAFEARRAY_SHAPE shape;
+
+    if ( !psa || !array_shape( psa, shape ) )
     {
-      return wstring();
+      return "[]";
     }
 
+    void* data = nullptr;
 
-    int size_needed = MultiByteToWideChar( CP_UTF8, 0, str.c_str(), static_cast<int>( str.length() ), nullptr, 0 );
+    if ( FAILED( SafeArrayAccessData( psa, &data ) ) )
+    {
+      return "ERROR";
+    }
 
+    string out;
+    out.reserve( shape.total * 8 + 2 );
 
-    if ( size_needed <= 0 || size_needed > DEFAULT_MAX_STRING_BUFFER )
+    switch ( V_VT( &va ) & VT_TYPEMASK )
     {
-      cerr << "Warning: String conversion buffer size issue: " << size_needed << endl;
-      size_needed = min( size_needed, static_cast<int>( DEFAULT_MAX_STRING_BUFFER ) );
-      if ( size_needed <= 0 )
-        return wstring();
-    }
+      case VT_I1:
+        walk_numbers<CHAR>( out, shape, data );
+        break;
+      case VT_UI1:
+        walk_numbers<BYTE>( out, shape, data );
+        break;
+      case VT_I2:
+        walk_numbers<SHORT>( out, shape, data );
+        break;
+      case VT_UI2:
+        walk_numbers<USHORT>( out, shape, data );
+        break;
+      case VT_I4:
+      case VT_INT:
+      case VT_ERROR:
+        walk_numbers<LONG>( out, shape, data );
+        break;
+      case VT_UI4:
+      case VT_UINT:
+        walk_numbers<ULONG>( out, shape, data );
+        break;
+      case VT_I8:
+        walk_numbers<LONGLONG>( out, shape, data );
+        break;
+      case VT_UI8:
+        walk_numbers<ULONGLONG>( out, shape, data );
+        break;
+      case VT_R4:
+        walk_numbers<FLOAT>( out, shape, data );
+        break;
+      case VT_R8:
+        walk_numbers<DOUBLE>( out, shape, data );
+        break;
 
+      case VT_BOOL:
+      {
+        const VARIANT_BOOL* values = static_cast<const VARIANT_BOOL*>( data );
+        auto emit = [values]( string& s, size_t at ) { s += values[at] ? "TRUE" : "FALSE"; };
+        walk_array( out, shape, 0, 0, emit );
+        break;
+      }
 
-    wstring result( size_needed, 0 );
+      case VT_BSTR:
+      {
+        const BSTR* values = static_cast<const BSTR*>( data );
+        auto emit = [values]( string& s, size_t at ) {
+          if ( values[at] )
+          {
+            append_utf8( values[at], SysStringLen( values[at] ), s );
+          }
+        };
+        walk_array( out, shape, 0, 0, emit );
+        break;
+      }
 
+      case VT_VARIANT:
+      {
+        VARIANT* values = static_cast<VARIANT*>( data );
+        auto emit = [values]( string& s, size_t at ) { s += variant_to_str( values[at] ); };
+        walk_array( out, shape, 0, 0, emit );
+        break;
+      }
+
+      case VT_CY:
+      case VT_DATE:
+      case VT_DECIMAL:
+      {
+        VARTYPE vt = V_VT( &va ) & VT_TYPEMASK;
+        const BYTE* bytes = static_cast<const BYTE*>( data );
+        UINT size = SafeArrayGetElemsize( psa );
+        auto emit = [vt, bytes, size]( string& s, size_t at ) {
+          VARIANT element;
+          VariantInit( &element );
+
+          if ( vt == VT_DECIMAL )
+          {
+            memcpy( &V_DECIMAL( &element ), bytes + at * size, sizeof( DECIMAL ) );
+          }
+          else
+          {
+            memcpy( &V_CY( &element ), bytes + at * size, size );
+          }
 
-    MultiByteToWideChar( CP_UTF8, 0, str.c_str(), static_cast<int>( str.length() ), &result[0], size_needed );
+          V_VT( &element ) = vt;
+          s += variant_to_str( element );
+        };
+        walk_array( out, shape, 0, 0, emit );
+        break;
+      }
 
-    return result;
+      default:
+        out = "ERROR";
+        break;
+    }
+
+    SafeArrayUnaccessData( psa );
+    return out;
   }
 
-  wstring str_to_wstr( const string& str, size_t max_buffer_size )
+  bool array_to_doubles( const VARIANT& va, vector<double>& values )
   {
-    if ( str.empty() )
+    SAFEARRAY* psa = V_ARRAY( &va );
+    SAFEARRAY_SHAPE shape;
+
+    values.clear();
+
+    if ( !( V_VT( &va ) & VT_ARRAY ) || !psa || !array_shape( psa, shape ) )
+    {
+      return false;
+    }
+
+    void* data = nullptr;
+
+    if ( FAILED( SafeArrayAccessData( psa, &data ) ) )
     {
-      return wstring();
+      return false;
     }
 
+    bool converted = true;
+    values.resize( shape.total );
+
+    switch ( V_VT( &va ) & VT_TYPEMASK )
+    {
+      case VT_R8:
+        memcpy( values.data(), data, shape.total * sizeof( DOUBLE ) );
+        break;
+      case VT_R4:
+        widen_all<FLOAT>( data, shape.total, values.data() );
+        break;
+      case VT_I1:
+        widen_all<CHAR>( data, shape.total, values.data() );
+        break;
+      case VT_UI1:
+        widen_all<BYTE>( data, shape.total, values.data() );
+        break;
+      case VT_I2:
+        widen_all<SHORT>( data, shape.total, values.data() );
+        break;
+      case VT_UI2:
+        widen_all<USHORT>( data, shape.total, values.data() );
+        break;
+      case VT_I4:
+      case VT_INT:
+        widen_all<LONG>( data, shape.total, values.data() );
+        break;
+      case VT_UI4:
+      case VT_UINT:
+        widen_all<ULONG>( data, shape.total, values.data() );
+        break;
+      case VT_I8:
+        widen_all<LONGLONG>( data, shape.total, values.data() );
+        break;
+      case VT_UI8:
+        widen_all<ULONGLONG>( data, shape.total, values.data() );
+        break;
+
+      case VT_BOOL:
+      {
+        const VARIANT_BOOL* flags = static_cast<const VARIANT_BOOL*>( data );
+        for ( size_t i = 0; i < shape.total; ++i )
+        {
+          values[i] = flags[i] ? 1.0 : 0.0;
+        }
+        break;
+      }
 
-    int size_needed = MultiByteToWideChar( CP_UTF8, 0, str.c_str(), static_cast<int>( str.length() ), nullptr, 0 );
+      case VT_BSTR:
+      {
+        const BSTR* strings = static_cast<const BSTR*>( data );
+        for ( size_t i = 0; i < shape.total && converted; ++i )
+        {
+          converted = strings[i] && SUCCEEDED( VarR8FromStr( strings[i], LOCALE_USER_DEFAULT, 0, &values[i] ) );
+        }
+        break;
+      }
 
+      case VT_VARIANT:
+      {
+        VARIANT* elements = static_cast<VARIANT*>( data );
+        for ( size_t i = 0; i < shape.total && converted; ++i )
+        {
+          VARIANT element;
+          VariantInit( &element );
+          converted = SUCCEEDED( VariantChangeType( &element, &elements[i], 0, VT_R8 ) );
+          values[i] = converted ? V_R8( &element ) : 0.0;
+          VariantClear( &element );
+        }
+        break;
+      }
 
-    if ( size_needed <= 0 || size_needed > static_cast<int>( max_buffer_size ) )
+      default:
+        converted = false;
+        break;
+    }
+
+    SafeArrayUnaccessData( psa );
+
+    if ( !converted )
     {
-      cerr << "Warning: String conversion buffer size issue: " << size_needed << endl;
-      size_needed = min( size_needed, static_cast<int>( max_buffer_size ) );
-      if ( size_needed <= 0 )
-        return wstring();
+      values.clear();
     }
 
+    return converted;
+  }
+
+  wstring str_to_wstr( const string& str )
+  {
+    wstring result;
+    append_wide( str.data(), str.size(), result );
+    return result;
+  }
 
-    wstring result( size_needed, 0 );
+  wstring str_to_wstr( const string& str, size_t max_buffer_size )
+  {
+    wstring result;
+    append_wide( str.data(), str.size(), result );
 
+    if ( result.size() > max_buffer_size )
+    {
+      Logger::instance().logWarning( "String conversion truncated to " + to_string( max_buffer_size ) + " characters" );
+      result.resize( max_buffer_size );
 
-    MultiByteToWideChar( CP_UTF8, 0, str.c_str(), static_cast<int>( str.length() ), &result[0], size_needed );
+      // never leave half of a surrogate pair behind
+      if ( !result.empty() && result.back() >= 0xD800 && result.back() <= 0xDBFF )
+      {
+        result.pop_back();
+      }
+    }
 
     return result;
   }
@@ -461,6 +800,12 @@ namespace OPCDA::UTILS
 
   string filetime_to_isotime( const FILETIME& st )
   {
+    ULARGE_INTEGER uli;
+    uli.LowPart = st.dwLowDateTime;
+    uli.HighPart = st.dwHighDateTime;
+
+    char buffer[FORMAT_TIME_CHARS];
+    return string( buffer, format_iso8601( buffer, buffer + sizeof( buffer ), static_cast<int64_t>( uli.QuadPart ) ) );
   }
 
   long long systemtime_to_epochtime( const SYSTEMTIME& st )
@@ -475,9 +820,69 @@ namespace OPCDA::UTILS
 
   string systemtime_to_isotime( const SYSTEMTIME& st )
   {
-    std::ostringstream oss;
-    oss << std::setfill( '0' ) << std::setw( 4 ) << st.wYear << "-" << std::setw( 2 ) << st.wMonth << "-" << std::setw( 2 ) << st.wDay << "T" << std::setw( 2 ) << st.wHour << ":" << std::setw( 2 ) << st.wMinute << ":" << std::setw( 2 ) << st.wSecond << "." << std::setw( 3 ) << st.wMilliseconds << "Z";
-    return oss.str();
+    char buffer[FORMAT_TIME_CHARS];
+    return string( buffer, format_iso8601( buffer, buffer + sizeof( buffer ), st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, st.wMilliseconds ) );
+  }
+
+  bool tag_to_sample( const OPCDA_TAG& tag, OPCDA_SAMPLE& sample )
+  {
+    VARIANT converted;
+    VariantInit( &converted );
+
+    HRESULT hr = VariantChangeType( &converted, const_cast<VARIANT*>( &tag.value ), 0, VT_R8 );
+    if ( FAILED( hr ) )
+    {
+      VariantClear( &converted );
+      return false;
+    }
+
+    ULARGE_INTEGER uli;
+    uli.LowPart = tag.timestamp.dwLowDateTime;
+    uli.HighPart = tag.timestamp.dwHighDateTime;
+
+    sample.id = wstr_to_str( tag.id );
+    sample.timestamp = static_cast<int64_t>( uli.QuadPart );
+    sample.value = V_R8( &converted );
+    sample.quality = tag.quality;
+
+    VariantClear( &converted );
+    return true;
+  }
+
+  bool tag_to_samples( const OPCDA_TAG& tag, vector<OPCDA_SAMPLE>& samples )
+  {
+    if ( !( V_VT( &tag.value ) & VT_ARRAY ) || ( V_VT( &tag.value ) & VT_BYREF ) )
+    {
+      OPCDA_SAMPLE sample;
+
+      if ( !tag_to_sample( tag, sample ) )
+      {
+        return false;
+      }
+
+      samples.push_back( move( sample ) );
+      return true;
+    }
+
+    OPCDA_SAMPLE sample;
+
+    if ( !array_to_doubles( tag.value, sample.elements ) )
+    {
+      return false;
+    }
+
+    ULARGE_INTEGER uli;
+    uli.LowPart = tag.timestamp.dwLowDateTime;
+    uli.HighPart = tag.timestamp.dwHighDateTime;
+
+    // the whole array stays one sample with one contiguous payload
+    sample.id = wstr_to_str( tag.id );
+    sample.timestamp = static_cast<int64_t>( uli.QuadPart );
+    sample.value = sample.elements.empty() ? 0.0 : sample.elements.front();
+    sample.quality = tag.quality;
+    samples.push_back( move( sample ) );
+
+    return true;
   }
 
   int dword_to_int( const DWORD& value )
@@ -514,24 +919,7 @@ namespace OPCDA::UTILS
        */
       else if ( std::holds_alternative<wstring>( v ) )
       {
-        wstring wstr = std::get<wstring>( v );
-
-        if ( wstr.empty() )
-        {
-          return string();
-        }
-
-        int size_needed = WideCharToMultiByte( CP_UTF8, 0, wstr.c_str(), static_cast<int>( wstr.length() ), nullptr, 0, nullptr, nullptr );
-        size_needed = std::min( size_needed, static_cast<int>( DEFAULT_MAX_STRING_BUFFER ) );
-
-        if ( size_needed <= 0 )
-        {
-          return string();
-        }
-
-        string result( size_needed, 0 );
-        WideCharToMultiByte( CP_UTF8, 0, wstr.c_str(), static_cast<int>( wstr.length() ), &result[0], size_needed, nullptr, nullptr );
-        return result;
+        return wstr_to_str( std::get<wstring>( v ) );
       }
       /* VARIANT
        */
@@ -13,10 +13,12 @@
 #include <opcda.h>
 #include <sstream>
 #include <string>
+#include <vector>
 #include <windows.h>
 
 #include "logger.h"
 #include "opcda_client.h"
+#include "opcda_sample.h"
 #include "result_formatter.hpp"
 
 namespace OPCDA::UTILS
@@ -27,12 +29,18 @@ namespace OPCDA::UTILS
   long long systemtime_to_epochtime( const SYSTEMTIME& st );
   string filetime_to_isotime( const FILETIME& st );
   string systemtime_to_isotime( const SYSTEMTIME& st );
+  string array_to_str( const VARIANT& va );
+  bool array_to_doubles( const VARIANT& va, vector<double>& values );
   string to_str( const std::variant<HRESULT, wstring, VARIANT, VARTYPE, SYSTEMTIME, FILETIME>& v );
   string variant_to_str( VARIANT& va );
   string vartype_to_str( VARTYPE& type );
+  VARTYPE str_to_vartype( const string& name );
   string wstr_to_str( const wstring& wstr );
+  bool tag_to_sample( const OPCDA_TAG& tag, OPCDA_SAMPLE& sample );
+  bool tag_to_samples( const OPCDA_TAG& tag, vector<OPCDA_SAMPLE>& samples );
   wstring access_to_str( DWORD rights );
   wstring quality_to_str( WORD quality );
+  string server_state_to_str( DWORD state );
   wstring str_to_wstr( const string& str );
   wstring str_to_wstr( const string& str, size_t max_buffer_size );
 
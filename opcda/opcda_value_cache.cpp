@@ -0,0 +1,155 @@
+// opcda_value_cache.cpp
+#include <chrono>
+#include <thread>
+
+#include "opcda_value_cache.h"
+
+using namespace std;
+
+ValueCache::ValueCache()
+{
+  for ( auto& chunk : m_chunks )
+  {
+    chunk.store( nullptr, memory_order_relaxed );
+  }
+}
+
+ValueCache::~ValueCache()
+{
+  for ( auto& chunk : m_chunks )
+  {
+    delete[] chunk.load( memory_order_relaxed );
+  }
+}
+
+int64_t ValueCache::now_us()
+{
+  // never 0, which marks an empty slot
+  static const chrono::steady_clock::time_point epoch = chrono::steady_clock::now() - chrono::microseconds( 1 );
+  return chrono::duration_cast<chrono::microseconds>( chrono::steady_clock::now() - epoch ).count();
+}
+
+ValueCache::VALUE_SLOT* ValueCache::slot( uint32_t handle, bool create )
+{
+  size_t index = handle / VALUE_CACHE_CHUNK_SLOTS;
+  if ( index >= VALUE_CACHE_MAX_CHUNKS )
+  {
+    return nullptr;
+  }
+
+  VALUE_SLOT* chunk = m_chunks[index].load( memory_order_acquire );
+  if ( !chunk && create )
+  {
+    // whoever loses the race frees its copy and uses the winner's
+    VALUE_SLOT* fresh = new VALUE_SLOT[VALUE_CACHE_CHUNK_SLOTS];
+    if ( m_chunks[index].compare_exchange_strong( chunk, fresh, memory_order_acq_rel, memory_order_acquire ) )
+    {
+      chunk = fresh;
+    }
+    else
+    {
+      delete[] fresh;
+    }
+  }
+
+  return chunk ? &chunk[handle % VALUE_CACHE_CHUNK_SLOTS] : nullptr;
+}
+
+const ValueCache::VALUE_SLOT* ValueCache::find( uint32_t handle ) const
+{
+  return const_cast<ValueCache*>( this )->slot( handle, false );
+}
+
+void ValueCache::store( VALUE_SLOT& slot, uint64_t bits, uint64_t meta, int64_t timestamp, int64_t stored_us )
+{
+  uint32_t sequence = slot.sequence.load( memory_order_relaxed );
+
+  while ( ( sequence & 1 ) || !slot.sequence.compare_exchange_weak( sequence, sequence + 1, memory_order_acquire, memory_order_relaxed ) )
+  {
+    if ( sequence & 1 )
+    {
+      this_thread::yield();
+      sequence = slot.sequence.load( memory_order_relaxed );
+    }
+  }
+
+  // keeps the field stores from moving ahead of the odd sequence
+  atomic_thread_fence( memory_order_release );
+
+  slot.bits.store( bits, memory_order_relaxed );
+  slot.meta.store( meta, memory_order_relaxed );
+  slot.timestamp.store( timestamp, memory_order_relaxed );
+  slot.stored_us.store( stored_us, memory_order_relaxed );
+
+  slot.sequence.store( sequence + 2, memory_order_release );
+}
+
+bool ValueCache::put( uint32_t handle, uint16_t type, uint64_t bits, uint16_t quality, int64_t timestamp )
+{
+  VALUE_SLOT* target = slot( handle, true );
+  if ( !target )
+  {
+    return false;
+  }
+
+  uint64_t generation = m_generation.load( memory_order_relaxed );
+  store( *target, bits, type | static_cast<uint64_t>( quality ) << 16 | generation << 32, timestamp, now_us() );
+  return true;
+}
+
+void ValueCache::invalidate( uint32_t handle )
+{
+  VALUE_SLOT* target = slot( handle, false );
+  if ( target && target->stored_us.load( memory_order_relaxed ) )
+  {
+    store( *target, 0, 0, 0, 0 );
+  }
+}
+
+void ValueCache::clear()
+{
+  m_generation.fetch_add( 1, memory_order_relaxed );
+}
+
+bool ValueCache::get( uint32_t handle, int64_t max_age_us, CACHED_VALUE& value ) const
+{
+  const VALUE_SLOT* source = find( handle );
+
+  if ( source )
+  {
+    while ( true )
+    {
+      uint32_t before = source->sequence.load( memory_order_acquire );
+      if ( before & 1 )
+      {
+        this_thread::yield();
+        continue;
+      }
+
+      uint64_t bits = source->bits.load( memory_order_relaxed );
+      uint64_t meta = source->meta.load( memory_order_relaxed );
+      int64_t timestamp = source->timestamp.load( memory_order_relaxed );
+      int64_t stored_us = source->stored_us.load( memory_order_relaxed );
+
+      atomic_thread_fence( memory_order_acquire );
+      if ( source->sequence.load( memory_order_relaxed ) != before )
+      {
+        continue;
+      }
+
+      // values from before the last clear() carry an older generation
+      if ( stored_us && ( meta >> 32 ) == m_generation.load( memory_order_relaxed ) && now_us() - stored_us <= max_age_us )
+      {
+        value.type = static_cast<uint16_t>( meta & 0xFFFF );
+        value.quality = static_cast<uint16_t>( meta >> 16 );
+        value.bits = bits;
+        value.timestamp = timestamp;
+        value.stored_us = stored_us;
+        return true;
+      }
+      break;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,75 @@
+// opcda_value_cache.h
+#ifndef OPCDA_VALUE_CACHE_H
+#define OPCDA_VALUE_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+constexpr size_t VALUE_CACHE_CHUNK_SLOTS = 1024;
+constexpr size_t VALUE_CACHE_MAX_CHUNKS = 4096;
+
+/** @brief One cached value: a scalar VARIANT payload, kept as its type and raw 8 bytes. */
+struct CACHED_VALUE
+{
+  uint16_t type = 0;
+  uint64_t bits = 0;
+  uint16_t quality = 0;
+  int64_t timestamp = 0;  // FILETIME ticks
+  int64_t stored_us = 0;  // ValueCache::now_us() when the value was read
+};
+
+/**
+ * @brief Last value per item handle, readable without locks.
+ *
+ * Slots are indexed by client handle, which the client hands out densely from
+ * 1, in chunks that are allocated once and never move, so a lookup is two
+ * array loads. Each slot is a seqlock: a writer makes the sequence odd,
+ * stores the fields and makes it even again; a reader copies the fields and
+ * retries if the sequence moved underneath it. Readers therefore never block
+ * a writer and never see a torn value. Writers to the same handle exclude
+ * each other through the sequence itself.
+ *
+ * Only fixed size payloads fit a slot; the owner keeps strings and arrays
+ * out, which simply makes them stale on every lookup.
+ */
+class ValueCache
+{
+public:
+  ValueCache();
+  ~ValueCache();
+
+  static int64_t now_us();
+
+  /** @brief Stores a value read at now_us(); false when the handle is out of range. */
+  bool put( uint32_t handle, uint16_t type, uint64_t bits, uint16_t quality, int64_t timestamp );
+  /** @brief True when a value no older than max_age_us is cached for the handle. */
+  bool get( uint32_t handle, int64_t max_age_us, CACHED_VALUE& value ) const;
+  void invalidate( uint32_t handle );
+  /** @brief Drops every value at once; slots are reused, not freed. */
+  void clear();
+
+  ValueCache( const ValueCache& ) = delete;
+  ValueCache& operator=( const ValueCache& ) = delete;
+
+private:
+  struct alignas( 64 ) VALUE_SLOT
+  {
+    atomic<uint32_t> sequence { 0 };
+    atomic<uint64_t> bits { 0 };
+    atomic<uint64_t> meta { 0 };  // type | quality << 16 | generation << 32
+    atomic<int64_t> timestamp { 0 };
+    atomic<int64_t> stored_us { 0 };
+  };
+
+  atomic<VALUE_SLOT*> m_chunks[VALUE_CACHE_MAX_CHUNKS];
+  atomic<uint32_t> m_generation { 0 };
+
+  VALUE_SLOT* slot( uint32_t handle, bool create );
+  const VALUE_SLOT* find( uint32_t handle ) const;
+  void store( VALUE_SLOT& slot, uint64_t bits, uint64_t meta, int64_t timestamp, int64_t stored_us );
+};
+
+#endif
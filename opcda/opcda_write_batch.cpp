@@ -0,0 +1,121 @@
+// opcda_write_batch.cpp
+#define NOMINMAX
+#include <algorithm>
+#include <windows.h>
+
+#include "logger.h"
+#include "opcda_write_batch.h"
+
+using namespace std;
+
+WriteBatcher::WriteBatcher( OpcDaClient& client ) : m_client( client )
+{
+}
+
+void WriteBatcher::set_window( int window_ms )
+{
+  m_window_ms = max( window_ms, 0 );
+}
+
+void WriteBatcher::set_async( bool async )
+{
+  m_async = async;
+}
+
+void WriteBatcher::submit( const wstring& item_id, const VARIANT& value )
+{
+  lock_guard<mutex> lock( m_lock );
+
+  if ( m_pending.empty() )
+  {
+    m_first_pending = clock::now();
+  }
+
+  auto it = m_pending.find( item_id );
+  if ( it != m_pending.end() )
+  {
+    it->second = value;
+    ++m_coalesced;
+  }
+  else
+  {
+    m_pending.emplace( item_id, CComVariant( value ) );
+  }
+
+  ++m_submitted;
+}
+
+bool WriteBatcher::due() const
+{
+  lock_guard<mutex> lock( m_lock );
+  return !m_pending.empty() && clock::now() - m_first_pending >= chrono::milliseconds( m_window_ms );
+}
+
+size_t WriteBatcher::pending() const
+{
+  lock_guard<mutex> lock( m_lock );
+  return m_pending.size();
+}
+
+HRESULT WriteBatcher::flush_if_due( vector<OPCDA_WRITE_RESULT>& results )
+{
+  results.clear();
+  return due() ? flush( results ) : S_OK;
+}
+
+HRESULT WriteBatcher::flush( vector<OPCDA_WRITE_RESULT>& results )
+{
+  results.clear();
+
+  map<wstring, CComVariant> batch;
+  {
+    lock_guard<mutex> lock( m_lock );
+    batch.swap( m_pending );
+  }
+
+  if ( batch.empty() )
+  {
+    return S_OK;
+  }
+
+  vector<wstring> ids;
+  vector<VARIANT> values;
+  ids.reserve( batch.size() );
+  values.reserve( batch.size() );
+
+  // shallow copies, batch keeps ownership until the call returns
+  for ( const auto& entry : batch )
+  {
+    ids.push_back( entry.first );
+    values.push_back( entry.second );
+  }
+
+  vector<HRESULT> errors;
+  HRESULT hr;
+
+  if ( m_async )
+  {
+    DWORD transaction = 0;
+    hr = m_client.write_async( ids, values, transaction, errors );
+  }
+  else
+  {
+    hr = m_client.write_sync( ids, values, errors );
+  }
+
+  ++m_batches;
+
+  results.resize( ids.size() );
+  for ( size_t i = 0; i < ids.size(); ++i )
+  {
+    results[i].id = ids[i];
+    results[i].error = i < errors.size() ? errors[i] : hr;
+  }
+
+  if ( FAILED( hr ) )
+  {
+    Logger::instance().logWarning( "[write] Batch of " + to_string( ids.size() ) + " items failed" );
+  }
+
+  return hr;
+}
@@ -0,0 +1,78 @@
+// opcda_write_batch.h
+#ifndef OPCDA_WRITE_BATCH_H
+#define OPCDA_WRITE_BATCH_H
+
+#include <atlbase.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "opcda_client.h"
+
+using namespace std;
+
+constexpr int DEFAULT_WRITE_WINDOW_MS = 100;
+
+struct OPCDA_WRITE_RESULT
+{
+  wstring id;
+  HRESULT error = S_OK;
+};
+
+/**
+ * @brief Coalesces writes per tag and sends them to the client in bulk.
+ *
+ * submit() may be called from any thread; a later value for a tag replaces the
+ * pending one (last write wins). flush() hands everything pending to one
+ * write_sync or write_async call and must run on a thread the client accepts
+ * writes from, typically the one that connected it.
+ */
+class WriteBatcher
+{
+public:
+  explicit WriteBatcher( OpcDaClient& client );
+
+  void set_window( int window_ms );
+  void set_async( bool async );
+
+  void submit( const wstring& item_id, const VARIANT& value );
+  bool due() const;
+  size_t pending() const;
+
+  HRESULT flush( vector<OPCDA_WRITE_RESULT>& results );
+  HRESULT flush_if_due( vector<OPCDA_WRITE_RESULT>& results );
+
+  size_t submitted() const
+  {
+    return m_submitted.load( memory_order_relaxed );
+  }
+  size_t coalesced() const
+  {
+    return m_coalesced.load( memory_order_relaxed );
+  }
+  size_t batches() const
+  {
+    return m_batches.load( memory_order_relaxed );
+  }
+
+private:
+  using clock = chrono::steady_clock;
+
+  OpcDaClient& m_client;
+  int m_window_ms = DEFAULT_WRITE_WINDOW_MS;
+  bool m_async = false;
+
+  mutable mutex m_lock;
+  map<wstring, CComVariant> m_pending;
+  clock::time_point m_first_pending;
+
+  // the accessors read these without m_lock, and flush() counts its batch after releasing it
+  atomic<size_t> m_submitted{ 0 };
+  atomic<size_t> m_coalesced{ 0 };
+  atomic<size_t> m_batches{ 0 };
+};
+
+#endif
@@ -6,9 +6,15 @@
 #include <map>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "opcda_client.h"
+#include "opcda_connection_manager.h"
+#include "opcda_discovery.h"
+#include "opcda_format.h"
+#include "opcda_health.h"
+#include "opcda_write_batch.h"
 #include "opcda_utils.h"
 
 using namespace std;
@@ -78,6 +84,40 @@ public:
     }
   }
 
+  void printDiscoveryHeader()
+  {
+    cout << "success: true" << endl;
+    cout << "result:" << endl;
+  }
+
+  void printDiscoveryHost( const DISCOVERY_RESULT& result )
+  {
+    cout << "  " << result.host << ":" << endl;
+    cout << "    status: " << DiscoverySweep::status_to_str( result.status ) << endl;
+    cout << "    elapsed_ms: " << result.elapsed_ms << endl;
+
+    if ( FAILED( result.error ) )
+    {
+      cout << "    error: 0x" << hex << static_cast<unsigned long>( result.error ) << dec << endl;
+    }
+
+    if ( result.servers.empty() )
+    {
+      return;
+    }
+
+    cout << "    servers:" << endl;
+    for ( const auto& server : result.servers )
+    {
+      wchar_t* clsid_str = nullptr;
+      StringFromCLSID( server.clsid, &clsid_str );
+
+      cout << "      - { progid: " << OPCDA::UTILS::wstr_to_str( server.progid ) << ", clsid: " << OPCDA::UTILS::wstr_to_str( clsid_str ? clsid_str : L"" ) << " }" << endl;
+
+      CoTaskMemFree( clsid_str );
+    }
+  }
+
   void printTags( const vector<string>& tags )
   {
     cout << "success: true" << endl;
@@ -88,7 +128,7 @@ public:
     }
   }
 
-  void printTagValues( const map<string, OPCDA_TAG>& values )
+  void printTagValues( const map<string, OPCDA_TAG>& values, const map<string, OPCDA_ITEM_PROPERTIES>* properties = nullptr )
   {
     cout << "success: true" << endl;
     cout << "result:" << endl;
@@ -98,21 +138,169 @@ public:
       cout << "  " << tag.first << ":" << endl;
 
       VARIANT tag_value = tag.second.value;
-      VARTYPE tag_type = tag.second.data_type;
       string tab = "    ";
 
-      // tag.second.id
-      // tag.second.timestamp
-      cout << tab << "- id: " << OPCDA::UTILS::wstr_to_str( tag.second.id ) << endl;
-      cout << tab << "- value: " << OPCDA::UTILS::variant_to_str( tag_value ) << endl;
-      cout << tab << "- data_type: " << OPCDA::UTILS::vartype_to_str( tag_type ) << endl;
-      cout << tab << "- timestamp: " << OPCDA::UTILS::filetime_to_epochtime( tag.second.timestamp ) << endl;
-      cout << tab << "- isotime: " << OPCDA::UTILS::filetime_to_isotime( tag.second.timestamp ) << endl;
+      printTagEntry( tag.second, tab );
+
+      if ( properties )
+      {
+        auto found = properties->find( tag.first );
+        if ( found != properties->end() )
+        {
+          printProperties( found->second, tab, false );
+        }
+      }
 
       VariantClear( &tag_value );
     }
   }
 
+  void printTagEntry( const OPCDA_TAG& tag, const string& tab )
+  {
+    // shallow copy, the caller still owns the value
+    VARIANT tag_value = tag.value;
+    VARTYPE tag_type = tag.data_type;
+
+    cout << tab << "- id: " << OPCDA::UTILS::wstr_to_str( tag.id ) << endl;
+    cout << tab << "- value: " << OPCDA::UTILS::variant_to_str( tag_value ) << endl;
+    cout << tab << "- data_type: " << OPCDA::UTILS::vartype_to_str( tag_type ) << endl;
+    cout << tab << "- timestamp: " << OPCDA::UTILS::filetime_to_epochtime( tag.timestamp ) << endl;
+    cout << tab << "- isotime: " << OPCDA::UTILS::filetime_to_isotime( tag.timestamp ) << endl;
+  }
+
+  void printServerResult( const OPCDA_SERVER_RESULT& result )
+  {
+    cout << "success: " << ( SUCCEEDED( result.error ) ? "true" : "false" ) << endl;
+    cout << "server: " << result.server << endl;
+    cout << "session: " << result.session << endl;
+    cout << "elapsed_ms: " << result.elapsed_ms << endl;
+
+    if ( FAILED( result.error ) )
+    {
+      cout << "error:" << endl;
+      cout << "  code: 0x" << hex << static_cast<unsigned long>( result.error ) << dec << endl;
+      return;
+    }
+
+    cout << "result:" << endl;
+    for ( const auto& tag : result.tags )
+    {
+      cout << "  " << OPCDA::UTILS::wstr_to_str( tag.id ) << ":" << endl;
+      printTagEntry( tag, "    " );
+    }
+  }
+
+  void printHealthSample( const OPCDA_HEALTH_SAMPLE& sample )
+  {
+    cout << "health:" << endl;
+    cout << "  state: " << OPCDA::UTILS::server_state_to_str( sample.state ) << endl;
+    cout << "  running: " << ( sample.running ? "true" : "false" ) << endl;
+    cout << "  rtt_us: " << sample.rtt_us << endl;
+    cout << "  group_count: " << sample.group_count << endl;
+    cout << "  update_lag_ms: " << sample.update_lag_ms << endl;
+    cout << "  epochtime: " << sample.sampled_epochtime << endl;
+
+    if ( FAILED( sample.error ) )
+    {
+      cout << "  error: 0x" << hex << static_cast<unsigned long>( sample.error ) << dec << endl;
+    }
+  }
+
+  void printWriteResults( const vector<OPCDA_WRITE_RESULT>& results )
+  {
+    bool all_ok = all_of( results.begin(), results.end(), []( const OPCDA_WRITE_RESULT& r ) { return SUCCEEDED( r.error ); } );
+
+    cout << "success: " << ( all_ok ? "true" : "false" ) << endl;
+    cout << "result:" << endl;
+    for ( const auto& r : results )
+    {
+      cout << "  " << OPCDA::UTILS::wstr_to_str( r.id ) << ": 0x" << hex << static_cast<unsigned long>( r.error ) << dec << endl;
+    }
+  }
+
+  void printTagProperties( const vector<OPCDA_ITEM_PROPERTIES>& items )
+  {
+    cout << "success: true" << endl;
+    cout << "result:" << endl;
+
+    for ( const auto& item : items )
+    {
+      cout << "  " << OPCDA::UTILS::wstr_to_str( item.item_id ) << ":" << endl;
+      printProperties( item, "    ", true );
+    }
+  }
+
+  void printProperties( const OPCDA_ITEM_PROPERTIES& item, const string& tab, bool with_type )
+  {
+    if ( FAILED( item.error ) )
+    {
+      cout << tab << "- error: 0x" << hex << static_cast<unsigned long>( item.error ) << dec << endl;
+      return;
+    }
+
+    if ( with_type && ( item.present & PROPERTY_DATATYPE ) )
+    {
+      VARTYPE data_type = item.data_type;
+      cout << tab << "- data_type: " << OPCDA::UTILS::vartype_to_str( data_type ) << endl;
+    }
+    if ( item.present & PROPERTY_ACCESS_RIGHTS )
+    {
+      cout << tab << "- access: " << OPCDA::UTILS::wstr_to_str( OPCDA::UTILS::access_to_str( item.access_rights ) ) << endl;
+    }
+    if ( item.present & PROPERTY_EU_UNITS )
+    {
+      cout << tab << "- eu_units: " << OPCDA::UTILS::wstr_to_str( item.eu_units ) << endl;
+    }
+    if ( item.present & PROPERTY_EU_RANGE )
+    {
+      cout << tab << "- eu_range: [" << item.eu_low << ", " << item.eu_high << "]" << endl;
+    }
+    if ( item.present & PROPERTY_DESCRIPTION )
+    {
+      cout << tab << "- description: " << OPCDA::UTILS::wstr_to_str( item.description ) << endl;
+    }
+    if ( item.present & PROPERTY_SCAN_RATE )
+    {
+      cout << tab << "- scan_rate: " << item.scan_rate << endl;
+    }
+  }
+
+  void printCaptureSamples( const map<string, vector<OPCDA_SAMPLE>>& samples )
+  {
+    cout << "success: true" << endl;
+    cout << "result:" << endl;
+
+    char epoch[OPCDA::UTILS::FORMAT_NUMBER_CHARS];
+    char value[OPCDA::UTILS::FORMAT_NUMBER_CHARS];
+
+    for ( const auto& tag : samples )
+    {
+      cout << "  " << tag.first << ":" << endl;
+
+      for ( const auto& s : tag.second )
+      {
+        string_view epoch_str( epoch, OPCDA::UTILS::format_epoch_ms( epoch, epoch + sizeof( epoch ), s.timestamp ) - epoch );
+
+        cout << "    - { epochtime: " << epoch_str << ", value: ";
+
+        if ( s.elements.empty() )
+        {
+          cout << string_view( value, OPCDA::UTILS::format_double( value, value + sizeof( value ), s.value ) - value );
+        }
+        else
+        {
+          for ( size_t i = 0; i < s.elements.size(); ++i )
+          {
+            cout << ( i == 0 ? "[" : ", " ) << string_view( value, OPCDA::UTILS::format_double( value, value + sizeof( value ), s.elements[i] ) - value );
+          }
+          cout << "]";
+        }
+
+        cout << ", quality: 0x" << hex << s.quality << dec << " }" << endl;
+      }
+    }
+  }
+
 private:
   ResultFormatter()
   {